@@ -0,0 +1,345 @@
+#include "batchrenderer.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QImage>
+#include <QMatrix4x4>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QSurfaceFormat>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "frustum.h"
+#include "model.h"
+#include "scrollingheightmap.h"
+#include "shadercache.h"
+#include "terrainchunks.h"
+#include "terrainnoise.h"
+
+namespace {
+
+// The clear and fog color of MainView
+const QVector3D kBackground(0.31F, 0.0F, 0.51F);
+
+QSurfaceFormat contextFormat() {
+  QSurfaceFormat format;
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setVersion(3, 3);
+  return format;
+}
+
+QString modeName(ShadingMode shading) {
+  switch (shading) {
+    case NORMAL:
+      return "normal";
+    case PHONG:
+      return "phong";
+    case BLACKGREENWHITE:
+      return "gradient";
+    case RAINBOWLAYERS:
+      return "layers";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+BatchRenderer::BatchRenderer(const BatchSettings &settings)
+    : settings(settings) {}
+
+/**
+ * @brief BatchRenderer::sweep Returns the jobs for every shading mode, every
+ * palette of the palette modes and every seed.
+ * @param seeds The seeds of the terrain noise.
+ */
+QVector<BatchJob> BatchRenderer::sweep(const QVector<unsigned> &seeds) {
+  struct NamedPalette {
+    QString name;
+    Palette palette;
+  };
+  const QVector<NamedPalette> palettes = {
+      {"blackgreenwhite",
+       Palette::heightGradient({0.0F, 0.0F, 0.0F}, {0.0F, 1.0F, 0.0F},
+                               {1.0F, 1.0F, 1.0F})},
+      {"rainbow", Palette::rainbowLayers()},
+      {"landscape", Palette::landscape()},
+  };
+
+  QVector<BatchJob> jobs;
+  for (unsigned seed : seeds) {
+    for (ShadingMode shading : {NORMAL, PHONG, BLACKGREENWHITE, RAINBOWLAYERS}) {
+      BatchJob job;
+      job.shading = shading;
+      job.seed = seed;
+      if (shading != BLACKGREENWHITE && shading != RAINBOWLAYERS) {
+        jobs.append(job);
+        continue;
+      }
+      for (const NamedPalette &palette : palettes) {
+        job.paletteName = palette.name;
+        job.palette = palette.palette;
+        jobs.append(job);
+      }
+    }
+  }
+  return jobs;
+}
+
+/**
+ * @brief BatchRenderer::fileName Returns the name of the image of a job,
+ * such as layers_rainbow_1337.png.
+ */
+QString BatchRenderer::fileName(const BatchJob &job) {
+  QString name = modeName(job.shading);
+  if (!job.paletteName.isEmpty()) {
+    name += "_" + job.paletteName;
+  }
+  return name + QString("_%1.png").arg(job.seed);
+}
+
+/**
+ * @brief BatchRenderer::run Renders the jobs into the output directory.
+ * @param jobs The jobs.
+ * @return Number of images written.
+ */
+int BatchRenderer::run(const QVector<BatchJob> &jobs) {
+  if (jobs.isEmpty()) return 0;
+  if (!QDir().mkpath(settings.outputDirectory)) {
+    qWarning() << "BatchRenderer: cannot create" << settings.outputDirectory;
+    return 0;
+  }
+  prepare(jobs);
+
+  int threadCount = settings.threadCount > 0 ? settings.threadCount
+                                             : QThread::idealThreadCount();
+  threadCount = std::max(1, std::min(threadCount, int(jobs.size())));
+
+  // Surfaces can only be created on the GUI thread, the contexts are made
+  // on the threads that use them
+  std::vector<std::unique_ptr<QOffscreenSurface>> surfaces;
+  for (int i = 0; i != threadCount; ++i) {
+    surfaces.emplace_back(new QOffscreenSurface);
+    surfaces.back()->setFormat(contextFormat());
+    surfaces.back()->create();
+  }
+
+  std::atomic<int> next{0};
+  std::atomic<int> written{0};
+  QThreadPool workers;
+  workers.setMaxThreadCount(std::max(1, threadCount - 1));
+  for (int i = 1; i < threadCount; ++i) {
+    QOffscreenSurface *surface = surfaces[i].get();
+    workers.start([this, surface, &jobs, &next, &written]() {
+      work(surface, jobs, next, written);
+    });
+  }
+  work(surfaces[0].get(), jobs, next, written);
+  workers.waitForDone();
+
+  // Every context has its own copy of the mesh by now
+  scene.vertices = MeshSpan<QVector3D>();
+  scene.model->release();
+  return written;
+}
+
+/**
+ * @brief BatchRenderer::prepare Decodes the terrain mesh and computes the
+ * heights of every seed of the jobs.
+ * @param jobs The jobs.
+ */
+void BatchRenderer::prepare(const QVector<BatchJob> &jobs) {
+  scene.model.reset(new Model(":/models/terrain2.obj", Model::UNPACKED));
+  scene.vertices = scene.model->getCoords();
+
+  // The heights cover the noise texture of MainView, so the seeds replace
+  // it sample for sample
+  QImage noise(":/textures/noiseTextureG.png");
+  scene.noiseWidth = noise.width();
+  scene.noiseHeight = noise.height();
+  Aabb extent =
+      Aabb::fromPoints(scene.vertices.data(), scene.vertices.size());
+  scene.firstRow = static_cast<int>(std::floor(2 - extent.maximum.z())) - 1;
+  scene.rowCount = static_cast<int>(std::floor(2 - extent.minimum.z())) -
+                   scene.firstRow + 4;
+
+  for (const BatchJob &job : jobs) {
+    if (scene.heights.contains(job.seed)) continue;
+    TerrainNoise terrainNoise(job.seed);
+    QVector<float> heights(scene.noiseWidth * scene.noiseHeight);
+    for (int y = 0; y != scene.noiseHeight; ++y) {
+      for (int x = 0; x != scene.noiseWidth; ++x) {
+        heights[y * scene.noiseWidth + x] =
+            terrainNoise.sample(x, y) / 255.0F;
+      }
+    }
+    scene.heights.insert(job.seed, heights);
+  }
+}
+
+/**
+ * @brief BatchRenderer::work Renders jobs on the calling thread until none
+ * are left. Creates a context on the surface and uploads the mesh first.
+ * @param surface The surface of this thread.
+ * @param jobs All jobs.
+ * @param next Index of the next job to take.
+ * @param written Incremented for every image written.
+ */
+void BatchRenderer::work(QOffscreenSurface *surface,
+                         const QVector<BatchJob> &jobs, std::atomic<int> &next,
+                         std::atomic<int> &written) const {
+  QOpenGLContext context;
+  context.setFormat(contextFormat());
+  if (!surface->isValid() || !context.create() ||
+      !context.makeCurrent(surface)) {
+    qWarning() << "BatchRenderer: cannot create an offscreen context";
+    return;
+  }
+  QOpenGLFunctions_3_3_Core gl;
+  gl.initializeOpenGLFunctions();
+
+  // The mesh, with the barycentric coordinates of the shader wireframe
+  GLuint vao, buffers[2];
+  gl.glGenVertexArrays(1, &vao);
+  gl.glGenBuffers(2, buffers);
+  gl.glBindVertexArray(vao);
+  gl.glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+  gl.glBufferData(GL_ARRAY_BUFFER, scene.vertices.size() * sizeof(QVector3D),
+                  scene.vertices.data(), GL_STATIC_DRAW);
+  gl.glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D),
+                           reinterpret_cast<GLvoid *>(0));
+  gl.glEnableVertexAttribArray(0);
+  QVector<quint8> barycentrics(scene.vertices.size() * 4, 0);
+  for (int i = 0; i < scene.vertices.size(); ++i) {
+    barycentrics[i * 4 + i % 3] = 255;
+  }
+  gl.glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+  gl.glBufferData(GL_ARRAY_BUFFER, barycentrics.size(),
+                  barycentrics.constData(), GL_STATIC_DRAW);
+  gl.glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, 4,
+                           reinterpret_cast<GLvoid *>(0));
+  gl.glEnableVertexAttribArray(3);
+  gl.glBindBuffer(GL_ARRAY_BUFFER, 0);
+  gl.glBindVertexArray(0);
+
+  GLuint framebuffer, renderbuffers[2];
+  gl.glGenFramebuffers(1, &framebuffer);
+  gl.glGenRenderbuffers(2, renderbuffers);
+  gl.glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+  gl.glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, settings.width,
+                           settings.height);
+  gl.glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+  gl.glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                           settings.width, settings.height);
+  gl.glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  gl.glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_RENDERBUFFER, renderbuffers[0]);
+  gl.glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_RENDERBUFFER, renderbuffers[1]);
+
+  ScrollingHeightMap heightMap;
+  heightMap.initialize(&gl);
+  PaletteTexture palette;
+  palette.initialize(&gl);
+  ShaderCache shaders(":/shaders/vertshader_terrain.glsl",
+                      ":/shaders/fragshader_terrain.glsl",
+                      {":/shaders/shadows.glsl"});
+
+  // The camera and light of MainView at startup
+  QMatrix4x4 projection;
+  projection.perspective(
+      60.0F, static_cast<float>(settings.width) / settings.height, 0.2F,
+      600.0F);
+  QMatrix4x4 modelView;
+  modelView.translate(-100, -30, -17);
+  modelView.rotate(QQuaternion::fromEulerAngles({20, 0, 0}));
+  QVector3D lightPosition(100.0F, 50.0F, 0.0F);
+
+  gl.glEnable(GL_DEPTH_TEST);
+  gl.glEnable(GL_CULL_FACE);
+  gl.glDepthFunc(GL_LEQUAL);
+  // The wireframe lines are blended over the background, which stays opaque
+  gl.glEnable(GL_BLEND);
+  gl.glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO,
+                         GL_ONE);
+  gl.glViewport(0, 0, settings.width, settings.height);
+  gl.glClearColor(kBackground.x(), kBackground.y(), kBackground.z(), 1.0F);
+
+  unsigned uploadedSeed = 0;
+  bool uploaded = false;
+  QImage image(settings.width, settings.height, QImage::Format_RGBA8888);
+  for (int index = next++; index < jobs.size(); index = next++) {
+    const BatchJob &job = jobs[index];
+    if (!uploaded || uploadedSeed != job.seed) {
+      heightMap.setHeights(scene.noiseWidth, scene.noiseHeight,
+                           scene.heights.value(job.seed));
+      heightMap.setWindow(scene.firstRow, scene.rowCount);
+      heightMap.update(0.0F);
+      uploadedSeed = job.seed;
+      uploaded = true;
+    }
+
+    // As MainView draws the fixed terrain, with the shader wireframe and fog
+    unsigned features = shadingFeatures(job.shading, true, false, true, true);
+    QOpenGLShaderProgram *program = shaders.program(features);
+    if (program == nullptr) continue;  // the shader cache logged why
+    program->bind();
+    program->setUniformValue("modelViewTransform", modelView);
+    program->setUniformValue("projectionTransform", projection);
+    program->setUniformValue("normalMatrix", modelView.normalMatrix());
+    gl.glActiveTexture(GL_TEXTURE1);
+    gl.glBindTexture(GL_TEXTURE_2D, heightMap.getTexture());
+    gl.glActiveTexture(GL_TEXTURE0);
+    program->setUniformValue("heightMap", 1);
+    program->setUniformValue("heightScale", TerrainChunks::heightFromNoise(255));
+    program->setUniformValue("flying", 0.0F);
+    program->setUniformValue("lightPosition", lightPosition);
+    program->setUniformValue("lightColor", QVector3D(1.0F, 1.0F, 1.0F));
+    program->setUniformValue("materialCoeffecients",
+                            QVector4D(0.4F, 0.7F, 0.3F, 16.0F));
+    program->setUniformValue("materialColor", QVector3D(0.55F, 0.6F, 0.65F));
+    program->setUniformValue("lineColor", QVector3D(1.0F, 0.0F, 0.0F));
+    if (features & COLOR_PALETTE) {
+      palette.setPalette(job.palette);
+      palette.bind(GL_TEXTURE2);
+      program->setUniformValue("palette", 2);
+      program->setUniformValue("paletteRange", palette.getRange());
+    }
+    program->setUniformValue("lineWidth", 1.5F);
+    program->setUniformValue("hiddenLineFill", false);
+    program->setUniformValue("fillColor", kBackground);
+    program->setUniformValue("fogDensity", 0.012F);
+    program->setUniformValue("fogHeightFalloff", 0.04F);
+    program->setUniformValue("fogEnd", 180.0F);
+    program->setUniformValue("fogColor", kBackground);
+
+    gl.glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    gl.glBindVertexArray(vao);
+    gl.glDrawArrays(GL_TRIANGLES, 0, scene.vertices.size());
+    gl.glBindVertexArray(0);
+    program->release();
+
+    gl.glReadPixels(0, 0, settings.width, settings.height, GL_RGBA,
+                    GL_UNSIGNED_BYTE, image.bits());
+    QString path = QDir(settings.outputDirectory).filePath(fileName(job));
+    if (image.mirrored().save(path)) {
+      ++written;
+    } else {
+      qWarning() << "BatchRenderer: cannot write" << path;
+    }
+  }
+
+  shaders.clear();
+  palette.destroy();
+  heightMap.destroy();
+  gl.glDeleteFramebuffers(1, &framebuffer);
+  gl.glDeleteRenderbuffers(2, renderbuffers);
+  gl.glDeleteBuffers(2, buffers);
+  gl.glDeleteVertexArrays(1, &vao);
+  context.doneCurrent();
+}
@@ -0,0 +1,77 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QHash>
+#include <QString>
+#include <QVector3D>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+#include "model.h"
+#include "palette.h"
+#include "shadingmode.h"
+
+class QOffscreenSurface;
+
+/**
+ * @brief One image of a batch: the fixed terrain in a shading mode, with a
+ * palette for the palette modes, on the noise of a seed.
+ */
+struct BatchJob {
+  ShadingMode shading = NORMAL;
+  QString paletteName;  // empty for the modes without a palette
+  Palette palette;
+  unsigned seed = 1337;
+};
+
+struct BatchSettings {
+  int width = 1280;
+  int height = 720;
+  int threadCount = 0;  // contexts, one per core if zero
+  QString outputDirectory = ".";
+};
+
+/**
+ * @brief Renders jobs into image files on several offscreen GL contexts at
+ * once, without a window.
+ *
+ * Every worker thread creates its own context on an offscreen surface, which
+ * on Mesa without a GPU is a software context, and takes the next job as
+ * soon as it has written an image. The terrain mesh and the heights of every
+ * seed are decoded once before the workers start and only read by them;
+ * each context uploads its own copy, as contexts on different threads do not
+ * share objects, and the decoded mesh is released once all copies exist.
+ * Must be called from the GUI thread, which creates the surfaces and renders
+ * jobs as well.
+ */
+class BatchRenderer {
+ public:
+  explicit BatchRenderer(const BatchSettings &settings);
+
+  static QVector<BatchJob> sweep(const QVector<unsigned> &seeds);
+  static QString fileName(const BatchJob &job);
+
+  int run(const QVector<BatchJob> &jobs);
+
+ private:
+  // Read only while the workers run
+  struct Scene {
+    std::unique_ptr<Model> model;  // released once the workers are done
+    MeshSpan<QVector3D> vertices;  // the terrain mesh, triangle by triangle
+    int noiseWidth = 0;
+    int noiseHeight = 0;
+    int firstRow = 0;  // rows of heights that the mesh reaches
+    int rowCount = 0;
+    QHash<unsigned, QVector<float>> heights;  // by seed, from 0 to 1
+  };
+
+  void prepare(const QVector<BatchJob> &jobs);
+  void work(QOffscreenSurface *surface, const QVector<BatchJob> &jobs,
+            std::atomic<int> &next, std::atomic<int> &written) const;
+
+  BatchSettings settings;
+  Scene scene;
+};
+
+#endif  // BATCHRENDERER_H
@@ -0,0 +1,140 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+/**
+ * @brief Bvh::build Builds the tree by recursively splitting the items at the
+ * median of the longest axis of their centers.
+ * @param itemBounds The bounds of every item.
+ */
+void Bvh::build(const QVector<Aabb> &itemBounds) {
+  nodes.clear();
+  items.resize(itemBounds.size());
+  for (int i = 0; i != items.size(); ++i) {
+    items[i] = i;
+  }
+  if (items.isEmpty()) return;
+
+  nodes.reserve(2 * items.size());
+  Node root;
+  root.count = items.size();
+  nodes.append(root);
+  subdivide(0, itemBounds);
+  refit(itemBounds);
+}
+
+void Bvh::subdivide(int nodeIndex, const QVector<Aabb> &itemBounds) {
+  Node node = nodes[nodeIndex];
+  if (node.count <= kMaxLeafSize) return;
+
+  Aabb centers(itemBounds[items[node.first]].center(),
+               itemBounds[items[node.first]].center());
+  for (int i = node.first; i != node.first + node.count; ++i) {
+    QVector3D c = itemBounds[items[i]].center();
+    centers.expand(Aabb(c, c));
+  }
+
+  QVector3D size = centers.maximum - centers.minimum;
+  int axis = 0;
+  if (size.y() > size[axis]) axis = 1;
+  if (size.z() > size[axis]) axis = 2;
+
+  int half = node.count / 2;
+  auto begin = items.begin() + node.first;
+  std::nth_element(begin, begin + half, begin + node.count,
+                   [&itemBounds, axis](int a, int b) {
+                     return itemBounds[a].center()[axis] <
+                            itemBounds[b].center()[axis];
+                   });
+
+  Node left;
+  left.first = node.first;
+  left.count = half;
+  Node right;
+  right.first = node.first + half;
+  right.count = node.count - half;
+
+  nodes[nodeIndex].left = nodes.size();
+  nodes.append(left);
+  nodes.append(right);
+  int leftIndex = nodes[nodeIndex].left;
+  subdivide(leftIndex, itemBounds);
+  subdivide(leftIndex + 1, itemBounds);
+}
+
+/**
+ * @brief Bvh::refit Recomputes the bounds of every node without changing the
+ * structure of the tree. Children are always stored after their parent, so a
+ * single reverse pass is enough.
+ * @param itemBounds The new bounds of every item.
+ */
+void Bvh::refit(const QVector<Aabb> &itemBounds) {
+  bounds.resize(items.size());
+  for (int i = 0; i != items.size(); ++i) {
+    bounds[i] = itemBounds[items[i]];
+  }
+
+  for (int n = nodes.size() - 1; n >= 0; --n) {
+    Node &node = nodes[n];
+    if (node.left == -1) {
+      node.bounds = bounds[node.first];
+      for (int i = node.first + 1; i != node.first + node.count; ++i) {
+        node.bounds.expand(bounds[i]);
+      }
+    } else {
+      node.bounds = nodes[node.left].bounds;
+      node.bounds.expand(nodes[node.left + 1].bounds);
+    }
+  }
+}
+
+/**
+ * @brief Bvh::query Collects the items that are (partially) inside the
+ * frustum. Subtrees fully inside or outside the frustum are accepted or
+ * rejected without testing their items; the items of intersecting leaves are
+ * tested in one batch.
+ * @param frustum The frustum to test against.
+ * @param visibleItems Output, the visible items are appended to this list.
+ * @param stats Output, the visible and culled items are added to this.
+ */
+void Bvh::query(const Frustum &frustum, QVector<int> &visibleItems,
+                CullStats &stats) const {
+  if (nodes.isEmpty()) return;
+
+  const Aabb *leafBoxes[kMaxLeafSize];
+  bool leafVisible[kMaxLeafSize];
+
+  int stack[64];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0) {
+    const Node &node = nodes[stack[--stackSize]];
+    Frustum::Result result = frustum.classify(node.bounds);
+
+    if (result == Frustum::OUTSIDE) {
+      stats.culled += node.count;
+    } else if (result == Frustum::INSIDE) {
+      for (int i = node.first; i != node.first + node.count; ++i) {
+        visibleItems.append(items[i]);
+      }
+      stats.visible += node.count;
+    } else if (node.left != -1) {
+      stack[stackSize++] = node.left;
+      stack[stackSize++] = node.left + 1;
+    } else {
+      for (int i = 0; i != node.count; ++i) {
+        leafBoxes[i] = &bounds[node.first + i];
+      }
+      frustum.testAabbs(leafBoxes, node.count, leafVisible);
+      for (int i = 0; i != node.count; ++i) {
+        if (leafVisible[i]) {
+          visibleItems.append(items[node.first + i]);
+          ++stats.visible;
+        } else {
+          ++stats.culled;
+        }
+      }
+    }
+  }
+}
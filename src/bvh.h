@@ -0,0 +1,42 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <QVector>
+
+#include "frustum.h"
+
+/**
+ * @brief A bounding volume hierarchy over a fixed set of items, used to find
+ * the items that intersect the view frustum. The tree is built once and can
+ * be refitted cheaply when the bounds of the items change.
+ */
+class Bvh {
+ public:
+  void build(const QVector<Aabb> &itemBounds);
+  void refit(const QVector<Aabb> &itemBounds);
+  void query(const Frustum &frustum, QVector<int> &visibleItems,
+             CullStats &stats) const;
+
+  bool isEmpty() const { return nodes.isEmpty(); }
+  int getItemCount() const { return items.size(); }
+
+ private:
+  // Every node covers the range [first, first + count) of items. Internal
+  // nodes have their children at left and left + 1.
+  struct Node {
+    Aabb bounds;
+    int first = 0;
+    int count = 0;
+    int left = -1;
+  };
+
+  static constexpr int kMaxLeafSize = 4;
+
+  void subdivide(int nodeIndex, const QVector<Aabb> &itemBounds);
+
+  QVector<Node> nodes;
+  QVector<int> items;
+  QVector<Aabb> bounds;  // item bounds in the order of items
+};
+
+#endif  // BVH_H
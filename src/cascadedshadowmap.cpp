@@ -0,0 +1,292 @@
+#include "cascadedshadowmap.h"
+
+#include <QDebug>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Weight of the logarithmic splits against the uniform ones. Logarithmic
+// splits match the texel density to the perspective, but leave the far
+// cascades very long.
+constexpr float kSplitBlend = 0.75F;
+
+// Coverage around each slice, relative to its radius, that the terrain may
+// scroll through before the cascade has to be drawn again
+constexpr float kScrollMargin = 0.25F;
+
+// How far in front of a slice, towards the light, casters are included
+constexpr float kCasterDistance = 100.0F;
+
+// Depth offset of the casters, against acne on the lit surfaces
+constexpr float kSlopeBias = 2.0F;
+constexpr float kConstantBias = 4.0F;
+
+bool overlaps(const Aabb &a, const Aabb &b) {
+  for (int i = 0; i != 3; ++i) {
+    if (a.maximum[i] < b.minimum[i] || b.maximum[i] < a.minimum[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+/**
+ * @brief CascadedShadowMap::initialize Creates the depth texture array and
+ * the framebuffer that the cascades are drawn with.
+ * @param functions The functions of the current context.
+ * @param newResolution Width and height of each cascade in texels.
+ */
+void CascadedShadowMap::initialize(QOpenGLFunctions_3_3_Core *functions,
+                                   int newResolution) {
+  gl = functions;
+  resolution = newResolution;
+
+  gl->glGenTextures(1, &texture);
+  gl->glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  gl->glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution,
+                   resolution, kCascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
+                   nullptr);
+  // Linear filtering of a compared texture blends the results of the four
+  // nearest texels, which smooths the PCF taps further
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                      GL_COMPARE_REF_TO_TEXTURE);
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  // Everything outside a cascade is lit
+  const GLfloat border[] = {1.0F, 1.0F, 1.0F, 1.0F};
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+                      GL_CLAMP_TO_BORDER);
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+                      GL_CLAMP_TO_BORDER);
+  gl->glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+  gl->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  GLint previous = 0;
+  gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  gl->glGenFramebuffers(1, &framebuffer);
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  gl->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture,
+                                0, 0);
+  gl->glDrawBuffer(GL_NONE);
+  gl->glReadBuffer(GL_NONE);
+  if (gl->glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+      GL_FRAMEBUFFER_COMPLETE) {
+    qWarning() << "CascadedShadowMap: framebuffer of" << resolution << "x"
+               << resolution << "is incomplete";
+  }
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+  invalidate();
+}
+
+void CascadedShadowMap::destroy() {
+  if (gl == nullptr) return;
+  gl->glDeleteFramebuffers(1, &framebuffer);
+  gl->glDeleteTextures(1, &texture);
+  resolution = 0;
+}
+
+/**
+ * @brief CascadedShadowMap::fit Fits the cascades to the view frustum of the
+ * camera at the origin, looking down the negative z axis. Cascades whose
+ * projection does not change keep their map.
+ * @param newDirection Direction towards the light.
+ * @param verticalAngle Vertical field of view in degrees.
+ * @param aspectRatio Width over height of the view.
+ * @param nearPlane Distance of the near plane.
+ * @param shadowDistance Distance up to which shadows are drawn.
+ */
+void CascadedShadowMap::fit(const QVector3D &newDirection, float verticalAngle,
+                            float aspectRatio, float nearPlane,
+                            float shadowDistance) {
+  if (resolution == 0) return;
+  direction = newDirection.normalized();
+
+  // A rotation only, so that the texel grid does not move with the camera
+  QVector3D up = std::fabs(direction.y()) < 0.99F ? QVector3D(0, 1, 0)
+                                                  : QVector3D(0, 0, 1);
+  QMatrix4x4 lightView;
+  lightView.lookAt(QVector3D(), -direction, up);
+
+  // Squared distance of a frustum corner from the view axis, per unit depth
+  float tanY = std::tan(qDegreesToRadians(verticalAngle) / 2.0F);
+  float tanX = tanY * aspectRatio;
+  float corner = tanX * tanX + tanY * tanY;
+
+  float start = nearPlane;
+  for (int i = 0; i != kCascadeCount; ++i) {
+    Cascade &cascade = cascades[i];
+    float part = static_cast<float>(i + 1) / kCascadeCount;
+    float logarithmic = nearPlane * std::pow(shadowDistance / nearPlane, part);
+    float uniform = nearPlane + (shadowDistance - nearPlane) * part;
+    float end = kSplitBlend * logarithmic + (1.0F - kSplitBlend) * uniform;
+
+    // The sphere through the near and far corners of the slice, or around
+    // the far corners if that is smaller. It only depends on the depths and
+    // the field of view, not on where the camera looks.
+    float center = std::min(end, (start + end) * (1.0F + corner) / 2.0F);
+    float radius = std::max(
+        std::sqrt(end * end * corner + (end - center) * (end - center)),
+        std::sqrt(start * start * corner + (center - start) * (center - start)));
+    // Rounded up, so that rounding errors do not change the texel size
+    radius = std::ceil(radius * 16.0F) / 16.0F;
+
+    float margin = radius * kScrollMargin;
+    float halfSize = radius + margin;
+    float texel = 2.0F * halfSize / resolution;
+    QVector3D lightCenter = lightView.map(QVector3D(0, 0, -center));
+    float x = std::floor(lightCenter.x() / texel) * texel;
+    float y = std::floor(lightCenter.y() / texel) * texel;
+
+    QMatrix4x4 transform;
+    transform.ortho(x - halfSize, x + halfSize, y - halfSize, y + halfSize,
+                    -(lightCenter.z() + halfSize + kCasterDistance),
+                    -(lightCenter.z() - halfSize));
+    transform *= lightView;
+    if (transform != cascade.transform) {
+      cascade.transform = transform;
+      cascade.frustum.update(transform);
+      cascade.dirty = true;
+    }
+    cascade.end = end;
+    cascade.margin = margin;
+    // Lookups only fall in this cascade inside the slice itself
+    QVector3D farCorner(end * tanX, end * tanY, -end);
+    cascade.receivers =
+        Aabb(QVector3D(-farCorner.x(), -farCorner.y(), -end),
+             QVector3D(farCorner.x(), farCorner.y(), -start));
+    start = end;
+  }
+}
+
+/**
+ * @brief CascadedShadowMap::scroll Tells how far the terrain has moved.
+ * @param newOffset Offset of the terrain in view space, as from any fixed
+ * starting point.
+ */
+void CascadedShadowMap::scroll(const QVector3D &newOffset) {
+  offset = newOffset;
+}
+
+/**
+ * @brief CascadedShadowMap::invalidate Draws all cascades again, for changes
+ * all over the scene.
+ */
+void CascadedShadowMap::invalidate() {
+  for (Cascade &cascade : cascades) {
+    cascade.dirty = true;
+  }
+}
+
+/**
+ * @brief CascadedShadowMap::invalidate Draws the cascades again whose slice
+ * a changed caster can shadow.
+ * @param casterBounds The caster before or after the change, in view space.
+ */
+void CascadedShadowMap::invalidate(const Aabb &casterBounds) {
+  // The shadow falls away from the light, at most the caster distance
+  Aabb shadowed = casterBounds;
+  shadowed.expand(Aabb(casterBounds.minimum - direction * kCasterDistance,
+                       casterBounds.maximum - direction * kCasterDistance));
+  for (Cascade &cascade : cascades) {
+    if (overlaps(shadowed, cascade.receivers)) {
+      cascade.dirty = true;
+    }
+  }
+}
+
+/**
+ * @brief CascadedShadowMap::needsUpdate Tells whether a cascade has to be
+ * drawn before the shadows are looked up.
+ * @param cascade Index of the cascade, nearest first.
+ */
+bool CascadedShadowMap::needsUpdate(int cascade) const {
+  const Cascade &c = cascades[cascade];
+  return c.dirty || (offset - c.drawnOffset).length() > c.margin;
+}
+
+/**
+ * @brief CascadedShadowMap::getTransform Returns the transform from view
+ * space to the clip space of a cascade, to draw its casters with.
+ * @param cascade Index of the cascade, nearest first.
+ */
+const QMatrix4x4 &CascadedShadowMap::getTransform(int cascade) const {
+  return cascades[cascade].transform;
+}
+
+/**
+ * @brief CascadedShadowMap::getFrustum Returns the view volume of a cascade
+ * in view space, to cull its casters with.
+ * @param cascade Index of the cascade, nearest first.
+ */
+const Frustum &CascadedShadowMap::getFrustum(int cascade) const {
+  return cascades[cascade].frustum;
+}
+
+/**
+ * @brief CascadedShadowMap::beginCascade Binds and clears the layer of a
+ * cascade for drawing its casters. Leaves the framebuffer bound and the
+ * viewport set to the layer until endCascade().
+ * @param cascade Index of the cascade, nearest first.
+ */
+void CascadedShadowMap::beginCascade(int cascade) {
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  gl->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture,
+                                0, cascade);
+  gl->glViewport(0, 0, resolution, resolution);
+  gl->glClear(GL_DEPTH_BUFFER_BIT);
+  gl->glEnable(GL_POLYGON_OFFSET_FILL);
+  gl->glPolygonOffset(kSlopeBias, kConstantBias);
+  // Casters in front of the near plane still shadow at the near plane
+  gl->glEnable(GL_DEPTH_CLAMP);
+}
+
+/**
+ * @brief CascadedShadowMap::endCascade Finishes drawing a cascade, which is
+ * kept until it needs an update again. The caller binds its framebuffer and
+ * viewport again.
+ * @param cascade Index of the cascade, nearest first.
+ */
+void CascadedShadowMap::endCascade(int cascade) {
+  gl->glDisable(GL_DEPTH_CLAMP);
+  gl->glDisable(GL_POLYGON_OFFSET_FILL);
+  cascades[cascade].dirty = false;
+  cascades[cascade].drawnOffset = offset;
+}
+
+/**
+ * @brief CascadedShadowMap::bind Binds the shadow map to a texture unit and
+ * sets the uniforms of a bound program that looks up shadows: shadowMap,
+ * shadowTransforms from view space to the texture coordinates and depth of
+ * each cascade, and cascadeEnds, the view distance where each cascade ends.
+ * @param program The bound program.
+ * @param unit The texture unit, which no other kind of sampler may use.
+ * @param enabled False to end all cascades at distance zero, so that every
+ * lookup is lit.
+ */
+void CascadedShadowMap::bind(QOpenGLShaderProgram &program, int unit,
+                             bool enabled) const {
+  gl->glActiveTexture(GL_TEXTURE0 + unit);
+  gl->glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  gl->glActiveTexture(GL_TEXTURE0);
+
+  QMatrix4x4 bias;
+  bias.translate(0.5F, 0.5F, 0.5F);
+  bias.scale(0.5F);
+  QMatrix4x4 transforms[kCascadeCount];
+  GLfloat ends[kCascadeCount];
+  for (int i = 0; i != kCascadeCount; ++i) {
+    // Look up where the terrain was when the cascade was drawn
+    transforms[i] = bias * cascades[i].transform;
+    transforms[i].translate(cascades[i].drawnOffset - offset);
+    ends[i] = enabled ? cascades[i].end : 0.0F;
+  }
+  program.setUniformValue("shadowMap", unit);
+  program.setUniformValueArray("shadowTransforms", transforms, kCascadeCount);
+  program.setUniformValueArray("cascadeEnds", ends, kCascadeCount, 1);
+}
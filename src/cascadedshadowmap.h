@@ -0,0 +1,74 @@
+#ifndef CASCADEDSHADOWMAP_H
+#define CASCADEDSHADOWMAP_H
+
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLShaderProgram>
+#include <QVector3D>
+
+#include "frustum.h"
+
+/**
+ * @brief Cascaded shadow maps of a directional light, fitted to the view
+ * frustum.
+ *
+ * The view frustum up to the shadow distance is split into kCascadeCount
+ * slices, the near ones shorter than the far ones. Each cascade is an
+ * orthographic light projection around the bounding sphere of its slice, so
+ * its size does not change as the view turns, and it only moves in whole
+ * texels, so shadow edges do not crawl. The cascades are the layers of one
+ * depth texture array, which the shaders sample with hardware comparison and
+ * 3 x 3 PCF taps.
+ *
+ * A drawn cascade is kept until its fit or the light changes, a caster that
+ * can shadow its slice changes, see invalidate(), or the terrain has
+ * scrolled further than the margin around the slice. Until then the lookups
+ * are shifted back by the scroll since it was drawn, since the terrain
+ * carries its own shadows along. Everything is in view space. Requires a
+ * current context for all calls but the fitting and invalidation.
+ */
+class CascadedShadowMap {
+ public:
+  static constexpr int kCascadeCount = 3;
+
+  void initialize(QOpenGLFunctions_3_3_Core *functions, int newResolution);
+  void destroy();
+
+  void fit(const QVector3D &newDirection, float verticalAngle,
+           float aspectRatio, float nearPlane, float shadowDistance);
+  void scroll(const QVector3D &newOffset);
+  void invalidate();
+  void invalidate(const Aabb &casterBounds);
+
+  bool needsUpdate(int cascade) const;
+  const QMatrix4x4 &getTransform(int cascade) const;
+  const Frustum &getFrustum(int cascade) const;
+  void beginCascade(int cascade);
+  void endCascade(int cascade);
+
+  void bind(QOpenGLShaderProgram &program, int unit,
+            bool enabled = true) const;
+  GLuint getTexture() const { return texture; }
+
+ private:
+  struct Cascade {
+    float end = 0.0F;      // view distance where the slice ends
+    float margin = 0.0F;   // coverage around the slice, used up by scrolling
+    Aabb receivers;        // box around the slice
+    QMatrix4x4 transform;  // view space to light clip space
+    Frustum frustum;       // of the transform, to cull the casters
+    bool dirty = true;
+    QVector3D drawnOffset;  // terrain offset when it was drawn
+  };
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  GLuint texture = 0;
+  GLuint framebuffer = 0;
+  int resolution = 0;
+
+  Cascade cascades[kCascadeCount];
+  QVector3D direction;  // towards the light
+  QVector3D offset;     // current terrain offset
+};
+
+#endif  // CASCADEDSHADOWMAP_H
@@ -0,0 +1,162 @@
+#include "commandline.h"
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QThread>
+#include <cstring>
+
+#include "batchrenderer.h"
+#include "erosion.h"
+
+/**
+ * @brief CommandLine::CommandLine Applies the options that have to be set
+ * before the QApplication exists. Several batch contexts already keep every
+ * core busy, so the software rasterizer of Mesa gets one thread per context,
+ * which has to be set before the first context is made.
+ * @param argc Argument count.
+ * @param argv Arguments.
+ */
+CommandLine::CommandLine(int argc, char *argv[]) {
+  bool singleContext = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--batch-render") == 0) {
+      batch = true;
+    } else if (std::strcmp(argv[i], "--batch-threads") == 0 && i + 1 < argc) {
+      singleContext = std::strcmp(argv[i + 1], "1") == 0;
+    }
+  }
+  if (batch && !singleContext &&
+      !qEnvironmentVariableIsSet("LP_NUM_THREADS")) {
+    qputenv("LP_NUM_THREADS", "1");
+  }
+}
+
+/**
+ * @brief CommandLine::parse Applies the remaining options. The debug context
+ * checks every GL call, so by default it is only requested in debug builds.
+ * @param newArguments The arguments of the QApplication.
+ */
+void CommandLine::parse(const QStringList &newArguments) {
+  arguments = newArguments;
+  if (arguments.contains("--gl-debug")) {
+    Log::setGlDebugEnabled(true);
+  } else if (arguments.contains("--no-gl-debug")) {
+    Log::setGlDebugEnabled(false);
+  }
+}
+
+/**
+ * @brief CommandLine::hasTool Returns whether a tool runs instead of the
+ * window.
+ */
+bool CommandLine::hasTool() const {
+  return batch || arguments.contains("--erosion-benchmark");
+}
+
+/**
+ * @brief CommandLine::runTool Runs the tool that was asked for.
+ * @return Exit code.
+ */
+int CommandLine::runTool() {
+  if (arguments.contains("--erosion-benchmark")) {
+    return runErosionBenchmark();
+  }
+  return runBatchRender();
+}
+
+/**
+ * @brief CommandLine::runErosionBenchmark Erodes the noise texture on one
+ * thread and on all cores and prints the throughput. The checksums of the
+ * results must match, as the erosion does not depend on the number of
+ * threads.
+ * @return Exit code.
+ */
+int CommandLine::runErosionBenchmark() {
+  constexpr int kBatches = 50;
+  QImage noise(":/textures/noiseTextureG.png");
+  QVector<int> threadCounts = {1};
+  if (QThread::idealThreadCount() > 1) {
+    threadCounts.append(QThread::idealThreadCount());
+  }
+
+  for (int threads : threadCounts) {
+    ErosionSettings settings;
+    settings.threadCount = threads;
+    TerrainErosion erosion(settings);
+    erosion.setHeightSource(noise);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i != kBatches; ++i) {
+      erosion.runBatch();
+    }
+    double seconds = timer.nsecsElapsed() / 1.0e9;
+
+    quint32 checksum = 0;
+    for (float height : erosion.getHeights()) {
+      quint32 bits;
+      std::memcpy(&bits, &height, sizeof(bits));
+      checksum = checksum * 31 + bits;
+    }
+    qInfo().noquote() << QStringLiteral(
+                             "Erosion: %1 threads, %2 droplets in %3 s, "
+                             "%4 droplets/s, checksum %5")
+                             .arg(threads)
+                             .arg(erosion.getDropletCount())
+                             .arg(seconds, 0, 'f', 3)
+                             .arg(erosion.getDropletCount() / seconds, 0, 'f', 0)
+                             .arg(checksum, 8, 16, QLatin1Char('0'));
+  }
+  return 0;
+}
+
+/**
+ * @brief CommandLine::runBatchRender Renders every shading mode and palette
+ * for a list of seeds into images, on several offscreen contexts, and prints
+ * the throughput. Options:
+ *   --batch-render <directory>   where the images go
+ *   --batch-seeds <a,b,...>      seeds of the terrain noise, 1337 if not given
+ *   --batch-size <width>x<height>
+ *   --batch-threads <count>      contexts, one per core if not given
+ * @return Exit code.
+ */
+int CommandLine::runBatchRender() {
+  BatchSettings settings;
+  settings.outputDirectory = value("--batch-render", ".");
+  settings.threadCount = value("--batch-threads", "0").toInt();
+  QStringList size = value("--batch-size", "1280x720").split('x');
+  if (size.size() == 2 && size[0].toInt() > 0 && size[1].toInt() > 0) {
+    settings.width = size[0].toInt();
+    settings.height = size[1].toInt();
+  }
+  QVector<unsigned> seeds;
+  for (const QString &seed : value("--batch-seeds", "1337").split(',')) {
+    seeds.append(seed.toUInt());
+  }
+
+  QVector<BatchJob> jobs = BatchRenderer::sweep(seeds);
+  QElapsedTimer timer;
+  timer.start();
+  int written = BatchRenderer(settings).run(jobs);
+  double seconds = timer.nsecsElapsed() / 1.0e9;
+  qInfo().noquote() << QStringLiteral(
+                           "Batch: %1 of %2 images in %3 s, %4 images/s")
+                           .arg(written)
+                           .arg(jobs.size())
+                           .arg(seconds, 0, 'f', 3)
+                           .arg(written / seconds, 0, 'f', 2);
+  return written == jobs.size() ? 0 : 1;
+}
+
+/**
+ * @brief CommandLine::value Returns the value that follows an option, such
+ * as "out" for --batch-render out.
+ * @param option The option.
+ * @param fallback Returned if the option or its value is missing.
+ */
+QString CommandLine::value(const QString &option,
+                           const QString &fallback) const {
+  int index = arguments.indexOf(option);
+  if (index == -1 || index + 1 == arguments.size()) return fallback;
+  return arguments[index + 1];
+}
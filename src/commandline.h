@@ -0,0 +1,38 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <QStringList>
+
+#include "logging.h"
+
+/**
+ * @brief The options of the application and the tools that run instead of
+ * the window: the erosion benchmark and the batch renderer.
+ *
+ * Constructed before the QApplication, as some options have to be applied
+ * before the first context is made, and kept until the application ends,
+ * since it owns the sink of the log. Options:
+ *   --gl-debug, --no-gl-debug   request a debug context or not, by default
+ *                               only in debug builds
+ *   --erosion-benchmark         time the erosion on one thread and on all
+ *   --batch-render <directory>  render images offline, see runBatchRender()
+ */
+class CommandLine {
+ public:
+  CommandLine(int argc, char *argv[]);
+
+  void parse(const QStringList &newArguments);
+  bool hasTool() const;
+  int runTool();
+
+ private:
+  int runErosionBenchmark();
+  int runBatchRender();
+  QString value(const QString &option, const QString &fallback) const;
+
+  Log::Sink logSink;
+  QStringList arguments;
+  bool batch = false;
+};
+
+#endif  // COMMANDLINE_H
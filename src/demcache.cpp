@@ -0,0 +1,338 @@
+#include "demcache.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Modulo that stays positive for negative samples.
+int wrap(int value, int size) { return ((value % size) + size) % size; }
+
+// The tiles along one axis of a level that hold the samples first to last,
+// which wrap around at the edge of the level.
+QVector<int> tilesAlong(int first, int last, int size, int tileSize,
+                        int tileCount) {
+  QVector<int> tiles;
+  last = std::min(last, first + size - 1);
+  for (int position = first; position <= last; ++position) {
+    int tile = std::min(wrap(position, size) / tileSize, tileCount - 1);
+    if (!tiles.contains(tile)) tiles.append(tile);
+  }
+  return tiles;
+}
+
+}  // namespace
+
+/**
+ * @brief DemLayout::DemLayout Computes the size of every level and where its
+ * tiles are in the file.
+ * @param header The header of the file.
+ */
+DemLayout::DemLayout(const DemCacheHeader &header)
+    : tileSize(header.tileSize) {
+  int width = header.width;
+  int height = header.height;
+  qint64 offset = sizeof(DemCacheHeader);
+  for (int level = 0; level != header.levelCount; ++level) {
+    Level l;
+    l.width = width;
+    l.height = height;
+    l.tilesX = std::max(1, (width - 2) / tileSize + 1);
+    l.tilesY = std::max(1, (height - 2) / tileSize + 1);
+    l.offset = offset;
+    levels.append(l);
+
+    offset += qint64(l.tilesX) * l.tilesY * tileBytes();
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+  }
+  fileSize = offset;
+}
+
+/**
+ * @brief DemCache::DemCache Creates a cache without a file.
+ * @param memoryBudget Maximum number of bytes used by the tiles copied out of
+ * the file.
+ */
+DemCache::DemCache(qsizetype memoryBudget) : memoryBudget(memoryBudget) {}
+
+DemCache::~DemCache() { close(); }
+
+/**
+ * @brief DemCache::open Maps a tile cache file. Only the header is read.
+ * @param path The tile cache file.
+ * @return False if the file cannot be mapped or is not a tile cache.
+ */
+bool DemCache::open(const QString &path) {
+  close();
+  file.setFileName(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << "DemCache: cannot open" << path;
+    return false;
+  }
+
+  if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) !=
+          qint64(sizeof(header)) ||
+      header.magic != DemCacheHeader::kMagic ||
+      header.version != DemCacheHeader::kVersion || header.width < 2 ||
+      header.height < 2 || header.tileSize < 1 || header.levelCount < 1) {
+    qWarning() << "DemCache:" << path << "is not a tile cache";
+    file.close();
+    return false;
+  }
+
+  layout = DemLayout(header);
+  if (file.size() < layout.fileSize) {
+    qWarning() << "DemCache:" << path << "is truncated";
+    file.close();
+    return false;
+  }
+
+  mapping = file.map(0, layout.fileSize);
+  if (mapping == nullptr) {
+    qWarning() << "DemCache: cannot map" << path << file.errorString();
+    file.close();
+    return false;
+  }
+
+  qDebug() << ":: DEM" << header.width << "x" << header.height << "in"
+           << header.levelCount << "levels of" << header.tileSize
+           << "sample tiles";
+  return true;
+}
+
+/**
+ * @brief DemCache::close Unmaps the file and drops the cached tiles. Must not
+ * be called while other threads sample.
+ */
+void DemCache::close() {
+  QMutexLocker locker(&mutex);
+  entries.clear();
+  memoryUsage = 0;
+  if (mapping != nullptr) {
+    file.unmap(mapping);
+    mapping = nullptr;
+  }
+  file.close();
+  layout = DemLayout();
+}
+
+/**
+ * @brief DemCache::region Looks up the tiles needed to sample an area.
+ * @param level The level of the pyramid, 0 being the full resolution.
+ * @param x0 Smallest position along the rows, in samples of the level.
+ * @param y0 Smallest position along the columns.
+ * @param x1 Largest position along the rows.
+ * @param y1 Largest position along the columns.
+ * @return The region, which samples nothing but zeros if no file is open.
+ */
+DemCache::Region DemCache::region(int level, float x0, float y0, float x1,
+                                  float y1) const {
+  Region region;
+  if (mapping == nullptr) return region;
+  region.cache = this;
+  region.level = qBound(0, level, getLevelCount() - 1);
+  const DemLayout::Level &l = layout.levels[region.level];
+
+  // One more sample on the far side, for the interpolation
+  QVector<int> columns =
+      tilesAlong(static_cast<int>(std::floor(x0)),
+                 static_cast<int>(std::floor(x1)) + 1, l.width,
+                 layout.tileSize, l.tilesX);
+  QVector<int> rows =
+      tilesAlong(static_cast<int>(std::floor(y0)),
+                 static_cast<int>(std::floor(y1)) + 1, l.height,
+                 layout.tileSize, l.tilesY);
+  region.tiles.reserve(columns.size() * rows.size());
+  for (int tileY : rows) {
+    for (int tileX : columns) {
+      QSharedPointer<const Tile> t = tile(region.level, tileX, tileY);
+      region.tiles.append({tileX, tileY, t, t->constData()});
+    }
+  }
+  return region;
+}
+
+/**
+ * @brief DemCache::sample Interpolates the elevation at a position, wrapping
+ * around at the edges of the data. Looks up the tiles on every call; see
+ * region() for sampling many positions.
+ * @param level The level of the pyramid, 0 being the full resolution.
+ * @param x Position in samples of the level along the rows.
+ * @param y Position in samples of the level along the columns.
+ * @return The elevation, from 0 at the lowest to 1 at the highest point of
+ * the data.
+ */
+float DemCache::sample(int level, float x, float y) const {
+  return region(level, x, y, x, y).sample(x, y);
+}
+
+/**
+ * @brief DemCache::Region::sample Interpolates the elevation at a position,
+ * wrapping around at the edges of the data.
+ * @param x Position in samples of the level along the rows.
+ * @param y Position in samples of the level along the columns.
+ * @return The elevation, from 0 at the lowest to 1 at the highest point of
+ * the data.
+ */
+float DemCache::Region::sample(float x, float y) const {
+  if (cache == nullptr) return 0.0F;
+  const DemLayout &layout = cache->layout;
+  const DemLayout::Level &l = layout.levels[level];
+
+  float floorX = std::floor(x);
+  float floorY = std::floor(y);
+  float fx = x - floorX;
+  float fy = y - floorY;
+  int x0 = wrap(static_cast<int>(floorX), l.width);
+  int y0 = wrap(static_cast<int>(floorY), l.height);
+
+  // The tiles overlap by a sample, so away from the seam where the data
+  // wraps around the four codes are in one tile
+  int tileX = std::min(x0 / layout.tileSize, l.tilesX - 1);
+  int tileY = std::min(y0 / layout.tileSize, l.tilesY - 1);
+  const quint16 *codes = x0 + 1 < l.width && y0 + 1 < l.height
+                             ? tileCodes(tileX, tileY)
+                             : nullptr;
+  float c00, c10, c01, c11;
+  if (codes != nullptr) {
+    int stride = layout.tileSize + 1;
+    codes += (y0 - tileY * layout.tileSize) * stride +
+             (x0 - tileX * layout.tileSize);
+    c00 = codes[0];
+    c10 = codes[1];
+    c01 = codes[stride];
+    c11 = codes[stride + 1];
+  } else {
+    int x1 = wrap(x0 + 1, l.width);
+    int y1 = wrap(y0 + 1, l.height);
+    c00 = code(x0, y0);
+    c10 = code(x1, y0);
+    c01 = code(x0, y1);
+    c11 = code(x1, y1);
+  }
+
+  const DemCacheHeader &header = cache->header;
+  float top = c00 + fx * (c10 - c00);
+  float bottom = c01 + fx * (c11 - c01);
+  float value = top + fy * (bottom - top);
+  float range = std::max(1, header.maximum - header.minimum);
+  return qBound(0.0F, (value - header.minimum) / range, 1.0F);
+}
+
+/**
+ * @brief DemCache::Region::tileCodes Finds a tile of the region.
+ * @return The samples of the tile, or null if it is outside of the region.
+ */
+const quint16 *DemCache::Region::tileCodes(int tileX, int tileY) const {
+  for (const Pinned &pinned : tiles) {
+    if (pinned.tileX == tileX && pinned.tileY == tileY) return pinned.codes;
+  }
+  return nullptr;
+}
+
+/**
+ * @brief DemCache::Region::code Looks up a single sample, in the cache if it
+ * is outside of the region.
+ * @param x Column of the sample, inside the level.
+ * @param y Row of the sample, inside the level.
+ * @return The code of the sample.
+ */
+quint16 DemCache::Region::code(int x, int y) const {
+  const DemLayout &layout = cache->layout;
+  const DemLayout::Level &l = layout.levels[level];
+  int tileX = std::min(x / layout.tileSize, l.tilesX - 1);
+  int tileY = std::min(y / layout.tileSize, l.tilesY - 1);
+  int index = (y - tileY * layout.tileSize) * (layout.tileSize + 1) +
+              (x - tileX * layout.tileSize);
+  const quint16 *codes = tileCodes(tileX, tileY);
+  if (codes != nullptr) return codes[index];
+  return cache->tile(level, tileX, tileY)->at(index);
+}
+
+/**
+ * @brief DemCache::setMemoryBudget Changes the memory budget, evicting tiles
+ * right away when the cache is too large.
+ * @param bytes The new budget in bytes.
+ */
+void DemCache::setMemoryBudget(qsizetype bytes) {
+  QMutexLocker locker(&mutex);
+  memoryBudget = bytes;
+  evict();
+}
+
+qsizetype DemCache::getMemoryUsage() const {
+  QMutexLocker locker(&mutex);
+  return memoryUsage;
+}
+
+/**
+ * @brief DemCache::tile Looks up a tile, copying it out of the file if it is
+ * not cached. The copy is made under the lock, so a tile is read only once.
+ * @param level The level of the pyramid.
+ * @param tileX Column of the tile.
+ * @param tileY Row of the tile.
+ * @return The samples of the tile, row by row.
+ */
+QSharedPointer<const DemCache::Tile> DemCache::tile(int level, int tileX,
+                                                    int tileY) const {
+  QMutexLocker locker(&mutex);
+  quint64 k = key(level, tileX, tileY);
+  auto it = entries.find(k);
+  if (it != entries.end()) {
+    it->lastUse = ++useCounter;
+    return it->tile;
+  }
+
+  qint64 offset = layout.tileOffset(level, tileX, tileY);
+  qint64 bytes = layout.tileBytes();
+  QSharedPointer<Tile> copy(new Tile(bytes / sizeof(quint16)));
+  std::memcpy(copy->data(), mapping + offset, bytes);
+
+#ifdef Q_OS_UNIX
+  // The pages are clean, so the system can drop them instead of keeping
+  // them cached on top of the copy. Only whole pages are given back.
+  static const qint64 pageSize = sysconf(_SC_PAGESIZE);
+  qint64 first = (offset + pageSize - 1) / pageSize * pageSize;
+  qint64 last = (offset + bytes) / pageSize * pageSize;
+  if (last > first) {
+    posix_madvise(mapping + first, last - first, POSIX_MADV_DONTNEED);
+  }
+#endif
+
+  Entry entry;
+  entry.tile = copy;
+  entry.lastUse = ++useCounter;
+  entries.insert(k, entry);
+  memoryUsage += bytes;
+  evict();
+  return copy;
+}
+
+void DemCache::evict() const {
+  if (memoryUsage <= memoryBudget) return;
+
+  // Sort once on last use instead of searching the oldest tile every time.
+  QVector<QPair<quint64, quint64>> ages;
+  ages.reserve(entries.size());
+  for (auto it = entries.cbegin(); it != entries.cend(); ++it) {
+    ages.append(qMakePair(it->lastUse, it.key()));
+  }
+  std::sort(ages.begin(), ages.end());
+
+  // Tiles still in use by a sampling thread stay alive through their
+  // shared pointer until it is done with them.
+  for (const QPair<quint64, quint64> &age : ages) {
+    if (memoryUsage <= memoryBudget) break;
+    memoryUsage -= entries[age.second].tile->size() * sizeof(quint16);
+    entries.remove(age.second);
+  }
+}
@@ -0,0 +1,154 @@
+#ifndef DEMCACHE_H
+#define DEMCACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief The header at the start of a tile cache file, as written by
+ * DemImporter. Stored in the byte order of the machine that built it.
+ *
+ * The file holds a pyramid of levels, each half the size of the previous
+ * one, cut into square tiles of tileSize + 1 samples a side: neighbouring
+ * tiles share their border samples, so a tile can be interpolated without
+ * looking at the next one. Levels follow each other, and the tiles of a
+ * level are stored row by row. Samples are unsigned 16-bit codes; the
+ * elevation of a code is code - codeOffset.
+ */
+struct DemCacheHeader {
+  static constexpr quint32 kMagic = 0x434d4544;  // "DEMC"
+  static constexpr quint32 kVersion = 1;
+
+  quint32 magic = kMagic;
+  quint32 version = kVersion;
+  qint32 width = 0;  // samples of level 0
+  qint32 height = 0;
+  qint32 tileSize = 0;
+  qint32 levelCount = 0;
+  qint32 codeOffset = 0;
+  quint16 minimum = 0;  // lowest and highest code of level 0
+  quint16 maximum = 0;
+  quint64 sourceSize = 0;  // size and time of the source, to spot changes
+  qint64 sourceModified = 0;
+};
+
+/**
+ * @brief The size and position of each level of a tile cache.
+ */
+struct DemLayout {
+  struct Level {
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    qint64 offset;  // of the first tile, from the start of the file
+  };
+
+  DemLayout() = default;
+  explicit DemLayout(const DemCacheHeader &header);
+
+  qint64 tileBytes() const {
+    return qint64(tileSize + 1) * (tileSize + 1) * sizeof(quint16);
+  }
+  qint64 tileOffset(int level, int tileX, int tileY) const {
+    const Level &l = levels[level];
+    return l.offset + (qint64(tileY) * l.tilesX + tileX) * tileBytes();
+  }
+
+  int tileSize = 0;
+  QVector<Level> levels;
+  qint64 fileSize = 0;
+};
+
+/**
+ * @brief Reads heights from a tile cache file built by DemImporter.
+ *
+ * The file is memory mapped, but only the tiles in use are copied out of it
+ * and kept, the most recently used first, up to a memory budget. After a
+ * tile is copied its pages are given back to the system, so the data can be
+ * far larger than the memory. The terrain wraps around at the edges of the
+ * data. Sampling is thread safe, so tiles can be generated on worker
+ * threads. Every sample() locks the cache, so callers that take many
+ * samples of an area look its tiles up once through region() instead.
+ */
+class DemCache {
+ public:
+  explicit DemCache(qsizetype memoryBudget = 64 * 1024 * 1024);
+  ~DemCache();
+
+  bool open(const QString &path);
+  void close();
+  bool isOpen() const { return mapping != nullptr; }
+
+  class Region;
+  Region region(int level, float x0, float y0, float x1, float y1) const;
+  float sample(int level, float x, float y) const;
+
+  const DemCacheHeader &getHeader() const { return header; }
+  int getLevelCount() const { return layout.levels.size(); }
+  int getWidth(int level) const { return layout.levels[level].width; }
+  int getHeight(int level) const { return layout.levels[level].height; }
+
+  void setMemoryBudget(qsizetype bytes);
+  qsizetype getMemoryUsage() const;
+
+ private:
+  using Tile = QVector<quint16>;
+  struct Entry {
+    QSharedPointer<const Tile> tile;
+    quint64 lastUse = 0;
+  };
+
+  static quint64 key(int level, int tileX, int tileY) {
+    return (quint64(level) << 48) | (quint64(quint32(tileY)) << 24) |
+           quint32(tileX);
+  }
+
+  QSharedPointer<const Tile> tile(int level, int tileX, int tileY) const;
+  void evict() const;
+
+  QFile file;
+  uchar *mapping = nullptr;
+  DemCacheHeader header;
+  DemLayout layout;
+
+  mutable QMutex mutex;  // guards the members below
+  mutable QHash<quint64, Entry> entries;
+  mutable quint64 useCounter = 0;
+  mutable qsizetype memoryUsage = 0;
+  qsizetype memoryBudget;
+};
+
+/**
+ * @brief The tiles of one level of a DemCache that cover an area, looked up
+ * once. They are kept alive by the region even when the cache evicts them,
+ * so sampling inside the area takes no lock. Samples outside of the area
+ * fall back to the cache. The cache must stay open while the region is used.
+ */
+class DemCache::Region {
+ public:
+  float sample(float x, float y) const;
+
+ private:
+  friend class DemCache;
+
+  struct Pinned {
+    int tileX;
+    int tileY;
+    QSharedPointer<const Tile> tile;
+    const quint16 *codes;  // the samples of the tile, row by row
+  };
+
+  const quint16 *tileCodes(int tileX, int tileY) const;
+  quint16 code(int x, int y) const;
+
+  const DemCache *cache = nullptr;
+  int level = 0;
+  QVector<Pinned> tiles;  // a handful, so they are searched in order
+};
+
+#endif  // DEMCACHE_H
@@ -0,0 +1,414 @@
+#include "demimporter.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+#include "demcache.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+/**
+ * @brief A mapped source heightmap. Rows are found through their offsets,
+ * since the rows of a TIFF are spread over strips.
+ */
+struct SourceImage {
+  const uchar *data = nullptr;
+  int width = 0;
+  int height = 0;
+  int bytesPerSample = 2;
+  bool bigEndian = false;
+  bool signedSamples = false;
+  QVector<qint64> rowOffsets;
+
+  quint16 code(int x, int y) const {
+    const uchar *p = data + rowOffsets[y] + qint64(x) * bytesPerSample;
+    if (bytesPerSample == 1) return *p;
+    quint16 value = bigEndian ? quint16(p[0] << 8 | p[1])
+                              : quint16(p[1] << 8 | p[0]);
+    if (!signedSamples) return value;
+    // Voids in the data become sea level
+    qint16 elevation = static_cast<qint16>(value);
+    if (elevation == -32768) elevation = 0;
+    return static_cast<quint16>(elevation + 32768);
+  }
+};
+
+void setContiguousRows(SourceImage &image, qint64 offset) {
+  image.rowOffsets.resize(image.height);
+  qint64 rowBytes = qint64(image.width) * image.bytesPerSample;
+  for (int y = 0; y != image.height; ++y) {
+    image.rowOffsets[y] = offset + y * rowBytes;
+  }
+}
+
+/**
+ * @brief parsePgm Reads the header of a binary PGM file. Samples of more
+ * than 8 bits are big endian.
+ */
+bool parsePgm(const uchar *data, qint64 size, SourceImage &image) {
+  qint64 position = 2;
+  int values[3];
+  for (int &value : values) {
+    // Skip whitespace and comments up to the next number
+    while (position < size) {
+      if (data[position] == '#') {
+        while (position < size && data[position] != '\n') ++position;
+      } else if (std::isspace(data[position])) {
+        ++position;
+      } else {
+        break;
+      }
+    }
+    value = 0;
+    while (position < size && std::isdigit(data[position])) {
+      value = value * 10 + (data[position++] - '0');
+    }
+  }
+  ++position;  // the single whitespace before the samples
+
+  image.width = values[0];
+  image.height = values[1];
+  image.bytesPerSample = values[2] < 256 ? 1 : 2;
+  image.bigEndian = true;
+  if (image.width < 2 || image.height < 2 || values[2] < 1 ||
+      values[2] > 65535) {
+    qWarning() << "DemImporter: unsupported PGM header";
+    return false;
+  }
+  if (position + qint64(image.width) * image.height * image.bytesPerSample >
+      size) {
+    qWarning() << "DemImporter: PGM file is smaller than" << image.width
+               << "x" << image.height << "samples";
+    return false;
+  }
+  setContiguousRows(image, position);
+  return true;
+}
+
+/**
+ * @brief Reads the fields of the first directory of a TIFF file.
+ */
+class TiffReader {
+ public:
+  TiffReader(const uchar *data, qint64 size)
+      : data(data), size(size), little(data[0] == 'I') {}
+
+  quint32 read(qint64 offset, int bytes) const {
+    if (offset < 0 || offset + bytes > size) return 0;
+    quint32 value = 0;
+    for (int i = 0; i != bytes; ++i) {
+      int shift = little ? 8 * i : 8 * (bytes - 1 - i);
+      value |= quint32(data[offset + i]) << shift;
+    }
+    return value;
+  }
+
+  // Finds a tag in the directory, returning its entry or -1.
+  qint64 find(quint16 tag) const {
+    qint64 directory = read(4, 4);
+    int count = read(directory, 2);
+    for (int i = 0; i != count; ++i) {
+      qint64 entry = directory + 2 + 12 * i;
+      if (read(entry, 2) == tag) return entry;
+    }
+    return -1;
+  }
+
+  int count(qint64 entry) const { return entry < 0 ? 0 : read(entry + 4, 4); }
+
+  // Value number index of an entry of SHORT or LONG values.
+  quint32 value(qint64 entry, int index, quint32 fallback = 0) const {
+    if (entry < 0 || index >= count(entry)) return fallback;
+    int bytes = read(entry + 2, 2) == 3 ? 2 : 4;
+    qint64 values = entry + 8;
+    if (qint64(count(entry)) * bytes > 4) values = read(entry + 8, 4);
+    return read(values + qint64(index) * bytes, bytes);
+  }
+
+  bool isLittleEndian() const { return little; }
+
+ private:
+  const uchar *data;
+  qint64 size;
+  bool little;
+};
+
+/**
+ * @brief parseTiff Reads the first image of a TIFF file, which has to be
+ * uncompressed, single-channel and stored in strips.
+ */
+bool parseTiff(const uchar *data, qint64 size, SourceImage &image) {
+  TiffReader tiff(data, size);
+  if (tiff.read(2, 2) != 42) {
+    qWarning() << "DemImporter: not a TIFF file";
+    return false;
+  }
+
+  image.width = tiff.value(tiff.find(256), 0);
+  image.height = tiff.value(tiff.find(257), 0);
+  int bits = tiff.value(tiff.find(258), 0, 1);
+  int compression = tiff.value(tiff.find(259), 0, 1);
+  int channels = tiff.value(tiff.find(277), 0, 1);
+  int sampleFormat = tiff.value(tiff.find(339), 0, 1);
+  qint64 stripOffsets = tiff.find(273);
+  int rowsPerStrip = tiff.value(tiff.find(278), 0, image.height);
+
+  if (tiff.find(322) >= 0 || stripOffsets < 0) {
+    qWarning() << "DemImporter: tiled TIFF files are not supported";
+    return false;
+  }
+  if (compression != 1 || channels != 1 || (bits != 8 && bits != 16) ||
+      sampleFormat > 2 || image.width < 2 || image.height < 2 ||
+      rowsPerStrip < 1) {
+    qWarning() << "DemImporter: only uncompressed 8 or 16-bit integer"
+               << "single-channel TIFF files are supported";
+    return false;
+  }
+
+  image.bytesPerSample = bits / 8;
+  image.bigEndian = !tiff.isLittleEndian();
+  image.signedSamples = sampleFormat == 2 && bits == 16;
+  image.rowOffsets.resize(image.height);
+  qint64 rowBytes = qint64(image.width) * image.bytesPerSample;
+  for (int y = 0; y != image.height; ++y) {
+    qint64 strip = tiff.value(stripOffsets, y / rowsPerStrip);
+    image.rowOffsets[y] = strip + (y % rowsPerStrip) * rowBytes;
+    if (strip == 0 || image.rowOffsets[y] + rowBytes > size) {
+      qWarning() << "DemImporter: TIFF strips out of range";
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief parseRaw Sets up headerless 16-bit samples.
+ */
+bool parseRaw(qint64 size, const DemImportOptions &options, bool hgt,
+              SourceImage &image) {
+  image.width = options.width;
+  image.height = options.height;
+  image.bigEndian = options.bigEndian || hgt;
+  image.signedSamples = options.signedSamples || hgt;
+  if (image.width == 0) {
+    image.width = static_cast<int>(std::sqrt(size / 2.0));
+    image.height = image.width;
+  }
+  if (image.width < 2 || image.height < 2 ||
+      qint64(image.width) * image.height * 2 > size) {
+    qWarning() << "DemImporter: RAW file is smaller than" << image.width
+               << "x" << image.height << "samples";
+    return false;
+  }
+  setContiguousRows(image, 0);
+  return true;
+}
+
+quint16 *tileAt(uchar *tiles, const DemLayout &layout, int level, int tileX,
+                int tileY) {
+  return reinterpret_cast<quint16 *>(
+      tiles + layout.tileOffset(level, tileX, tileY));
+}
+
+// A sample of a level that has already been written, clamped to the level.
+quint16 cachedCode(uchar *tiles, const DemLayout &layout, int level, int x,
+                   int y) {
+  const DemLayout::Level &l = layout.levels[level];
+  x = std::min(x, l.width - 1);
+  y = std::min(y, l.height - 1);
+  int tileX = std::min(x / layout.tileSize, l.tilesX - 1);
+  int tileY = std::min(y / layout.tileSize, l.tilesY - 1);
+  return tileAt(tiles, layout, level, tileX, tileY)
+      [(y - tileY * layout.tileSize) * (layout.tileSize + 1) +
+       (x - tileX * layout.tileSize)];
+}
+
+/**
+ * @brief writeFirstLevel Cuts the source into tiles. Goes through the source
+ * a band of tile rows at a time, so that it is read nearly in order.
+ */
+void writeFirstLevel(const SourceImage &image, uchar *tiles,
+                     const DemLayout &layout, DemCacheHeader &header) {
+  const DemLayout::Level &l = layout.levels[0];
+  int tileSize = layout.tileSize;
+  quint16 minimum = 65535;
+  quint16 maximum = 0;
+  for (int tileY = 0; tileY != l.tilesY; ++tileY) {
+    for (int j = 0; j <= tileSize; ++j) {
+      int y = std::min(tileY * tileSize + j, l.height - 1);
+      for (int tileX = 0; tileX != l.tilesX; ++tileX) {
+        quint16 *row = tileAt(tiles, layout, 0, tileX, tileY) +
+                       j * (tileSize + 1);
+        for (int i = 0; i <= tileSize; ++i) {
+          int x = std::min(tileX * tileSize + i, l.width - 1);
+          quint16 code = image.code(x, y);
+          row[i] = code;
+          minimum = std::min(minimum, code);
+          maximum = std::max(maximum, code);
+        }
+      }
+    }
+  }
+  header.minimum = minimum;
+  header.maximum = maximum;
+}
+
+/**
+ * @brief writeLevel Averages 2 by 2 samples of the previous level.
+ */
+void writeLevel(int level, uchar *tiles, const DemLayout &layout) {
+  const DemLayout::Level &l = layout.levels[level];
+  int tileSize = layout.tileSize;
+  for (int tileY = 0; tileY != l.tilesY; ++tileY) {
+    for (int tileX = 0; tileX != l.tilesX; ++tileX) {
+      quint16 *tile = tileAt(tiles, layout, level, tileX, tileY);
+      for (int j = 0; j <= tileSize; ++j) {
+        int y = 2 * std::min(tileY * tileSize + j, l.height - 1);
+        for (int i = 0; i <= tileSize; ++i) {
+          int x = 2 * std::min(tileX * tileSize + i, l.width - 1);
+          quint32 sum = cachedCode(tiles, layout, level - 1, x, y) +
+                        cachedCode(tiles, layout, level - 1, x + 1, y) +
+                        cachedCode(tiles, layout, level - 1, x, y + 1) +
+                        cachedCode(tiles, layout, level - 1, x + 1, y + 1);
+          tile[j * (tileSize + 1) + i] = static_cast<quint16>((sum + 2) / 4);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief DemImporter::import Builds the tile cache of a heightmap. The cache
+ * is written next to its final name and only renamed when complete.
+ * @param source The heightmap: .pgm, .tif, .tiff, .hgt or RAW samples.
+ * @param cache The tile cache file to create.
+ * @param options Settings for RAW files and the tile size.
+ * @return False if the source cannot be read or the cache not written.
+ */
+bool DemImporter::import(const QString &source, const QString &cache,
+                         const DemImportOptions &options) {
+  QElapsedTimer timer;
+  timer.start();
+
+  QFile in(source);
+  if (!in.open(QIODevice::ReadOnly) || in.size() < 8) {
+    qWarning() << "DemImporter: cannot read" << source;
+    return false;
+  }
+  const uchar *data = in.map(0, in.size());
+  if (data == nullptr) {
+    qWarning() << "DemImporter: cannot map" << source << in.errorString();
+    return false;
+  }
+#ifdef Q_OS_UNIX
+  posix_madvise(const_cast<uchar *>(data), in.size(),
+                POSIX_MADV_SEQUENTIAL);
+#endif
+
+  SourceImage image;
+  image.data = data;
+  QString suffix = QFileInfo(source).suffix().toLower();
+  bool parsed = false;
+  if (data[0] == 'P' && data[1] == '5') {
+    parsed = parsePgm(data, in.size(), image);
+  } else if ((data[0] == 'I' && data[1] == 'I') ||
+             (data[0] == 'M' && data[1] == 'M')) {
+    parsed = parseTiff(data, in.size(), image);
+  } else {
+    parsed = parseRaw(in.size(), options, suffix == "hgt", image);
+  }
+  if (!parsed) return false;
+
+  DemCacheHeader header;
+  header.width = image.width;
+  header.height = image.height;
+  header.tileSize = std::max(16, options.tileSize);
+  header.codeOffset = image.signedSamples ? 32768 : 0;
+  header.sourceSize = in.size();
+  header.sourceModified =
+      QFileInfo(source).lastModified().toMSecsSinceEpoch();
+  int width = image.width;
+  int height = image.height;
+  header.levelCount = 1;
+  while (width > header.tileSize + 1 || height > header.tileSize + 1) {
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+    ++header.levelCount;
+  }
+  DemLayout layout(header);
+
+  QString partial = cache + ".part";
+  QFile out(partial);
+  if (!out.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+      !out.resize(layout.fileSize)) {
+    qWarning() << "DemImporter: cannot create" << partial
+               << out.errorString();
+    return false;
+  }
+  uchar *tiles = out.map(0, layout.fileSize);
+  if (tiles == nullptr) {
+    qWarning() << "DemImporter: cannot map" << partial << out.errorString();
+    return false;
+  }
+
+  writeFirstLevel(image, tiles, layout, header);
+  qDebug() << ":: DEM level 0," << image.width << "x" << image.height
+           << "samples, after" << timer.elapsed() << "ms";
+  in.unmap(const_cast<uchar *>(data));
+
+  for (int level = 1; level != header.levelCount; ++level) {
+    writeLevel(level, tiles, layout);
+    qDebug() << ":: DEM level" << level << "after" << timer.elapsed()
+             << "ms";
+  }
+
+  std::memcpy(tiles, &header, sizeof(header));
+  out.unmap(tiles);
+  out.close();
+
+  QFile::remove(cache);
+  if (!QFile::rename(partial, cache)) {
+    qWarning() << "DemImporter: cannot rename" << partial << "to" << cache;
+    return false;
+  }
+  qDebug() << ":: DEM tile cache" << cache << "of"
+           << layout.fileSize / (1024 * 1024) << "MiB built in"
+           << timer.elapsed() << "ms";
+  return true;
+}
+
+/**
+ * @brief DemImporter::isUpToDate Checks whether a tile cache was built from
+ * the current version of a heightmap.
+ * @param source The heightmap.
+ * @param cache The tile cache file.
+ * @return True if the cache exists and matches the source.
+ */
+bool DemImporter::isUpToDate(const QString &source, const QString &cache) {
+  QFile file(cache);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+  DemCacheHeader header;
+  if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) !=
+      qint64(sizeof(header))) {
+    return false;
+  }
+  QFileInfo info(source);
+  return header.magic == DemCacheHeader::kMagic &&
+         header.version == DemCacheHeader::kVersion &&
+         header.sourceSize == quint64(info.size()) &&
+         header.sourceModified == info.lastModified().toMSecsSinceEpoch() &&
+         file.size() >= DemLayout(header).fileSize;
+}
@@ -0,0 +1,38 @@
+#ifndef DEMIMPORTER_H
+#define DEMIMPORTER_H
+
+#include <QString>
+
+/**
+ * @brief Settings for files that do not describe themselves.
+ */
+struct DemImportOptions {
+  // Size of RAW files; 0 assumes a square that fills the file.
+  int width = 0;
+  int height = 0;
+  // Sample format of RAW files. SRTM .hgt files are always signed and big
+  // endian.
+  bool bigEndian = false;
+  bool signedSamples = false;
+  // Samples along a side of a tile, not counting the shared border.
+  int tileSize = 256;
+};
+
+/**
+ * @brief Converts a large heightmap into the tiled pyramid read by DemCache.
+ *
+ * Both the source and the tile cache are memory mapped, so neither has to
+ * fit in memory; the system pages them in and out while the tiles are cut
+ * and the levels are averaged down. Reads binary PGM (P5, 8 or 16 bits),
+ * uncompressed single-channel TIFF and GeoTIFF files stored in strips, and
+ * RAW 16-bit samples. Signed samples are offset into unsigned codes, with
+ * the SRTM void value -32768 read as sea level.
+ */
+class DemImporter {
+ public:
+  static bool import(const QString &source, const QString &cache,
+                     const DemImportOptions &options = DemImportOptions());
+  static bool isUpToDate(const QString &source, const QString &cache);
+};
+
+#endif  // DEMIMPORTER_H
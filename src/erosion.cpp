@@ -0,0 +1,463 @@
+#include "erosion.h"
+
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define EROSION_USE_SSE
+#endif
+
+namespace {
+
+// Rows handed to a worker at a time by the thermal passes.
+constexpr int kRowsPerJob = 16;
+
+/**
+ * @brief SplitMix64, small and the same on every platform, unlike the
+ * distributions of <random>.
+ */
+class Random {
+ public:
+  explicit Random(quint64 seed) : state(seed) {}
+
+  // Uniform in [0, 1)
+  float next() {
+    state += 0x9e3779b97f4a7c15ULL;
+    quint64 z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return static_cast<float>(z >> 40) * (1.0F / 16777216.0F);
+  }
+
+ private:
+  quint64 state;
+};
+
+}  // namespace
+
+/**
+ * @brief TerrainErosion::TerrainErosion Creates the erosion without a grid.
+ * @param settings The parameters, fixed for the lifetime of the erosion.
+ */
+TerrainErosion::TerrainErosion(const ErosionSettings &settings)
+    : settings(settings),
+      radius(qBound(1, settings.radius, kTileSize / 2 - 2)),
+      threadCount(settings.threadCount > 0 ? settings.threadCount
+                                           : QThread::idealThreadCount()) {
+  workers.setMaxThreadCount(std::max(1, threadCount - 1));
+
+  // Weights falling off linearly with the distance, summing to one
+  float sum = 0.0F;
+  for (int dy = -radius; dy <= radius; ++dy) {
+    for (int dx = -radius; dx <= radius; ++dx) {
+      float distance = std::sqrt(static_cast<float>(dx * dx + dy * dy));
+      if (distance >= radius) continue;
+      float weight = 1.0F - distance / radius;
+      brush.append({dx, dy, weight});
+      sum += weight;
+    }
+  }
+  for (BrushCell &cell : brush) {
+    cell.weight /= sum;
+  }
+}
+
+TerrainErosion::~TerrainErosion() { workers.waitForDone(); }
+
+/**
+ * @brief TerrainErosion::setHeights Replaces the grid and starts over.
+ * @param newWidth Number of samples per row.
+ * @param newHeight Number of rows.
+ * @param values The heights from 0 to 1, row by row.
+ */
+void TerrainErosion::setHeights(int newWidth, int newHeight,
+                                const QVector<float> &values) {
+  width = newWidth;
+  height = newHeight;
+  tilesX = (width + kTileSize - 1) / kTileSize;
+  tilesY = (height + kTileSize - 1) / kTileSize;
+  batchCount = 0;
+  heights = values;
+  reportedCodes.resize(width * height);
+  std::transform(heights.cbegin(), heights.cend(), reportedCodes.begin(),
+                 toCode);
+  outLeft.fill(0.0F, width * height);
+  outRight.fill(0.0F, width * height);
+  outUp.fill(0.0F, width * height);
+  outDown.fill(0.0F, width * height);
+}
+
+/**
+ * @brief TerrainErosion::setHeights Replaces the heights in a region, such as
+ * an edit, and goes on eroding from there. The region does not count as
+ * changed by the erosion.
+ * @param region The samples that changed.
+ * @param values All heights from 0 to 1, row by row, of the size of the
+ * grid. Only the region is read.
+ */
+void TerrainErosion::setHeights(const QRect &region,
+                                const QVector<float> &values) {
+  QRect clipped = region & QRect(0, 0, width, height);
+  for (int y = clipped.top(); y <= clipped.bottom(); ++y) {
+    int offset = y * width + clipped.left();
+    std::copy_n(values.constData() + offset, clipped.width(),
+                heights.data() + offset);
+    std::transform(heights.constData() + offset,
+                   heights.constData() + offset + clipped.width(),
+                   reportedCodes.data() + offset, toCode);
+  }
+}
+
+/**
+ * @brief TerrainErosion::setHeightSource Takes the heights from the red
+ * channel of an image, 255 being a height of 1.
+ * @param image The height image, pixel (x, y) becomes sample (x, y).
+ */
+void TerrainErosion::setHeightSource(const QImage &image) {
+  QImage pixels = image.convertToFormat(QImage::Format_RGB32);
+  QVector<float> values(pixels.width() * pixels.height());
+  for (int y = 0; y != pixels.height(); ++y) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(pixels.constScanLine(y));
+    for (int x = 0; x != pixels.width(); ++x) {
+      values[y * pixels.width() + x] = qRed(line[x]) / 255.0F;
+    }
+  }
+  setHeights(pixels.width(), pixels.height(), values);
+}
+
+/**
+ * @brief TerrainErosion::runBatch Runs the droplets of one batch on all
+ * tiles, then one thermal pass.
+ */
+void TerrainErosion::runBatch() {
+  if (width < 2 || height < 2) return;
+  // Unshare the heights here, not in the workers
+  heights.detach();
+
+  for (int phase = 0; phase != 4; ++phase) {
+    int firstX = phase & 1;
+    int firstY = phase >> 1;
+    int columns = (tilesX - firstX + 1) / 2;
+    int rows = (tilesY - firstY + 1) / 2;
+    parallelFor(columns * rows, [this, firstX, firstY, columns](int i) {
+      erodeTile(firstX + 2 * (i % columns), firstY + 2 * (i / columns));
+    });
+  }
+
+  // All outflows are computed before any height changes
+  int jobs = (height + kRowsPerJob - 1) / kRowsPerJob;
+  parallelFor(jobs, [this](int job) {
+    int last = std::min(height, (job + 1) * kRowsPerJob);
+    for (int row = job * kRowsPerJob; row != last; ++row) computeOutflow(row);
+  });
+  parallelFor(jobs, [this](int job) {
+    int last = std::min(height, (job + 1) * kRowsPerJob);
+    for (int row = job * kRowsPerJob; row != last; ++row) applyOutflow(row);
+  });
+
+  ++batchCount;
+}
+
+/**
+ * @brief TerrainErosion::run Runs whole batches for about the given time.
+ * Stops early when the next batch would likely not fit, but always runs at
+ * least one.
+ * @param nanoseconds The time to spend.
+ * @return The number of batches run.
+ */
+int TerrainErosion::run(qint64 nanoseconds) {
+  QElapsedTimer timer;
+  timer.start();
+  int batches = 0;
+  do {
+    runBatch();
+    ++batches;
+  } while (timer.nsecsElapsed() * (batches + 1) / batches <= nanoseconds);
+  return batches;
+}
+
+/**
+ * @brief TerrainErosion::takeChangedRegion Finds the samples whose heights
+ * changed since the last call, at the 16-bit precision of the height
+ * texture, so that only that part has to be passed on. The rows are
+ * compared on the workers.
+ * @return The bounds of the changed samples, empty if none changed.
+ */
+QRect TerrainErosion::takeChangedRegion() {
+  int jobs = (height + kRowsPerJob - 1) / kRowsPerJob;
+  QVector<QRect> changed(jobs);
+  parallelFor(jobs, [this, &changed](int job) {
+    int left = width;
+    int right = -1;
+    int top = -1;
+    int bottom = -1;
+    int last = std::min(height, (job + 1) * kRowsPerJob);
+    for (int row = job * kRowsPerJob; row != last; ++row) {
+      const float *h = heights.constData() + row * width;
+      quint16 *codes = reportedCodes.data() + row * width;
+      for (int x = 0; x != width; ++x) {
+        quint16 code = toCode(h[x]);
+        if (code == codes[x]) continue;
+        codes[x] = code;
+        left = std::min(left, x);
+        right = std::max(right, x);
+        if (top == -1) top = row;
+        bottom = row;
+      }
+    }
+    if (right != -1) {
+      changed[job] = QRect(QPoint(left, top), QPoint(right, bottom));
+    }
+  });
+
+  QRect region;
+  for (const QRect &rect : changed) {
+    region |= rect;
+  }
+  return region;
+}
+
+qint64 TerrainErosion::getDropletCount() const {
+  return qint64(batchCount) * tilesX * tilesY * settings.dropletsPerTile;
+}
+
+quint16 TerrainErosion::toCode(float value) {
+  return static_cast<quint16>(qBound(0.0F, value, 1.0F) * 65535.0F + 0.5F);
+}
+
+/**
+ * @brief TerrainErosion::parallelFor Runs a job for every index on the
+ * calling thread and the workers. The threads take the next index as soon as
+ * they are done with one, so uneven jobs even out.
+ * @param count Number of indices.
+ * @param job The job, called once for every index in [0, count).
+ */
+void TerrainErosion::parallelFor(int count,
+                                 const std::function<void(int)> &job) {
+  std::atomic<int> next{0};
+  auto work = [&next, count, &job]() {
+    for (int i = next++; i < count; i = next++) job(i);
+  };
+
+  int helpers = std::min(threadCount - 1, count - 1);
+  for (int i = 0; i < helpers; ++i) {
+    workers.start(work);
+  }
+  work();
+  workers.waitForDone();
+}
+
+/**
+ * @brief TerrainErosion::erodeTile Runs the droplets of a tile. A droplet
+ * picks up sediment while it speeds up downhill and drops it where it slows
+ * down or runs uphill, until it evaporates, stops or leaves the area of the
+ * tile.
+ * @param tileX Column of the tile.
+ * @param tileY Row of the tile.
+ */
+void TerrainErosion::erodeTile(int tileX, int tileY) {
+  // Droplets may wander up to the margin into the neighbouring tiles, which
+  // with the brush keeps them clear of the tiles two steps away.
+  const int margin = kTileSize / 2 - radius - 2;
+  int x0 = tileX * kTileSize;
+  int y0 = tileY * kTileSize;
+  int x1 = std::min(x0 + kTileSize, width - 1);
+  int y1 = std::min(y0 + kTileSize, height - 1);
+  float minimumX = std::max(0, x0 - margin);
+  float minimumY = std::max(0, y0 - margin);
+  float maximumX = std::min(width - 1, x1 + margin);
+  float maximumY = std::min(height - 1, y1 + margin);
+  if (x1 <= x0 || y1 <= y0) return;  // only the last row or column
+
+  float *grid = heights.data();
+  auto sample = [this, grid](int x, int y) { return grid[y * width + x]; };
+
+  Random random(settings.seed * 0x9e3779b97f4a7c15ULL ^
+                (quint64(batchCount) << 32) ^
+                quint64(tileY * tilesX + tileX));
+  for (int d = 0; d != settings.dropletsPerTile; ++d) {
+    float x = x0 + random.next() * (x1 - x0);
+    float y = y0 + random.next() * (y1 - y0);
+    float directionX = 0.0F;
+    float directionY = 0.0F;
+    float speed = 1.0F;
+    float water = 1.0F;
+    float sediment = 0.0F;
+
+    for (int step = 0; step != settings.maxLifetime; ++step) {
+      int nodeX = static_cast<int>(x);
+      int nodeY = static_cast<int>(y);
+      float u = x - nodeX;
+      float v = y - nodeY;
+
+      // Height and gradient from the four samples around the droplet
+      float h00 = sample(nodeX, nodeY);
+      float h10 = sample(nodeX + 1, nodeY);
+      float h01 = sample(nodeX, nodeY + 1);
+      float h11 = sample(nodeX + 1, nodeY + 1);
+      float gradientX = (h10 - h00) * (1.0F - v) + (h11 - h01) * v;
+      float gradientY = (h01 - h00) * (1.0F - u) + (h11 - h10) * u;
+      float oldHeight = h00 * (1.0F - u) * (1.0F - v) + h10 * u * (1.0F - v) +
+                        h01 * (1.0F - u) * v + h11 * u * v;
+
+      directionX = directionX * settings.inertia -
+                   gradientX * (1.0F - settings.inertia);
+      directionY = directionY * settings.inertia -
+                   gradientY * (1.0F - settings.inertia);
+      float length = std::sqrt(directionX * directionX +
+                               directionY * directionY);
+      if (length < 1e-6F) break;
+      directionX /= length;
+      directionY /= length;
+      x += directionX;
+      y += directionY;
+      if (x < minimumX || x >= maximumX || y < minimumY || y >= maximumY) {
+        break;
+      }
+
+      int newX = static_cast<int>(x);
+      int newY = static_cast<int>(y);
+      float nu = x - newX;
+      float nv = y - newY;
+      float newHeight =
+          sample(newX, newY) * (1.0F - nu) * (1.0F - nv) +
+          sample(newX + 1, newY) * nu * (1.0F - nv) +
+          sample(newX, newY + 1) * (1.0F - nu) * nv +
+          sample(newX + 1, newY + 1) * nu * nv;
+      float deltaHeight = newHeight - oldHeight;
+
+      float capacity =
+          std::max(-deltaHeight * speed * water * settings.sedimentCapacity,
+                   settings.minSedimentCapacity);
+      if (sediment > capacity || deltaHeight > 0.0F) {
+        // Fill the pit it climbs out of, or drop the excess sediment
+        float amount = deltaHeight > 0.0F
+                           ? std::min(deltaHeight, sediment)
+                           : (sediment - capacity) * settings.depositSpeed;
+        sediment -= amount;
+        float *node = grid + nodeY * width + nodeX;
+        node[0] += amount * (1.0F - u) * (1.0F - v);
+        node[1] += amount * u * (1.0F - v);
+        node[width] += amount * (1.0F - u) * v;
+        node[width + 1] += amount * u * v;
+      } else {
+        // Erode over the brush, never deeper than the slope it runs down
+        float amount = std::min((capacity - sediment) * settings.erodeSpeed,
+                                -deltaHeight);
+        for (const BrushCell &cell : brush) {
+          int cellX = nodeX + cell.dx;
+          int cellY = nodeY + cell.dy;
+          if (cellX < 0 || cellX >= width || cellY < 0 || cellY >= height) {
+            continue;
+          }
+          float &h = grid[cellY * width + cellX];
+          float eroded = std::min(h, amount * cell.weight);
+          h -= eroded;
+          sediment += eroded;
+        }
+      }
+
+      speed = std::sqrt(
+          std::max(0.0F, speed * speed - deltaHeight * settings.gravity));
+      water *= 1.0F - settings.evaporateSpeed;
+    }
+  }
+}
+
+/**
+ * @brief TerrainErosion::computeOutflow Computes how much of each sample of a
+ * row slides to each of its four neighbours: a share of the height
+ * difference beyond the talus. Samples on the border have no neighbour on
+ * the outside, which is treated as a neighbour of equal height.
+ * @param row The row.
+ */
+void TerrainErosion::computeOutflow(int row) {
+  const float *h = heights.constData() + row * width;
+  const float *above = row > 0 ? h - width : h;
+  const float *below = row + 1 < height ? h + width : h;
+  float *left = outLeft.data() + row * width;
+  float *right = outRight.data() + row * width;
+  float *up = outUp.data() + row * width;
+  float *down = outDown.data() + row * width;
+  const float talus = settings.talus;
+  const float rate = 0.25F * settings.thermalRate;
+
+  auto scalar = [&](int x) {
+    float center = h[x];
+    float l = x > 0 ? h[x - 1] : center;
+    float r = x + 1 < width ? h[x + 1] : center;
+    left[x] = rate * std::max(0.0F, center - l - talus);
+    right[x] = rate * std::max(0.0F, center - r - talus);
+    up[x] = rate * std::max(0.0F, center - above[x] - talus);
+    down[x] = rate * std::max(0.0F, center - below[x] - talus);
+  };
+
+  int x = 1;
+  scalar(0);
+#ifdef EROSION_USE_SSE
+  const __m128 talus4 = _mm_set1_ps(talus);
+  const __m128 rate4 = _mm_set1_ps(rate);
+  const __m128 zero = _mm_setzero_ps();
+  auto flow = [&](__m128 center, __m128 neighbour) {
+    __m128 excess = _mm_sub_ps(_mm_sub_ps(center, neighbour), talus4);
+    return _mm_mul_ps(rate4, _mm_max_ps(excess, zero));
+  };
+  for (; x + 4 < width; x += 4) {
+    __m128 center = _mm_loadu_ps(h + x);
+    _mm_storeu_ps(left + x, flow(center, _mm_loadu_ps(h + x - 1)));
+    _mm_storeu_ps(right + x, flow(center, _mm_loadu_ps(h + x + 1)));
+    _mm_storeu_ps(up + x, flow(center, _mm_loadu_ps(above + x)));
+    _mm_storeu_ps(down + x, flow(center, _mm_loadu_ps(below + x)));
+  }
+#endif
+  for (; x < width; ++x) {
+    scalar(x);
+  }
+}
+
+/**
+ * @brief TerrainErosion::applyOutflow Moves the outflows computed for the
+ * whole grid in and out of the samples of a row.
+ * @param row The row.
+ */
+void TerrainErosion::applyOutflow(int row) {
+  int offset = row * width;
+  float *h = heights.data() + offset;
+  const float *left = outLeft.constData() + offset;
+  const float *right = outRight.constData() + offset;
+  const float *up = outUp.constData() + offset;
+  const float *down = outDown.constData() + offset;
+  // What slides down from the row above and up from the row below. The
+  // first row has nothing flowing up out of it and the last row nothing
+  // flowing down, so those rows stand in for the missing neighbours.
+  const float *fromAbove = row > 0 ? down - width : up;
+  const float *fromBelow = row + 1 < height ? up + width : down;
+
+  auto scalar = [&](int x) {
+    float in = fromAbove[x] + fromBelow[x];
+    if (x > 0) in += right[x - 1];
+    if (x + 1 < width) in += left[x + 1];
+    h[x] += in - (left[x] + right[x] + up[x] + down[x]);
+  };
+
+  int x = 1;
+  scalar(0);
+#ifdef EROSION_USE_SSE
+  for (; x + 4 < width; x += 4) {
+    __m128 in = _mm_add_ps(
+        _mm_add_ps(_mm_loadu_ps(fromAbove + x), _mm_loadu_ps(fromBelow + x)),
+        _mm_add_ps(_mm_loadu_ps(right + x - 1), _mm_loadu_ps(left + x + 1)));
+    __m128 out = _mm_add_ps(
+        _mm_add_ps(_mm_loadu_ps(left + x), _mm_loadu_ps(right + x)),
+        _mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)));
+    _mm_storeu_ps(h + x, _mm_add_ps(_mm_loadu_ps(h + x), _mm_sub_ps(in, out)));
+  }
+#endif
+  for (; x < width; ++x) {
+    scalar(x);
+  }
+}
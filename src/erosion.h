@@ -0,0 +1,106 @@
+#ifndef EROSION_H
+#define EROSION_H
+
+#include <QImage>
+#include <QRect>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+
+/**
+ * @brief Parameters of the erosion. Heights run from 0 to 1, one unit along
+ * the grid is one sample.
+ */
+struct ErosionSettings {
+  unsigned seed = 1;
+  int threadCount = 0;  // 0 uses all cores
+
+  // Hydraulic erosion, after Hans Theobald Beyer's droplet model
+  int dropletsPerTile = 16;  // per batch
+  int maxLifetime = 30;      // steps of one sample
+  int radius = 3;            // of the erosion brush
+  float inertia = 0.05F;
+  float sedimentCapacity = 4.0F;
+  float minSedimentCapacity = 0.01F;
+  float depositSpeed = 0.3F;
+  float erodeSpeed = 0.3F;
+  float evaporateSpeed = 0.01F;
+  float gravity = 4.0F;
+
+  // Thermal erosion: material slides down where neighbours differ by more
+  // than the talus height
+  float talus = 3.0F / 255.0F;
+  float thermalRate = 0.5F;
+};
+
+/**
+ * @brief Shapes a height grid with hydraulic and thermal erosion, a batch at
+ * a time, so that it can run for a bounded time per frame.
+ *
+ * A batch drops dropletsPerTile droplets on every tile of kTileSize samples
+ * and then relaxes all slopes steeper than the talus once. The tiles are run
+ * in four phases of tiles that are two tiles apart, and droplets are stopped
+ * before they reach halfway into the next tile, so the tiles of a phase
+ * never touch the same samples and run on the workers without locks. Each
+ * tile draws its droplets from its own generator, seeded by the seed, the
+ * batch and the tile, and the thermal pass reads only the heights of the
+ * previous pass. The result thus only depends on the seed and the number of
+ * batches, not on the number of threads or their timing. The erosion may run
+ * on a thread of its own, as long as it is not used elsewhere meanwhile.
+ */
+class TerrainErosion {
+ public:
+  static constexpr int kTileSize = 64;
+
+  explicit TerrainErosion(const ErosionSettings &settings = ErosionSettings());
+  ~TerrainErosion();
+
+  void setHeights(int newWidth, int newHeight, const QVector<float> &values);
+  void setHeights(const QRect &region, const QVector<float> &values);
+  void setHeightSource(const QImage &image);
+
+  void runBatch();
+  int run(qint64 nanoseconds);
+  QRect takeChangedRegion();
+
+  const QVector<float> &getHeights() const { return heights; }
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  int getBatchCount() const { return batchCount; }
+  qint64 getDropletCount() const;
+
+ private:
+  struct BrushCell {
+    int dx;
+    int dy;
+    float weight;
+  };
+
+  void parallelFor(int count, const std::function<void(int)> &job);
+  void erodeTile(int tileX, int tileY);
+  void computeOutflow(int row);
+  void applyOutflow(int row);
+  static quint16 toCode(float value);
+
+  const ErosionSettings settings;
+  const int radius;       // of the brush, limited by the tile size
+  const int threadCount;  // including the calling thread
+  QThreadPool workers;
+
+  int width = 0;
+  int height = 0;
+  int tilesX = 0;
+  int tilesY = 0;
+  int batchCount = 0;
+  QVector<float> heights;
+  QVector<quint16> reportedCodes;  // heights at the last takeChangedRegion()
+  QVector<BrushCell> brush;
+
+  // Thermal outflow of every sample towards each neighbour
+  QVector<float> outLeft;
+  QVector<float> outRight;
+  QVector<float> outUp;
+  QVector<float> outDown;
+};
+
+#endif  // EROSION_H
@@ -0,0 +1,273 @@
+#include "framecapture.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QImage>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Frames waiting for an encoder thread. Beyond this the render loop waits,
+// which bounds the memory held by queued frames.
+constexpr int kMaxQueuedFrames = 16;
+
+// Raw frames waiting for the pipe writer. Beyond this the render loop waits
+// for the encoder process to catch up.
+constexpr int kMaxPipeFrames = 4;
+
+constexpr GLuint64 kFenceTimeout = 1000000000;  // one second
+
+}  // namespace
+
+FrameCapture::FrameCapture()
+    : queuedFrames(kMaxQueuedFrames), pipeFrames(kMaxPipeFrames) {
+  encoders.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+  // The encoder process belongs to the thread that created it, so the one
+  // writer thread is kept for as long as the capture lives
+  pipeWriter.setMaxThreadCount(1);
+  pipeWriter.setExpiryTimeout(-1);
+}
+
+FrameCapture::~FrameCapture() {
+  encoders.waitForDone();
+  pipeWriter.waitForDone();
+}
+
+/**
+ * @brief FrameCapture::initialize Creates the ring of pixel pack buffers. They
+ * are sized on the first capture. Requires a current context.
+ * @param functions The OpenGL functions of the context.
+ */
+void FrameCapture::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+  slots.resize(kRingSize);
+  for (Slot &slot : slots) {
+    gl->glGenBuffers(1, &slot.buffer);
+  }
+}
+
+/**
+ * @brief FrameCapture::destroy Finishes a running capture and deletes the
+ * buffers.
+ */
+void FrameCapture::destroy() {
+  if (gl == nullptr) return;
+  stop();
+  for (Slot &slot : slots) {
+    gl->glDeleteBuffers(1, &slot.buffer);
+  }
+  slots.clear();
+}
+
+/**
+ * @brief FrameCapture::start Starts capturing with the next frame.
+ * @param newSettings Where and how much to capture.
+ * @return False if the output directory could not be created.
+ */
+bool FrameCapture::start(const CaptureSettings &newSettings) {
+  if (active) return true;
+  settings = newSettings;
+  if (settings.pipeCommand.isEmpty() && !QDir().mkpath(settings.directory)) {
+    qDebug() << "Could not create capture directory" << settings.directory;
+    return false;
+  }
+  captured = 0;
+  active = true;
+  qDebug() << ":: Capture started";
+  return true;
+}
+
+/**
+ * @brief FrameCapture::stop Reads back the frames still in flight, waits for
+ * the encoders and closes the encoder process.
+ */
+void FrameCapture::stop() {
+  if (!active) return;
+  while (pending > 0) {
+    readOldest(true);
+  }
+  encoders.waitForDone();
+  if (piping) {
+    // Queued after the last frames, so the encoder gets all of them
+    pipeWriter.start([this]() {
+      encoderProcess->closeWriteChannel();
+      if (!encoderProcess->waitForFinished(30000)) {
+        qDebug() << "Encoder did not finish, stopping it";
+        encoderProcess->kill();
+      }
+      encoderProcess.reset();
+    });
+    pipeWriter.waitForDone();
+    piping = false;
+  }
+  active = false;
+  qDebug() << ":: Capture stopped after" << captured << "frames";
+}
+
+/**
+ * @brief FrameCapture::capture Queues the readback of the frame that was just
+ * drawn into the bound framebuffer, and delivers the frames whose readback
+ * has finished. Only waits when the whole ring is still in flight.
+ * @param width Width of the framebuffer in pixels.
+ * @param height Height of the framebuffer in pixels.
+ */
+void FrameCapture::capture(int width, int height) {
+  if (!active || gl == nullptr) return;
+
+  if (width != frameWidth || height != frameHeight) {
+    if (piping) {
+      // A raw video stream cannot change its size
+      qDebug() << "Frame size changed, stopping the capture";
+      stop();
+      return;
+    }
+    resize(width, height);
+  }
+
+  if (!settings.pipeCommand.isEmpty() && !piping) {
+    QString command = settings.pipeCommand;
+    command.replace("%size", QString("%1x%2").arg(width).arg(height));
+    if (!startEncoder(command)) {
+      active = false;
+      return;
+    }
+  }
+
+  if (pending == kRingSize) {
+    readOldest(true);
+  }
+
+  Slot &slot = slots[next];
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  gl->glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.frame = captured++;
+  next = (next + 1) % kRingSize;
+  ++pending;
+
+  while (pending > 0 && readOldest(false)) {
+  }
+
+  if (settings.frameCount > 0 && captured >= settings.frameCount) {
+    stop();
+  }
+}
+
+/**
+ * @brief FrameCapture::startEncoder Starts the encoder process on the pipe
+ * writer thread, which does all the writing from then on, and waits until
+ * it runs.
+ * @param command The command line of the encoder.
+ * @return False if the encoder could not be started.
+ */
+bool FrameCapture::startEncoder(const QString &command) {
+  bool started = false;
+  pipeWriter.start([this, command, &started]() {
+    encoderProcess.reset(new QProcess());
+    encoderProcess->setProcessChannelMode(QProcess::ForwardedChannels);
+    encoderProcess->startCommand(command);
+    if (!encoderProcess->waitForStarted()) {
+      qDebug() << "Could not start encoder" << command;
+      encoderProcess.reset();
+      return;
+    }
+    started = true;
+  });
+  pipeWriter.waitForDone();
+  piping = started;
+  return started;
+}
+
+void FrameCapture::resize(int width, int height) {
+  while (pending > 0) {
+    readOldest(true);
+  }
+  frameWidth = width;
+  frameHeight = height;
+  for (Slot &slot : slots) {
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    gl->glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr,
+                     GL_STREAM_READ);
+  }
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/**
+ * @brief FrameCapture::readOldest Maps the oldest buffer in flight and
+ * delivers its frame. A readback that does not finish within the timeout,
+ * or whose fence fails, is dropped instead of mapped, as mapping would stall
+ * until the GPU is done or read a buffer that was never filled.
+ * @param wait Whether to wait for the readback to finish.
+ * @return False if the readback has not finished yet.
+ */
+bool FrameCapture::readOldest(bool wait) {
+  Slot &slot = slots[(next - pending + kRingSize) % kRingSize];
+  GLenum status =
+      gl->glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                           wait ? kFenceTimeout : 0);
+  if (status == GL_TIMEOUT_EXPIRED && !wait) return false;
+  gl->glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+  --pending;
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    qDebug() << "Readback of frame" << slot.frame << "failed, dropping it";
+    return true;
+  }
+
+  qsizetype bytes = qsizetype(frameWidth) * frameHeight * 4;
+  QByteArray pixels(bytes, Qt::Uninitialized);
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  const void *mapped =
+      gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+  if (mapped != nullptr) {
+    std::memcpy(pixels.data(), mapped, bytes);
+    gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (mapped != nullptr) {
+    deliver(slot.frame, pixels);
+  }
+  return true;
+}
+
+/**
+ * @brief FrameCapture::deliver Hands a frame to the encoder. The rows arrive
+ * bottom up, as OpenGL reads them. Neither the pipe nor the PNG encoding
+ * blocks the calling thread unless too many frames are queued already.
+ * @param frame Index of the frame in the capture.
+ * @param pixels RGBA pixels of the frame.
+ */
+void FrameCapture::deliver(int frame, const QByteArray &pixels) {
+  int width = frameWidth, height = frameHeight;
+  if (piping) {
+    // The writer takes the frames in order, as it is a single thread
+    pipeFrames.acquire();
+    pipeWriter.start([this, pixels, width, height]() {
+      qsizetype rowBytes = qsizetype(width) * 4;
+      for (int y = height - 1; y >= 0; --y) {
+        encoderProcess->write(pixels.constData() + y * rowBytes, rowBytes);
+      }
+      while (encoderProcess->bytesToWrite() > 0) {
+        if (!encoderProcess->waitForBytesWritten()) break;
+      }
+      pipeFrames.release();
+    });
+    return;
+  }
+
+  queuedFrames.acquire();
+  QString name = QString("frame_%1.png").arg(frame, 5, 10, QChar('0'));
+  QString path = QDir(settings.directory).filePath(name);
+  encoders.start([this, pixels, width, height, path]() {
+    QImage image(reinterpret_cast<const uchar *>(pixels.constData()), width,
+                 height, QImage::Format_RGBX8888);
+    if (!image.mirrored().save(path, "PNG")) {
+      qDebug() << "Could not write" << path;
+    }
+    queuedFrames.release();
+  });
+}
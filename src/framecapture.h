@@ -0,0 +1,85 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <QByteArray>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QProcess>
+#include <QScopedPointer>
+#include <QSemaphore>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+/**
+ * @brief Where and how much to capture.
+ */
+struct CaptureSettings {
+  // Directory of the PNG sequence, used when there is no pipe command.
+  QString directory = "capture";
+  // Encoder that reads raw RGBA frames from its standard input, e.g.
+  // "ffmpeg -f rawvideo -pix_fmt rgba -s %size -r 60 -i - flight.mp4".
+  // %size is replaced by the frame size.
+  QString pipeCommand;
+  // Number of frames to capture, or 0 to capture until stopped.
+  int frameCount = 0;
+};
+
+/**
+ * @brief Records the rendered frames without stalling the render loop.
+ *
+ * Every frame is read into the next pixel pack buffer of a small ring and
+ * fenced. The buffers are mapped frames later, once their fence has been
+ * signalled, and the pixels are either encoded to PNG on worker threads or
+ * written to the pipe of an encoder process by a writer thread, which owns
+ * the process. Requires a current context for all calls except start().
+ */
+class FrameCapture {
+ public:
+  static constexpr int kRingSize = 3;
+
+  FrameCapture();
+  ~FrameCapture();
+
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  bool start(const CaptureSettings &newSettings);
+  void stop();
+  void capture(int width, int height);
+
+  bool isActive() const { return active; }
+  int getCapturedCount() const { return captured; }
+
+ private:
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    int frame = -1;
+  };
+
+  bool startEncoder(const QString &command);
+  void resize(int width, int height);
+  bool readOldest(bool wait);
+  void deliver(int frame, const QByteArray &pixels);
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  QVector<Slot> slots;
+  int next = 0;
+  int pending = 0;
+  int frameWidth = 0, frameHeight = 0;
+
+  CaptureSettings settings;
+  bool active = false;
+  int captured = 0;
+
+  QThreadPool encoders;
+  QSemaphore queuedFrames;
+
+  // Only used on the pipe writer thread
+  QScopedPointer<QProcess> encoderProcess;
+  QThreadPool pipeWriter;
+  QSemaphore pipeFrames;
+  bool piping = false;  // whether the encoder process runs
+};
+
+#endif  // FRAMECAPTURE_H
@@ -0,0 +1,175 @@
+#include "frustum.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE
+#endif
+
+/**
+ * @brief Aabb::fromPoints Computes the bounding box of a set of points.
+ * @param points The points, should not be empty.
+ * @return The smallest box containing all points.
+ */
+Aabb Aabb::fromPoints(const QVector<QVector3D> &points) {
+  return fromPoints(points.constData(), points.size());
+}
+
+/**
+ * @brief Aabb::fromPoints Computes the bounding box of an array of points.
+ * @param points The points.
+ * @param count Number of points, should not be zero.
+ * @return The smallest box containing all points.
+ */
+Aabb Aabb::fromPoints(const QVector3D *points, qsizetype count) {
+  Aabb box(points[0], points[0]);
+  for (qsizetype i = 0; i != count; ++i) {
+    box.expand(Aabb(points[i], points[i]));
+  }
+  return box;
+}
+
+/**
+ * @brief Aabb::expand Grows the box so that it also contains another box.
+ * @param other The box to include.
+ */
+void Aabb::expand(const Aabb &other) {
+  minimum = QVector3D(std::min(minimum.x(), other.minimum.x()),
+                      std::min(minimum.y(), other.minimum.y()),
+                      std::min(minimum.z(), other.minimum.z()));
+  maximum = QVector3D(std::max(maximum.x(), other.maximum.x()),
+                      std::max(maximum.y(), other.maximum.y()),
+                      std::max(maximum.z(), other.maximum.z()));
+}
+
+/**
+ * @brief Aabb::distanceTo Computes the distance from a point to the nearest
+ * point of the box.
+ * @param point The point to measure from.
+ * @return The distance, or zero if the point lies inside the box.
+ */
+float Aabb::distanceTo(const QVector3D &point) const {
+  QVector3D delta;
+  for (int i = 0; i != 3; ++i) {
+    delta[i] = std::max({minimum[i] - point[i], 0.0F, point[i] - maximum[i]});
+  }
+  return delta.length();
+}
+
+/**
+ * @brief Aabb::transformed Computes the axis aligned box around this box after
+ * an affine transformation.
+ * @param transform The transformation to apply.
+ * @return The transformed bounding box.
+ */
+Aabb Aabb::transformed(const QMatrix4x4 &transform) const {
+  QVector3D c = transform.map(center());
+  QVector3D e = extent();
+  QVector3D r;
+  for (int i = 0; i != 3; ++i) {
+    r[i] = std::fabs(transform(i, 0)) * e.x() +
+           std::fabs(transform(i, 1)) * e.y() +
+           std::fabs(transform(i, 2)) * e.z();
+  }
+  return Aabb(c - r, c + r);
+}
+
+/**
+ * @brief Frustum::update Extracts the clip planes from a transformation
+ * matrix (Gribb & Hartmann). The planes point inwards.
+ * @param transform The (model) view projection matrix.
+ */
+void Frustum::update(const QMatrix4x4 &transform) {
+  QVector4D x = transform.row(0);
+  QVector4D y = transform.row(1);
+  QVector4D z = transform.row(2);
+  QVector4D w = transform.row(3);
+
+  planes[0] = w + x;  // left
+  planes[1] = w - x;  // right
+  planes[2] = w + y;  // bottom
+  planes[3] = w - y;  // top
+  planes[4] = w + z;  // near
+  planes[5] = w - z;  // far
+}
+
+/**
+ * @brief Frustum::classify Tests a single box against the frustum.
+ * @param box The box to test.
+ * @return Whether the box is fully outside, fully inside or intersecting.
+ */
+Frustum::Result Frustum::classify(const Aabb &box) const {
+  QVector3D c = box.center();
+  QVector3D e = box.extent();
+  Result result = INSIDE;
+
+  for (const QVector4D &p : planes) {
+    float d = p.x() * c.x() + p.y() * c.y() + p.z() * c.z() + p.w();
+    float r = std::fabs(p.x()) * e.x() + std::fabs(p.y()) * e.y() +
+              std::fabs(p.z()) * e.z();
+    if (d + r < 0.0F) return OUTSIDE;
+    if (d - r < 0.0F) result = INTERSECTING;
+  }
+  return result;
+}
+
+/**
+ * @brief Frustum::testAabbs Tests a batch of boxes against the frustum. With
+ * SSE, four boxes are tested against each plane at a time.
+ * @param boxes The boxes to test.
+ * @param count Number of boxes.
+ * @param visible Output, true for every box that is not fully outside.
+ */
+void Frustum::testAabbs(const Aabb *const *boxes, int count,
+                        bool *visible) const {
+  int i = 0;
+
+#ifdef FRUSTUM_USE_SSE
+  const __m128 signMask = _mm_set1_ps(-0.0F);
+  alignas(16) float cx[4], cy[4], cz[4], ex[4], ey[4], ez[4];
+
+  for (; i + 4 <= count; i += 4) {
+    // Transpose four boxes into center/extent lanes.
+    for (int k = 0; k != 4; ++k) {
+      QVector3D c = boxes[i + k]->center();
+      QVector3D e = boxes[i + k]->extent();
+      cx[k] = c.x();
+      cy[k] = c.y();
+      cz[k] = c.z();
+      ex[k] = e.x();
+      ey[k] = e.y();
+      ez[k] = e.z();
+    }
+    __m128 centerX = _mm_load_ps(cx), centerY = _mm_load_ps(cy);
+    __m128 centerZ = _mm_load_ps(cz), extentX = _mm_load_ps(ex);
+    __m128 extentY = _mm_load_ps(ey), extentZ = _mm_load_ps(ez);
+
+    __m128 outside = _mm_setzero_ps();
+    for (const QVector4D &p : planes) {
+      __m128 px = _mm_set1_ps(p.x()), py = _mm_set1_ps(p.y());
+      __m128 pz = _mm_set1_ps(p.z()), pw = _mm_set1_ps(p.w());
+
+      __m128 d = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(px, centerX), _mm_mul_ps(py, centerY)),
+          _mm_add_ps(_mm_mul_ps(pz, centerZ), pw));
+      __m128 r = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), extentX),
+                     _mm_mul_ps(_mm_andnot_ps(signMask, py), extentY)),
+          _mm_mul_ps(_mm_andnot_ps(signMask, pz), extentZ));
+      outside = _mm_or_ps(outside,
+                          _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+    }
+
+    int mask = _mm_movemask_ps(outside);
+    for (int k = 0; k != 4; ++k) {
+      visible[i + k] = (mask & (1 << k)) == 0;
+    }
+  }
+#endif
+
+  for (; i < count; ++i) {
+    visible[i] = classify(*boxes[i]) != OUTSIDE;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+#include <QVector>
+
+/**
+ * @brief An axis aligned bounding box.
+ */
+struct Aabb {
+  QVector3D minimum;
+  QVector3D maximum;
+
+  Aabb() = default;
+  Aabb(QVector3D minimum, QVector3D maximum)
+      : minimum(minimum), maximum(maximum) {}
+
+  static Aabb fromPoints(const QVector<QVector3D> &points);
+  static Aabb fromPoints(const QVector3D *points, qsizetype count);
+
+  QVector3D center() const { return (minimum + maximum) * 0.5F; }
+  QVector3D extent() const { return (maximum - minimum) * 0.5F; }
+
+  void expand(const Aabb &other);
+  float distanceTo(const QVector3D &point) const;
+  Aabb transformed(const QMatrix4x4 &transform) const;
+};
+
+/**
+ * @brief Counters for the items tested by the culling code.
+ */
+struct CullStats {
+  int visible = 0;
+  int culled = 0;
+  int fogged = 0;
+};
+
+/**
+ * @brief The six clip planes of a view volume, extracted from a (model) view
+ * projection matrix. Boxes are tested in the space the matrix maps from.
+ */
+class Frustum {
+ public:
+  enum Result { OUTSIDE, INTERSECTING, INSIDE };
+
+  void update(const QMatrix4x4 &transform);
+
+  Result classify(const Aabb &box) const;
+  void testAabbs(const Aabb *const *boxes, int count, bool *visible) const;
+
+ private:
+  QVector4D planes[6];
+};
+
+#endif  // FRUSTUM_H
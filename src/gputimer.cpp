@@ -0,0 +1,50 @@
+#include "gputimer.h"
+
+void GpuTimer::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+  gl->glGenQueries(kRingSize, queries);
+}
+
+void GpuTimer::destroy() {
+  if (gl == nullptr) return;
+  gl->glDeleteQueries(kRingSize, queries);
+  pending = 0;
+}
+
+/**
+ * @brief GpuTimer::begin Starts measuring. Skipped if all queries are still
+ * waiting for their results.
+ */
+void GpuTimer::begin() {
+  if (pending == kRingSize) return;
+  gl->glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+  running = true;
+}
+
+void GpuTimer::end() {
+  if (!running) return;
+  gl->glEndQuery(GL_TIME_ELAPSED);
+  running = false;
+  next = (next + 1) % kRingSize;
+  ++pending;
+}
+
+/**
+ * @brief GpuTimer::takeResult Returns the oldest measurement, if the GPU has
+ * finished it.
+ * @param milliseconds Receives the measured time.
+ * @return False if no measurement is available yet.
+ */
+bool GpuTimer::takeResult(float &milliseconds) {
+  if (pending == 0) return false;
+  GLuint query = queries[(next - pending + kRingSize) % kRingSize];
+  GLint available = 0;
+  gl->glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) return false;
+
+  GLuint64 nanoseconds = 0;
+  gl->glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+  --pending;
+  milliseconds = static_cast<float>(nanoseconds / 1.0e6);
+  return true;
+}
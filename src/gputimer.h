@@ -0,0 +1,32 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+/**
+ * @brief Measures the GPU time of a part of the frame with a ring of
+ * GL_TIME_ELAPSED queries. Results are picked up frames later, once they are
+ * available, so measuring never stalls the pipeline. Requires a current
+ * context for all calls.
+ */
+class GpuTimer {
+ public:
+  static constexpr int kRingSize = 4;
+
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  void begin();
+  void end();
+  bool takeResult(float &milliseconds);
+  int getPendingCount() const { return pending; }
+
+ private:
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  GLuint queries[kRingSize] = {};
+  int next = 0;
+  int pending = 0;
+  bool running = false;
+};
+
+#endif  // GPUTIMER_H
@@ -0,0 +1,391 @@
+#include "heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define HEIGHTFIELD_USE_SSE
+#endif
+
+namespace {
+
+/**
+ * @brief clipSlab Narrows a ray interval to the part between two planes
+ * perpendicular to one axis.
+ * @return False if nothing of the interval is left.
+ */
+bool clipSlab(float origin, float direction, float low, float high,
+              float &tNear, float &tFar) {
+  if (direction == 0.0F) return origin >= low && origin <= high;
+  float t0 = (low - origin) / direction;
+  float t1 = (high - origin) / direction;
+  if (t0 > t1) std::swap(t0, t1);
+  tNear = std::max(tNear, t0);
+  tFar = std::min(tFar, t1);
+  return tNear <= tFar;
+}
+
+}  // namespace
+
+/**
+ * @brief Heightfield::setHeights Replaces the grid and rebuilds the pyramid.
+ * @param newWidth Number of samples per row.
+ * @param newHeight Number of rows.
+ * @param values The heights, row by row.
+ */
+void Heightfield::setHeights(int newWidth, int newHeight,
+                             const QVector<float> &values) {
+  width = newWidth;
+  height = newHeight;
+  heights = values;
+  buildPyramid();
+}
+
+/**
+ * @brief Heightfield::setHeights Replaces the heights in a region and updates
+ * the pyramid nodes above it.
+ * @param region The samples that changed.
+ * @param values All heights, row by row, of the size of the grid. Only the
+ * region is read.
+ * @param heightScale Factor the values are scaled by.
+ */
+void Heightfield::setHeights(const QRect &region, const QVector<float> &values,
+                             float heightScale) {
+  QRect clipped = region & QRect(0, 0, width, height);
+  if (clipped.isEmpty()) return;
+  for (int row = clipped.top(); row <= clipped.bottom(); ++row) {
+    for (int column = clipped.left(); column <= clipped.right(); ++column) {
+      int i = row * width + column;
+      heights[i] = values[i] * heightScale;
+    }
+  }
+  // The cells that have one of the samples as a corner
+  updatePyramid(clipped.adjusted(-1, -1, 0, 0));
+}
+
+/**
+ * @brief Heightfield::setHeightSource Takes the heights from the red channel
+ * of an image, scaled the same way as the height map of the terrain shader.
+ * @param image The height image, pixel (x, y) becomes sample (x, y).
+ * @param heightScale The height of a full red channel.
+ */
+void Heightfield::setHeightSource(const QImage &image, float heightScale) {
+  QImage pixels = image.convertToFormat(QImage::Format_RGB32);
+  QVector<float> values(pixels.width() * pixels.height());
+  for (int y = 0; y != pixels.height(); ++y) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(pixels.constScanLine(y));
+    for (int x = 0; x != pixels.width(); ++x) {
+      values[y * pixels.width() + x] = qRed(line[x]) / 255.0F * heightScale;
+    }
+  }
+  setHeights(pixels.width(), pixels.height(), values);
+}
+
+/**
+ * @brief Heightfield::heightAt Interpolates the height at a point.
+ * @param x Position along the columns.
+ * @param z Position along the rows.
+ * @return The bilinearly interpolated height.
+ */
+float Heightfield::heightAt(float x, float z) const {
+  if (isEmpty()) return 0.0F;
+  x = std::clamp(x, 0.0F, static_cast<float>(width - 1));
+  z = std::clamp(z, 0.0F, static_cast<float>(height - 1));
+  int column = std::min(static_cast<int>(x), width - 2);
+  int row = std::min(static_cast<int>(z), height - 2);
+  float fx = x - column;
+  float fz = z - row;
+
+  float h00 = sample(column, row), h10 = sample(column + 1, row);
+  float h01 = sample(column, row + 1), h11 = sample(column + 1, row + 1);
+  float back = h00 + (h10 - h00) * fx;
+  float front = h01 + (h11 - h01) * fx;
+  return back + (front - back) * fz;
+}
+
+/**
+ * @brief Heightfield::heightsAt Interpolates the heights at many points at
+ * once. With SSE2 the clamping, cell lookup and interpolation run on four
+ * points at a time; the results match heightAt().
+ * @param x Positions along the columns.
+ * @param z Positions along the rows.
+ * @param count Number of points.
+ * @param result Output, the height of every point.
+ */
+void Heightfield::heightsAt(const float *x, const float *z, int count,
+                            float *result) const {
+  if (isEmpty()) {
+    std::fill(result, result + count, 0.0F);
+    return;
+  }
+  int i = 0;
+
+#ifdef HEIGHTFIELD_USE_SSE
+  const __m128 maximumX = _mm_set1_ps(static_cast<float>(width - 1));
+  const __m128 maximumZ = _mm_set1_ps(static_cast<float>(height - 1));
+  const __m128i lastColumn = _mm_set1_epi32(width - 2);
+  const __m128i lastRow = _mm_set1_epi32(height - 2);
+  alignas(16) int columns[4], rows[4];
+  alignas(16) float h00[4], h10[4], h01[4], h11[4];
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 px = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(x + i), _mm_setzero_ps()),
+                           maximumX);
+    __m128 pz = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(z + i), _mm_setzero_ps()),
+                           maximumZ);
+
+    // The positions are clamped to be positive, so truncation is the floor.
+    // SSE2 has no integer minimum, select the last cell with a mask instead.
+    __m128i column = _mm_cvttps_epi32(px);
+    __m128i row = _mm_cvttps_epi32(pz);
+    __m128i beyond = _mm_cmpgt_epi32(column, lastColumn);
+    column = _mm_or_si128(_mm_and_si128(beyond, lastColumn),
+                          _mm_andnot_si128(beyond, column));
+    beyond = _mm_cmpgt_epi32(row, lastRow);
+    row = _mm_or_si128(_mm_and_si128(beyond, lastRow),
+                       _mm_andnot_si128(beyond, row));
+    __m128 fx = _mm_sub_ps(px, _mm_cvtepi32_ps(column));
+    __m128 fz = _mm_sub_ps(pz, _mm_cvtepi32_ps(row));
+
+    // Gather the corners of the four cells.
+    _mm_store_si128(reinterpret_cast<__m128i *>(columns), column);
+    _mm_store_si128(reinterpret_cast<__m128i *>(rows), row);
+    for (int k = 0; k != 4; ++k) {
+      const float *corner = heights.constData() + rows[k] * width + columns[k];
+      h00[k] = corner[0];
+      h10[k] = corner[1];
+      h01[k] = corner[width];
+      h11[k] = corner[width + 1];
+    }
+
+    __m128 a = _mm_load_ps(h00), b = _mm_load_ps(h10);
+    __m128 c = _mm_load_ps(h01), d = _mm_load_ps(h11);
+    __m128 back = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+    __m128 front = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), fx));
+    _mm_storeu_ps(result + i,
+                  _mm_add_ps(back, _mm_mul_ps(_mm_sub_ps(front, back), fz)));
+  }
+#endif
+
+  for (; i < count; ++i) {
+    result[i] = heightAt(x[i], z[i]);
+  }
+}
+
+/**
+ * @brief Heightfield::normalAt Estimates the surface normal at a point from
+ * central differences.
+ * @param x Position along the columns.
+ * @param z Position along the rows.
+ * @return The unit normal, in the space of the heightfield.
+ */
+QVector3D Heightfield::normalAt(float x, float z) const {
+  float left = heightAt(x - 1.0F, z), right = heightAt(x + 1.0F, z);
+  float back = heightAt(x, z - 1.0F), front = heightAt(x, z + 1.0F);
+  return QVector3D(left - right, 2.0F, back - front).normalized();
+}
+
+/**
+ * @brief Heightfield::intersect Finds the first point where a ray meets the
+ * surface. The pyramid is descended front to back: nodes the ray passes
+ * entirely above are skipped, and a node the ray passes entirely below ends
+ * the search where the ray enters it.
+ * @param origin Start of the ray.
+ * @param direction Direction of the ray, need not be normalized.
+ * @param maxDistance Length of the ray.
+ * @param hit Output, the nearest hit.
+ * @return True if the ray meets the surface within maxDistance.
+ */
+bool Heightfield::intersect(const QVector3D &origin,
+                            const QVector3D &direction, float maxDistance,
+                            HeightfieldHit &hit) const {
+  if (isEmpty() || direction.isNull()) return false;
+  QVector3D dir = direction.normalized();
+
+  struct Node {
+    int level;
+    int column;
+    int row;
+  };
+  // Every step down pops one node and pushes at most four.
+  QVector<Node> stack;
+  stack.reserve(3 * levels.size() + 1);
+  stack.append({static_cast<int>(levels.size()) - 1, 0, 0});
+
+  // Children on the side the ray comes from are visited first.
+  int nearColumn = dir.x() < 0.0F ? 1 : 0;
+  int nearRow = dir.z() < 0.0F ? 1 : 0;
+  const Level &cells = levels.constFirst();
+
+  while (!stack.isEmpty()) {
+    Node node = stack.takeLast();
+    const Level &level = levels[node.level];
+
+    float tNear = 0.0F, tFar = maxDistance;
+    float firstColumn = static_cast<float>(node.column << node.level);
+    float lastColumn = static_cast<float>(
+        std::min((node.column + 1) << node.level, cells.columns));
+    float firstRow = static_cast<float>(node.row << node.level);
+    float lastRow = static_cast<float>(
+        std::min((node.row + 1) << node.level, cells.rows));
+    if (!clipSlab(origin.x(), dir.x(), firstColumn, lastColumn, tNear,
+                  tFar) ||
+        !clipSlab(origin.z(), dir.z(), firstRow, lastRow, tNear, tFar)) {
+      continue;
+    }
+
+    float yNear = origin.y() + dir.y() * tNear;
+    float yFar = origin.y() + dir.y() * tFar;
+    int index = node.row * level.columns + node.column;
+    if (std::min(yNear, yFar) > level.maximum[index]) continue;
+    if (std::max(yNear, yFar) <= level.minimum[index]) {
+      hit.distance = tNear;
+      hit.position = origin + dir * tNear;
+      return true;
+    }
+
+    if (node.level == 0) {
+      float t = 0.0F;
+      if (intersectCell(node.column, node.row, origin, dir, tNear, tFar, t)) {
+        hit.distance = t;
+        hit.position = origin + dir * t;
+        return true;
+      }
+      continue;
+    }
+
+    // Push the children far to near, so the nearest one is popped first.
+    const Level &children = levels[node.level - 1];
+    for (int k = 3; k >= 0; --k) {
+      int column = node.column * 2 + ((k & 1) ^ nearColumn);
+      int row = node.row * 2 + ((k >> 1) ^ nearRow);
+      if (column < children.columns && row < children.rows) {
+        stack.append({node.level - 1, column, row});
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Heightfield::buildPyramid Computes the height range of every cell,
+ * then of every 2x2 block of the level below, up to a single root node.
+ */
+void Heightfield::buildPyramid() {
+  levels.clear();
+  if (isEmpty()) return;
+
+  Level level;
+  level.columns = width - 1;
+  level.rows = height - 1;
+  while (true) {
+    level.minimum.resize(level.columns * level.rows);
+    level.maximum.resize(level.columns * level.rows);
+    levels.append(level);
+    if (level.columns == 1 && level.rows == 1) break;
+    level.columns = (level.columns + 1) / 2;
+    level.rows = (level.rows + 1) / 2;
+  }
+  updatePyramid(QRect(0, 0, width - 1, height - 1));
+}
+
+/**
+ * @brief Heightfield::updatePyramid Recomputes the bounds of some cells and
+ * of the nodes above them.
+ * @param cells The cells, a cell being named after its first corner.
+ */
+void Heightfield::updatePyramid(const QRect &cells) {
+  QRect nodes = cells & QRect(0, 0, width - 1, height - 1);
+  if (nodes.isEmpty()) return;
+
+  Level &base = levels.first();
+  for (int row = nodes.top(); row <= nodes.bottom(); ++row) {
+    for (int column = nodes.left(); column <= nodes.right(); ++column) {
+      auto range = std::minmax(
+          {sample(column, row), sample(column + 1, row),
+           sample(column, row + 1), sample(column + 1, row + 1)});
+      base.minimum[row * base.columns + column] = range.first;
+      base.maximum[row * base.columns + column] = range.second;
+    }
+  }
+
+  for (int l = 1; l < levels.size(); ++l) {
+    const Level &below = levels[l - 1];
+    Level &level = levels[l];
+    nodes = QRect(QPoint(nodes.left() / 2, nodes.top() / 2),
+                  QPoint(nodes.right() / 2, nodes.bottom() / 2));
+    for (int row = nodes.top(); row <= nodes.bottom(); ++row) {
+      for (int column = nodes.left(); column <= nodes.right(); ++column) {
+        float minimum = std::numeric_limits<float>::max();
+        float maximum = std::numeric_limits<float>::lowest();
+        int lastRow = std::min(row * 2 + 1, below.rows - 1);
+        int lastColumn = std::min(column * 2 + 1, below.columns - 1);
+        for (int r = row * 2; r <= lastRow; ++r) {
+          for (int c = column * 2; c <= lastColumn; ++c) {
+            minimum = std::min(minimum, below.minimum[r * below.columns + c]);
+            maximum = std::max(maximum, below.maximum[r * below.columns + c]);
+          }
+        }
+        level.minimum[row * level.columns + column] = minimum;
+        level.maximum[row * level.columns + column] = maximum;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Heightfield::intersectCell Intersects a ray with the bilinear patch
+ * of a single cell. Along the ray the patch height is a quadratic in the ray
+ * parameter, so the crossing is a root of a quadratic.
+ * @param column Column of the cell.
+ * @param row Row of the cell.
+ * @param origin Start of the ray.
+ * @param direction Unit direction of the ray.
+ * @param tNear Ray parameter where the ray enters the cell.
+ * @param tFar Ray parameter where the ray leaves the cell.
+ * @param t Output, the ray parameter of the hit.
+ * @return True if the ray meets the patch inside the cell.
+ */
+bool Heightfield::intersectCell(int column, int row, const QVector3D &origin,
+                                const QVector3D &direction, float tNear,
+                                float tFar, float &t) const {
+  float h00 = sample(column, row), h10 = sample(column + 1, row);
+  float h01 = sample(column, row + 1), h11 = sample(column + 1, row + 1);
+  float slopeX = h10 - h00, slopeZ = h01 - h00;
+  float twist = h00 - h10 - h01 + h11;
+
+  // Measure from where the ray enters, in coordinates local to the cell.
+  QVector3D entry = origin + direction * tNear;
+  float x = entry.x() - column, z = entry.z() - row;
+  float dx = direction.x(), dz = direction.z();
+
+  // Ray height minus patch height: qa * s^2 + qb * s + qc
+  float qa = -twist * dx * dz;
+  float qb = direction.y() -
+             (slopeX * dx + slopeZ * dz + twist * (x * dz + dx * z));
+  float qc = entry.y() - (h00 + slopeX * x + slopeZ * z + twist * x * z);
+  if (qc <= 0.0F) {
+    t = tNear;
+    return true;
+  }
+
+  float s = 0.0F;
+  if (std::fabs(qa) < 1e-7F) {
+    if (qb >= 0.0F) return false;
+    s = -qc / qb;
+  } else {
+    float discriminant = qb * qb - 4.0F * qa * qc;
+    if (discriminant < 0.0F) return false;
+    // Numerically stable form of the two roots
+    float q = -0.5F * (qb + std::copysign(std::sqrt(discriminant), qb));
+    float s0 = q / qa, s1 = qc / q;
+    if (s0 > s1) std::swap(s0, s1);
+    s = s0 >= 0.0F ? s0 : s1;
+    if (s < 0.0F) return false;
+  }
+  if (s > tFar - tNear) return false;
+  t = tNear + s;
+  return true;
+}
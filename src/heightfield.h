@@ -0,0 +1,71 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector3D>
+#include <QVector>
+
+/**
+ * @brief A point where a ray meets the heightfield.
+ */
+struct HeightfieldHit {
+  QVector3D position;  // in the space of the heightfield
+  float distance = 0.0F;
+};
+
+/**
+ * @brief CPU copy of a terrain height grid that answers height, normal and
+ * ray queries without a round trip to the GPU.
+ *
+ * The heightfield lives in its own space: x runs along the columns and z
+ * along the rows of the grid, one unit per sample, and y is the height.
+ * Heights between samples are interpolated bilinearly, positions outside the
+ * grid are clamped to its border. Ray queries descend a min/max pyramid over
+ * the cells, so large areas the ray passes above are skipped at once. When a
+ * region of the heights changes, only the nodes above it are updated.
+ */
+class Heightfield {
+ public:
+  void setHeights(int newWidth, int newHeight, const QVector<float> &values);
+  void setHeights(const QRect &region, const QVector<float> &values,
+                  float heightScale = 1.0F);
+  void setHeightSource(const QImage &image, float heightScale);
+
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  bool isEmpty() const { return width < 2 || height < 2; }
+
+  float heightAt(float x, float z) const;
+  void heightsAt(const float *x, const float *z, int count,
+                 float *result) const;
+  QVector3D normalAt(float x, float z) const;
+  bool intersect(const QVector3D &origin, const QVector3D &direction,
+                 float maxDistance, HeightfieldHit &hit) const;
+
+ private:
+  // Minimum and maximum height of every node of one pyramid level. A node of
+  // level l covers 2^l by 2^l cells.
+  struct Level {
+    int columns = 0;
+    int rows = 0;
+    QVector<float> minimum;
+    QVector<float> maximum;
+  };
+
+  float sample(int column, int row) const {
+    return heights[row * width + column];
+  }
+  void buildPyramid();
+  void updatePyramid(const QRect &cells);
+  bool intersectCell(int column, int row, const QVector3D &origin,
+                     const QVector3D &direction, float tNear, float tFar,
+                     float &t) const;
+
+  int width = 0;
+  int height = 0;
+  QVector<float> heights;
+  QVector<Level> levels;
+};
+
+#endif  // HEIGHTFIELD_H
@@ -0,0 +1,228 @@
+#include "logging.h"
+
+#include <QDebug>
+#include <chrono>
+
+namespace Log {
+
+namespace {
+
+/**
+ * @brief Bounded multi-producer, single-consumer queue. Every slot carries a
+ * sequence number that tells producers and the consumer whose turn it is,
+ * so neither side takes a lock (Vyukov's bounded queue).
+ */
+class Queue {
+ public:
+  static constexpr quint64 kCapacity = 1024;
+
+  Queue() {
+    for (quint64 i = 0; i != kCapacity; ++i) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(const Record &record) {
+    quint64 position = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+      slot = &slots[position % kCapacity];
+      quint64 sequence = slot->sequence.load(std::memory_order_acquire);
+      qint64 difference =
+          static_cast<qint64>(sequence) - static_cast<qint64>(position);
+      if (difference == 0) {
+        if (head.compare_exchange_weak(position, position + 1,
+                                       std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        return false;  // full
+      } else {
+        position = head.load(std::memory_order_relaxed);
+      }
+    }
+    slot->record = record;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only called by the sink thread.
+  bool pop(Record &record) {
+    Slot &slot = slots[tail % kCapacity];
+    quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != tail + 1) return false;
+    record = slot.record;
+    slot.sequence.store(tail + kCapacity, std::memory_order_release);
+    ++tail;
+    return true;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<quint64> sequence;
+    Record record;
+  };
+
+  Slot slots[kCapacity];
+  alignas(64) std::atomic<quint64> head{0};
+  alignas(64) quint64 tail = 0;
+};
+
+Queue queue;
+std::atomic<int> minimumLevel{LOG_MIN_LEVEL};
+std::atomic<quint64> dropped{0};
+std::atomic<quint64> suppressed{0};
+
+#ifdef NDEBUG
+std::atomic<bool> glDebug{false};
+#else
+std::atomic<bool> glDebug{true};
+#endif
+
+const std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+
+// How long the sink sleeps when the queue is empty, and how often it
+// reports lost messages.
+constexpr std::chrono::milliseconds kDrainInterval(20);
+constexpr qint64 kReportInterval = 1000000000;
+
+QString format(const Record &record) {
+  QString message = QString::fromUtf8(record.format);
+  for (int i = 0; i != record.argumentCount; ++i) {
+    const Argument &argument = record.arguments[i];
+    switch (argument.type) {
+      case Argument::INTEGER:
+        message = message.arg(argument.integer);
+        break;
+      case Argument::REAL:
+        message = message.arg(argument.real);
+        break;
+      case Argument::LITERAL:
+        message = message.arg(QString::fromUtf8(argument.literal));
+        break;
+      case Argument::TEXT:
+        message = message.arg(QString::fromUtf8(record.text));
+        break;
+    }
+  }
+  return QStringLiteral("[%1] %2")
+      .arg(record.time / 1.0e9, 9, 'f', 3)
+      .arg(message);
+}
+
+}  // namespace
+
+qint64 now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+bool enabled(Level level) {
+  return level >= minimumLevel.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief setLevel Sets the lowest level that is logged at run time. Levels
+ * below LOG_MIN_LEVEL are not compiled in and stay off.
+ * @param level The lowest level to log.
+ */
+void setLevel(Level level) {
+  minimumLevel.store(std::max<int>(level, LOG_MIN_LEVEL),
+                     std::memory_order_relaxed);
+}
+
+void submit(Record &record) {
+  if (!queue.push(record)) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief glDebugEnabled Whether to request an OpenGL debug context and log
+ * its messages synchronously. On by default in debug builds only.
+ */
+bool glDebugEnabled() { return glDebug.load(std::memory_order_relaxed); }
+
+void setGlDebugEnabled(bool enabled) {
+  glDebug.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * @brief RateLimit::allow Counts a message against the limit of the current
+ * one second window.
+ * @return False if the message should be suppressed.
+ */
+bool RateLimit::allow() {
+  qint64 time = now();
+  qint64 window = windowStart.load(std::memory_order_relaxed);
+  if (time - window >= 1000000000 &&
+      windowStart.compare_exchange_strong(window, time,
+                                          std::memory_order_relaxed)) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  if (count.fetch_add(1, std::memory_order_relaxed) < perSecond) return true;
+  suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+Sink::Sink() : thread(&Sink::run, this) {}
+
+Sink::~Sink() {
+  running.store(false);
+  thread.join();
+  drain(true);
+}
+
+void Sink::run() {
+  while (running.load()) {
+    drain(false);
+    std::this_thread::sleep_for(kDrainInterval);
+  }
+}
+
+/**
+ * @brief Sink::drain Writes all queued messages. Once per report interval,
+ * and on the final drain, also notes how many messages were lost.
+ * @param final True for the last drain before the sink stops.
+ */
+void Sink::drain(bool final) {
+  Record record;
+  while (queue.pop(record)) {
+    QString message = format(record);
+    switch (record.level) {
+      case LEVEL_TRACE:
+      case LEVEL_DEBUG:
+        qDebug().noquote() << message;
+        break;
+      case LEVEL_INFO:
+        qInfo().noquote() << message;
+        break;
+      case LEVEL_WARNING:
+        qWarning().noquote() << message;
+        break;
+      case LEVEL_ERROR:
+        qCritical().noquote() << message;
+        break;
+    }
+  }
+
+  qint64 time = now();
+  if (!final && time - lastReport < kReportInterval) return;
+  lastReport = time;
+
+  quint64 drops = dropped.load(std::memory_order_relaxed);
+  quint64 suppressions = suppressed.load(std::memory_order_relaxed);
+  if (drops != reportedDrops || suppressions != reportedSuppressed) {
+    qInfo().noquote() << QStringLiteral(
+                             "Log: %1 messages dropped, %2 suppressed by "
+                             "rate limits")
+                             .arg(drops - reportedDrops)
+                             .arg(suppressions - reportedSuppressed);
+    reportedDrops = drops;
+    reportedSuppressed = suppressions;
+  }
+}
+
+}  // namespace Log
@@ -0,0 +1,225 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+/*
+ * Logging for the input and render paths. A log call copies its format
+ * string pointer and arguments into a lock-free ring buffer; formatting and
+ * output happen on the thread of the Log::Sink. Levels below LOG_MIN_LEVEL
+ * are removed by the preprocessor, by default trace and debug messages in
+ * release builds.
+ *
+ *   LOG_DEBUG("Picked terrain at %1, %2, %3", x, y, z);
+ *   LOG_TRACE_RATE(10, "Mouse at %1, %2", x, y);  // at most 10 per second
+ *
+ * Formats use the %1 to %8 placeholders of QString::arg() and must be string
+ * literals, as must const char * arguments. QString and QByteArray arguments
+ * are copied, truncated to Log::kTextSize bytes, and only one is kept per
+ * message.
+ */
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_ERROR 4
+
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+namespace Log {
+
+enum Level {
+  LEVEL_TRACE = LOG_LEVEL_TRACE,
+  LEVEL_DEBUG = LOG_LEVEL_DEBUG,
+  LEVEL_INFO = LOG_LEVEL_INFO,
+  LEVEL_WARNING = LOG_LEVEL_WARNING,
+  LEVEL_ERROR = LOG_LEVEL_ERROR
+};
+
+constexpr int kMaxArguments = 8;
+constexpr int kTextSize = 64;
+
+/**
+ * @brief An unformatted argument of a message.
+ */
+struct Argument {
+  enum Type { INTEGER, REAL, LITERAL, TEXT } type;
+  union {
+    qint64 integer;
+    double real;
+    const char *literal;
+  };
+};
+
+/**
+ * @brief A message as it is queued, formatted only by the sink.
+ */
+struct Record {
+  qint64 time;  // nanoseconds since the start of the log
+  Level level;
+  const char *format;
+  int argumentCount;
+  Argument arguments[kMaxArguments];
+  char text[kTextSize];  // the copy of a TEXT argument
+};
+
+qint64 now();
+bool enabled(Level level);
+void setLevel(Level level);
+void submit(Record &record);
+
+bool glDebugEnabled();
+void setGlDebugEnabled(bool enabled);
+
+/**
+ * @brief Lets through a number of messages per second from one call site
+ * and counts the rest.
+ */
+class RateLimit {
+ public:
+  explicit RateLimit(int perSecond) : perSecond(perSecond) {}
+  bool allow();
+
+ private:
+  const int perSecond;
+  std::atomic<qint64> windowStart{0};
+  std::atomic<int> count{0};
+};
+
+/**
+ * @brief Drains the log on a background thread and writes the messages
+ * through the Qt message handler. Only one sink should exist; it flushes
+ * the remaining messages when it is destroyed.
+ */
+class Sink {
+ public:
+  Sink();
+  ~Sink();
+
+ private:
+  void run();
+  void drain(bool final);
+
+  std::atomic<bool> running{true};
+  qint64 lastReport = 0;
+  quint64 reportedDrops = 0;
+  quint64 reportedSuppressed = 0;
+  std::thread thread;  // last, so it starts after the other members
+};
+
+namespace detail {
+
+template <typename T>
+void pack(Record &record, const T &value) {
+  if (record.argumentCount == kMaxArguments) return;
+  Argument &argument = record.arguments[record.argumentCount++];
+  if constexpr (std::is_same_v<T, QString> || std::is_same_v<T, QByteArray>) {
+    QByteArray utf8;
+    if constexpr (std::is_same_v<T, QString>) {
+      utf8 = value.toUtf8();
+    } else {
+      utf8 = value;
+    }
+    qsizetype size = std::min<qsizetype>(utf8.size(), kTextSize - 1);
+    std::memcpy(record.text, utf8.constData(), size);
+    record.text[size] = '\0';
+    argument.type = Argument::TEXT;
+  } else if constexpr (std::is_convertible_v<T, const char *>) {
+    argument.type = Argument::LITERAL;
+    argument.literal = value;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    argument.type = Argument::REAL;
+    argument.real = value;
+  } else {
+    static_assert(std::is_integral_v<T> || std::is_enum_v<T>,
+                  "Unsupported log argument");
+    argument.type = Argument::INTEGER;
+    argument.integer = static_cast<qint64>(value);
+  }
+}
+
+/**
+ * @brief discard Names the arguments of a stripped message in an unevaluated
+ * operand, so that they count as used without being computed. Never called,
+ * so it is not defined.
+ */
+template <typename... Arguments>
+int discard(const Arguments &...arguments);
+
+}  // namespace detail
+
+/**
+ * @brief write Queues a message. Does not format anything, and drops the
+ * message if the queue is full.
+ * @param level Severity of the message.
+ * @param format String literal with %1 to %8 placeholders.
+ * @param arguments Values for the placeholders.
+ */
+template <typename... Arguments>
+void write(Level level, const char *format, const Arguments &...arguments) {
+  static_assert(sizeof...(Arguments) <= kMaxArguments,
+                "Too many log arguments");
+  if (!enabled(level)) return;
+  Record record;
+  record.time = now();
+  record.level = level;
+  record.format = format;
+  record.argumentCount = 0;
+  (detail::pack(record, arguments), ...);
+  submit(record);
+}
+
+}  // namespace Log
+
+#define LOG_WRITE(level, ...) Log::write(level, __VA_ARGS__)
+#define LOG_WRITE_RATE(level, perSecond, ...)                 \
+  do {                                                        \
+    static Log::RateLimit logRateLimit_(perSecond);           \
+    if (logRateLimit_.allow()) Log::write(level, __VA_ARGS__); \
+  } while (0)
+#define LOG_STRIPPED(...) \
+  static_cast<void>(sizeof(Log::detail::discard(__VA_ARGS__)))
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_WRITE(Log::LEVEL_TRACE, __VA_ARGS__)
+#define LOG_TRACE_RATE(...) LOG_WRITE_RATE(Log::LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) LOG_STRIPPED(__VA_ARGS__)
+#define LOG_TRACE_RATE(...) LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_WRITE(Log::LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_DEBUG_RATE(...) LOG_WRITE_RATE(Log::LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_STRIPPED(__VA_ARGS__)
+#define LOG_DEBUG_RATE(...) LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_WRITE(Log::LEVEL_INFO, __VA_ARGS__)
+#define LOG_INFO_RATE(...) LOG_WRITE_RATE(Log::LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_STRIPPED(__VA_ARGS__)
+#define LOG_INFO_RATE(...) LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#define LOG_WARNING(...) LOG_WRITE(Log::LEVEL_WARNING, __VA_ARGS__)
+#define LOG_WARNING_RATE(...) LOG_WRITE_RATE(Log::LEVEL_WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_WRITE(Log::LEVEL_ERROR, __VA_ARGS__)
+
+#endif  // LOGGING_H
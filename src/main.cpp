@@ -2,6 +2,7 @@
 #include <QSurfaceFormat>
 #include <ctime>
 
+#include "commandline.h"
 #include "mainwindow.h"
 
 /**
@@ -13,13 +14,20 @@
  */
 int main(int argc, char *argv[]) {
   std::srand(std::time(nullptr));
+  CommandLine commandLine(argc, argv);
   QApplication a(argc, argv);
+  commandLine.parse(a.arguments());
+  if (commandLine.hasTool()) {
+    return commandLine.runTool();
+  }
 
   // Request OpenGL 3.3 Core
   QSurfaceFormat glFormat;
   glFormat.setProfile(QSurfaceFormat::CoreProfile);
   glFormat.setVersion(3, 3);
-  glFormat.setOption(QSurfaceFormat::DebugContext);
+  if (Log::glDebugEnabled()) {
+    glFormat.setOption(QSurfaceFormat::DebugContext);
+  }
 
   // Some platforms need to explicitly set the depth buffer size (24 bits)
   glFormat.setDepthBufferSize(24);
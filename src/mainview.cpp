@@ -1,7 +1,31 @@
 #include "mainview.h"
 
 #include <QDateTime>
+#include <algorithm>
 #include <cmath>
+#include <limits>
+
+#include "logging.h"
+
+namespace {
+
+/**
+ * @brief exhaustEmitters Creates the two engine nozzles at the back of the
+ * ship.
+ * @param particleCount Number of particles of both together.
+ * @return The emitters, in the model space of the ship.
+ */
+QVector<ParticleEmitter> exhaustEmitters(int particleCount) {
+    ParticleEmitter left;
+    left.position = QVector3D(-0.35F, 0.0F, 0.9F);
+    left.particleCount = particleCount / 2;
+    ParticleEmitter right = left;
+    right.position.setX(0.35F);
+    right.particleCount = particleCount - left.particleCount;
+    return {left, right};
+}
+
+}  // namespace
 
 /**
  * @brief MainView::MainView Constructs a new main view.
@@ -12,8 +36,12 @@ MainView::MainView(QWidget *parent) : QOpenGLWidget(parent) {
     qDebug() << "MainView constructor";
 
     connect(&timer, SIGNAL(timeout()), this, SLOT(update()));
-    connect(&timer, SIGNAL(timeout()), this, SLOT(updateRotation()));
+    connect(&timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
 
+    spaceShip.reset(QVector3D(0, -10, -28));
+    particles.setEmitters(exhaustEmitters(kExhaustParticles));
+    simulationClock.start();
+    particleClock.start();
     timer.start(0);
 }
 
@@ -27,6 +55,10 @@ MainView::MainView(QWidget *parent) : QOpenGLWidget(parent) {
 MainView::~MainView() {
     qDebug() << "MainView destructor";
 
+    // An import still running would report back to this view
+    demLoader.waitForDone();
+    erosionWorker.waitForDone();
+
     makeCurrent();
 
     destroyModelBuffers();
@@ -45,7 +77,7 @@ void MainView::initializeGL() {
     connect(&debugLogger, SIGNAL(messageLogged(QOpenGLDebugMessage)), this,
             SLOT(onMessageLogged(QOpenGLDebugMessage)), Qt::DirectConnection);
 
-    if (debugLogger.initialize()) {
+    if (Log::glDebugEnabled() && debugLogger.initialize()) {
         qDebug() << ":: Logging initialized";
         debugLogger.startLogging(QOpenGLDebugLogger::SynchronousLogging);
     }
@@ -69,6 +101,23 @@ void MainView::initializeGL() {
     loadMesh(":/models/terrain2.obj");
     loadSun();
     loadShip();
+    terrainStreamer.initialize(this);
+    gradientPalette.initialize(this);
+    updateGradientPalette();
+    layerPalette.initialize(this);
+    layerPalette.setPalette(Palette::rainbowLayers());
+    frameCapture.initialize(this);
+    renderGraph.initialize(this);
+    postProcessing.initialize(this);
+    gpuTimer.initialize(this);
+    particles.initialize(this);
+    shadowMap.initialize(this, kShadowMapResolution);
+
+    // The scene items tracked for culling: the terrain chunks, then the sun
+    // and the ship.
+    sunItem = terrainChunks.getChunkCount();
+    spaceShipItem = sunItem + 1;
+    statsTimer.start();
 
     //rotation 0, 349, 28
     //translation 0, 1, 28
@@ -88,85 +137,314 @@ void MainView::initializeGL() {
     sunTransform.rotate(QQuaternion::fromEulerAngles({0, 0, 0}));
     sunTransform.scale(150);
 
-    spaceShipTransform.setToIdentity();
-    shipTranslation = QVector3D(0, -10, -28);
-    spaceShipTransform.translate(0, -10, -28);
-    spaceShipTransform.rotate(QQuaternion::fromEulerAngles({0, 349, 28}));
-    spaceShipTransform.scale(2);
+    updateSpaceShipTransform();
 
     // set lighting
     lightPosition = QVector3D(100.0F, 50.0F, 0.0F);
     lightColor = QVector3D(1.0F, 1.0F, 1.0F);
-    shaderPrograms[shadingMode].setUniformValue("lightPosition", lightPosition);
-    shaderPrograms[shadingMode].setUniformValue("lightColor", lightColor);
+}
+
+/**
+ * @brief MainView::onTimeout Advances the scene in fixed steps for the time
+ * passed since the last call, so that the flight does not depend on the
+ * frame rate. After a stall only a few steps are made up for. While
+ * recording, paintGL() advances the scene instead, so that every captured
+ * frame is one step further.
+ */
+void MainView::onTimeout() {
+    float elapsed = simulationClock.nsecsElapsed() / 1.0e9f;
+    simulationClock.restart();
+    if (frameCapture.isActive()) {
+        return;
+    }
+
+    simulationLag = std::min(simulationLag + elapsed, kMaxSimulationLag);
+    while (simulationLag >= kSimulationStep) {
+        updateRotation();
+        simulationLag -= kSimulationStep;
+    }
+    updateSpaceShipTransform();
+
+    if (terrainEditor.isStroking()) {
+        sculptTerrain(std::min(elapsed, kMaxSimulationLag));
+    }
+    if (erosionEnabled && !infiniteFlight) {
+        updateErosion();
+    }
+}
+
+/**
+ * @brief MainView::updateErosion Passes on the heights of the last slice of
+ * erosion once it is done, and starts the next one on the worker thread.
+ */
+void MainView::updateErosion() {
+    if (erosionRunning && !erosionWorker.waitForDone(0)) {
+        return;
+    }
+    finishErosionSlice();
+
+    erosionRunning = true;
+    erosionWorker.start([this]() {
+        erosion.run(kErosionSlice);
+        erosionRegion = erosion.takeChangedRegion();
+    });
+}
+
+/**
+ * @brief MainView::finishErosionSlice Waits for the running slice of erosion,
+ * if any, and passes on what it changed. The rows on the GPU and the editor
+ * follow right away; the heightfield and the chunk bounds, which take
+ * longer to rebuild, a few times per second.
+ */
+void MainView::finishErosionSlice() {
+    if (erosionRunning) {
+        erosionWorker.waitForDone();
+        erosionRunning = false;
+
+        const QVector<float> &heights = erosion.getHeights();
+        if (!erosionRegion.isEmpty()) {
+            terrainHeights.setHeights(erosionRegion, heights);
+            terrainEditor.setHeights(erosionRegion, heights);
+            invalidateTerrainShadows(erosionRegion);
+            erosionQueryRegion |= erosionRegion;
+        }
+    }
+
+    bool queriesDue = !erosionQueryClock.isValid() || erosionQueryClock.elapsed() >= kErosionQueryInterval;
+    if (erosionQueryRegion.isEmpty() || (erosionEnabled && !queriesDue)) {
+        return;
+    }
+    erosionQueryClock.start();
+
+    const QVector<float> &heights = erosion.getHeights();
+    heightfield.setHeights(erosionQueryRegion, heights, TerrainChunks::heightFromNoise(255));
+    terrainChunks.setHeights(erosionQueryRegion, heights);
+    erosionQueryRegion = QRect();
+    LOG_DEBUG_RATE(1, "Erosion: %1 batches, %2 droplets", erosion.getBatchCount(),
+                   erosion.getDropletCount());
+}
+
+/**
+ * @brief MainView::sculptTerrain Applies the brush of the current stroke at
+ * the terrain under the mouse.
+ * @param seconds Time the brush was held since the last call.
+ */
+void MainView::sculptTerrain(float seconds) {
+    QVector3D hit;
+    if (!pickTerrain(sculptPosition, hit)) {
+        return;
+    }
+    // The brush works on the eroded heights, see applyTerrainEdit()
+    finishErosionSlice();
+    QVector3D sample = toHeightfield(hit);
+    applyTerrainEdit(terrainEditor.apply(sample.x(), sample.z(), seconds));
+}
+
+/**
+ * @brief MainView::applyTerrainEdit Passes an edit of the heights on to all
+ * other copies of them. Only the edited region is converted, and only its
+ * rows are uploaded; the normals follow from the height texture. The editor
+ * must have made the edit after finishErosionSlice(), so that the edit
+ * starts from the eroded heights and the erosion is not running.
+ * @param region The samples that changed.
+ */
+void MainView::applyTerrainEdit(const QRect &region) {
+    if (region.isEmpty()) {
+        return;
+    }
+    const QVector<float> &heights = terrainEditor.getHeights();
+    terrainHeights.setHeights(region, heights);
+    heightfield.setHeights(region, heights, TerrainChunks::heightFromNoise(255));
+    terrainChunks.setHeights(region, heights);
+    erosion.setHeights(region, heights);
+    invalidateTerrainShadows(region);
+    update();
+}
+
+/**
+ * @brief MainView::invalidateTerrainShadows Redraws the shadow cascades that
+ * see a region of the fixed terrain whose heights changed.
+ * @param region The samples that changed.
+ */
+void MainView::invalidateTerrainShadows(const QRect &region) {
+    // Rows run against z, so the last row is the nearest corner
+    Aabb changed(fromHeightfield(QVector3D(region.left(), 0, region.bottom())),
+                 fromHeightfield(QVector3D(region.right(), TerrainChunks::heightFromNoise(255), region.top())));
+    shadowMap.invalidate(changed.transformed(meshTransform));
+}
+
+/**
+ * @brief MainView::updateParticles Advances the exhaust by the time since the
+ * last frame, or by a simulation step while recording. The particles are left
+ * behind in the air, which moves along with the terrain.
+ */
+void MainView::updateParticles() {
+    float seconds = particleClock.nsecsElapsed() / 1.0e9f;
+    particleClock.restart();
+    if (frameCapture.isActive()) {
+        seconds = kSimulationStep;
+    }
+    QVector3D drift = meshTransform.mapVector(QVector3D(0, 0, kFlightSpeed));
+    particles.update(std::min(seconds, kMaxSimulationLag), spaceShipTransform, drift);
 
-    // set material properties
-    shaderPrograms[shadingMode].setUniformValue("materialCoeffecients", QVector4D(0.4F, 0.4F, 0.4F, 8.0F));
+    float milliseconds;
+    if (!particles.takeUpdateTime(milliseconds)) {
+        return;
+    }
+    lastParticleTime = milliseconds;
+    if (particleBenchmarkSteps == 0) {
+        return;
+    }
+    if (particleBenchmarkSkips > 0) {
+        --particleBenchmarkSkips;
+        return;
+    }
+    particleBenchmarkTime += milliseconds;
+    if (--particleBenchmarkSteps == 0) {
+        double perStep = particleBenchmarkTime / kParticleBenchmarkSteps;
+        LOG_INFO(":: Particle benchmark: %1 particles, %2 ms per update, %3 particles/ms",
+                 particles.getParticleCount(), perStep, particles.getParticleCount() / perStep);
+        emit particleBenchmarkFinished();
+    }
 }
 
+/**
+ * @brief MainView::updateRotation Advances the terrain and the ship by one
+ * fixed step.
+ */
 void MainView::updateRotation() {
-    flying += 0.2f;
-    if(flying >= 800) {
-        flying = 0;
+    // Sample the ground along the path of the ship, so that it climbs before
+    // it reaches a ridge instead of cutting through it
+    float columns[SpaceShip::kLookAheadSamples];
+    float rows[SpaceShip::kLookAheadSamples];
+    float heights[SpaceShip::kLookAheadSamples];
+
+    if (infiniteFlight) {
+        // The tiles are generated on worker threads, only upload them here
+        distanceFlown += kFlightSpeed * kSimulationStep;
+        if (terrainStreamer.update(meshTransform.inverted().map(QVector3D(0, 0, 0)), distanceFlown) != 0) {
+            shadowMap.invalidate();
+        }
+        spaceShip.lookAhead(25, 25 + distanceFlown, kFlightSpeed, columns, rows);
+        for (int i = 0; i != SpaceShip::kLookAheadSamples; ++i) {
+            heights[i] = terrainStreamer.heightAt(columns[i], rows[i]);
+        }
+    } else {
+        flying += kFlightSpeed * kSimulationStep;
+        if(flying >= 800) {
+            flying = 0;
+        }
+
+        // The vertex shader takes the heights from the height texture, only
+        // the bounds used for culling follow the terrain here
+        terrainChunks.updateBounds(flying);
+        spaceShip.lookAhead(25, 25 + flying, kFlightSpeed, columns, rows);
+        heightfield.heightsAt(columns, rows, SpaceShip::kLookAheadSamples, heights);
     }
 
-    for (int i = 0; i < meshSize; ++i) {
-        float actualx = (terrainVertices[i].x() + 2);
-        float actualz = (terrainVertices[i].z() - 2) * -1;
-        terrainVertices[i].setY(noise.pixelColor(actualx, actualz + flying).red() / 6.0f);
+    float ground = *std::max_element(heights, heights + SpaceShip::kLookAheadSamples);
+    spaceShip.step(kSimulationStep, -10 + ground / 2.0f);
+}
+
+/**
+ * @brief MainView::pickTerrain Finds the point of the fixed terrain under a
+ * position in the widget, by casting a ray through the heightfield.
+ * @param position Position in the widget, in logical pixels.
+ * @param hit Output, the hit in mesh coordinates.
+ * @return True if the terrain was hit.
+ */
+bool MainView::pickTerrain(const QPointF &position, QVector3D &hit) const {
+    if (infiniteFlight || width() == 0 || height() == 0) {
+        return false;
     }
 
-    // Bind and fill vertex coordinates VBO
-    glBindBuffer(GL_ARRAY_BUFFER, meshPositionVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, terrainVertices.size() * sizeof(QVector3D),
-                    terrainVertices.constData());
+    // Unproject the position on the near and far plane into mesh space
+    QMatrix4x4 inverse = (projectionTransform * meshTransform).inverted();
+    float x = 2.0f * position.x() / width() - 1.0f;
+    float y = 1.0f - 2.0f * position.y() / height();
+    QVector3D nearPoint = inverse.map(QVector3D(x, y, -1.0f));
+    QVector3D farPoint = inverse.map(QVector3D(x, y, 1.0f));
 
-    // Unbind VBO
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    QVector3D origin = toHeightfield(nearPoint);
+    QVector3D direction = toHeightfield(farPoint) - origin;
 
-    shipTranslation = QVector3D(0, -10 + noise.pixelColor(25, 25 + flying).red() / 12.0f, shipTranslation.z());
-    updateSpaceShipTransform();
+    HeightfieldHit result;
+    if (!heightfield.intersect(origin, direction, direction.length(), result)) {
+        return false;
+    }
+    hit = fromHeightfield(result.position);
+    return true;
 }
+
 /**
- * @brief MainView::createShaderProgram Creates a new shader program with a
- * vertex and fragment shader.
+ * @brief MainView::toHeightfield Maps a point of the fixed terrain mesh to
+ * the heightfield, where x is the column and z the row of the noise, as in
+ * TerrainChunks::noiseColumn() and noiseRow(). The height stays the same.
+ * @param point The point in mesh coordinates.
+ * @return The point in heightfield coordinates.
+ */
+QVector3D MainView::toHeightfield(const QVector3D &point) const {
+    return QVector3D(point.x() + 2, point.y(), 2 - point.z() + flying);
+}
+
+/**
+ * @brief MainView::fromHeightfield Maps a point of the heightfield back to
+ * the fixed terrain mesh, the inverse of toHeightfield().
+ * @param point The point in heightfield coordinates.
+ * @return The point in mesh coordinates.
+ */
+QVector3D MainView::fromHeightfield(const QVector3D &point) const {
+    return QVector3D(point.x() - 2, point.y(), 2 - point.z() + flying);
+}
+/**
+ * @brief MainView::createShaderProgram Creates the shader program of the sun
+ * and the ship. The terrain variants are compiled on demand by terrainShaders.
  */
 void MainView::createShaderProgram() {
     // Create shader program
 
-    shaderPrograms[PHONG].addShaderFromSourceFile(QOpenGLShader::Vertex,
-                                                  ":/shaders/vertshader_phong.glsl");
-    shaderPrograms[PHONG].addShaderFromSourceFile(QOpenGLShader::Fragment,
-                                                  ":/shaders/fragshader_phong.glsl");
-    shaderPrograms[NORMAL].addShaderFromSourceFile(QOpenGLShader::Vertex,
-                                                   ":/shaders/vertshader_lines.glsl");
-    shaderPrograms[NORMAL].addShaderFromSourceFile(QOpenGLShader::Fragment,
-                                                   ":/shaders/fragshader_lines.glsl");
-    shaderPrograms[BLACKGREENWHITE].addShaderFromSourceFile(QOpenGLShader::Vertex,
-                                                    ":/shaders/vertshader_gouraud.glsl");
-    shaderPrograms[BLACKGREENWHITE].addShaderFromSourceFile(QOpenGLShader::Fragment,
-                                                    ":/shaders/fragshader_gouraud.glsl");
-    shaderPrograms[RAINBOWLAYERS].addShaderFromSourceFile(QOpenGLShader::Vertex,
-                                                            ":/shaders/vertshader_rainbowlayers.glsl");
-    shaderPrograms[RAINBOWLAYERS].addShaderFromSourceFile(QOpenGLShader::Fragment,
-                                                            ":/shaders/fragshader_rainbowlayers.glsl");
-
-    shaderPrograms[PHONG].link();
-    shaderPrograms[NORMAL].link();
-    shaderPrograms[BLACKGREENWHITE].link();
-    shaderPrograms[RAINBOWLAYERS].link();
+    objectProgram.addShaderFromSourceFile(QOpenGLShader::Vertex,
+                                          ":/shaders/vertshader_phong.glsl");
+    // The shadow lookup is shared with the terrain, see ShaderCache::load()
+    objectProgram.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                          ShaderCache::header(SHADOWS) +
+                                          ShaderCache::load(":/shaders/fragshader_phong.glsl", {":/shaders/shadows.glsl"}));
+    objectProgram.link();
+
+    // The shadow map keeps a unit of its own, as samplers of different types
+    // may not share one, even while the shadow casters are drawn
+    objectProgram.bind();
+    objectProgram.setUniformValue("shadowMap", kShadowMapUnit);
+    objectProgram.release();
+
+    // Compile the variant of the initial shading mode up front
+    terrainShaders.program(terrainFeatures());
+}
+
+/**
+ * @brief MainView::terrainFeatures Picks the features of the terrain shader
+ * for the current shading mode and settings.
+ * @return Bitmask of ShaderFeature values.
+ */
+unsigned MainView::terrainFeatures() const {
+    // The streamed tiles bring their own heights and normals
+    return shadingFeatures(shadingMode, !infiniteFlight, shadowsEnabled, fogEnabled, shaderWireframe);
 }
 
 void MainView::loadSun() {
-    Model model(":/models/sun.obj");
+    // Indexed, so that the vertices are shared and drawn in the order of the
+    // vertex cache optimization
+    Model model(":/models/sun.obj", Model::INDEXED);
     QImage image(":/textures/starry-night-sky.jpg");
-    QVector<QVector2D> sunTextureCoords = model.getTextureCoords();
-    QVector<QVector3D> sunNormals = model.getNormals();
-    QVector<QVector3D> sunCoords = model.getCoords();
+    MeshSpan<QVector2D> sunTextureCoords = model.getTextureCoordsIndexed();
+    MeshSpan<QVector3D> sunNormals = model.getNormalsIndexed();
+    MeshSpan<QVector3D> sunCoords = model.getCoordsIndexed();
+    MeshSpan<unsigned> sunIndices = model.getIndices();
 
     QVector<quint8> textureVector = imageToBytes(image);
 
-    sunSize = sunCoords.size();
+    sunSize = sunIndices.size();
+    sunBounds = Aabb::fromPoints(sunCoords.data(), sunCoords.size());
 
     // Generate VAO
     glGenVertexArrays(1, &sunVAO);
@@ -176,6 +454,7 @@ void MainView::loadSun() {
     glGenBuffers(1, &sunPositionVBO);
     glGenBuffers(1, &sunNormalVBO);
     glGenBuffers(1, &sunTextureCoordVBO);
+    glGenBuffers(1, &sunIndexBuffer);
     glGenTextures(1, &textureName);
 
     // Bind and fill vertex coordinates VBO
@@ -208,6 +487,11 @@ void MainView::loadSun() {
                           reinterpret_cast<GLvoid *>(0));
     glEnableVertexAttribArray(2);
 
+    // The element buffer binding is part of the VAO state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sunIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sunIndices.size() * sizeof(unsigned),
+                 sunIndices.data(), GL_STATIC_DRAW);
+
     // Unbind VBOs and VAO
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
@@ -221,18 +505,27 @@ void MainView::loadSun() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // Upload texture data
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, textureVector.data());
+
+    // The mesh is on the GPU now
+    model.release();
 }
 
 void MainView::loadShip() {
-    Model model(":/models/sun.obj");
+    Model model(":/models/sun.obj", Model::INDEXED);
     QImage image(":/textures/path836.png");
-    QVector<QVector2D> spaceShipTextureCoords = model.getTextureCoords();
-    QVector<QVector3D> spaceShipNormals = model.getNormals();
-    QVector<QVector3D> spaceShipCoords = model.getCoords();
+    MeshSpan<QVector2D> spaceShipTextureCoords = model.getTextureCoordsIndexed();
+    MeshSpan<QVector3D> spaceShipNormals = model.getNormalsIndexed();
+    MeshSpan<QVector3D> spaceShipCoords = model.getCoordsIndexed();
+    // Every level indexes into the same vertices, full detail first. The
+    // ship is a textured quad, below LodChain::kMinTriangles, so it only
+    // gets the full detail level.
+    spaceShipLods = model.buildLodChain();
 
     QVector<quint8> textureVector = imageToBytes(image);
 
-    spaceShipSize = spaceShipCoords.size();
+    spaceShipSize = spaceShipLods.getLevels().first().indexCount;
+    spaceShipBounds =
+        Aabb::fromPoints(spaceShipCoords.data(), spaceShipCoords.size());
 
     // Generate VAO
     glGenVertexArrays(1, &spaceShipVAO);
@@ -242,6 +535,7 @@ void MainView::loadShip() {
     glGenBuffers(1, &spaceShipPositionVBO);
     glGenBuffers(1, &spaceShipNormalVBO);
     glGenBuffers(1, &spaceShipTextureCoordVBO);
+    glGenBuffers(1, &spaceShipIndexBuffer);
     glGenTextures(1, &shipTexture);
 
     // Bind and fill vertex coordinates VBO
@@ -274,6 +568,12 @@ void MainView::loadShip() {
                           reinterpret_cast<GLvoid *>(0));
     glEnableVertexAttribArray(2);
 
+    // The element buffer binding is part of the VAO state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, spaceShipIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, spaceShipLods.getIndices().size() * sizeof(unsigned),
+                 spaceShipLods.getIndices().constData(), GL_STATIC_DRAW);
+    spaceShipLods.releaseIndices();
+
     // Unbind VBOs and VAO
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
@@ -287,6 +587,9 @@ void MainView::loadShip() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // Upload texture data
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, textureVector.data());
+
+    // The mesh is on the GPU now
+    model.release();
 }
 
 /**
@@ -295,10 +598,31 @@ void MainView::loadShip() {
  * @param filename Filename of where the mesh is located.
  */
 void MainView::loadMesh(const QString &filename) {
-    Model model(filename);
+    Model model(filename, Model::UNPACKED);
     QImage image(":/textures/noiseTextureG.png");
     noise = image;
-    terrainVertices = model.getCoords();
+
+    // Sort the triangles in chunks of 10 by 10 quads for culling
+    terrainVertices = terrainChunks.build(model.getCoords(), 20.0F);
+    // The sorted copy is all that is used from here on
+    model.release();
+    terrainChunks.setHeightSource(noise);
+    heightfield.setHeightSource(noise, TerrainChunks::heightFromNoise(255));
+    erosion.setHeightSource(noise);
+    terrainEditor.setHeightSource(noise);
+
+    // Keep only the noise rows the terrain reaches on the GPU: the rows
+    // under the mesh, the next row that the shader blends with, and a row
+    // on either side for the normals
+    Aabb extent = Aabb::fromPoints(terrainVertices);
+    int nearRow = static_cast<int>(std::floor(2 - extent.maximum.z()));
+    int farRow = static_cast<int>(std::floor(2 - extent.minimum.z()));
+    terrainHeights.initialize(this);
+    terrainHeights.setSource(noise);
+    // One more row at the far end, as the fraction of flying can carry the
+    // rows past the integer part
+    terrainHeights.setWindow(nearRow - 1, farRow - nearRow + 5);
+    terrainHeights.update(flying);
 
     meshSize = terrainVertices.size();
 
@@ -319,6 +643,18 @@ void MainView::loadMesh(const QString &filename) {
                           reinterpret_cast<GLvoid *>(0));
     glEnableVertexAttribArray(0);
 
+    // Barycentric coordinates for the shader wireframe. Sorting into chunks
+    // keeps the triangles intact, so vertex i is always corner i % 3.
+    QVector<quint8> barycentrics(terrainVertices.size() * 4, 0);
+    for (int i = 0; i < terrainVertices.size(); ++i) {
+        barycentrics[i * 4 + i % 3] = 255;
+    }
+    glGenBuffers(1, &meshBarycentricVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, meshBarycentricVBO);
+    glBufferData(GL_ARRAY_BUFFER, barycentrics.size(), barycentrics.constData(), GL_STATIC_DRAW);
+    glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, 4, reinterpret_cast<GLvoid *>(0));
+    glEnableVertexAttribArray(3);
+
     // Unbind VBOs and VAO
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
@@ -332,64 +668,552 @@ void MainView::loadMesh(const QString &filename) {
  *
  */
 void MainView::paintGL() {
+    // The simulation steps up to the next frame share one budget of tile
+    // uploads, however many of them there are
+    terrainStreamer.startFrame();
+    if (frameCapture.isActive()) {
+        simulationLag = 0;
+        updateRotation();
+        updateSpaceShipTransform();
+    }
+    updateParticles();
+
+    // Adapt the quality to the GPU time of the frames a few frames back
+    float gpuTime;
+    if (gpuTimer.takeResult(gpuTime)) {
+        lastGpuTime = gpuTime;
+        if (adaptiveQuality && qualityGovernor.update(gpuTime)) {
+            applyQualityLevel();
+        }
+    }
+
+    // Render at a lower resolution if needed and scale up at the end
+    int windowWidth = qRound(width() * devicePixelRatioF());
+    int windowHeight = qRound(height() * devicePixelRatioF());
+    float renderScale = adaptiveQuality ? qualityGovernor.getLevel().renderScale : 1.0F;
+    bool scaled = renderScale < 1.0F;
+    int sceneHeight = scaled ? qMax(1, qRound(windowHeight * renderScale)) : windowHeight;
+    gpuTimer.begin();
+
     hue += 0.1f;
     // Convert HSV to RGB
     float r, g, b;
     hsvToRgb(hue, 1.0f, 1.0f, r, g, b);
+    QVector3D lineColor(r, g, b);
+
+    updateVisibility();
+
+    // Heights and normals of the fixed terrain, only the rows that scrolled
+    // into view are uploaded. The shadow casters need them as well.
+    terrainHeights.update(flying);
+
+    // The passes of the frame. The graph binds and clears their targets and
+    // skips the ones whose results are not used.
+    RenderGraph::Target window =
+        renderGraph.importFramebuffer("window", defaultFramebufferObject(), windowWidth, windowHeight);
+    RenderGraph::Target scene = window;
+    if (postProcessing.isEnabled()) {
+        // Colors above one are kept for the bloom and the tonemap
+        scene = renderGraph.createTarget("scene", qMax(1, qRound(windowWidth * renderScale)), sceneHeight, GL_RGBA16F);
+    } else if (scaled) {
+        scene = renderGraph.createTarget("scene", qMax(1, qRound(windowWidth * renderScale)), sceneHeight, GL_RGBA8);
+    }
+    RenderGraph::Resource shadows = renderGraph.importTexture("shadow map", shadowMap.getTexture());
+    // The lit terrain is opaque and expensive to shade, so its depth is laid
+    // down first and only the visible fragments are shaded
+    bool depthPrepass = shadingMode == PHONG;
+
+    // The minimap shares the meshes, textures and programs of the main view
+    // and only adds a small target. Added first, so that the stats of the
+    // terrain streamer are those of the main view.
+    int minimapSide = qMax(1, windowHeight / 4);
+    cameraView.viewportHeight = sceneHeight;
+    minimapView.viewportHeight = minimapSide;
+    RenderGraph::Target minimap;
+    if (minimapEnabled) {
+        minimap = renderGraph.createTarget("minimap", minimapSide, minimapSide, GL_RGBA8);
+        renderGraph.addPass("minimap terrain",
+            [&](RenderGraph::PassBuilder &pass) {
+                pass.writeColor(minimap.color, true);
+                pass.writeDepth(minimap.depth, true);
+            },
+            [this, lineColor]() { drawTerrain(minimapView, terrainFeatures() & ~(FOG | SHADOWS), lineColor, false); });
+        renderGraph.addPass("minimap objects",
+            [&](RenderGraph::PassBuilder &pass) {
+                pass.writeColor(minimap.color);
+                pass.writeDepth(minimap.depth);
+            },
+            [this]() { drawObjects(minimapView, false); });
+    }
+
+    if (shadowsEnabled) {
+        renderGraph.addPass("shadows",
+            [&](RenderGraph::PassBuilder &pass) { pass.write(shadows); },
+            [this]() { renderShadows(); });
+    }
+    if (depthPrepass) {
+        renderGraph.addPass("depth prepass",
+            [&](RenderGraph::PassBuilder &pass) { pass.writeDepth(scene.depth, true); },
+            [this]() { drawTerrainDepth(); });
+    }
+    renderGraph.addPass("terrain",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.writeColor(scene.color, true);
+            if (depthPrepass) {
+                pass.readDepth(scene.depth);
+            } else {
+                pass.writeDepth(scene.depth, true);
+            }
+            if (terrainFeatures() & SHADOWS) {
+                pass.read(shadows);
+            }
+        },
+        [this, lineColor, depthPrepass]() { drawTerrain(cameraView, terrainFeatures(), lineColor, depthPrepass); });
+    renderGraph.addPass("objects",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.writeColor(scene.color);
+            pass.writeDepth(scene.depth);
+            if (shadowsEnabled) {
+                pass.read(shadows);
+            }
+        },
+        [this]() { drawObjects(cameraView, true); });
+    // Blended over everything else, so it comes last
+    renderGraph.addPass("particles",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.writeColor(scene.color);
+            pass.readDepth(scene.depth);
+        },
+        [this, sceneHeight]() { particles.draw(projectionTransform, sceneHeight); });
+    if (postProcessing.isEnabled()) {
+        postProcessing.addPasses(renderGraph, scene.color, window.color);
+    } else if (scaled) {
+        renderGraph.addPass("upscale",
+            [&](RenderGraph::PassBuilder &pass) {
+                pass.read(scene.color);
+                pass.writeColor(window.color);
+            },
+            [this, scene]() { renderGraph.blit(scene.color); });
+    }
+    if (minimapEnabled) {
+        // In the top right corner, over the finished image
+        QRect corner(windowWidth - minimapSide - kMinimapMargin, windowHeight - minimapSide - kMinimapMargin,
+                     minimapSide, minimapSide);
+        renderGraph.addPass("minimap overlay",
+            [&](RenderGraph::PassBuilder &pass) {
+                pass.read(minimap.color);
+                pass.writeColor(window.color);
+            },
+            [this, minimap, corner]() { renderGraph.blit(minimap.color, corner); });
+    }
+    // Only queues the readback, the frame is written out a few frames later
+    bool capturing = frameCapture.isActive();
+    if (capturing) {
+        renderGraph.addPass("capture",
+            [&](RenderGraph::PassBuilder &pass) {
+                pass.read(window.color);
+                pass.setSideEffect();
+            },
+            [this, windowWidth, windowHeight]() {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, defaultFramebufferObject());
+                frameCapture.capture(windowWidth, windowHeight);
+            });
+    }
+
+    renderGraph.execute();
+    gpuTimer.end();
+
+    logStats();
 
-    // if(shadingMode == NORMAL)
-    glPolygonMode(GL_FRONT_AND_BACK,GL_LINE);
-    // Clear the screen before rendering
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    shaderPrograms[shadingMode].link();
-    shaderPrograms[shadingMode].bind();
+    if (capturing && !frameCapture.isActive()) {
+        emit captureFinished();
+    }
+}
+
+/**
+ * @brief MainView::drawTerrain Draws the terrain in the current shading mode.
+ * @param view The camera and the chunks it sees.
+ * @param features The shader features, see terrainFeatures().
+ * @param lineColor Color of the lines in the normal shading mode.
+ * @param depthPrepass Whether the depth of the terrain is already drawn, so
+ * that only the fragments on it have to be shaded.
+ */
+void MainView::drawTerrain(const RenderView &view, unsigned features, const QVector3D &lineColor,
+                           bool depthPrepass) {
+    // Phong lights the filled terrain, the other modes draw a wireframe. The
+    // shader wireframe draws filled triangles, glPolygonMode(GL_LINE) is kept
+    // to compare against.
+    bool wireframe = shadingMode != PHONG;
+    QOpenGLShaderProgram *program = terrainShaders.program(features);
+    if (program == nullptr) return;  // the shader cache logged why
+    QOpenGLShaderProgram &terrainProgram = *program;
+    glPolygonMode(GL_FRONT_AND_BACK, wireframe && !shaderWireframe ? GL_LINE : GL_FILL);
+    terrainProgram.bind();
 
     // Update the uniform values. Note that it is better to only do this when the
     // matrices change, but for the sake of simplicity this was not done.
-    shaderPrograms[shadingMode].setUniformValue("modelViewTransform", meshTransform);
-    shaderPrograms[shadingMode].setUniformValue("projectionTransform", projectionTransform);
+    // Uniforms that the variant does not use are ignored.
+    QMatrix4x4 modelView = view.viewTransform * meshTransform;
+    terrainProgram.setUniformValue("modelViewTransform", modelView);
+    terrainProgram.setUniformValue("projectionTransform", view.projectionTransform);
+    terrainProgram.setUniformValue("normalMatrix", modelView.normalMatrix());
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, terrainHeights.getTexture());
+    glActiveTexture(GL_TEXTURE0);
+    terrainProgram.setUniformValue("heightMap", 1);
+    terrainProgram.setUniformValue("heightScale", TerrainChunks::heightFromNoise(255));
+    terrainProgram.setUniformValue("flying", flying);
+    terrainProgram.setUniformValue("lightPosition", view.viewTransform.map(lightPosition));
+    terrainProgram.setUniformValue("lightColor", lightColor);
+    terrainProgram.setUniformValue("materialCoeffecients", QVector4D(0.4F, 0.7F, 0.3F, 16.0F));
+    terrainProgram.setUniformValue("materialColor", QVector3D(0.55F, 0.6F, 0.65F));
+    if (features & SHADOWS) {
+        shadowMap.bind(terrainProgram, kShadowMapUnit);
+    }
+
     if(shadingMode == NORMAL) {
-        shaderPrograms[NORMAL].setUniformValue("lineColor", QVector3D(r, g, b));
+        terrainProgram.setUniformValue("lineColor", lineColor);
     }
-    if(shadingMode == BLACKGREENWHITE) {
-        hsvToRgb(bottomHue, 1.0f, 1.0f, r, g, b);
-        shaderPrograms[BLACKGREENWHITE].setUniformValue("bottomColor", QVector3D(r, g, b));
-        hsvToRgb(middleHue, 1.0f, 1.0f, r, g, b);
-        shaderPrograms[BLACKGREENWHITE].setUniformValue("middleColor", QVector3D(r, g, b));
-        hsvToRgb(topHue, 1.0f, 1.0f, r, g, b);
-        shaderPrograms[BLACKGREENWHITE].setUniformValue("topColor", QVector3D(r, g, b));
+    if(shadingMode == BLACKGREENWHITE || shadingMode == RAINBOWLAYERS) {
+        // The palettes are only rebaked when they change
+        PaletteTexture &palette = shadingMode == BLACKGREENWHITE ? gradientPalette : layerPalette;
+        palette.bind(GL_TEXTURE2);
+        terrainProgram.setUniformValue("palette", 2);
+        terrainProgram.setUniformValue("paletteRange", palette.getRange());
     }
 
+    terrainProgram.setUniformValue("lineWidth", lineWidth);
+    terrainProgram.setUniformValue("hiddenLineFill", hiddenLineFill);
+    terrainProgram.setUniformValue("fillColor", QVector3D(0.31F, 0.0F, 0.51F));  // the clear color
+    terrainProgram.setUniformValue("fogDensity", fogDensity);
+    terrainProgram.setUniformValue("fogHeightFalloff", fogHeightFalloff);
+    terrainProgram.setUniformValue("fogEnd", viewDistance());
+    terrainProgram.setUniformValue("fogColor", QVector3D(0.31F, 0.0F, 0.51F));
+
+    // Anti-aliased lines without fill are blended over the background
+    bool blendLines = wireframe && shaderWireframe && !hiddenLineFill;
+    if (blendLines) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    if (depthPrepass) {
+        glDepthMask(GL_FALSE);
+    }
 
-    glBindVertexArray(meshVAO);
-    glDrawArrays(GL_TRIANGLES, 0, meshSize);
+    if (infiniteFlight) {
+        terrainStreamer.draw(terrainProgram, modelView, view.localFrustum(), distanceFlown, view.maxDistance);
+    } else {
+        drawTerrainChunks(view.itemVisible);
+    }
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+/**
+ * @brief MainView::drawTerrainDepth Draws only the depth of the terrain that
+ * the main camera sees.
+ */
+void MainView::drawTerrainDepth() {
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    QOpenGLShaderProgram *depthProgram = bindTerrainDepthProgram(projectionTransform);
+    if (depthProgram != nullptr && infiniteFlight) {
+        terrainStreamer.draw(*depthProgram, meshTransform, cameraView.localFrustum(), distanceFlown, cameraView.maxDistance);
+    } else if (depthProgram != nullptr) {
+        drawTerrainChunks(cameraView.itemVisible);
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+/**
+ * @brief MainView::bindTerrainDepthProgram Binds the terrain shader variant
+ * that only places the vertices, for drawing the depth of the terrain.
+ * @param projection The projection from view space.
+ * @return The bound program, nullptr if the variant failed to build.
+ */
+QOpenGLShaderProgram *MainView::bindTerrainDepthProgram(const QMatrix4x4 &projection) {
+    QOpenGLShaderProgram *variant = terrainShaders.program(terrainFeatures() & HEIGHT_MAP_DISPLACEMENT);
+    if (variant == nullptr) return nullptr;
+    QOpenGLShaderProgram &program = *variant;
+    program.bind();
+    program.setUniformValue("modelViewTransform", meshTransform);
+    program.setUniformValue("projectionTransform", projection);
+    if (!infiniteFlight) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, terrainHeights.getTexture());
+        glActiveTexture(GL_TEXTURE0);
+        program.setUniformValue("heightMap", 1);
+        program.setUniformValue("heightScale", TerrainChunks::heightFromNoise(255));
+        program.setUniformValue("flying", flying);
+    }
+    return variant;
+}
 
+/**
+ * @brief MainView::drawObjects Draws the sun, which is the sky, and the lit
+ * ship.
+ * @param view The camera and the items it sees.
+ * @param mainCamera Whether the view is the main camera. Only the main
+ * camera is inside the sky and in the range of the shadow map.
+ */
+void MainView::drawObjects(const RenderView &view, bool mainCamera) {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, textureName);
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    shaderPrograms[PHONG].bind();
-    shaderPrograms[PHONG].setUniformValue("materialCoeffecients", QVector4D(0.4F, 0.4F, 0.4F, 8.0F));
-    shaderPrograms[PHONG].setUniformValue("lightPosition", lightPosition);
-    shaderPrograms[PHONG].setUniformValue("lightColor", lightColor);
-    shaderPrograms[PHONG].setUniformValue("modelViewTransform", sunTransform);
-    shaderPrograms[PHONG].setUniformValue("projectionTransform", projectionTransform);
-    shaderPrograms[PHONG].setUniformValue("normalMatrix", normalMatrix);
-    shaderPrograms[PHONG].setUniformValue("samplerUniform", 0);
-
-    glBindVertexArray(sunVAO);
-    glDrawArrays(GL_TRIANGLES, 0, sunSize);
+    objectProgram.bind();
+    objectProgram.setUniformValue("materialCoeffecients", QVector4D(0.4F, 0.4F, 0.4F, 8.0F));
+    objectProgram.setUniformValue("lightPosition", view.viewTransform.map(lightPosition));
+    objectProgram.setUniformValue("lightColor", lightColor);
+    objectProgram.setUniformValue("modelViewTransform", sunTransform);
+    objectProgram.setUniformValue("projectionTransform", view.projectionTransform);
+    objectProgram.setUniformValue("normalMatrix", normalMatrix);
+    objectProgram.setUniformValue("samplerUniform", 0);
+    objectProgram.setUniformValue("lit", false);
+    objectProgram.setUniformValue("emission", postProcessing.isEnabled() ? kSkyEmission : 0.0F);
+    shadowMap.bind(objectProgram, kShadowMapUnit, shadowsEnabled && mainCamera);
+
+    if (mainCamera && view.itemVisible[sunItem]) {
+        glBindVertexArray(sunVAO);
+        glDrawElements(GL_TRIANGLES, sunSize, GL_UNSIGNED_INT, nullptr);
+    }
 
 
     glBindTexture(GL_TEXTURE_2D, shipTexture);
-    shaderPrograms[PHONG].setUniformValue("modelViewTransform", spaceShipTransform);
-    shaderPrograms[PHONG].setUniformValue("normalMatrix", spaceShipTransform.normalMatrix());
-    shaderPrograms[PHONG].setUniformValue("samplerUniform", 0);
+    QMatrix4x4 shipModelView = view.viewTransform * spaceShipTransform;
+    objectProgram.setUniformValue("modelViewTransform", shipModelView);
+    objectProgram.setUniformValue("normalMatrix", shipModelView.normalMatrix());
+    objectProgram.setUniformValue("samplerUniform", 0);
+    objectProgram.setUniformValue("lit", true);
+
+    if (view.itemVisible[spaceShipItem]) {
+        // The coarsest level whose error stays below a pixel in this view
+        float pixels = view.pixelsPerUnit(shipModelView.map(spaceShipBounds.center()));
+        const LodLevel &level = spaceShipLods.getLevels()[spaceShipLods.selectLevel(pixels, shipScale)];
+        glBindVertexArray(spaceShipVAO);
+        glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT,
+                       reinterpret_cast<GLvoid *>(level.firstIndex * sizeof(unsigned)));
+    }
 
-    glBindVertexArray(spaceShipVAO);
-    glDrawArrays(GL_TRIANGLES, 0, spaceShipSize);
+    objectProgram.release();
+}
 
-    shaderPrograms[shadingMode].release();
+/**
+ * @brief MainView::updateVisibility Tests all scene items against the
+ * frustum of every view. The items are tracked in the view space of the main
+ * camera, since the model view transforms already contain it; the other
+ * views are placed relative to it.
+ */
+void MainView::updateVisibility() {
+    int chunkCount = terrainChunks.getChunkCount();
+    sceneBounds.resize(chunkCount + 2);
+    for (int i = 0; i < chunkCount; ++i) {
+        sceneBounds[i] = terrainChunks.getChunk(i).bounds.transformed(meshTransform);
+    }
+    sceneBounds[sunItem] = sunBounds.transformed(sunTransform);
+    sceneBounds[spaceShipItem] = spaceShipBounds.transformed(spaceShipTransform);
+
+    // The chunks never move in x and z, so the tree only needs refitting
+    if (sceneBvh.getItemCount() != sceneBounds.size()) {
+        sceneBvh.build(sceneBounds);
+    } else {
+        sceneBvh.refit(sceneBounds);
+    }
+
+    // The far plane only has to reach the end of the fog and the sun and
+    // ship. Pulling it in leaves more depth precision for the terrain.
+    float farthest = fogEnabled ? viewDistance() : 600.0F;
+    farthest = std::max(farthest, -sceneBounds[sunItem].minimum.z());
+    farthest = std::max(farthest, -sceneBounds[spaceShipItem].minimum.z());
+    farthest = std::min(std::ceil(farthest), 600.0F);
+    if (farthest != farPlane) {
+        farPlane = farthest;
+        updateProjectionTransform();
+    }
+
+    // Fully fogged chunks are dropped as well
+    cameraView.projectionTransform = projectionTransform;
+    cameraView.maxDistance = fogEnabled ? viewDistance() : std::numeric_limits<float>::infinity();
+    QVector<RenderView *> views = {&cameraView};
+    if (minimapEnabled) {
+        updateMinimapView();
+        views.append(&minimapView);
+    }
+    viewCuller.cull(sceneBvh, sceneBounds, chunkCount, views);
+}
+
+/**
+ * @brief MainView::updateMinimapView Places the minimap camera straight
+ * above the ship, looking down at the terrain with the direction of flight
+ * pointing up.
+ */
+void MainView::updateMinimapView() {
+    QVector3D up = meshTransform.mapVector(QVector3D(0, 1, 0)).normalized();
+    QVector3D ship = spaceShipTransform.map(QVector3D());
+    QVector3D forward(0, 0, -1);
+    forward -= up * QVector3D::dotProduct(forward, up);
+    if (forward.lengthSquared() < 1e-6F) {
+        forward = QVector3D(0, 1, 0);  // looking straight down already
+    }
+
+    minimapView.viewTransform.setToIdentity();
+    minimapView.viewTransform.lookAt(ship + up * kMinimapHeight, ship, forward.normalized());
+    minimapView.projectionTransform.setToIdentity();
+    minimapView.projectionTransform.ortho(-kMinimapExtent, kMinimapExtent, -kMinimapExtent, kMinimapExtent, 1.0F,
+                                          2.0F * kMinimapHeight);
+}
+
+/**
+ * @brief MainView::renderShadows Fits the shadow cascades to the view and
+ * draws the ones that are out of date. The casters of each cascade are
+ * culled with the scene tree; the sun is the sky and casts nothing. Leaves
+ * the framebuffer of the shadow map bound if anything was drawn.
+ */
+void MainView::renderShadows() {
+    float shadowDistance = std::min(kShadowDistance, viewDistance());
+    QVector3D lightDirection = lightPosition - QVector3D(0, 0, -shadowDistance / 2);
+    shadowMap.fit(lightDirection, 60.0F, aspectRatio, 0.2F, shadowDistance);
+
+    QVector3D offset = terrainOffset();
+    shadowMap.scroll(offset);
+
+    // The terrain moves under the ship, so the shadow of the ship is drawn
+    // again where it was and where it is whenever either of them moves
+    if (spaceShipTransform != shadowShipTransform || offset != shadowTerrainOffset) {
+        shadowMap.invalidate(spaceShipBounds.transformed(shadowShipTransform));
+        shadowMap.invalidate(sceneBounds[spaceShipItem]);
+        shadowShipTransform = spaceShipTransform;
+        shadowTerrainOffset = offset;
+    }
+
+    bool drawn = false;
+    for (int cascade = 0; cascade != CascadedShadowMap::kCascadeCount; ++cascade) {
+        if (!shadowMap.needsUpdate(cascade)) {
+            continue;
+        }
+        if (!drawn) {
+            // The map must not be bound for reading while it is drawn
+            glActiveTexture(GL_TEXTURE0 + kShadowMapUnit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            drawn = true;
+        }
+
+        const Frustum &cascadeFrustum = shadowMap.getFrustum(cascade);
+        const QMatrix4x4 &lightTransform = shadowMap.getTransform(cascade);
+        shadowItems.clear();
+        CullStats stats;
+        sceneBvh.query(cascadeFrustum, shadowItems, stats);
+        shadowItemVisible.fill(false, sceneBounds.size());
+        for (int item : shadowItems) {
+            shadowItemVisible[item] = true;
+        }
+        shadowItemVisible[sunItem] = false;
+
+        shadowMap.beginCascade(cascade);
+
+        // Only the shape of the terrain matters here. Without a program the
+        // ship still casts its shadow.
+        QOpenGLShaderProgram *casterProgram = bindTerrainDepthProgram(lightTransform);
+        if (casterProgram != nullptr && infiniteFlight) {
+            terrainStreamer.draw(*casterProgram, meshTransform, cascadeFrustum, distanceFlown,
+                                 std::numeric_limits<float>::infinity());
+        } else if (casterProgram != nullptr) {
+            drawTerrainChunks(shadowItemVisible);
+        }
+
+        // The texture cuts holes in the ship, and so in its shadow
+        if (shadowItemVisible[spaceShipItem]) {
+            objectProgram.bind();
+            objectProgram.setUniformValue("modelViewTransform", spaceShipTransform);
+            objectProgram.setUniformValue("projectionTransform", lightTransform);
+            objectProgram.setUniformValue("samplerUniform", 0);
+            objectProgram.setUniformValue("lit", false);
+            glBindTexture(GL_TEXTURE_2D, shipTexture);
+            glBindVertexArray(spaceShipVAO);
+            glDrawElements(GL_TRIANGLES, spaceShipSize, GL_UNSIGNED_INT, nullptr);
+        }
+
+        shadowMap.endCascade(cascade);
+        shadowCascadesDrawn++;
+    }
+
+}
+
+/**
+ * @brief MainView::terrainOffset How far the terrain has scrolled, in view
+ * space. The fixed terrain jumps back when it wraps around.
+ */
+QVector3D MainView::terrainOffset() const {
+    float distance = infiniteFlight ? static_cast<float>(distanceFlown) : flying;
+    return meshTransform.mapVector(QVector3D(0, 0, distance));
+}
+
+/**
+ * @brief MainView::drawTerrainChunks Draws chunks of the fixed terrain,
+ * merging the ones that are adjacent in memory.
+ * @param visible Whether each scene item is to be drawn; only the chunks
+ * are looked at.
+ */
+void MainView::drawTerrainChunks(const QVector<bool> &visible) {
+    terrainDrawFirsts.clear();
+    terrainDrawCounts.clear();
+    for (int i = 0; i < terrainChunks.getChunkCount(); ++i) {
+        if (!visible[i]) continue;
+        const TerrainChunk &chunk = terrainChunks.getChunk(i);
+        if (!terrainDrawFirsts.isEmpty() &&
+            terrainDrawFirsts.last() + terrainDrawCounts.last() == chunk.firstVertex) {
+            terrainDrawCounts.last() += chunk.vertexCount;
+        } else {
+            terrainDrawFirsts.append(chunk.firstVertex);
+            terrainDrawCounts.append(chunk.vertexCount);
+        }
+    }
+
+    glBindVertexArray(meshVAO);
+    glMultiDrawArrays(GL_TRIANGLES, terrainDrawFirsts.constData(), terrainDrawCounts.constData(),
+                      terrainDrawFirsts.size());
+}
+
+/**
+ * @brief MainView::logStats Logs the frame time and culling results once per
+ * second.
+ */
+void MainView::logStats() {
+    framesSinceStats++;
+    qint64 elapsed = statsTimer.elapsed();
+    if (elapsed < 1000) return;
+
+    LOG_INFO(":: Frames: %1 in %2 ms, %3 ms per frame, %4 wireframe",
+             framesSinceStats, elapsed, static_cast<double>(elapsed) / framesSinceStats,
+             shaderWireframe ? "shader" : "line");
+    LOG_INFO(":: Culling: %1 visible, %2 culled, %3 fogged, far plane at %4",
+             cameraView.cullStats.visible, cameraView.cullStats.culled, cameraView.cullStats.fogged, farPlane);
+    if (infiniteFlight) {
+        const CullStats &tileStats = terrainStreamer.getCullStats();
+        const TileCache &cache = terrainStreamer.getCache();
+        LOG_INFO(":: Terrain tiles: %1 visible, %2 culled, %3 fogged, %4 cached in %5 KiB, %6 pending",
+                 tileStats.visible, tileStats.culled, tileStats.fogged,
+                 cache.getTileCount(), cache.getMemoryUsage() / 1024, cache.getPendingCount());
+    }
+    LOG_INFO(":: Particles: %1, update %2 ms on the GPU", particles.getParticleCount(), lastParticleTime);
+    LOG_INFO(":: Shadows: %1, %2 of %3 cascades drawn per frame", shadowsEnabled ? "on" : "off",
+             static_cast<double>(shadowCascadesDrawn) / framesSinceStats, CascadedShadowMap::kCascadeCount);
+    shadowCascadesDrawn = 0;
+    const RenderGraphStats &graphStats = renderGraph.getStats();
+    LOG_INFO(":: Render graph: %1 passes, %2 culled, %3 transient textures in %4 textures of %5 MB",
+             graphStats.passes, graphStats.culledPasses, graphStats.transientTextures, graphStats.textures,
+             graphStats.textureBytes / (1024.0 * 1024.0));
+    const QualityLevel &level = qualityGovernor.getLevel();
+    LOG_INFO(":: Quality: %1, GPU %2 ms, %3 ms average, target %4 ms, step %5 of %6",
+             adaptiveQuality ? "adaptive" : "fixed", lastGpuTime, qualityGovernor.getAverageFrameTime(),
+             qualityGovernor.getTargetFrameTime(), qualityGovernor.getStep(), QualityGovernor::getStepCount() - 1);
+    LOG_INFO(":: Quality settings: render scale %1, terrain detail %2, view distance %3",
+             adaptiveQuality ? level.renderScale : 1.0F, terrainStreamer.getDetail(), viewDistance());
+    framesSinceStats = 0;
+    statsTimer.restart();
 }
 
 void MainView::hsvToRgb(float h, float s, float v, float &r, float &g, float &b) {
@@ -426,10 +1250,10 @@ void MainView::resizeGL(int newWidth, int newHeight) {
  * matrix taking into consideration the current aspect ratio.
  */
 void MainView::updateProjectionTransform() {
-    float aspectRatio =
-        static_cast<float>(width()) / static_cast<float>(height());
+    // A minimized window has no height
+    aspectRatio = static_cast<float>(width()) / static_cast<float>(qMax(1, height()));
     projectionTransform.setToIdentity();
-    projectionTransform.perspective(60.0F, aspectRatio, 0.2F, 600.0F);
+    projectionTransform.perspective(60.0F, aspectRatio, 0.2F, farPlane);
 }
 
 /**
@@ -442,6 +1266,7 @@ void MainView::updateModelTransforms() {
     meshTransform.rotate(QQuaternion::fromEulerAngles(rotation));
     meshTransform.scale(scale);
     normalMatrix = meshTransform.normalMatrix();
+    shadowMap.invalidate();
     update();
 }
 
@@ -454,9 +1279,12 @@ void MainView::updateBackgroundTransform() {
 }
 
 void MainView::updateSpaceShipTransform() {
+    // Draw the ship between the last two simulation steps
+    float alpha = simulationLag / kSimulationStep;
     spaceShipTransform.setToIdentity();
-    spaceShipTransform.translate(shipTranslation.x(), shipTranslation.y(), shipTranslation.z());
-    spaceShipTransform.rotate(QQuaternion::fromEulerAngles(shipRotation));
+    spaceShipTransform.translate(spaceShip.getPosition(alpha));
+    spaceShipTransform.rotate(QQuaternion::fromEulerAngles(spaceShip.getBank(alpha)) *
+                              QQuaternion::fromEulerAngles(shipRotation));
     spaceShipTransform.scale(shipScale);
     update();
 }
@@ -464,16 +1292,292 @@ void MainView::updateSpaceShipTransform() {
 void MainView::setBottomHue(float value)
 {
     bottomHue = value;
+    updateGradientPalette();
 }
 
 void MainView::setMiddleHue(float value)
 {
     middleHue = value;
+    updateGradientPalette();
 }
 
 void MainView::setTopHue(float value)
 {
     topHue = value;
+    updateGradientPalette();
+}
+
+/**
+ * @brief MainView::updateGradientPalette Rebuilds the palette of the gradient
+ * shading mode from the hue sliders.
+ */
+void MainView::updateGradientPalette()
+{
+    float r, g, b;
+    hsvToRgb(bottomHue, 1.0f, 1.0f, r, g, b);
+    QVector3D bottom(r, g, b);
+    hsvToRgb(middleHue, 1.0f, 1.0f, r, g, b);
+    QVector3D middle(r, g, b);
+    hsvToRgb(topHue, 1.0f, 1.0f, r, g, b);
+    gradientPalette.setPalette(Palette::heightGradient(bottom, middle, QVector3D(r, g, b)));
+}
+
+/**
+ * @brief MainView::setLayerPalette Sets the palette of the layered shading
+ * mode. Any number of stops is allowed.
+ * @param palette The new palette.
+ */
+void MainView::setLayerPalette(const Palette &palette)
+{
+    layerPalette.setPalette(palette);
+}
+
+/**
+ * @brief MainView::setInfiniteFlight Switches between the fixed terrain mesh,
+ * which wraps around after a while, and the streamed infinite terrain.
+ * @param enabled Whether to fly over the infinite terrain.
+ */
+void MainView::setInfiniteFlight(bool enabled)
+{
+    infiniteFlight = enabled;
+    distanceFlown = flying;
+    shadowMap.invalidate();
+}
+
+/**
+ * @brief MainView::loadDem Makes the infinite terrain follow a digital
+ * elevation model instead of the noise. The first time, the heightmap is
+ * converted into a tile cache next to it, which can take a while for large
+ * files, so the import runs on a worker thread and the terrain switches
+ * over once it is done. Emits demLoaded() when done.
+ * @param filename The heightmap, see DemImporter::import().
+ * @param options Settings for RAW heightmaps.
+ * @param level The finest level of the tile cache to fly over, each level
+ * halving the resolution. Tiles further away use coarser levels.
+ */
+void MainView::loadDem(const QString &filename, const DemImportOptions &options,
+                       int level)
+{
+    demLoader.start([this, filename, options, level]() {
+        QString cacheName = filename + ".tiles";
+        QSharedPointer<DemCache> dem;
+        if (DemImporter::isUpToDate(filename, cacheName) ||
+            DemImporter::import(filename, cacheName, options)) {
+            dem.reset(new DemCache);
+            if (!dem->open(cacheName)) {
+                dem.reset();
+            }
+        }
+
+        // The streamer belongs to the GUI thread
+        QMetaObject::invokeMethod(this, [this, dem, level]() {
+            if (!dem.isNull()) {
+                terrainStreamer.setHeightSource(dem, level);
+            }
+            emit demLoaded(!dem.isNull());
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief MainView::setShaderWireframe Switches between the wireframe drawn in
+ * the fragment shader and the one drawn with glPolygonMode(GL_LINE).
+ * @param enabled Whether to draw the wireframe in the fragment shader.
+ */
+void MainView::setShaderWireframe(bool enabled)
+{
+    shaderWireframe = enabled;
+}
+
+/**
+ * @brief MainView::setHiddenLineFill Fills the wireframe triangles with the
+ * background color, so lines behind the terrain are hidden.
+ * @param enabled Whether to hide the lines behind the terrain.
+ */
+void MainView::setHiddenLineFill(bool enabled)
+{
+    hiddenLineFill = enabled;
+}
+
+/**
+ * @brief MainView::setLineWidth Sets the width of the shader wireframe lines.
+ * @param width Line width in pixels.
+ */
+void MainView::setLineWidth(float width)
+{
+    lineWidth = width;
+}
+
+/**
+ * @brief MainView::setFogEnabled Turns the distance fog on or off. Without
+ * fog the terrain is drawn up to the regular far plane.
+ * @param enabled Whether to draw the fog.
+ */
+void MainView::setFogEnabled(bool enabled)
+{
+    fogEnabled = enabled;
+}
+
+/**
+ * @brief MainView::setFogDensity Sets how quickly the fog thickens with the
+ * distance, in the valleys.
+ * @param density Fog density per terrain unit.
+ */
+void MainView::setFogDensity(float density)
+{
+    fogDensity = density;
+}
+
+/**
+ * @brief MainView::setFogEnd Sets the distance at which the terrain is fully
+ * fogged. This also limits the far plane.
+ * @param distance Distance from the camera.
+ */
+void MainView::setFogEnd(float distance)
+{
+    fogEnd = distance;
+}
+
+/**
+ * @brief MainView::setAdaptiveQuality Lets the quality governor lower the
+ * resolution, view distance and terrain density to hold the target frame
+ * time. Turning it off returns to full quality.
+ * @param enabled Whether to adapt the quality.
+ */
+void MainView::setAdaptiveQuality(bool enabled)
+{
+    adaptiveQuality = enabled;
+    qualityGovernor.reset();
+    applyQualityLevel();
+}
+
+/**
+ * @brief MainView::setErosionEnabled Starts or pauses the erosion of the
+ * fixed terrain. Pausing keeps the terrain as far as it has been eroded.
+ * @param enabled Whether to erode.
+ */
+void MainView::setErosionEnabled(bool enabled)
+{
+    erosionEnabled = enabled;
+    if (!enabled) {
+        // Keep what the last slice did, and bring the queries up to date
+        finishErosionSlice();
+    }
+    erosionQueryClock.invalidate();
+}
+
+/**
+ * @brief MainView::setShadowsEnabled Turns the shadows of the ship and the
+ * terrain on or off. Off, nothing is drawn into the shadow map.
+ * @param enabled Whether to draw shadows.
+ */
+void MainView::setShadowsEnabled(bool enabled)
+{
+    shadowsEnabled = enabled;
+    shadowMap.invalidate();
+}
+
+/**
+ * @brief MainView::setMinimapEnabled Shows or hides the view from above the
+ * ship in the corner of the window.
+ * @param enabled Whether to draw the minimap.
+ */
+void MainView::setMinimapEnabled(bool enabled)
+{
+    minimapEnabled = enabled;
+}
+
+/**
+ * @brief MainView::setBloomEnabled Turns the glow around bright parts of the
+ * image on or off.
+ * @param enabled Whether to draw the bloom.
+ */
+void MainView::setBloomEnabled(bool enabled)
+{
+    postProcessing.setBloomEnabled(enabled);
+}
+
+/**
+ * @brief MainView::setFxaaEnabled Turns the anti-aliasing of the final image
+ * on or off.
+ * @param enabled Whether to smooth the edges with FXAA.
+ */
+void MainView::setFxaaEnabled(bool enabled)
+{
+    postProcessing.setFxaaEnabled(enabled);
+}
+
+/**
+ * @brief MainView::startParticleBenchmark Replaces the exhaust with a given
+ * number of particles and logs the average GPU time of the next updates, then
+ * emits particleBenchmarkFinished(). The timings still in flight belong to
+ * the old count, and the first update only sets up the new particles, so
+ * they are dropped.
+ * @param particleCount Number of particles.
+ */
+void MainView::startParticleBenchmark(int particleCount)
+{
+    particles.setEmitters(exhaustEmitters(particleCount));
+    particleBenchmarkSkips = particles.getPendingUpdateTimes() + 1;
+    particleBenchmarkSteps = kParticleBenchmarkSteps;
+    particleBenchmarkTime = 0.0;
+}
+
+/**
+ * @brief MainView::setTargetFrameTime Sets the GPU frame time the quality
+ * governor aims for.
+ * @param milliseconds Target time per frame.
+ */
+void MainView::setTargetFrameTime(float milliseconds)
+{
+    qualityGovernor.setTargetFrameTime(milliseconds);
+}
+
+/**
+ * @brief MainView::applyQualityLevel Applies the settings of the quality
+ * level that only change when the level does. The render scale and view
+ * distance are read every frame.
+ */
+void MainView::applyQualityLevel()
+{
+    const QualityLevel &level = qualityGovernor.getLevel();
+    terrainStreamer.setDetail(adaptiveQuality ? level.terrainDetail : 0);
+    shadowMap.invalidate();
+    LOG_INFO(":: Quality step %1 at %2 ms: render scale %3, terrain detail %4, view distance %5",
+             qualityGovernor.getStep(), qualityGovernor.getAverageFrameTime(), level.renderScale,
+             level.terrainDetail, level.viewDistance);
+}
+
+/**
+ * @brief MainView::viewDistance The distance up to which the terrain is
+ * drawn: the fog end, shortened by the quality governor.
+ */
+float MainView::viewDistance() const
+{
+    return adaptiveQuality ? fogEnd * qualityGovernor.getLevel().viewDistance : fogEnd;
+}
+
+/**
+ * @brief MainView::startCapture Starts recording the rendered frames.
+ * @param settings Where and how much to record.
+ * @return False if the recording could not be started.
+ */
+bool MainView::startCapture(const CaptureSettings &settings)
+{
+    return frameCapture.start(settings);
+}
+
+/**
+ * @brief MainView::stopCapture Stops recording, after writing out the frames
+ * that are still in flight.
+ */
+void MainView::stopCapture()
+{
+    if (!frameCapture.isActive()) return;
+    makeCurrent();
+    frameCapture.stop();
+    doneCurrent();
+    emit captureFinished();
 }
 
 /**
@@ -484,6 +1588,7 @@ void MainView::destroyModelBuffers() {
     glDeleteBuffers(1, &sunPositionVBO);
     glDeleteBuffers(1, &spaceShipPositionVBO);
     glDeleteBuffers(1, &meshNormalVBO);
+    glDeleteBuffers(1, &meshBarycentricVBO);
     glDeleteBuffers(1, &sunNormalVBO);
     glDeleteBuffers(1, &spaceShipNormalVBO);
     glDeleteVertexArrays(1, &meshVAO);
@@ -492,7 +1597,21 @@ void MainView::destroyModelBuffers() {
     glDeleteBuffers(1, &meshTextureCoordVBO);
     glDeleteBuffers(1, &sunTextureCoordVBO);
     glDeleteBuffers(1, &spaceShipTextureCoordVBO);
+    glDeleteBuffers(1, &sunIndexBuffer);
+    glDeleteBuffers(1, &spaceShipIndexBuffer);
     glDeleteTextures(1, &textureName);
+    glDeleteTextures(1, &shipTexture);
+    terrainHeights.destroy();
+    terrainStreamer.destroy();
+    terrainShaders.clear();
+    frameCapture.destroy();
+    renderGraph.destroy();
+    postProcessing.destroy();
+    gpuTimer.destroy();
+    particles.destroy();
+    shadowMap.destroy();
+    gradientPalette.destroy();
+    layerPalette.destroy();
 }
 
 /**
@@ -504,13 +1623,13 @@ void MainView::destroyModelBuffers() {
 void MainView::setRotation(int rotateX, int rotateY, int rotateZ) {
     shipRotation = {static_cast<float>(rotateX), static_cast<float>(rotateY),
                 static_cast<float>(rotateZ)};
-    qDebug() << QVector3D(rotateX, rotateY, rotateZ);
+    LOG_DEBUG("Ship rotation %1, %2, %3", rotateX, rotateY, rotateZ);
     updateSpaceShipTransform();
 }
 
 void MainView::setTranslation(QVector3D position) {
-    shipTranslation = position;
-    qDebug() << position;
+    spaceShip.reset(position);
+    LOG_DEBUG("Ship moved to %1, %2, %3", position.x(), position.y(), position.z());
     updateSpaceShipTransform();
 }
 
@@ -526,14 +1645,15 @@ void MainView::setScale(float newScale) {
 
 void MainView::setShadingMode(ShadingMode shading) {
     shadingMode = shading;
-    qDebug() << "Changed shading to" << shading;
+    LOG_DEBUG("Changed shading to %1", shading);
 }
 
 /**
- * @brief MainView::onMessageLogged OpenGL logging function, do not change.
+ * @brief MainView::onMessageLogged OpenGL logging function. Only connected
+ * to a debug context, see Log::glDebugEnabled().
  *
  * @param Message The message to be logged.
  */
 void MainView::onMessageLogged(QOpenGLDebugMessage Message) {
-    qDebug() << " → Log:" << Message;
+    LOG_WARNING(" → GL message %1: %2", Message.id(), Message.message());
 }
@@ -1,6 +1,7 @@
 #ifndef MAINVIEW_H
 #define MAINVIEW_H
 
+#include <QElapsedTimer>
 #include <QKeyEvent>
 #include <QMatrix4x4>
 #include <QMouseEvent>
@@ -8,11 +9,31 @@
 #include <QOpenGLFunctions_3_3_Core>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLWidget>
+#include <QThreadPool>
 #include <QTimer>
 #include <QVector3D>
 
+#include "bvh.h"
+#include "cascadedshadowmap.h"
+#include "demimporter.h"
+#include "erosion.h"
+#include "framecapture.h"
+#include "gputimer.h"
+#include "heightfield.h"
 #include "model.h"
+#include "palette.h"
+#include "particlesystem.h"
+#include "postprocessing.h"
+#include "qualitygovernor.h"
+#include "rendergraph.h"
+#include "scrollingheightmap.h"
+#include "shadercache.h"
 #include "shadingmode.h"
+#include "spaceship.h"
+#include "terrainchunks.h"
+#include "terraineditor.h"
+#include "terrainstreamer.h"
+#include "viewculler.h"
 
 /**
  * @brief The MainView class is resonsible for the actual content of the main
@@ -33,7 +54,31 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
   void setBottomHue(float value);
   void setMiddleHue(float value);
   void setTopHue(float value);
+  void setInfiniteFlight(bool enabled);
+  void loadDem(const QString &filename, const DemImportOptions &options,
+               int level);
+  void setShaderWireframe(bool enabled);
+  void setHiddenLineFill(bool enabled);
+  void setLineWidth(float width);
+  void setFogEnabled(bool enabled);
+  void setFogDensity(float density);
+  void setFogEnd(float distance);
+  void setLayerPalette(const Palette &palette);
+  bool startCapture(const CaptureSettings &settings);
+  void setAdaptiveQuality(bool enabled);
+  void setTargetFrameTime(float milliseconds);
+  void setErosionEnabled(bool enabled);
+  void setShadowsEnabled(bool enabled);
+  void setBloomEnabled(bool enabled);
+  void setFxaaEnabled(bool enabled);
+  void setMinimapEnabled(bool enabled);
+  void startParticleBenchmark(int particleCount);
+  void stopCapture();
 
+ signals:
+  void captureFinished();
+  void particleBenchmarkFinished();
+  void demLoaded(bool loaded);
 
  protected:
   void initializeGL() override;
@@ -44,6 +89,7 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
   // Functions for keyboard input events
   void keyPressEvent(QKeyEvent *ev) override;
   void keyReleaseEvent(QKeyEvent *ev) override;
+  void focusOutEvent(QFocusEvent *ev) override;
 
   // Function for mouse input events
   void mouseDoubleClickEvent(QMouseEvent *ev) override;
@@ -55,6 +101,7 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
  private slots:
   void onMessageLogged(QOpenGLDebugMessage Message);
   void updateRotation();
+  void onTimeout();
 
  private:
   void createShaderProgram();
@@ -62,33 +109,62 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
   void loadSun();
   void loadShip();
   void hsvToRgb(float h, float s, float v, float &r, float &g, float &b);
+  void updateGradientPalette();
+  unsigned terrainFeatures() const;
+  float viewDistance() const;
+  void applyQualityLevel();
+  void updateErosion();
+  void finishErosionSlice();
+  void invalidateTerrainShadows(const QRect &region);
+  void updateParticles();
+  QVector3D terrainOffset() const;
+  void renderShadows();
+  void sculptTerrain(float seconds);
+  void applyTerrainEdit(const QRect &region);
   void destroyModelBuffers();
   void updateProjectionTransform();
   void updateModelTransforms();
   void updateBackgroundTransform();
   void updateSpaceShipTransform();
+  void updateVisibility();
+  void updateMinimapView();
+  void drawTerrain(const RenderView &view, unsigned features, const QVector3D &lineColor, bool depthPrepass);
+  void drawTerrainDepth();
+  QOpenGLShaderProgram *bindTerrainDepthProgram(const QMatrix4x4 &projection);
+  void drawTerrainChunks(const QVector<bool> &visible);
+  void drawObjects(const RenderView &view, bool mainCamera);
+  void logStats();
+  bool pickTerrain(const QPointF &position, QVector3D &hit) const;
+  QVector3D toHeightfield(const QVector3D &point) const;
+  QVector3D fromHeightfield(const QVector3D &point) const;
   QVector<quint8> imageToBytes(const QImage &image);
 
   QOpenGLDebugLogger debugLogger;
   QTimer timer;  // timer used for animation
 
-  QOpenGLShaderProgram shaderPrograms[5];
+  QOpenGLShaderProgram objectProgram;
+  ShaderCache terrainShaders{":/shaders/vertshader_terrain.glsl", ":/shaders/fragshader_terrain.glsl",
+                             {":/shaders/shadows.glsl"}};
 
   // Mesh values
   GLuint meshVAO, sunVAO, spaceShipVAO;
-  GLuint meshPositionVBO, meshNormalVBO, sunPositionVBO, sunNormalVBO, spaceShipPositionVBO, spaceShipNormalVBO;
-  GLuint meshSize, sunSize, spaceShipSize;
+  GLuint meshPositionVBO, meshNormalVBO, meshBarycentricVBO, sunPositionVBO, sunNormalVBO, spaceShipPositionVBO, spaceShipNormalVBO;
+  GLuint sunIndexBuffer, spaceShipIndexBuffer;
+  GLuint meshSize, sunSize, spaceShipSize;  // vertices of the mesh, indices of the others
+  LodChain spaceShipLods;  // the levels only, the indices are on the GPU
   QMatrix4x4 meshTransform, sunTransform, spaceShipTransform;
 
   // Transforms
   float scale = 1.0F, shipScale = 2.0F;
   QVector3D rotation, shipRotation = {0, 349, 28};
-  QVector3D translation, shipTranslation;
+  QVector3D translation;
   QMatrix4x4 projectionTransform;
+  float aspectRatio = 1.0F;  // of the widget, the scaled targets share it
+  float farPlane = 600.0F;
 
   //stuff we added
   QMatrix3x3 normalMatrix;
-  ShadingMode shadingMode;
+  ShadingMode shadingMode = NORMAL;
   QVector3D lightPosition;
   QVector3D lightColor;
   GLuint textureName, shipTexture;
@@ -97,8 +173,119 @@ class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
 
   QVector<QVector3D> terrainVertices;
   QImage noise;
+  Heightfield heightfield;  // CPU copy of the heights for queries
+  ScrollingHeightMap terrainHeights;  // the rows of the noise near the terrain
+
+  // Erosion of the fixed terrain, a slice of time per tick on a worker
+  // thread, which owns the erosion while the slice runs. Only what a slice
+  // changed is passed on: to the GPU rows and the editor after every slice,
+  // to the CPU copies for queries and culling less often.
+  static constexpr qint64 kErosionSlice = 4000000;  // nanoseconds
+  static constexpr qint64 kErosionQueryInterval = 250;  // milliseconds
+  TerrainErosion erosion;
+  bool erosionEnabled = false;
+  QThreadPool erosionWorker;
+  bool erosionRunning = false;  // a slice was started and not yet applied
+  QRect erosionRegion;          // changed by the last slice
+  QRect erosionQueryRegion;     // changed since the queries were updated
+  QElapsedTimer erosionQueryClock;
+
+  // Sculpting of the fixed terrain with the mouse. The brush works on the
+  // point under the cursor every tick, as the terrain scrolls beneath it.
+  TerrainEditor terrainEditor;
+  QPointF sculptPosition;
+
+  // Fixed step simulation of the flight
+  static constexpr float kSimulationStep = 1.0F / 60.0F;
+  static constexpr float kMaxSimulationLag = 0.25F;
+  static constexpr float kFlightSpeed = 12.0F;  // rows of terrain per second
+  SpaceShip spaceShip;
+  QElapsedTimer simulationClock;
+  float simulationLag = 0.0F;
   float flying = 0;
   float hue = 0, bottomHue = 0, middleHue= 0, topHue = 0;
+
+  // Height colors of the gradient and layered shading modes
+  PaletteTexture gradientPalette, layerPalette;
+
+  // Culling, for every view on its own thread
+  TerrainChunks terrainChunks;
+  Bvh sceneBvh;
+  Aabb sunBounds, spaceShipBounds;
+  int sunItem = 0, spaceShipItem = 0;
+  QVector<Aabb> sceneBounds;
+  ViewCuller viewCuller;
+  RenderView cameraView;  // the main camera, at the origin of view space
+  QVector<GLint> terrainDrawFirsts;
+  QVector<GLsizei> terrainDrawCounts;
+  QElapsedTimer statsTimer;
+  int framesSinceStats = 0;
+
+  // Infinite flight
+  TerrainStreamer terrainStreamer;
+  bool infiniteFlight = false;
+  double distanceFlown = 0;
+  QThreadPool demLoader;  // imports elevation models off the GUI thread
+
+  // Wireframe
+  bool shaderWireframe = true;
+  bool hiddenLineFill = false;
+  float lineWidth = 1.5F;
+
+  // Fog, in the clear color. Terrain beyond fogEnd is not drawn.
+  bool fogEnabled = true;
+  float fogDensity = 0.012F;
+  float fogHeightFalloff = 0.04F;
+  float fogEnd = 180.0F;
+
+  // Exhaust of the ship, simulated and drawn on the GPU. The GPU time of the
+  // updates is measured apart from the frame.
+  static constexpr int kExhaustParticles = 32768;
+  static constexpr int kParticleBenchmarkSteps = 600;
+  ParticleSystem particles;
+  QElapsedTimer particleClock;
+  float lastParticleTime = 0.0F;
+  int particleBenchmarkSteps = 0;  // updates left to measure
+  int particleBenchmarkSkips = 0;  // earlier updates still to be read back
+  double particleBenchmarkTime = 0.0;
+
+  // Shadows of the ship and the terrain, on the ship and on the terrain in
+  // Phong shading. The point light is taken as a directional light from the
+  // middle of the shadowed range. The cascades that the ship does not shadow
+  // keep their map while the terrain scrolls.
+  static constexpr int kShadowMapResolution = 2048;
+  static constexpr int kShadowMapUnit = 3;
+  static constexpr float kShadowDistance = 120.0F;
+  CascadedShadowMap shadowMap;
+  bool shadowsEnabled = true;
+  QMatrix4x4 shadowShipTransform;  // where the cascades last saw the ship
+  QVector3D shadowTerrainOffset;
+  QVector<int> shadowItems;
+  QVector<bool> shadowItemVisible;
+  int shadowCascadesDrawn = 0;
+
+  // Recording, one simulation step per captured frame
+  FrameCapture frameCapture;
+
+  // The passes of a frame, declared anew in every paintGL()
+  RenderGraph renderGraph;
+
+  // Top-down view of the terrain around the ship, in the corner of the window
+  static constexpr float kMinimapExtent = 60.0F;  // half the width shown
+  static constexpr float kMinimapHeight = 200.0F;
+  static constexpr int kMinimapMargin = 16;  // pixels
+  RenderView minimapView;
+  bool minimapEnabled = false;
+
+  // Bloom, tonemapping and FXAA of the HDR scene
+  static constexpr float kSkyEmission = 3.0F;
+  PostProcessing postProcessing;
+
+  // Dynamic resolution and quality
+  GpuTimer gpuTimer;
+  QualityGovernor qualityGovernor;
+  bool adaptiveQuality = true;
+  float lastGpuTime = 0.0F;
 };
 
 #endif  // MAINVIEW_H
@@ -1,5 +1,11 @@
 #include "mainwindow.h"
 
+#include <QCommandLineParser>
+#include <QSignalBlocker>
+#include <QSurfaceFormat>
+#include <algorithm>
+
+#include "palette.h"
 #include "shadingmode.h"
 #include "ui_mainwindow.h"
 
@@ -10,6 +16,108 @@
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), ui(new Ui::MainWindow) {
   ui->setupUi(this);
+
+  // The capture can also stop by itself, e.g. after a set number of frames
+  connect(ui->mainView, &MainView::captureFinished, this, [this]() {
+    QSignalBlocker blocker(ui->RecordButton);
+    ui->RecordButton->setChecked(false);
+  });
+
+  loadTerrainFromArguments();
+  startCaptureFromArguments();
+  startBenchmarkFromArguments();
+}
+
+/**
+ * @brief MainWindow::loadTerrainFromArguments Flies over the elevation model
+ * given on the command line, if any, as soon as it has been imported:
+ *   --dem FILE          heightmap, see DemImporter::import()
+ *   --dem-size WxH      size of a RAW heightmap, square by default
+ *   --dem-level N       finest level of the tile cache, 0 by default
+ */
+void MainWindow::loadTerrainFromArguments() {
+  QCommandLineParser parser;
+  QCommandLineOption demOption("dem", "Heightmap to fly over.", "FILE");
+  QCommandLineOption sizeOption("dem-size", "Size of a RAW heightmap.", "WxH");
+  QCommandLineOption levelOption("dem-level", "Tile cache level.", "N");
+  parser.addOptions({demOption, sizeOption, levelOption});
+  parser.parse(QCoreApplication::arguments());
+  if (!parser.isSet(demOption)) return;
+
+  DemImportOptions options;
+  QStringList size = parser.value(sizeOption).split('x');
+  if (size.size() == 2) {
+    options.width = size[0].toInt();
+    options.height = size[1].toInt();
+  }
+  int level = parser.value(levelOption).toInt();
+  connect(ui->mainView, &MainView::demLoaded, this, [this](bool loaded) {
+    if (loaded) ui->InfiniteFlight->setChecked(true);
+  });
+  ui->mainView->loadDem(parser.value(demOption), options, level);
+}
+
+/**
+ * @brief MainWindow::startCaptureFromArguments Starts the recording asked for
+ * on the command line, which renders the frames as fast as possible and
+ * quits when done:
+ *   --capture-frames N  number of frames to record
+ *   --capture-dir DIR   directory of the PNG sequence
+ *   --capture-pipe CMD  encoder to pipe raw frames to instead, see
+ *                       CaptureSettings::pipeCommand
+ *   --infinite          fly over the infinite terrain
+ */
+void MainWindow::startCaptureFromArguments() {
+  QCommandLineParser parser;
+  QCommandLineOption framesOption("capture-frames", "Frames to record.", "N");
+  QCommandLineOption directoryOption("capture-dir", "PNG sequence directory.", "DIR");
+  QCommandLineOption pipeOption("capture-pipe", "Encoder command.", "CMD");
+  QCommandLineOption infiniteOption("infinite", "Fly over the infinite terrain.");
+  parser.addOptions({framesOption, directoryOption, pipeOption, infiniteOption});
+  parser.parse(QCoreApplication::arguments());
+  if (!parser.isSet(framesOption)) return;
+
+  CaptureSettings settings;
+  settings.frameCount = std::max(1, parser.value(framesOption).toInt());
+  if (parser.isSet(directoryOption)) settings.directory = parser.value(directoryOption);
+  settings.pipeCommand = parser.value(pipeOption);
+  if (parser.isSet(infiniteOption)) ui->InfiniteFlight->setChecked(true);
+
+  // Render as fast as possible instead of at the display rate
+  QSurfaceFormat format = ui->mainView->format();
+  format.setSwapInterval(0);
+  ui->mainView->setFormat(format);
+
+  connect(ui->mainView, &MainView::captureFinished, qApp, &QCoreApplication::quit,
+          Qt::QueuedConnection);
+  if (!ui->mainView->startCapture(settings)) {
+    QMetaObject::invokeMethod(qApp, &QCoreApplication::quit, Qt::QueuedConnection);
+  }
+}
+
+/**
+ * @brief MainWindow::startBenchmarkFromArguments Runs the particle stress
+ * test asked for on the command line, rendering as fast as possible, and
+ * quits when it is done:
+ *   --particle-benchmark N  number of particles, a million by default
+ */
+void MainWindow::startBenchmarkFromArguments() {
+  QCommandLineParser parser;
+  QCommandLineOption particlesOption("particle-benchmark", "Particles to simulate.", "N");
+  parser.addOption(particlesOption);
+  parser.parse(QCoreApplication::arguments());
+  if (!parser.isSet(particlesOption)) return;
+
+  int particleCount = parser.value(particlesOption).toInt();
+  if (particleCount <= 0) particleCount = 1000000;
+
+  QSurfaceFormat format = ui->mainView->format();
+  format.setSwapInterval(0);
+  ui->mainView->setFormat(format);
+
+  connect(ui->mainView, &MainView::particleBenchmarkFinished, qApp, &QCoreApplication::quit,
+          Qt::QueuedConnection);
+  ui->mainView->startParticleBenchmark(particleCount);
 }
 
 /**
@@ -135,3 +243,101 @@ void MainWindow::on_TopHue_valueChanged(int value)
     ui->mainView->update();
 }
 
+
+void MainWindow::on_InfiniteFlight_toggled(bool checked)
+{
+    ui->mainView->setInfiniteFlight(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_Erosion_toggled(bool checked)
+{
+    ui->mainView->setErosionEnabled(checked);
+}
+
+void MainWindow::on_Shadows_toggled(bool checked)
+{
+    ui->mainView->setShadowsEnabled(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_Bloom_toggled(bool checked)
+{
+    ui->mainView->setBloomEnabled(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_Fxaa_toggled(bool checked)
+{
+    ui->mainView->setFxaaEnabled(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_Minimap_toggled(bool checked)
+{
+    ui->mainView->setMinimapEnabled(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_ShaderWireframe_toggled(bool checked)
+{
+    ui->mainView->setShaderWireframe(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_HiddenLines_toggled(bool checked)
+{
+    ui->mainView->setHiddenLineFill(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_LineWidth_valueChanged(double value)
+{
+    ui->mainView->setLineWidth(static_cast<float>(value));
+    ui->mainView->update();
+}
+
+void MainWindow::on_Fog_toggled(bool checked)
+{
+    ui->mainView->setFogEnabled(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_FogDensity_valueChanged(double value)
+{
+    ui->mainView->setFogDensity(static_cast<float>(value));
+    ui->mainView->update();
+}
+
+void MainWindow::on_FogEnd_valueChanged(double value)
+{
+    ui->mainView->setFogEnd(static_cast<float>(value));
+    ui->mainView->update();
+}
+
+void MainWindow::on_LayerPalette_currentIndexChanged(int index)
+{
+    ui->mainView->setLayerPalette(index == 0 ? Palette::rainbowLayers() : Palette::landscape());
+    ui->mainView->update();
+}
+
+void MainWindow::on_RecordButton_toggled(bool checked)
+{
+    if (!checked) {
+        ui->mainView->stopCapture();
+    } else if (!ui->mainView->startCapture(CaptureSettings())) {
+        QSignalBlocker blocker(ui->RecordButton);
+        ui->RecordButton->setChecked(false);
+    }
+}
+
+void MainWindow::on_AdaptiveQuality_toggled(bool checked)
+{
+    ui->mainView->setAdaptiveQuality(checked);
+    ui->mainView->update();
+}
+
+void MainWindow::on_TargetFrameTime_valueChanged(double value)
+{
+    ui->mainView->setTargetFrameTime(static_cast<float>(value));
+}
@@ -19,6 +19,9 @@ class MainWindow : public QMainWindow {
 
   explicit MainWindow(QWidget *parent = nullptr);
   void renderToFile();
+  void startCaptureFromArguments();
+  void startBenchmarkFromArguments();
+  void loadTerrainFromArguments();
   ~MainWindow() override;
 
  private slots:
@@ -34,6 +37,22 @@ class MainWindow : public QMainWindow {
   void on_BottomHue_valueChanged(int value);
   void on_MiddleHue_valueChanged(int value);
   void on_TopHue_valueChanged(int value);
+  void on_InfiniteFlight_toggled(bool checked);
+  void on_Erosion_toggled(bool checked);
+  void on_Shadows_toggled(bool checked);
+  void on_Bloom_toggled(bool checked);
+  void on_Fxaa_toggled(bool checked);
+  void on_Minimap_toggled(bool checked);
+  void on_ShaderWireframe_toggled(bool checked);
+  void on_HiddenLines_toggled(bool checked);
+  void on_LineWidth_valueChanged(double value);
+  void on_Fog_toggled(bool checked);
+  void on_LayerPalette_currentIndexChanged(int index);
+  void on_FogDensity_valueChanged(double value);
+  void on_FogEnd_valueChanged(double value);
+  void on_RecordButton_toggled(bool checked);
+  void on_AdaptiveQuality_toggled(bool checked);
+  void on_TargetFrameTime_valueChanged(double value);
 };
 
 #endif  // MAINWINDOW_H
@@ -0,0 +1,40 @@
+#include "mesharena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @brief MeshArena::release Frees all arrays at once.
+ */
+void MeshArena::release() {
+  blocks.clear();
+  next = nullptr;
+  remaining = 0;
+  bytesAllocated = 0;
+}
+
+/**
+ * @brief MeshArena::allocateBytes Takes memory from the current block, or
+ * starts a new one. Requests larger than a block get a block of their own.
+ * @param size Number of bytes.
+ * @param alignment Required alignment, a power of two.
+ * @return The memory.
+ */
+void *MeshArena::allocateBytes(qsizetype size, qsizetype alignment) {
+  qsizetype padding =
+      (alignment - reinterpret_cast<std::uintptr_t>(next) % alignment) %
+      alignment;
+  if (next == nullptr || padding + size > remaining) {
+    // new[] returns memory aligned for any fundamental type
+    qsizetype newSize = std::max(blockSize, size);
+    blocks.emplace_back(new char[newSize]);
+    next = blocks.back().get();
+    remaining = newSize;
+    padding = 0;
+  }
+  void *result = next + padding;
+  next += padding + size;
+  remaining -= padding + size;
+  bytesAllocated += size;
+  return result;
+}
@@ -0,0 +1,80 @@
+#ifndef MESHARENA_H
+#define MESHARENA_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A read-only view of an array owned by someone else, such as a
+ * MeshArena. Only valid as long as the owner keeps the array.
+ */
+template <typename T>
+class MeshSpan {
+ public:
+  MeshSpan() = default;
+  MeshSpan(const T *data, qsizetype size) : pointer(data), count(size) {}
+
+  const T *data() const { return pointer; }
+  qsizetype size() const { return count; }
+  bool isEmpty() const { return count == 0; }
+  qsizetype byteSize() const { return count * qsizetype(sizeof(T)); }
+
+  const T &operator[](qsizetype i) const { return pointer[i]; }
+  const T *begin() const { return pointer; }
+  const T *end() const { return pointer + count; }
+
+  QVector<T> toVector() const { return QVector<T>(begin(), end()); }
+
+ private:
+  const T *pointer = nullptr;
+  qsizetype count = 0;
+};
+
+/**
+ * @brief Bump allocator for mesh data that is built once and freed all at
+ * once, typically right after it has been uploaded to the GPU. Arrays are
+ * carved out of large blocks without any per-array bookkeeping, and
+ * release() returns every block in one go. Only for trivially destructible
+ * types, as nothing is destroyed individually.
+ */
+class MeshArena {
+ public:
+  explicit MeshArena(qsizetype blockSize = 1 << 20) : blockSize(blockSize) {}
+  MeshArena(const MeshArena &) = delete;
+  MeshArena &operator=(const MeshArena &) = delete;
+
+  /**
+   * @brief MeshArena::allocate Allocates a value-initialized array.
+   * @param count Number of elements.
+   * @return The array, valid until release().
+   */
+  template <typename T>
+  T *allocate(qsizetype count) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "MeshArena does not run destructors");
+    if (count == 0) return nullptr;
+    T *array = static_cast<T *>(allocateBytes(count * sizeof(T), alignof(T)));
+    for (qsizetype i = 0; i != count; ++i) {
+      new (array + i) T();
+    }
+    return array;
+  }
+
+  void release();
+  qsizetype getBytesAllocated() const { return bytesAllocated; }
+
+ private:
+  void *allocateBytes(qsizetype size, qsizetype alignment);
+
+  const qsizetype blockSize;
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char *next = nullptr;
+  qsizetype remaining = 0;
+  qsizetype bytesAllocated = 0;
+};
+
+#endif  // MESHARENA_H
@@ -0,0 +1,341 @@
+#include "meshoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Tuning constants of the Forsyth vertex cache optimizer. These are the values
+// from the original article, which work well for caches of 16-32 entries.
+constexpr int kCacheSize = 32;
+constexpr float kCacheDecayPower = 1.5F;
+constexpr float kLastTriangleScore = 0.75F;
+constexpr float kValenceBoostScale = 2.0F;
+constexpr float kValenceBoostPower = 0.5F;
+
+/**
+ * @brief vertexScore Scores a vertex based on its position in the simulated
+ * LRU cache and the number of triangles that still have to use it.
+ * @param cachePosition Position in the cache, -1 when not in the cache.
+ * @param liveTriangles Number of not yet emitted triangles using the vertex.
+ * @return The score, higher means the vertex should be used sooner.
+ */
+float vertexScore(int cachePosition, int liveTriangles) {
+  if (liveTriangles == 0) return -1.0F;
+
+  float score = 0.0F;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // The last triangle has been emitted with these vertices. Give them a
+      // fixed score so that the strip does not simply go back and forth.
+      score = kLastTriangleScore;
+    } else {
+      float scaler = 1.0F / (kCacheSize - 3);
+      score = 1.0F - (cachePosition - 3) * scaler;
+      score = std::pow(score, kCacheDecayPower);
+    }
+  }
+
+  // Boost vertices with few triangles left, so that they get finished and
+  // do not have to be loaded again later on.
+  score += kValenceBoostScale *
+           std::pow(static_cast<float>(liveTriangles), -kValenceBoostPower);
+  return score;
+}
+
+}  // namespace
+
+/**
+ * @brief MeshOptimizer::analyzeVertexCache Runs the index buffer through a
+ * simulated FIFO vertex cache and counts the misses.
+ * @param indices Triangle list indices.
+ * @param vertexCount Number of vertices referenced by the indices.
+ * @param cacheSize Number of entries in the simulated cache.
+ * @return The ACMR and ATVR of the index buffer.
+ */
+VertexCacheStatistics MeshOptimizer::analyzeVertexCache(
+    const QVector<unsigned> &indices, int vertexCount, int cacheSize) {
+  VertexCacheStatistics result;
+  if (indices.isEmpty() || vertexCount == 0) return result;
+
+  // Each vertex remembers the "time" it was put in the cache. A vertex is
+  // still in the FIFO when fewer than cacheSize misses happened since then.
+  QVector<unsigned> timestamps(vertexCount, 0);
+  QVector<bool> used(vertexCount, false);
+  unsigned time = cacheSize + 1;
+  int misses = 0;
+  int uniqueVertices = 0;
+
+  for (unsigned index : indices) {
+    if (!used[index]) {
+      used[index] = true;
+      ++uniqueVertices;
+    }
+    if (time - timestamps[index] > static_cast<unsigned>(cacheSize)) {
+      timestamps[index] = time++;
+      ++misses;
+    }
+  }
+
+  result.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  result.atvr = static_cast<float>(misses) / uniqueVertices;
+  return result;
+}
+
+/**
+ * @brief MeshOptimizer::optimizeVertexCache Reorders the triangles so that
+ * recently transformed vertices are reused as much as possible. This is Tom
+ * Forsyth's "Linear-Speed Vertex Cache Optimisation" algorithm.
+ * @param indices Triangle list indices, reordered in place.
+ * @param vertexCount Number of vertices referenced by the indices.
+ */
+void MeshOptimizer::optimizeVertexCache(QVector<unsigned> &indices,
+                                        int vertexCount) {
+  int triangleCount = indices.size() / 3;
+  if (triangleCount == 0) return;
+
+  // Build the vertex to triangle adjacency in one flat array.
+  QVector<int> liveTriangles(vertexCount, 0);
+  for (unsigned index : indices) {
+    ++liveTriangles[index];
+  }
+
+  QVector<int> adjacencyOffsets(vertexCount + 1, 0);
+  for (int v = 0; v != vertexCount; ++v) {
+    adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+  }
+
+  QVector<int> adjacency(indices.size());
+  QVector<int> fill = adjacencyOffsets;
+  for (int t = 0; t != triangleCount; ++t) {
+    for (int k = 0; k != 3; ++k) {
+      adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+  }
+
+  QVector<int> cachePosition(vertexCount, -1);
+  QVector<float> vertexScores(vertexCount);
+  for (int v = 0; v != vertexCount; ++v) {
+    vertexScores[v] = vertexScore(-1, liveTriangles[v]);
+  }
+
+  QVector<float> triangleScores(triangleCount);
+  QVector<bool> emitted(triangleCount, false);
+  for (int t = 0; t != triangleCount; ++t) {
+    triangleScores[t] = vertexScores[indices[t * 3]] +
+                        vertexScores[indices[t * 3 + 1]] +
+                        vertexScores[indices[t * 3 + 2]];
+  }
+
+  // The cache holds three extra entries, since a new triangle pushes up to
+  // three vertices in before the oldest ones are evicted.
+  QVector<int> cache;
+  cache.reserve(kCacheSize + 3);
+  QVector<int> newCache;
+  newCache.reserve(kCacheSize + 3);
+
+  QVector<unsigned> result;
+  result.reserve(indices.size());
+
+  int inputCursor = 0;
+  int bestTriangle = -1;
+
+  while (result.size() != indices.size()) {
+    if (bestTriangle == -1) {
+      // Nothing adjacent to the cache, continue with the next triangle in
+      // the input order.
+      while (emitted[inputCursor]) {
+        ++inputCursor;
+      }
+      bestTriangle = inputCursor;
+    }
+
+    emitted[bestTriangle] = true;
+
+    newCache.clear();
+    for (int k = 0; k != 3; ++k) {
+      unsigned v = indices[bestTriangle * 3 + k];
+      result.append(v);
+      newCache.append(v);
+
+      // Remove the triangle from the adjacency of the vertex.
+      int begin = adjacencyOffsets[v];
+      int end = begin + liveTriangles[v];
+      for (int i = begin; i != end; ++i) {
+        if (adjacency[i] == bestTriangle) {
+          std::swap(adjacency[i], adjacency[end - 1]);
+          break;
+        }
+      }
+      --liveTriangles[v];
+    }
+
+    for (int v : cache) {
+      if (!newCache.contains(v)) {
+        newCache.append(v);
+      }
+    }
+    // Evicted vertices score as out of the cache again, and so do their
+    // triangles, or they would keep the bonus of their old position.
+    for (int i = kCacheSize; i < newCache.size(); ++i) {
+      int v = newCache[i];
+      cachePosition[v] = -1;
+      float delta = vertexScore(-1, liveTriangles[v]) - vertexScores[v];
+      vertexScores[v] += delta;
+
+      int begin = adjacencyOffsets[v];
+      int end = begin + liveTriangles[v];
+      for (int j = begin; j != end; ++j) {
+        triangleScores[adjacency[j]] += delta;
+      }
+    }
+    if (newCache.size() > kCacheSize) {
+      newCache.resize(kCacheSize);
+    }
+    std::swap(cache, newCache);
+
+    // Update the scores of the vertices in the cache and their triangles, and
+    // look for the next triangle among them.
+    float bestScore = -1.0F;
+    bestTriangle = -1;
+    for (int i = 0; i != cache.size(); ++i) {
+      int v = cache[i];
+      cachePosition[v] = i;
+      float oldScore = vertexScores[v];
+      vertexScores[v] = vertexScore(i, liveTriangles[v]);
+      float delta = vertexScores[v] - oldScore;
+
+      int begin = adjacencyOffsets[v];
+      int end = begin + liveTriangles[v];
+      for (int j = begin; j != end; ++j) {
+        int t = adjacency[j];
+        triangleScores[t] += delta;
+        if (triangleScores[t] > bestScore) {
+          bestScore = triangleScores[t];
+          bestTriangle = t;
+        }
+      }
+    }
+  }
+
+  indices = result;
+}
+
+/**
+ * @brief MeshOptimizer::optimizeOverdraw Reorders clusters of triangles so
+ * that triangles facing outwards are drawn first, which lets the depth test
+ * reject more hidden fragments. Should be run after optimizeVertexCache(). The
+ * clusters are split at points where the cache restarts, so the vertex cache
+ * efficiency is mostly kept.
+ * @param indices Triangle list indices, reordered in place.
+ * @param positions Positions of the vertices.
+ * @param threshold The maximum allowed ACMR increase (1.05 means 5% worse).
+ * If the new order is worse than that, the indices are left untouched.
+ */
+void MeshOptimizer::optimizeOverdraw(QVector<unsigned> &indices,
+                                     const QVector<QVector3D> &positions,
+                                     float threshold) {
+  int triangleCount = indices.size() / 3;
+  if (triangleCount == 0) return;
+
+  int vertexCount = positions.size();
+  VertexCacheStatistics before = analyzeVertexCache(indices, vertexCount);
+
+  // Split into clusters at every triangle for which all three vertices miss
+  // the simulated cache, there is nothing to lose there.
+  QVector<int> clusterStarts;
+  QVector<unsigned> timestamps(vertexCount, 0);
+  unsigned time = kAnalyzeCacheSize + 1;
+  for (int t = 0; t != triangleCount; ++t) {
+    int misses = 0;
+    for (int k = 0; k != 3; ++k) {
+      unsigned v = indices[t * 3 + k];
+      if (time - timestamps[v] > kAnalyzeCacheSize) {
+        timestamps[v] = time++;
+        ++misses;
+      }
+    }
+    if (t == 0 || misses == 3) {
+      clusterStarts.append(t);
+    }
+  }
+  clusterStarts.append(triangleCount);
+
+  int clusterCount = clusterStarts.size() - 1;
+  if (clusterCount < 2) return;
+
+  QVector3D meshCentroid;
+  for (const QVector3D &p : positions) {
+    meshCentroid += p;
+  }
+  meshCentroid /= vertexCount;
+
+  // Sort the clusters on how much they face away from the mesh center.
+  QVector<float> sortKeys(clusterCount);
+  for (int c = 0; c != clusterCount; ++c) {
+    QVector3D centroid;
+    QVector3D normal;
+    float area = 0.0F;
+    for (int t = clusterStarts[c]; t != clusterStarts[c + 1]; ++t) {
+      QVector3D p0 = positions[indices[t * 3]];
+      QVector3D p1 = positions[indices[t * 3 + 1]];
+      QVector3D p2 = positions[indices[t * 3 + 2]];
+      QVector3D n = QVector3D::crossProduct(p1 - p0, p2 - p0);
+      float triangleArea = n.length();
+      centroid += (p0 + p1 + p2) * (triangleArea / 3.0F);
+      normal += n;
+      area += triangleArea;
+    }
+    if (area > 0.0F) {
+      centroid /= area;
+    }
+    sortKeys[c] = QVector3D::dotProduct(centroid - meshCentroid,
+                                        normal.normalized());
+  }
+
+  QVector<int> order(clusterCount);
+  for (int c = 0; c != clusterCount; ++c) {
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&sortKeys](int a, int b) {
+    return sortKeys[a] > sortKeys[b];
+  });
+
+  QVector<unsigned> result;
+  result.reserve(indices.size());
+  for (int c : order) {
+    for (int i = clusterStarts[c] * 3; i != clusterStarts[c + 1] * 3; ++i) {
+      result.append(indices[i]);
+    }
+  }
+
+  VertexCacheStatistics after = analyzeVertexCache(result, vertexCount);
+  if (after.acmr <= before.acmr * threshold) {
+    indices = result;
+  }
+}
+
+/**
+ * @brief MeshOptimizer::optimizeVertexFetchRemap Renumbers the vertices in the
+ * order in which they are first used by the index buffer, so that vertex
+ * fetches walk through memory mostly linearly. Unused vertices are dropped.
+ * @param indices Triangle list indices, rewritten to use the new numbering.
+ * @param vertexCount Number of vertices referenced by the indices.
+ * @param remap Output, maps each old vertex index to its new index.
+ * @return The number of vertices after remapping.
+ */
+int MeshOptimizer::optimizeVertexFetchRemap(QVector<unsigned> &indices,
+                                            int vertexCount,
+                                            QVector<unsigned> &remap) {
+  remap.fill(~0U, vertexCount);
+  unsigned next = 0;
+
+  for (unsigned &index : indices) {
+    if (remap[index] == ~0U) {
+      remap[index] = next++;
+    }
+    index = remap[index];
+  }
+
+  return static_cast<int>(next);
+}
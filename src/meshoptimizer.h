@@ -0,0 +1,69 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <QVector3D>
+#include <QVector>
+
+/**
+ * @brief Statistics of an index buffer when it is run through a simulated
+ * post-transform vertex cache.
+ *
+ * ACMR is the average number of cache misses per triangle (0.5 is the best
+ * possible value for a regular grid, 3.0 means no reuse at all). ATVR is the
+ * ratio between cache misses and unique vertices (1.0 is optimal).
+ */
+struct VertexCacheStatistics {
+  float acmr = 0.0F;
+  float atvr = 0.0F;
+};
+
+/**
+ * @brief Index and vertex reordering passes for indexed triangle meshes.
+ *
+ * All functions work on a triangle list (three indices per triangle) that
+ * references vertexCount vertices. They only change the order of the data,
+ * never the rendered result.
+ */
+namespace MeshOptimizer {
+
+// Size of the FIFO cache used for the statistics. Most GPUs behave roughly
+// like this, even if their actual cache works differently.
+constexpr int kAnalyzeCacheSize = 16;
+
+VertexCacheStatistics analyzeVertexCache(const QVector<unsigned> &indices,
+                                         int vertexCount,
+                                         int cacheSize = kAnalyzeCacheSize);
+
+void optimizeVertexCache(QVector<unsigned> &indices, int vertexCount);
+
+void optimizeOverdraw(QVector<unsigned> &indices,
+                      const QVector<QVector3D> &positions,
+                      float threshold = 1.05F);
+
+int optimizeVertexFetchRemap(QVector<unsigned> &indices, int vertexCount,
+                             QVector<unsigned> &remap);
+
+/**
+ * @brief MeshOptimizer::remapVertices Applies a remap table produced by
+ * optimizeVertexFetchRemap() to one vertex attribute array.
+ * @param data The attribute array, indexed by the old vertex index.
+ * @param remap Old to new vertex index, ~0U for unused vertices.
+ * @param uniqueCount The number of vertices after remapping.
+ */
+template <typename T>
+void remapVertices(QVector<T> &data, const QVector<unsigned> &remap,
+                   int uniqueCount) {
+  if (data.isEmpty()) return;
+
+  QVector<T> result(uniqueCount);
+  for (int i = 0; i != remap.size(); ++i) {
+    if (remap[i] != ~0U) {
+      result[remap[i]] = data[i];
+    }
+  }
+  data = result;
+}
+
+}  // namespace MeshOptimizer
+
+#endif  // MESHOPTIMIZER_H
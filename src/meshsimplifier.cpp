@@ -0,0 +1,564 @@
+#include "meshsimplifier.h"
+
+#include <QHash>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "meshoptimizer.h"
+
+namespace {
+
+// Border edges are held in place by planes perpendicular to the surface.
+// They get a higher weight than the surface itself so that the outline of
+// open meshes survives simplification.
+constexpr double kBorderWeight = 10.0;
+
+// Minimal cosine between the normal of a triangle before and after a collapse.
+// Collapses that rotate a triangle further than this are rejected.
+constexpr float kMinNormalCosine = 0.25F;
+
+// Minimal cosine between the border edges on either side of a border vertex.
+// Where the border turns further than this, the vertex is a corner of the
+// outline and stays in place.
+constexpr float kMinBorderCosine = 0.7F;
+
+enum VertexKind { FREE, BORDER, LOCKED };
+
+/**
+ * @brief A symmetric 4x4 error quadric (Garland & Heckbert). It stores the
+ * sum of squared distances to a set of planes, weighted by triangle area.
+ */
+struct Quadric {
+  double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  double w = 0;
+
+  static Quadric fromPlane(const QVector3D &n, double d, double weight) {
+    Quadric q;
+    q.a00 = weight * n.x() * n.x();
+    q.a11 = weight * n.y() * n.y();
+    q.a22 = weight * n.z() * n.z();
+    q.a01 = weight * n.x() * n.y();
+    q.a02 = weight * n.x() * n.z();
+    q.a12 = weight * n.y() * n.z();
+    q.b0 = weight * n.x() * d;
+    q.b1 = weight * n.y() * d;
+    q.b2 = weight * n.z() * d;
+    q.c = weight * d * d;
+    q.w = weight;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    a00 += o.a00;
+    a11 += o.a11;
+    a22 += o.a22;
+    a01 += o.a01;
+    a02 += o.a02;
+    a12 += o.a12;
+    b0 += o.b0;
+    b1 += o.b1;
+    b2 += o.b2;
+    c += o.c;
+    w += o.w;
+    return *this;
+  }
+
+  // Returns the weighted mean squared distance of p to the planes.
+  double error(const QVector3D &p) const {
+    double x = p.x(), y = p.y(), z = p.z();
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+               2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::fabs(e) / std::max(w, 1e-12);
+  }
+};
+
+struct Collapse {
+  unsigned from;
+  unsigned to;
+  double cost;
+};
+
+quint64 edgeKey(unsigned a, unsigned b) {
+  if (a > b) std::swap(a, b);
+  return (static_cast<quint64>(a) << 32) | b;
+}
+
+/**
+ * @brief buildCanonical Maps every vertex to the first vertex with the exact
+ * same position. Vertices that were split by alignData() because of different
+ * normals or texture coordinates end up in the same group.
+ * @param positions The vertex positions.
+ * @param groupSizes Output, number of vertices sharing each canonical vertex.
+ * @return The canonical vertex for each vertex.
+ */
+QVector<unsigned> buildCanonical(const QVector<QVector3D> &positions,
+                                 QVector<int> &groupSizes) {
+  int vertexCount = positions.size();
+  QVector<unsigned> order(vertexCount);
+  for (int i = 0; i != vertexCount; ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&positions](unsigned a, unsigned b) {
+    const QVector3D &pa = positions[a];
+    const QVector3D &pb = positions[b];
+    if (pa.x() != pb.x()) return pa.x() < pb.x();
+    if (pa.y() != pb.y()) return pa.y() < pb.y();
+    if (pa.z() != pb.z()) return pa.z() < pb.z();
+    return a < b;
+  });
+
+  QVector<unsigned> canonical(vertexCount);
+  groupSizes.fill(0, vertexCount);
+  for (int i = 0; i != vertexCount; ++i) {
+    if (i > 0 && positions[order[i]] == positions[order[i - 1]]) {
+      canonical[order[i]] = canonical[order[i - 1]];
+    } else {
+      canonical[order[i]] = order[i];
+    }
+    ++groupSizes[canonical[order[i]]];
+  }
+  return canonical;
+}
+
+QVector3D triangleNormal(const QVector3D &p0, const QVector3D &p1,
+                         const QVector3D &p2) {
+  return QVector3D::crossProduct(p1 - p0, p2 - p0);
+}
+
+/**
+ * @brief triangleDistance Returns the distance from a point to the closest
+ * point of a triangle, after Ericson, Real-Time Collision Detection 5.1.5.
+ */
+float triangleDistance(const QVector3D &p, const QVector3D &a,
+                       const QVector3D &b, const QVector3D &c) {
+  QVector3D ab = b - a;
+  QVector3D ac = c - a;
+  QVector3D ap = p - a;
+  float d1 = QVector3D::dotProduct(ab, ap);
+  float d2 = QVector3D::dotProduct(ac, ap);
+  if (d1 <= 0.0F && d2 <= 0.0F) return ap.length();
+
+  QVector3D bp = p - b;
+  float d3 = QVector3D::dotProduct(ab, bp);
+  float d4 = QVector3D::dotProduct(ac, bp);
+  if (d3 >= 0.0F && d4 <= d3) return bp.length();
+
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0F && d1 >= 0.0F && d3 <= 0.0F) {
+    return (ap - ab * (d1 / (d1 - d3))).length();
+  }
+
+  QVector3D cp = p - c;
+  float d5 = QVector3D::dotProduct(ab, cp);
+  float d6 = QVector3D::dotProduct(ac, cp);
+  if (d6 >= 0.0F && d5 <= d6) return cp.length();
+
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0F && d2 >= 0.0F && d6 <= 0.0F) {
+    return (ap - ac * (d2 / (d2 - d6))).length();
+  }
+
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0F && d4 - d3 >= 0.0F && d5 - d6 >= 0.0F) {
+    float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    return (bp - (c - b) * w).length();
+  }
+
+  float denominator = 1.0F / (va + vb + vc);
+  return (ap - ab * (vb * denominator) - ac * (vc * denominator)).length();
+}
+
+/**
+ * @brief measureError Finds the largest distance from a removed vertex to
+ * the triangles of the simplified mesh within two edges of the position it
+ * was collapsed to. The whole mesh is at least as close, so this bounds the
+ * distance of the removed vertices to the result.
+ * @param result Indices of the simplified mesh.
+ * @param positions Positions of the vertices.
+ * @param canonical The canonical vertex of every vertex, see buildCanonical().
+ * @param collapsedTo The vertex of the result that every vertex ended up in.
+ * @return The largest distance, in object space units.
+ */
+float measureError(const QVector<unsigned> &result,
+                   const QVector<QVector3D> &positions,
+                   const QVector<unsigned> &canonical,
+                   const QVector<unsigned> &collapsedTo) {
+  int vertexCount = positions.size();
+  QVector<int> offsets(vertexCount + 1, 0);
+  for (unsigned index : result) {
+    ++offsets[canonical[index] + 1];
+  }
+  for (int v = 0; v != vertexCount; ++v) {
+    offsets[v + 1] += offsets[v];
+  }
+  QVector<int> fans(result.size());
+  QVector<int> fill = offsets;
+  for (int i = 0; i != result.size(); ++i) {
+    fans[fill[canonical[result[i]]]++] = i / 3;
+  }
+
+  float error = 0.0F;
+  for (int v = 0; v != vertexCount; ++v) {
+    if (collapsedTo[v] == static_cast<unsigned>(v)) continue;
+    unsigned c = canonical[collapsedTo[v]];
+    float distance = std::numeric_limits<float>::infinity();
+    // The triangles around the vertex and around its neighbours
+    for (int j = offsets[c]; j != offsets[c + 1]; ++j) {
+      for (int k = 0; k != 3; ++k) {
+        unsigned n = canonical[result[fans[j] * 3 + k]];
+        for (int l = offsets[n]; l != offsets[n + 1]; ++l) {
+          int t = fans[l] * 3;
+          distance = std::min(
+              distance, triangleDistance(positions[v], positions[result[t]],
+                                         positions[result[t + 1]],
+                                         positions[result[t + 2]]));
+        }
+      }
+    }
+    // Every triangle around the vertex is gone, only the whole mesh is left
+    for (int t = 0; offsets[c] == offsets[c + 1] && t != result.size();
+         t += 3) {
+      distance = std::min(
+          distance, triangleDistance(positions[v], positions[result[t]],
+                                     positions[result[t + 1]],
+                                     positions[result[t + 2]]));
+    }
+    if (!result.isEmpty()) error = std::max(error, distance);
+  }
+  return error;
+}
+
+}  // namespace
+
+/**
+ * @brief MeshSimplifier::simplify Reduces the number of triangles in a mesh by
+ * repeatedly collapsing the edge that introduces the smallest quadric error.
+ * Vertices on attribute seams and corners of the outline are kept in place,
+ * other vertices on the border of open meshes only move along the border.
+ * @param indices Triangle list indices.
+ * @param positions Positions of the vertices.
+ * @param targetIndexCount The desired number of indices. The result can have
+ * more indices if no further collapse is possible.
+ * @param resultError Optional output, the largest distance from a removed
+ * vertex to the simplified mesh in object space units. It is measured
+ * against the triangles around the vertex the removed one ended up in, so
+ * it bounds the distance of every vertex of the input to the result.
+ * @return The indices of the simplified mesh.
+ */
+QVector<unsigned> MeshSimplifier::simplify(const QVector<unsigned> &indices,
+                                           const QVector<QVector3D> &positions,
+                                           int targetIndexCount,
+                                           float *resultError) {
+  int vertexCount = positions.size();
+  QVector<unsigned> result = indices;
+
+  // Where every vertex has been collapsed to so far.
+  QVector<unsigned> collapsedTo(vertexCount);
+  for (int v = 0; v != vertexCount; ++v) {
+    collapsedTo[v] = v;
+  }
+
+  QVector<int> groupSizes;
+  QVector<unsigned> canonical = buildCanonical(positions, groupSizes);
+
+  // Classify the vertices by counting the edges that only have one triangle.
+  QHash<quint64, int> edgeCounts;
+  for (int i = 0; i < result.size(); i += 3) {
+    for (int k = 0; k != 3; ++k) {
+      unsigned a = canonical[result[i + k]];
+      unsigned b = canonical[result[i + (k + 1) % 3]];
+      ++edgeCounts[edgeKey(a, b)];
+    }
+  }
+
+  QVector<int> borderEdges(vertexCount, 0);
+  // Directions of the border edges that end and start at each vertex
+  QVector<QVector3D> borderIn(vertexCount);
+  QVector<QVector3D> borderOut(vertexCount);
+  QVector<Quadric> quadrics(vertexCount);
+  for (int i = 0; i < result.size(); i += 3) {
+    const QVector3D &p0 = positions[result[i]];
+    const QVector3D &p1 = positions[result[i + 1]];
+    const QVector3D &p2 = positions[result[i + 2]];
+    QVector3D normal = triangleNormal(p0, p1, p2);
+    float area = normal.length();
+    if (area == 0.0F) continue;
+    normal /= area;
+
+    Quadric face = Quadric::fromPlane(
+        normal, -QVector3D::dotProduct(normal, p0), area);
+    for (int k = 0; k != 3; ++k) {
+      quadrics[canonical[result[i + k]]] += face;
+    }
+
+    for (int k = 0; k != 3; ++k) {
+      unsigned a = canonical[result[i + k]];
+      unsigned b = canonical[result[i + (k + 1) % 3]];
+      if (edgeCounts.value(edgeKey(a, b)) != 1) continue;
+
+      ++borderEdges[a];
+      ++borderEdges[b];
+      QVector3D edge = positions[b] - positions[a];
+      borderOut[a] = edge.normalized();
+      borderIn[b] = edge.normalized();
+      QVector3D planeNormal =
+          QVector3D::crossProduct(edge, normal).normalized();
+      Quadric border = Quadric::fromPlane(
+          planeNormal, -QVector3D::dotProduct(planeNormal, positions[a]),
+          edge.lengthSquared() * kBorderWeight);
+      quadrics[a] += border;
+      quadrics[b] += border;
+    }
+  }
+
+  QVector<VertexKind> kinds(vertexCount, FREE);
+  for (int v = 0; v != vertexCount; ++v) {
+    unsigned c = canonical[v];
+    if (groupSizes[c] > 1) {
+      kinds[v] = LOCKED;  // attribute seam
+    } else if (borderEdges[c] == 2 &&
+               QVector3D::dotProduct(borderIn[c], borderOut[c]) >=
+                   kMinBorderCosine) {
+      kinds[v] = BORDER;  // one border edge on either side
+    } else if (borderEdges[c] != 0) {
+      kinds[v] = LOCKED;  // corner or non-manifold vertex
+    }
+  }
+
+  QVector<int> adjacencyOffsets;
+  QVector<int> adjacency;
+  QVector<Collapse> candidates;
+  QVector<bool> touched;
+
+  while (result.size() > targetIndexCount) {
+    int triangleCount = result.size() / 3;
+
+    // Vertex to triangle adjacency of the current mesh.
+    adjacencyOffsets.fill(0, vertexCount + 1);
+    for (unsigned index : result) {
+      ++adjacencyOffsets[index + 1];
+    }
+    for (int v = 0; v != vertexCount; ++v) {
+      adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    adjacency.resize(result.size());
+    QVector<int> fill = adjacencyOffsets;
+    for (int t = 0; t != triangleCount; ++t) {
+      for (int k = 0; k != 3; ++k) {
+        adjacency[fill[result[t * 3 + k]]++] = t;
+      }
+    }
+
+    // Gather the allowed collapses of every edge, in both directions.
+    candidates.clear();
+    for (int t = 0; t != triangleCount; ++t) {
+      for (int k = 0; k != 3; ++k) {
+        unsigned a = result[t * 3 + k];
+        unsigned b = result[t * 3 + (k + 1) % 3];
+        unsigned ca = canonical[a];
+        unsigned cb = canonical[b];
+        if (ca == cb) continue;
+
+        bool borderEdge = edgeCounts.value(edgeKey(ca, cb)) == 1;
+        for (int direction = 0; direction != 2; ++direction) {
+          unsigned from = direction == 0 ? a : b;
+          unsigned to = direction == 0 ? b : a;
+          if (kinds[from] == LOCKED) continue;
+          if (kinds[from] == BORDER &&
+              (kinds[to] == FREE || !borderEdge)) {
+            continue;
+          }
+
+          Quadric q = quadrics[canonical[from]];
+          q += quadrics[canonical[to]];
+          candidates.append({from, to, q.error(positions[to])});
+        }
+      }
+    }
+
+    if (candidates.isEmpty()) break;
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Collapse &x, const Collapse &y) {
+                return x.cost < y.cost;
+              });
+
+    // Every collapse removes about two triangles. Do at most half of the
+    // remaining work in one pass, so the costs stay reasonably up to date.
+    int trianglesToRemove = (result.size() - targetIndexCount) / 3;
+    int collapseGoal = std::max(1, trianglesToRemove / 2);
+
+    QVector<unsigned> remap(vertexCount);
+    for (int v = 0; v != vertexCount; ++v) {
+      remap[v] = v;
+    }
+    touched.fill(false, vertexCount);
+    int collapses = 0;
+
+    for (const Collapse &collapse : candidates) {
+      if (collapses >= collapseGoal) break;
+
+      unsigned cFrom = canonical[collapse.from];
+      unsigned cTo = canonical[collapse.to];
+      if (touched[cFrom] || touched[cTo]) continue;
+
+      // Reject collapses that flip or badly distort a remaining triangle.
+      bool valid = true;
+      const QVector3D &target = positions[collapse.to];
+      for (int j = adjacencyOffsets[collapse.from];
+           j != adjacencyOffsets[collapse.from + 1] && valid; ++j) {
+        int t = adjacency[j];
+        QVector3D before[3];
+        QVector3D after[3];
+        bool removed = false;
+        for (int k = 0; k != 3; ++k) {
+          unsigned v = result[t * 3 + k];
+          if (canonical[v] == cTo) removed = true;
+          before[k] = positions[v];
+          after[k] = v == collapse.from ? target : positions[v];
+          if (touched[canonical[v]]) valid = false;
+        }
+        if (removed) continue;
+
+        QVector3D n0 = triangleNormal(before[0], before[1], before[2]);
+        QVector3D n1 = triangleNormal(after[0], after[1], after[2]);
+        float limit = kMinNormalCosine * n0.length() * n1.length();
+        if (QVector3D::dotProduct(n0, n1) <= limit) valid = false;
+      }
+      if (!valid) continue;
+
+      // Lock the neighbourhood for the rest of this pass.
+      for (int j = adjacencyOffsets[collapse.from];
+           j != adjacencyOffsets[collapse.from + 1]; ++j) {
+        int t = adjacency[j];
+        for (int k = 0; k != 3; ++k) {
+          touched[canonical[result[t * 3 + k]]] = true;
+        }
+      }
+
+      remap[collapse.from] = collapse.to;
+      quadrics[cTo] += quadrics[cFrom];
+      ++collapses;
+    }
+
+    if (collapses == 0) break;
+
+    // Targets do not move in the pass they are collapsed onto.
+    for (unsigned &to : collapsedTo) {
+      to = remap[to];
+    }
+
+    // Apply the collapses and drop the triangles that became degenerate.
+    int write = 0;
+    for (int i = 0; i < result.size(); i += 3) {
+      unsigned a = remap[result[i]];
+      unsigned b = remap[result[i + 1]];
+      unsigned c = remap[result[i + 2]];
+      if (canonical[a] == canonical[b] || canonical[b] == canonical[c] ||
+          canonical[a] == canonical[c]) {
+        continue;
+      }
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+
+  if (resultError) {
+    *resultError = measureError(result, positions, canonical, collapsedTo);
+  }
+  return result;
+}
+
+/**
+ * @brief LodChain::LodChain Builds the levels of detail for a mesh. Every
+ * level is simplified from the previous one and reordered for the vertex
+ * cache. Building stops early when the mesh can not be simplified further,
+ * or when a level would have fewer than kMinTriangles triangles.
+ * @param indices Triangle list indices of the full detail mesh.
+ * @param positions Positions of the vertices.
+ * @param ratios The fraction of triangles to keep for each level, in
+ * decreasing order. The first level should normally use 1.0.
+ */
+LodChain::LodChain(const QVector<unsigned> &indices,
+                   const QVector<QVector3D> &positions,
+                   const QVector<float> &ratios) {
+  if (positions.isEmpty()) return;
+
+  QVector3D minimum = positions[0];
+  QVector3D maximum = positions[0];
+  for (const QVector3D &p : positions) {
+    minimum = QVector3D(std::min(minimum.x(), p.x()),
+                        std::min(minimum.y(), p.y()),
+                        std::min(minimum.z(), p.z()));
+    maximum = QVector3D(std::max(maximum.x(), p.x()),
+                        std::max(maximum.y(), p.y()),
+                        std::max(maximum.z(), p.z()));
+  }
+  QVector3D center = (minimum + maximum) * 0.5F;
+  for (const QVector3D &p : positions) {
+    boundingRadius = std::max(boundingRadius, (p - center).length());
+  }
+
+  QVector<unsigned> current = indices;
+  float error = 0.0F;
+
+  for (float ratio : ratios) {
+    int target = static_cast<int>(indices.size() / 3 * ratio) * 3;
+    if (target < current.size()) {
+      if (!levels.isEmpty() && target < kMinTriangles * 3) break;
+      float levelError = 0.0F;
+      QVector<unsigned> simplified =
+          MeshSimplifier::simplify(current, positions, target, &levelError);
+      if (!levels.isEmpty() && simplified.size() == current.size()) break;
+
+      current = simplified;
+      MeshOptimizer::optimizeVertexCache(current, positions.size());
+      // The levels are simplified from each other, so their errors add up.
+      error += levelError;
+    }
+
+    LodLevel level;
+    level.firstIndex = this->indices.size();
+    level.indexCount = current.size();
+    level.error = error;
+    levels.append(level);
+    this->indices.append(current);
+  }
+}
+
+/**
+ * @brief LodChain::selectLevel Picks the coarsest level whose error, projected
+ * onto the screen, stays below a pixel threshold.
+ * @param pixelsPerUnit Pixels that one unit of view space covers at the
+ * center of the object, see RenderView::pixelsPerUnit().
+ * @param scale Uniform scale of the object in the scene.
+ * @param pixelThreshold Largest allowed error in pixels.
+ * @return The index of the level to draw.
+ */
+int LodChain::selectLevel(float pixelsPerUnit, float scale,
+                          float pixelThreshold) const {
+  if (levels.isEmpty()) return 0;
+
+  // Objects smaller than a pixel or two get the coarsest level right away.
+  float projectedSize = 2.0F * boundingRadius * scale * pixelsPerUnit;
+  if (projectedSize < 2.0F * pixelThreshold) return levels.size() - 1;
+
+  for (int i = levels.size() - 1; i > 0; --i) {
+    if (levels[i].error * scale * pixelsPerUnit <= pixelThreshold) return i;
+  }
+  return 0;
+}
+
+/**
+ * @brief LodChain::releaseIndices Frees the index buffer once it is on the
+ * GPU. The levels stay, so that selectLevel() still works.
+ */
+void LodChain::releaseIndices() {
+  indices.clear();
+  indices.squeeze();
+}
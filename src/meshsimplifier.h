@@ -0,0 +1,60 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <QVector3D>
+#include <QVector>
+
+/**
+ * @brief Quadric error metric simplification of indexed triangle meshes.
+ *
+ * Edges are collapsed onto one of their existing vertices, so the simplified
+ * index buffers can be drawn with the vertex buffer of the original mesh.
+ */
+namespace MeshSimplifier {
+
+QVector<unsigned> simplify(const QVector<unsigned> &indices,
+                           const QVector<QVector3D> &positions,
+                           int targetIndexCount, float *resultError = nullptr);
+
+}  // namespace MeshSimplifier
+
+/**
+ * @brief A level of detail in a LodChain.
+ */
+struct LodLevel {
+  int firstIndex = 0;  // offset in the index buffer of the chain
+  int indexCount = 0;
+  float error = 0.0F;  // geometric error in object space units
+};
+
+/**
+ * @brief A chain of increasingly simplified versions of a mesh. All levels
+ * share the vertices of the original mesh and are stored back to back in a
+ * single index buffer, so that one element buffer serves every level.
+ * Levels below kMinTriangles are not built, since simplifying a mesh that
+ * small removes whole parts of its shape; such a mesh gets a single level.
+ */
+class LodChain {
+ public:
+  static constexpr int kMinTriangles = 64;
+
+  LodChain() = default;
+  LodChain(const QVector<unsigned> &indices,
+           const QVector<QVector3D> &positions,
+           const QVector<float> &ratios = {1.0F, 0.5F, 0.25F, 0.1F});
+
+  const QVector<unsigned> &getIndices() const { return indices; }
+  const QVector<LodLevel> &getLevels() const { return levels; }
+  float getBoundingRadius() const { return boundingRadius; }
+
+  int selectLevel(float pixelsPerUnit, float scale,
+                  float pixelThreshold = 1.0F) const;
+  void releaseIndices();
+
+ private:
+  QVector<unsigned> indices;
+  QVector<LodLevel> levels;
+  float boundingRadius = 0.0F;
+};
+
+#endif  // MESHSIMPLIFIER_H
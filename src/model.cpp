@@ -2,14 +2,54 @@
 
 #include <QDebug>
 #include <QFile>
+#include <QHash>
 #include <QTextStream>
-#include <tuple>
+#include <algorithm>
+
+#include "meshoptimizer.h"
+
+namespace {
+
+/**
+ * @brief The position, normal and texture coordinate indices of one corner
+ * of a face. Missing indices are ~0U.
+ */
+struct Corner {
+  unsigned position;
+  unsigned normal;
+  unsigned texcoord;
+
+  bool operator==(const Corner& other) const {
+    return position == other.position && normal == other.normal &&
+           texcoord == other.texcoord;
+  }
+};
+
+size_t qHash(const Corner& corner, size_t seed = 0) {
+  return qHashMulti(seed, corner.position, corner.normal, corner.texcoord);
+}
+
+}  // namespace
+
+/**
+ * @brief The contents of an .obj file, as long as the model is being built.
+ */
+struct Model::ObjData {
+  QVector<QVector3D> positions;
+  QVector<QVector3D> normals;
+  QVector<QVector2D> texcoords;
+  QVector<Corner> corners;  // three per triangle
+};
 
 /**
  * @brief Model::Model Constructs a new model from a Wavefront .obj file.
  * @param filename The filename. Should be a .obj file
+ * @param layout The layouts to build. Getters of the other layout return
+ * empty views.
+ * @param reorderForOverdraw Also reorder the triangles to reduce overdraw.
+ * Only useful for closed meshes that are drawn with glDrawElements().
  */
-Model::Model(const QString& filename) {
+Model::Model(const QString& filename, Layout layout, bool reorderForOverdraw) {
   qDebug() << ":: Loading model:" << filename;
   QFile file(filename);
   if (file.open(QIODevice::ReadOnly)) {
@@ -17,38 +57,48 @@ Model::Model(const QString& filename) {
 
     QString line;
     QStringList tokens;
+    ObjData obj;
 
     while (!in.atEnd()) {
       line = in.readLine();
       if (line.startsWith("#")) continue;  // skip comments
 
       tokens = line.split(" ", Qt::SkipEmptyParts);
+      if (tokens.isEmpty()) continue;
 
       // Switch depending on first element
       if (tokens[0] == "v") {
-        parseVertex(tokens);
+        parseVertex(tokens, obj);
       }
 
       if (tokens[0] == "vn") {
-        parseNormal(tokens);
+        parseNormal(tokens, obj);
       }
 
       if (tokens[0] == "vt") {
-        parseTexture(tokens);
+        parseTexture(tokens, obj);
       }
 
       if (tokens[0] == "f") {
-        parseFace(tokens);
+        parseFace(tokens, obj);
       }
     }
 
     file.close();
+    triangleCount = obj.corners.size() / 3;
 
     // create an array version of the data
-    unpackIndexes();
+    if (layout & UNPACKED) {
+      unpackIndexes(obj);
+    }
 
     // Allign all vertex indices with the right normal/texturecoord indices
-    alignData();
+    if (layout & INDEXED) {
+      alignData(obj, reorderForOverdraw);
+    }
+
+    qDebug() << ":: Model data uses" << arena.getBytesAllocated() / 1024
+             << "KiB";
   }
 }
 
@@ -56,57 +106,62 @@ Model::Model(const QString& filename) {
  * @brief Model::parseVertex Parses the coordinates of a vertex from the
  * .obj file.
  * @param tokens Tokens on the line in question.
+ * @param obj The data parsed so far.
  */
-void Model::parseVertex(QStringList tokens) {
+void Model::parseVertex(const QStringList& tokens, ObjData& obj) {
   float x = tokens[1].toFloat();
   float y = tokens[2].toFloat();
   float z = tokens[3].toFloat();
-  vertices_indexed.append(QVector3D(x, y, z));
+  obj.positions.append(QVector3D(x, y, z));
 }
 
 /**
  * @brief Model::parseNormal Parses the normals of a vertex from the
  * .obj file.
  * @param tokens Tokens on the line in question.
+ * @param obj The data parsed so far.
  */
-void Model::parseNormal(QStringList tokens) {
+void Model::parseNormal(const QStringList& tokens, ObjData& obj) {
   hNorms = true;
   float x = tokens[1].toFloat();
   float y = tokens[2].toFloat();
   float z = tokens[3].toFloat();
-  norm.append(QVector3D(x, y, z));
+  obj.normals.append(QVector3D(x, y, z));
 }
 
 /**
  * @brief Model::parseTexture Parses a texture coordinate from the .obj file.
  * @param tokens Tokens on the line in question.
+ * @param obj The data parsed so far.
  */
-void Model::parseTexture(QStringList tokens) {
+void Model::parseTexture(const QStringList& tokens, ObjData& obj) {
   hTexs = true;
   float u = tokens[1].toFloat();
   float v = tokens[2].toFloat();
-  tex.append(QVector2D(u, v));
+  obj.texcoords.append(QVector2D(u, v));
 }
 
 /**
  * @brief Model::parseFace Parses a face from the .obj file.
  * @param tokens Tokens on the line in question.
+ * @param obj The data parsed so far.
  */
-void Model::parseFace(QStringList tokens) {
+void Model::parseFace(const QStringList& tokens, ObjData& obj) {
   QStringList elements;
 
   for (int i = 1; i != tokens.size(); ++i) {
     elements = tokens[i].split("/");
-    // -1 since .obj count from 1
-    indices.append(elements[0].toInt() - 1);
+    // -1 since .obj count from 1, ~0U if the index is missing
+    Corner corner{elements[0].toUInt() - 1, ~0U, ~0U};
 
     if (elements.size() > 1 && !elements[1].isEmpty()) {
-      texcoord_indices.append(elements[1].toInt() - 1);
+      corner.texcoord = elements[1].toUInt() - 1;
     }
 
     if (elements.size() > 2 && !elements[2].isEmpty()) {
-      normal_indices.append(elements[2].toInt() - 1);
+      corner.normal = elements[2].toUInt() - 1;
     }
+    obj.corners.append(corner);
   }
 }
 
@@ -115,82 +170,122 @@ void Model::parseFace(QStringList tokens) {
  *
  * Make sure that the indices from the vertices align with those
  * of the normals and the texture coordinates, create extra vertices
- * if vertex has multiple normals or texturecoords
+ * if vertex has multiple normals or texturecoords. Corners are merged
+ * through a hash of their indices. The triangles are then reordered for the
+ * post-transform vertex cache and optionally for overdraw, and the vertices
+ * are written into the arena in order of first use.
+ * @param obj The parsed .obj data.
+ * @param reorderForOverdraw Also reorder the triangles to reduce overdraw.
  */
-void Model::alignData() {
-  QVector<QVector3D> verts;
-  verts.reserve(vertices_indexed.size());
-  QVector<QVector3D> norms;
-  norms.reserve(vertices_indexed.size());
-  QVector<QVector2D> texcs;
-  texcs.reserve(vertices_indexed.size());
-  QVector<std::tuple<QVector3D, QVector3D, QVector2D>> vs;
-
-  QVector<unsigned> ind;
-  ind.reserve(indices.size());
-
-  unsigned currentIndex = 0;
-
-  for (int i = 0; i != indices.size(); ++i) {
-    QVector3D v = vertices_indexed[indices[i]];
-
-    QVector3D n(0, 0, 0);
-    if (hNorms) {
-      n = norm[normal_indices[i]];
+void Model::alignData(const ObjData& obj, bool reorderForOverdraw) {
+  QHash<Corner, unsigned> cornerIndices;
+  cornerIndices.reserve(obj.corners.size());
+  QVector<Corner> unique;
+  QVector<unsigned> indexList(obj.corners.size());
+
+  for (int i = 0; i != obj.corners.size(); ++i) {
+    const Corner& corner = obj.corners[i];
+    auto found = cornerIndices.constFind(corner);
+    if (found != cornerIndices.constEnd()) {
+      indexList[i] = *found;
+    } else {
+      indexList[i] = unique.size();
+      cornerIndices.insert(corner, indexList[i]);
+      unique.append(corner);
     }
+  }
 
-    QVector2D t(0, 0);
-    if (hTexs) {
-      t = tex[texcoord_indices[i]];
+  // A mesh whose vertices all fit in the cache misses each of them once in
+  // any order, so there is nothing to reorder or report.
+  int vertexCount = unique.size();
+  bool reorder = vertexCount > MeshOptimizer::kAnalyzeCacheSize;
+  VertexCacheStatistics before;
+  if (reorder) {
+    before = MeshOptimizer::analyzeVertexCache(indexList, vertexCount);
+    MeshOptimizer::optimizeVertexCache(indexList, vertexCount);
+  }
+  if (reorder && reorderForOverdraw) {
+    QVector<QVector3D> positions(vertexCount);
+    for (int i = 0; i != vertexCount; ++i) {
+      positions[i] = obj.positions[unique[i].position];
     }
+    MeshOptimizer::optimizeOverdraw(indexList, positions);
+  }
 
-    std::tuple<QVector3D, QVector3D, QVector2D> k(v, n, t);
-    if (vs.contains(k)) {
-      // Vertex already exists, use that index
-      ind.append(vs.indexOf(k));
-    } else {
-      // Create a new vertex
-      verts.append(v);
-      norms.append(n);
-      texcs.append(t);
-      vs.append(k);
-      ind.append(currentIndex);
-      ++currentIndex;
+  QVector<unsigned> remap;
+  int uniqueCount =
+      MeshOptimizer::optimizeVertexFetchRemap(indexList, vertexCount, remap);
+
+  auto* vertexData = arena.allocate<QVector3D>(uniqueCount);
+  auto* normalData = arena.allocate<QVector3D>(uniqueCount);
+  auto* texcoordData = arena.allocate<QVector2D>(uniqueCount);
+  for (int i = 0; i != remap.size(); ++i) {
+    if (remap[i] == ~0U) continue;
+    const Corner& corner = unique[i];
+    vertexData[remap[i]] = obj.positions[corner.position];
+    if (corner.normal < static_cast<unsigned>(obj.normals.size())) {
+      normalData[remap[i]] = obj.normals[corner.normal];
     }
+    if (corner.texcoord < static_cast<unsigned>(obj.texcoords.size())) {
+      texcoordData[remap[i]] = obj.texcoords[corner.texcoord];
+    }
+  }
+  auto* indexData = arena.allocate<unsigned>(indexList.size());
+  std::copy(indexList.cbegin(), indexList.cend(), indexData);
+
+  coordsIndexed = MeshSpan<QVector3D>(vertexData, uniqueCount);
+  normalsIndexed = MeshSpan<QVector3D>(normalData, uniqueCount);
+  textureCoordsIndexed = MeshSpan<QVector2D>(texcoordData, uniqueCount);
+  indices = MeshSpan<unsigned>(indexData, indexList.size());
+
+  if (reorder) {
+    VertexCacheStatistics after =
+        MeshOptimizer::analyzeVertexCache(indexList, uniqueCount);
+    qDebug() << ":: Vertex cache ACMR" << before.acmr << "->" << after.acmr
+             << "ATVR" << before.atvr << "->" << after.atvr;
   }
-  // Remove old data
-  vertices_indexed.clear();
-  normals_indexed.clear();
-  textureCoords_indexed.clear();
-  indices.clear();
-
-  // Set the new data
-  vertices_indexed = verts;
-  normals_indexed = norms;
-  textureCoords_indexed = texcs;
-  indices = ind;
 }
 
 /**
  * @brief Model::unpackIndexes Unpack indices so that they are available for
  * glDrawArrays()
- *
+ * @param obj The parsed .obj data.
  */
-void Model::unpackIndexes() {
-  vertices.clear();
-  normals.clear();
-  textureCoords.clear();
-  for (int i = 0; i != indices.size(); ++i) {
-    vertices.append(vertices_indexed[indices[i]]);
-
-    if (hNorms) {
-      normals.append(norm[normal_indices[i]]);
+void Model::unpackIndexes(const ObjData& obj) {
+  int count = obj.corners.size();
+  auto* vertexData = arena.allocate<QVector3D>(count);
+  auto* normalData = hNorms ? arena.allocate<QVector3D>(count) : nullptr;
+  auto* texcoordData = hTexs ? arena.allocate<QVector2D>(count) : nullptr;
+
+  for (int i = 0; i != count; ++i) {
+    const Corner& corner = obj.corners[i];
+    vertexData[i] = obj.positions[corner.position];
+
+    if (normalData &&
+        corner.normal < static_cast<unsigned>(obj.normals.size())) {
+      normalData[i] = obj.normals[corner.normal];
     }
 
-    if (hTexs) {
-      textureCoords.append(tex[texcoord_indices[i]]);
+    if (texcoordData &&
+        corner.texcoord < static_cast<unsigned>(obj.texcoords.size())) {
+      texcoordData[i] = obj.texcoords[corner.texcoord];
     }
   }
+
+  coords = MeshSpan<QVector3D>(vertexData, count);
+  normals = MeshSpan<QVector3D>(normalData, normalData ? count : 0);
+  textureCoords = MeshSpan<QVector2D>(texcoordData, texcoordData ? count : 0);
+}
+
+/**
+ * @brief Model::release Frees the mesh data in one go, for example once it
+ * has been uploaded. All views returned by the getters become invalid.
+ */
+void Model::release() {
+  coords = normals = coordsIndexed = normalsIndexed = MeshSpan<QVector3D>();
+  textureCoords = textureCoordsIndexed = MeshSpan<QVector2D>();
+  indices = MeshSpan<unsigned>();
+  arena.release();
 }
 
 /**
@@ -201,88 +296,21 @@ void Model::unpackIndexes() {
  */
 void Model::unitize() { qDebug() << "Implement this yourself (optional)"; }
 
-/**
- * @brief Model::getCoords Get all coordinates in the mesh. The coordinates are
- * ordered in such a way that they can be used in glDrawArrays. For a mesh
- * consisting of two triangles, this might look as follows: c1, c2, c3, c2,
- * c3, c4, etc.
- * @return The coordinates in the mesh.
- */
-QVector<QVector3D> Model::getCoords() { return vertices; }
-
-/**
- * @brief Model::getCoords Get all normals in the mesh. The normals are
- * ordered in such a way that they can be used in glDrawArrays. For a mesh
- * consisting of two triangles, this might look as follows: n1, n2, n3, n2, n3,
- * n4, etc.
- * @return The normals in the mesh.
- */
-QVector<QVector3D> Model::getNormals() { return normals; }
-
-/**
- * @brief Model::getCoords Get all texture coordinates in the mesh. The texture
- * coordinates are ordered in such a way that they can be used in glDrawArrays.
- * For a mesh consisting of two triangles, this might look as follows: tx1, tx2,
- * tx3, tx2, tx3, tx4, etc.
- * @return The texture coordinates in the mesh.
- */
-QVector<QVector2D> Model::getTextureCoords() { return textureCoords; }
-
-/**
- * @brief Model::getCoords Get all unique coordinates in the mesh. The
- * coordinates are ordered in such a way that they can be used in
- * glDrawElements. For a mesh consisting of two triangles, this might look as
- * follows: c1, c2, c3, c4. Intended to be used in combination with
- * getIndices().
- * @return The unique coordinates in the mesh.
- */
-QVector<QVector3D> Model::getCoordsIndexed() { return vertices_indexed; }
-
-/**
- * @brief Model::getCoords Get all unique normals in the mesh. The
- * normals are ordered in such a way that they can be used in
- * glDrawElements. For a mesh consisting of two triangles, this might look as
- * follows: n1, n2, n3, n4. Intended to be used in combination with
- * getIndices().
- * @return The unique normals in the mesh.
- */
-QVector<QVector3D> Model::getNormalsIndexed() { return normals_indexed; }
-
-/**
- * @brief Model::getCoords Get all unique texture coordinates in the mesh. The
- * texture coordinates are ordered in such a way that they can be used in
- * glDrawElements. For a mesh consisting of two triangles, this might look as
- * follows: tx1, tx2, tx3, tx4. Intended to be used in combination with
- * getIndices().
- * @return The unique texture coordinates in the mesh.
- */
-QVector<QVector2D> Model::getTextureCoordsIndexed() {
-  return textureCoords_indexed;
-}
-
-/**
- * @brief Model::getIndices Retrieves a list of indices in such a way that these
- * describe the topology of the mesh. In other words, these indices describe how
- * the given (unique) coordinates/normals/texture coordinates make up all the
- * different triangles in the mesh. Intended to be used with glDrawElements.
- * @return A list of indices.
- */
-QVector<unsigned> Model::getIndices() { return indices; }
-
 /**
  * @brief Model::getVNInterleaved Retrieves the coordinates and normals of a
  * mesh as separate float values so that all data can be handled by a single
  * buffer. The values are ordered in such a way that they can be used in
  * glDrawArrays. Each vertex consists of 6 float values (3 coordinate, 3
- * normal).
+ * normal). Missing normals are written as zeros.
  * @return A list of float values containing the coordinates and normals.
  */
-QVector<float> Model::getVNInterleaved() {
+QVector<float> Model::getVNInterleaved() const {
   QVector<float> buffer;
+  buffer.reserve(coords.size() * 6);
 
-  for (int i = 0; i != vertices.size(); ++i) {
-    QVector3D vertex = vertices.at(i);
-    QVector3D normal = normals.at(i);
+  for (int i = 0; i != coords.size(); ++i) {
+    QVector3D vertex = coords[i];
+    QVector3D normal = normals.isEmpty() ? QVector3D() : normals[i];
     buffer.append(vertex.x());
     buffer.append(vertex.y());
     buffer.append(vertex.z());
@@ -299,16 +327,18 @@ QVector<float> Model::getVNInterleaved() {
  * texture coordinates of a mesh as separate float values  so that all data can
  * be handled by a single buffer. The values are ordered in such a way that they
  * can be used in glDrawArrays. Each vertex consists of 8 float values (3
- * coordinate, 3 normal, 2 texture coordinate).
+ * coordinate, 3 normal, 2 texture coordinate). Missing normals and texture
+ * coordinates are written as zeros.
  * @return A list of float values containing the coordinates and normals.
  */
-QVector<float> Model::getVNTInterleaved() {
+QVector<float> Model::getVNTInterleaved() const {
   QVector<float> buffer;
+  buffer.reserve(coords.size() * 8);
 
-  for (int i = 0; i != vertices.size(); ++i) {
-    QVector3D vertex = vertices.at(i);
-    QVector3D normal = normals.at(i);
-    QVector2D uv = textureCoords.at(i);
+  for (int i = 0; i != coords.size(); ++i) {
+    QVector3D vertex = coords[i];
+    QVector3D normal = normals.isEmpty() ? QVector3D() : normals[i];
+    QVector2D uv = textureCoords.isEmpty() ? QVector2D() : textureCoords[i];
     buffer.append(vertex.x());
     buffer.append(vertex.y());
     buffer.append(vertex.z());
@@ -327,15 +357,16 @@ QVector<float> Model::getVNTInterleaved() {
  * of a mesh as separate float values  so that all data can be handled by a
  * single buffer. The values are ordered in such a way that they can be used in
  * glDrawElements. Each vertex consists of 6 float values (3 coordinate, 3
- * normal).
+ * normal). Missing normals are written as zeros.
  * @return A list of float values containing the coordinates and normals.
  */
-QVector<float> Model::getVNInterleavedIndexed() {
+QVector<float> Model::getVNInterleavedIndexed() const {
   QVector<float> buffer;
+  buffer.reserve(coordsIndexed.size() * 6);
 
-  for (int i = 0; i != vertices_indexed.size(); ++i) {
-    QVector3D vertex = vertices_indexed.at(i);
-    QVector3D normal = normals_indexed.at(i);
+  for (int i = 0; i != coordsIndexed.size(); ++i) {
+    QVector3D vertex = coordsIndexed[i];
+    QVector3D normal = normalsIndexed.isEmpty() ? QVector3D() : normalsIndexed[i];
     buffer.append(vertex.x());
     buffer.append(vertex.y());
     buffer.append(vertex.z());
@@ -352,16 +383,18 @@ QVector<float> Model::getVNInterleavedIndexed() {
  * texture coordinates of a mesh as separate float values  so that all data can
  * be handled by a single buffer. The values are ordered in such a way that they
  * can be used in glDrawElements. Each vertex consists of 8 float values (3
- * coordinate, 3 normal, 2 texture coordinate).
+ * coordinate, 3 normal, 2 texture coordinate). Missing normals and texture
+ * coordinates are written as zeros.
  * @return A list of float values containing the coordinates and normals.
  */
-QVector<float> Model::getVNTInterleavedIndexed() {
+QVector<float> Model::getVNTInterleavedIndexed() const {
   QVector<float> buffer;
+  buffer.reserve(coordsIndexed.size() * 8);
 
-  for (int i = 0; i != vertices_indexed.size(); ++i) {
-    QVector3D vertex = vertices_indexed.at(i);
-    QVector3D normal = normals_indexed.at(i);
-    QVector2D uv = textureCoords_indexed.at(i);
+  for (int i = 0; i != coordsIndexed.size(); ++i) {
+    QVector3D vertex = coordsIndexed[i];
+    QVector3D normal = normalsIndexed.isEmpty() ? QVector3D() : normalsIndexed[i];
+    QVector2D uv = textureCoordsIndexed.isEmpty() ? QVector2D() : textureCoordsIndexed[i];
     buffer.append(vertex.x());
     buffer.append(vertex.y());
     buffer.append(vertex.z());
@@ -376,13 +409,23 @@ QVector<float> Model::getVNTInterleavedIndexed() {
 }
 
 /**
- * @brief Model::getNumTriangles Retrieves the number of triangles in this mesh.
- * @return The number of triangles in this mesh.
+ * @brief Model::buildLodChain Builds a chain of simplified versions of the
+ * mesh. The levels index into the same unique coordinates, normals and texture
+ * coordinates as getIndices(), so only the index buffer differs per level.
+ * @param ratios The fraction of triangles to keep for each level.
+ * @return The levels of detail, from full detail to coarsest.
  */
-int Model::getNumTriangles() { return vertices.size() / 3; }
+LodChain Model::buildLodChain(const QVector<float>& ratios) const {
+  LodChain chain(indices.toVector(), coordsIndexed.toVector(), ratios);
+  for (const LodLevel& level : chain.getLevels()) {
+    qDebug() << ":: LOD" << level.indexCount / 3 << "triangles, error"
+             << level.error;
+  }
+  return chain;
+}
 
-QVector<QVector3D> Model::getRandomColors() {
-    auto size = vertices.size();
+QVector<QVector3D> Model::getRandomColors() const {
+    auto size = coords.size();
 
     QVector<QVector3D> colors(size);
 
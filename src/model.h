@@ -7,71 +7,93 @@
 #include <QVector3D>
 #include <QVector>
 
+#include "mesharena.h"
+#include "meshsimplifier.h"
+
 /**
  * @brief A simple Model class. Represents a 3D triangle mesh and is able to
  * load this data from a Wavefront .obj file. IMPORTANT: Current only supports
  * TRIANGLE meshes!
  *
+ * Only the layouts asked for are built, in a MeshArena, and the getters
+ * return views of them instead of copies. The parsed .obj data is dropped
+ * once the layouts are built. The views stay valid until release() is called
+ * or the model is destroyed, so a model is best kept only until its data is
+ * on the GPU.
+ *
  * Support for other meshes can be implemented by students.
  *
  */
 class Model {
  public:
-  Model(const QString& filename);
+  enum Layout {
+    UNPACKED = 1,  // for glDrawArrays()
+    INDEXED = 2,   // for glDrawElements()
+    BOTH = UNPACKED | INDEXED
+  };
+
+  Model(const QString& filename, Layout layout = BOTH,
+        bool reorderForOverdraw = false);
 
   // Used for glDrawArrays()
-  QVector<QVector3D> getCoords();
-  QVector<QVector3D> getNormals();
-  QVector<QVector2D> getTextureCoords();
-  QVector<QVector3D> getRandomColors();
+  MeshSpan<QVector3D> getCoords() const { return coords; }
+  MeshSpan<QVector3D> getNormals() const { return normals; }
+  MeshSpan<QVector2D> getTextureCoords() const { return textureCoords; }
+  QVector<QVector3D> getRandomColors() const;
 
   // Used for interleaving into one buffer for glDrawArrays()
-  QVector<float> getVNInterleaved();
-  QVector<float> getVNTInterleaved();
+  QVector<float> getVNInterleaved() const;
+  QVector<float> getVNTInterleaved() const;
 
   // Used for glDrawElements()
-  QVector<QVector3D> getCoordsIndexed();
-  QVector<QVector3D> getNormalsIndexed();
-  QVector<QVector2D> getTextureCoordsIndexed();
-  QVector<unsigned> getIndices();
+  MeshSpan<QVector3D> getCoordsIndexed() const { return coordsIndexed; }
+  MeshSpan<QVector3D> getNormalsIndexed() const { return normalsIndexed; }
+  MeshSpan<QVector2D> getTextureCoordsIndexed() const {
+    return textureCoordsIndexed;
+  }
+  MeshSpan<unsigned> getIndices() const { return indices; }
 
   // Used for interleaving into one buffer for glDrawElements()
-  QVector<float> getVNInterleavedIndexed();
-  QVector<float> getVNTInterleavedIndexed();
+  QVector<float> getVNInterleavedIndexed() const;
+  QVector<float> getVNTInterleavedIndexed() const;
 
-  bool hasNormals();
-  bool hasTextureCoords();
-  int getNumTriangles();
+  // Simplified index buffers for glDrawElements(), sharing the indexed data
+  LodChain buildLodChain(const QVector<float>& ratios = {1.0F, 0.5F, 0.25F,
+                                                         0.1F}) const;
 
+  bool hasNormals() const { return hNorms; }
+  bool hasTextureCoords() const { return hTexs; }
+  int getNumTriangles() const { return triangleCount; }
+  qsizetype getMemoryUsage() const { return arena.getBytesAllocated(); }
+
+  void release();
   void unitize();
 
  private:
+  struct ObjData;
+
   // OBJ parsing
-  void parseVertex(QStringList tokens);
-  void parseNormal(QStringList tokens);
-  void parseTexture(QStringList tokens);
-  void parseFace(QStringList tokens);
-
-  // Alignment of data
-  void alignData();
-  void unpackIndexes();
-
-  // Intermediate storage of values
-  QVector<QVector3D> vertices_indexed;
-  QVector<QVector3D> normals_indexed;
-  QVector<QVector2D> textureCoords_indexed;
-  QVector<unsigned> indices;
-
-  QVector<QVector3D> vertices;
-  QVector<QVector3D> normals;
-  QVector<QVector2D> textureCoords;
-
-  // Utility storage
-  QVector<unsigned> normal_indices;
-  QVector<unsigned> texcoord_indices;
-  QVector<QVector3D> norm;
-  QVector<QVector2D> tex;
+  void parseVertex(const QStringList& tokens, ObjData& obj);
+  void parseNormal(const QStringList& tokens, ObjData& obj);
+  void parseTexture(const QStringList& tokens, ObjData& obj);
+  void parseFace(const QStringList& tokens, ObjData& obj);
+
+  // Building the layouts
+  void unpackIndexes(const ObjData& obj);
+  void alignData(const ObjData& obj, bool reorderForOverdraw);
+
+  MeshArena arena;
+
+  MeshSpan<QVector3D> coords;
+  MeshSpan<QVector3D> normals;
+  MeshSpan<QVector2D> textureCoords;
+
+  MeshSpan<QVector3D> coordsIndexed;
+  MeshSpan<QVector3D> normalsIndexed;
+  MeshSpan<QVector2D> textureCoordsIndexed;
+  MeshSpan<unsigned> indices;
 
+  int triangleCount = 0;
   bool hNorms = false;
   bool hTexs = false;
 };
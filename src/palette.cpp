@@ -0,0 +1,163 @@
+#include "palette.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+/**
+ * @brief Palette::Palette Creates a palette from a list of stops.
+ * @param stops The stops, sorted by height here.
+ * @param maximumHeight The height at which the palette ends. Heights outside
+ * the palette get the color of the first or last stop.
+ * @param stepped Whether to keep the colors of the stops instead of blending.
+ */
+Palette::Palette(QVector<PaletteStop> stops, float maximumHeight, bool stepped)
+    : stops(std::move(stops)), maximumHeight(maximumHeight), stepped(stepped) {
+  std::stable_sort(this->stops.begin(), this->stops.end(),
+                   [](const PaletteStop &a, const PaletteStop &b) {
+                     return a.height < b.height;
+                   });
+  if (this->stops.isEmpty()) {
+    qDebug() << "Palette without stops, using white";
+    this->stops.append({0.0F, QVector3D(1.0F, 1.0F, 1.0F)});
+  }
+  if (this->maximumHeight <= this->stops.first().height) {
+    this->maximumHeight = this->stops.first().height + 1.0F;
+  }
+}
+
+/**
+ * @brief Palette::rainbowLayers The layers of the rainbow shading mode: a new
+ * color every two units of height.
+ */
+Palette Palette::rainbowLayers() {
+  return Palette({{0.0F, QVector3D(0.5F, 0.0F, 0.0F)},
+                  {2.0F, QVector3D(1.0F, 0.0F, 0.0F)},
+                  {4.0F, QVector3D(1.0F, 0.5F, 0.0F)},
+                  {6.0F, QVector3D(1.0F, 1.0F, 0.0F)},
+                  {8.0F, QVector3D(0.0F, 1.0F, 0.0F)},
+                  {10.0F, QVector3D(0.0F, 0.0F, 1.0F)},
+                  {12.0F, QVector3D(0.5F, 0.0F, 0.5F)},
+                  {14.0F, QVector3D(0.3F, 0.0F, 0.3F)}},
+                 16.0F, true);
+}
+
+/**
+ * @brief Palette::heightGradient The three color gradient of the gradient
+ * shading mode, from the valleys up to a height of 22.
+ */
+Palette Palette::heightGradient(QVector3D bottom, QVector3D middle,
+                                QVector3D top) {
+  return Palette({{0.0F, bottom}, {11.0F, middle}, {22.0F, top}}, 22.0F,
+                 false);
+}
+
+/**
+ * @brief Palette::landscape Water, beach, grass, rock and snow.
+ */
+Palette Palette::landscape() {
+  return Palette({{0.0F, QVector3D(0.05F, 0.2F, 0.45F)},
+                  {3.0F, QVector3D(0.1F, 0.45F, 0.7F)},
+                  {4.5F, QVector3D(0.85F, 0.8F, 0.55F)},
+                  {6.0F, QVector3D(0.3F, 0.6F, 0.2F)},
+                  {14.0F, QVector3D(0.15F, 0.4F, 0.15F)},
+                  {20.0F, QVector3D(0.45F, 0.4F, 0.35F)},
+                  {28.0F, QVector3D(0.95F, 0.95F, 1.0F)}},
+                 32.0F, false);
+}
+
+float Palette::getMinimumHeight() const { return stops.first().height; }
+
+/**
+ * @brief Palette::colorAt Looks up the color of a height.
+ * @param height The terrain height.
+ * @return The color at that height.
+ */
+QVector3D Palette::colorAt(float height) const {
+  auto next = std::upper_bound(
+      stops.begin(), stops.end(), height,
+      [](float h, const PaletteStop &stop) { return h < stop.height; });
+  if (next == stops.begin()) return stops.first().color;
+  auto previous = next - 1;
+  if (stepped || next == stops.end()) return previous->color;
+
+  float t = (height - previous->height) / (next->height - previous->height);
+  return previous->color + (next->color - previous->color) * t;
+}
+
+/**
+ * @brief Palette::bake Samples the palette at the centers of the texels of a
+ * lookup table that spans the heights of the palette.
+ * @param resolution The number of texels.
+ * @return The texels as RGBA bytes.
+ */
+QVector<quint8> Palette::bake(int resolution) const {
+  QVector<quint8> texels(resolution * 4);
+  float minimumHeight = getMinimumHeight();
+  float step = (maximumHeight - minimumHeight) / resolution;
+  for (int i = 0; i < resolution; ++i) {
+    QVector3D color = colorAt(minimumHeight + (i + 0.5F) * step);
+    for (int c = 0; c < 3; ++c) {
+      texels[i * 4 + c] = static_cast<quint8>(
+          std::lround(std::clamp(color[c], 0.0F, 1.0F) * 255.0F));
+    }
+    texels[i * 4 + 3] = 255;
+  }
+  return texels;
+}
+
+/**
+ * @brief PaletteTexture::initialize Creates the lookup texture. Requires a
+ * current context.
+ * @param functions The OpenGL functions of the context.
+ */
+void PaletteTexture::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+  gl->glGenTextures(1, &texture);
+  gl->glBindTexture(GL_TEXTURE_1D, texture);
+  gl->glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl->glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, kResolution, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, nullptr);
+  dirty = true;
+}
+
+void PaletteTexture::destroy() {
+  if (gl == nullptr) return;
+  gl->glDeleteTextures(1, &texture);
+  texture = 0;
+}
+
+void PaletteTexture::setPalette(const Palette &newPalette) {
+  palette = newPalette;
+  dirty = true;
+}
+
+/**
+ * @brief PaletteTexture::getRange The heights that map to the start and end
+ * of the texture, for the paletteRange uniform.
+ */
+QVector2D PaletteTexture::getRange() const {
+  return QVector2D(palette.getMinimumHeight(), palette.getMaximumHeight());
+}
+
+/**
+ * @brief PaletteTexture::bind Binds the texture, after rebaking it if the
+ * palette changed.
+ * @param unit The texture unit to bind to, e.g. GL_TEXTURE2.
+ */
+void PaletteTexture::bind(GLenum unit) {
+  gl->glActiveTexture(unit);
+  gl->glBindTexture(GL_TEXTURE_1D, texture);
+  if (dirty) {
+    QVector<quint8> texels = palette.bake(kResolution);
+    gl->glTexSubImage1D(GL_TEXTURE_1D, 0, 0, kResolution, GL_RGBA,
+                        GL_UNSIGNED_BYTE, texels.constData());
+    // Stepped palettes must not blend across the layer boundaries
+    GLint filter = palette.isStepped() ? GL_NEAREST : GL_LINEAR;
+    gl->glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, filter);
+    gl->glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, filter);
+    dirty = false;
+  }
+  gl->glActiveTexture(GL_TEXTURE0);
+}
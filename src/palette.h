@@ -0,0 +1,71 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <QOpenGLFunctions_3_3_Core>
+#include <QVector2D>
+#include <QVector3D>
+#include <QVector>
+
+/**
+ * @brief A color of a palette and the terrain height at which it starts.
+ */
+struct PaletteStop {
+  float height;
+  QVector3D color;
+};
+
+/**
+ * @brief Colors the terrain by height using any number of stops. Smooth
+ * palettes blend linearly between the stops, stepped palettes keep the color
+ * of a stop up to the next one.
+ */
+class Palette {
+ public:
+  Palette() = default;
+  Palette(QVector<PaletteStop> stops, float maximumHeight, bool stepped);
+
+  static Palette rainbowLayers();
+  static Palette heightGradient(QVector3D bottom, QVector3D middle,
+                                QVector3D top);
+  static Palette landscape();
+
+  QVector3D colorAt(float height) const;
+  QVector<quint8> bake(int resolution) const;
+
+  const QVector<PaletteStop> &getStops() const { return stops; }
+  float getMinimumHeight() const;
+  float getMaximumHeight() const { return maximumHeight; }
+  bool isStepped() const { return stepped; }
+
+ private:
+  QVector<PaletteStop> stops = {{0.0F, QVector3D(1.0F, 1.0F, 1.0F)}};
+  float maximumHeight = 1.0F;
+  bool stepped = false;
+};
+
+/**
+ * @brief A palette baked into a 1D lookup texture, which the height colored
+ * shaders sample instead of picking colors themselves. The texture is only
+ * rebaked when the palette changes.
+ */
+class PaletteTexture {
+ public:
+  static constexpr int kResolution = 256;
+
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  void setPalette(const Palette &newPalette);
+  const Palette &getPalette() const { return palette; }
+  QVector2D getRange() const;
+
+  void bind(GLenum unit);
+
+ private:
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  GLuint texture = 0;
+  Palette palette;
+  bool dirty = true;
+};
+
+#endif  // PALETTE_H
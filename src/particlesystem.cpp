@@ -0,0 +1,193 @@
+#include "particlesystem.h"
+
+#include <QDebug>
+#include <cstddef>
+
+void ParticleSystem::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+  gl->glGenBuffers(2, buffers);
+  gl->glGenVertexArrays(2, arrays);
+  for (int i = 0; i != 2; ++i) {
+    gl->glBindVertexArray(arrays[i]);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+    gl->glVertexAttribPointer(
+        0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle),
+        reinterpret_cast<GLvoid *>(offsetof(Particle, position)));
+    gl->glEnableVertexAttribArray(0);
+    gl->glVertexAttribPointer(
+        1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle),
+        reinterpret_cast<GLvoid *>(offsetof(Particle, velocity)));
+    gl->glEnableVertexAttribArray(1);
+  }
+  gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+  gl->glBindVertexArray(0);
+
+  // The captured outputs have to be named before linking
+  updateProgram.addShaderFromSourceFile(
+      QOpenGLShader::Vertex, ":/shaders/vertshader_particles_update.glsl");
+  const char *varyings[] = {"positionAge", "velocityLifetime"};
+  gl->glTransformFeedbackVaryings(updateProgram.programId(), 2, varyings,
+                                  GL_INTERLEAVED_ATTRIBS);
+  if (!updateProgram.link()) {
+    qWarning() << "ParticleSystem: cannot link the update program";
+  }
+  drawProgram.addShaderFromSourceFile(QOpenGLShader::Vertex,
+                                      ":/shaders/vertshader_particles.glsl");
+  drawProgram.addShaderFromSourceFile(QOpenGLShader::Fragment,
+                                      ":/shaders/fragshader_particles.glsl");
+  if (!drawProgram.link()) {
+    qWarning() << "ParticleSystem: cannot link the draw program";
+  }
+
+  updateTimer.initialize(functions);
+  allocated = false;
+}
+
+void ParticleSystem::destroy() {
+  if (gl == nullptr) return;
+  gl->glDeleteVertexArrays(2, arrays);
+  gl->glDeleteBuffers(2, buffers);
+  updateTimer.destroy();
+  allocated = false;
+}
+
+/**
+ * @brief ParticleSystem::setEmitters Replaces the emitters. The buffers are
+ * resized and the particles start over on the next update().
+ * @param newEmitters The emitters.
+ */
+void ParticleSystem::setEmitters(const QVector<ParticleEmitter> &newEmitters) {
+  emitters = newEmitters;
+  allocated = false;
+}
+
+int ParticleSystem::getParticleCount() const {
+  int count = 0;
+  for (const ParticleEmitter &emitter : emitters) {
+    count += emitter.particleCount;
+  }
+  return count;
+}
+
+/**
+ * @brief ParticleSystem::update Advances all particles by a time step on the
+ * GPU.
+ * @param seconds The time step.
+ * @param emitterTransform Transform of the emitters at the end of the step.
+ * The particles live in the space it maps to.
+ * @param drift Velocity of the air the particles slow down to, in the same
+ * space.
+ */
+void ParticleSystem::update(float seconds, const QMatrix4x4 &emitterTransform,
+                            const QVector3D &drift) {
+  if (!allocated) allocate();
+  if (capacity == 0) return;
+  if (restart) previousTransform = emitterTransform;
+
+  updateTimer.begin();
+  updateProgram.bind();
+  updateProgram.setUniformValue("emitterTransform", emitterTransform);
+  updateProgram.setUniformValue("previousEmitterTransform", previousTransform);
+  updateProgram.setUniformValue("timeStep", seconds);
+  updateProgram.setUniformValue("drift", drift);
+  updateProgram.setUniformValue("seed", static_cast<GLuint>(step++));
+  updateProgram.setUniformValue("restart", restart);
+
+  // Nothing is drawn, the new state only goes to the other buffer
+  gl->glEnable(GL_RASTERIZER_DISCARD);
+  gl->glBindVertexArray(arrays[current]);
+  int first = 0;
+  for (const ParticleEmitter &emitter : emitters) {
+    if (emitter.particleCount == 0) continue;
+    updateProgram.setUniformValue("emitterPosition", emitter.position);
+    updateProgram.setUniformValue("emitterDirection",
+                                  emitter.direction.normalized());
+    updateProgram.setUniformValue("spread", emitter.spread);
+    updateProgram.setUniformValue("speed", emitter.speed);
+    updateProgram.setUniformValue("drag", emitter.drag);
+    updateProgram.setUniformValue("lifetime", emitter.lifetime);
+    updateProgram.setUniformValue("firstParticle", first);
+    updateProgram.setUniformValue("particleCount", emitter.particleCount);
+
+    gl->glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1 - current],
+                          first * sizeof(Particle),
+                          emitter.particleCount * sizeof(Particle));
+    gl->glBeginTransformFeedback(GL_POINTS);
+    gl->glDrawArrays(GL_POINTS, first, emitter.particleCount);
+    gl->glEndTransformFeedback();
+    first += emitter.particleCount;
+  }
+  gl->glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+  gl->glBindVertexArray(0);
+  gl->glDisable(GL_RASTERIZER_DISCARD);
+  updateProgram.release();
+  updateTimer.end();
+
+  current = 1 - current;
+  previousTransform = emitterTransform;
+  restart = false;
+}
+
+/**
+ * @brief ParticleSystem::draw Draws the particles as round point sprites,
+ * blended additively and without writing depth, so they need no sorting.
+ * @param projectionTransform The projection of the space of the particles.
+ * @param viewportHeight Height of the viewport in pixels.
+ */
+void ParticleSystem::draw(const QMatrix4x4 &projectionTransform,
+                          float viewportHeight) {
+  if (!allocated || restart || capacity == 0) return;
+
+  drawProgram.bind();
+  drawProgram.setUniformValue("projectionTransform", projectionTransform);
+  // Pixels per unit of size at a distance of one
+  drawProgram.setUniformValue("pointScale",
+                              projectionTransform(1, 1) * viewportHeight / 2);
+
+  gl->glEnable(GL_PROGRAM_POINT_SIZE);
+  gl->glEnable(GL_BLEND);
+  gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+  gl->glDepthMask(GL_FALSE);
+  gl->glBindVertexArray(arrays[current]);
+  int first = 0;
+  for (const ParticleEmitter &emitter : emitters) {
+    if (emitter.particleCount == 0) continue;
+    drawProgram.setUniformValue("size", emitter.size);
+    drawProgram.setUniformValue("startColor", emitter.startColor);
+    drawProgram.setUniformValue("endColor", emitter.endColor);
+    gl->glDrawArrays(GL_POINTS, first, emitter.particleCount);
+    first += emitter.particleCount;
+  }
+  gl->glBindVertexArray(0);
+  gl->glDepthMask(GL_TRUE);
+  gl->glDisable(GL_BLEND);
+  gl->glDisable(GL_PROGRAM_POINT_SIZE);
+  drawProgram.release();
+}
+
+/**
+ * @brief ParticleSystem::takeUpdateTime Returns the GPU time of an earlier
+ * update, once it is available.
+ * @param milliseconds Receives the measured time.
+ * @return False if no measurement is available yet.
+ */
+bool ParticleSystem::takeUpdateTime(float &milliseconds) {
+  return updateTimer.takeResult(milliseconds);
+}
+
+/**
+ * @brief ParticleSystem::allocate Sizes both buffers for the particles of
+ * all emitters. Their contents are left undefined; the first update sets
+ * them up on the GPU.
+ */
+void ParticleSystem::allocate() {
+  capacity = getParticleCount();
+  for (GLuint buffer : buffers) {
+    gl->glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    gl->glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Particle), nullptr,
+                     GL_DYNAMIC_COPY);
+  }
+  gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+  allocated = true;
+  restart = true;
+}
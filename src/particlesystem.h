@@ -0,0 +1,89 @@
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLShaderProgram>
+#include <QVector3D>
+#include <QVector>
+
+#include "gputimer.h"
+
+/**
+ * @brief A source of particles, such as an engine nozzle. Positions and
+ * directions are in the space of the transform passed to
+ * ParticleSystem::update(), lengths and speeds in the space it maps to.
+ */
+struct ParticleEmitter {
+  QVector3D position;
+  QVector3D direction = {0.0F, 0.0F, 1.0F};
+  float spread = 0.15F;   // half angle of the cone of directions, in radians
+  float speed = 10.0F;    // at birth
+  float drag = 1.5F;      // per second, towards the drift of the air
+  float lifetime = 1.0F;  // longest, in seconds
+  float size = 0.5F;      // of a particle at birth
+  QVector3D startColor = {1.0F, 0.8F, 0.4F};
+  QVector3D endColor = {0.6F, 0.1F, 0.5F};
+  int particleCount = 4096;  // emitted once per lifetime
+};
+
+/**
+ * @brief Particles that are simulated and drawn entirely on the GPU.
+ *
+ * The state of every particle lives in two vertex buffers. Each update draws
+ * the particles of one buffer as points with the rasterizer off, and a
+ * vertex shader writes their next state into the other buffer through
+ * transform feedback; the buffers then swap. The same buffer is drawn as
+ * point sprites, so the CPU only sets a few uniforms per emitter and never
+ * touches or reads back a particle.
+ *
+ * Every emitter owns a fixed range of the buffers. A particle that dies is
+ * born again at its emitter, so an emitter sends out particleCount particles
+ * per lifetime. Births are spread over the time step and between the
+ * emitter transforms at its start and end, so a moving emitter leaves a
+ * smooth trail instead of puffs. Requires a current context for all calls
+ * but setEmitters().
+ */
+class ParticleSystem {
+ public:
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  void setEmitters(const QVector<ParticleEmitter> &newEmitters);
+  const QVector<ParticleEmitter> &getEmitters() const { return emitters; }
+  int getParticleCount() const;
+
+  void update(float seconds, const QMatrix4x4 &emitterTransform,
+              const QVector3D &drift);
+  void draw(const QMatrix4x4 &projectionTransform, float viewportHeight);
+  bool takeUpdateTime(float &milliseconds);
+  int getPendingUpdateTimes() const { return updateTimer.getPendingCount(); }
+
+ private:
+  // The state of a particle, two vec4 attributes
+  struct Particle {
+    float position[3];
+    float age;  // negative before the first birth
+    float velocity[3];
+    float lifetime;
+  };
+
+  void allocate();
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  QOpenGLShaderProgram updateProgram;
+  QOpenGLShaderProgram drawProgram;
+  GLuint buffers[2] = {};
+  GLuint arrays[2] = {};
+  int current = 0;  // the buffer holding the latest state
+  GpuTimer updateTimer;
+
+  QVector<ParticleEmitter> emitters;
+  int capacity = 0;        // particles the buffers hold
+  bool allocated = false;  // whether the buffers fit the emitters
+  bool restart = true;     // whether the state must be set up first
+  QMatrix4x4 previousTransform;
+  quint32 step = 0;  // seeds the random numbers of the births
+};
+
+#endif  // PARTICLESYSTEM_H
@@ -0,0 +1,167 @@
+#include "postprocessing.h"
+
+#include <QDebug>
+#include <QtGlobal>
+
+namespace {
+
+bool link(QOpenGLShaderProgram &program, const QString &fragmentShader) {
+  program.addShaderFromSourceFile(QOpenGLShader::Vertex,
+                                  ":/shaders/vertshader_fullscreen.glsl");
+  program.addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShader);
+  return program.link();
+}
+
+}  // namespace
+
+void PostProcessing::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+  gl->glGenVertexArrays(1, &emptyArray);
+  if (!link(downsampleProgram, ":/shaders/fragshader_bloom_downsample.glsl") ||
+      !link(upsampleProgram, ":/shaders/fragshader_bloom_upsample.glsl") ||
+      !link(tonemapProgram, ":/shaders/fragshader_tonemap.glsl") ||
+      !link(fxaaProgram, ":/shaders/fragshader_fxaa.glsl")) {
+    qWarning() << "PostProcessing: cannot link the programs";
+  }
+}
+
+void PostProcessing::destroy() {
+  if (gl == nullptr) return;
+  gl->glDeleteVertexArrays(1, &emptyArray);
+  emptyArray = 0;
+}
+
+/**
+ * @brief PostProcessing::addPasses Adds the passes from the HDR scene to the
+ * output to a render graph.
+ * @param graph The graph of the frame.
+ * @param scene The HDR color of the scene, a transient texture.
+ * @param output Where the image goes, usually the window. May be larger than
+ * the scene.
+ */
+void PostProcessing::addPasses(RenderGraph &graph, RenderGraph::Resource scene,
+                               RenderGraph::Resource output) {
+  RenderTextureDesc sceneDesc = graph.getDesc(scene);
+
+  RenderGraph::Resource bloom = -1;
+  if (bloomEnabled) {
+    RenderGraph::Resource down[kBloomLevels];
+    RenderTextureDesc desc = sceneDesc;
+    desc.format = GL_RGBA16F;
+    for (int level = 0; level != kBloomLevels; ++level) {
+      desc.width = qMax(1, desc.width / 2);
+      desc.height = qMax(1, desc.height / 2);
+      down[level] =
+          graph.createTexture(QString("bloom down %1").arg(level), desc);
+      RenderGraph::Resource source = level == 0 ? scene : down[level - 1];
+      RenderGraph::Resource target = down[level];
+      graph.addPass(
+          QString("bloom downsample %1").arg(level),
+          [&](RenderGraph::PassBuilder &pass) {
+            pass.read(source);
+            pass.writeColor(target);
+          },
+          [this, &graph, source, level]() {
+            downsampleProgram.bind();
+            downsampleProgram.setUniformValue("source", 0);
+            downsampleProgram.setUniformValue("prefilter", level == 0);
+            downsampleProgram.setUniformValue("threshold", bloomThreshold);
+            downsampleProgram.setUniformValue("knee", bloomKnee);
+            gl->glActiveTexture(GL_TEXTURE0);
+            gl->glBindTexture(GL_TEXTURE_2D, graph.getTexture(source));
+            drawFullscreen(downsampleProgram);
+          });
+    }
+
+    // Each level of the up chain is the blurred level above it plus the
+    // same level of the down chain
+    bloom = down[kBloomLevels - 1];
+    for (int level = kBloomLevels - 2; level >= 0; --level) {
+      RenderGraph::Resource blurred = bloom;
+      RenderGraph::Resource detail = down[level];
+      RenderTextureDesc desc = graph.getDesc(detail);
+      RenderGraph::Resource target =
+          graph.createTexture(QString("bloom up %1").arg(level), desc);
+      graph.addPass(
+          QString("bloom upsample %1").arg(level),
+          [&](RenderGraph::PassBuilder &pass) {
+            pass.read(blurred);
+            pass.read(detail);
+            pass.writeColor(target);
+          },
+          [this, &graph, blurred, detail]() {
+            upsampleProgram.bind();
+            upsampleProgram.setUniformValue("blurred", 0);
+            upsampleProgram.setUniformValue("detail", 1);
+            gl->glActiveTexture(GL_TEXTURE1);
+            gl->glBindTexture(GL_TEXTURE_2D, graph.getTexture(detail));
+            gl->glActiveTexture(GL_TEXTURE0);
+            gl->glBindTexture(GL_TEXTURE_2D, graph.getTexture(blurred));
+            drawFullscreen(upsampleProgram);
+          });
+      bloom = target;
+    }
+  }
+
+  // FXAA needs the tonemapped image with its luma
+  RenderGraph::Resource tonemapped = output;
+  if (fxaaEnabled) {
+    tonemapped = graph.createTexture(
+        "tonemapped", {sceneDesc.width, sceneDesc.height, GL_RGBA8});
+  }
+  graph.addPass(
+      "tonemap",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.read(scene);
+        if (bloom != -1) {
+          pass.read(bloom);
+        }
+        pass.writeColor(tonemapped);
+      },
+      [this, &graph, scene, bloom]() {
+        tonemapProgram.bind();
+        tonemapProgram.setUniformValue("scene", 0);
+        tonemapProgram.setUniformValue("bloom", 1);
+        tonemapProgram.setUniformValue(
+            "bloomIntensity", bloom != -1 ? bloomIntensity : 0.0F);
+        tonemapProgram.setUniformValue("exposure", exposure);
+        gl->glActiveTexture(GL_TEXTURE1);
+        gl->glBindTexture(GL_TEXTURE_2D,
+                          bloom != -1 ? graph.getTexture(bloom) : 0);
+        gl->glActiveTexture(GL_TEXTURE0);
+        gl->glBindTexture(GL_TEXTURE_2D, graph.getTexture(scene));
+        drawFullscreen(tonemapProgram);
+      });
+
+  if (fxaaEnabled) {
+    graph.addPass(
+        "fxaa",
+        [&](RenderGraph::PassBuilder &pass) {
+          pass.read(tonemapped);
+          pass.writeColor(output);
+        },
+        [this, &graph, tonemapped]() {
+          fxaaProgram.bind();
+          fxaaProgram.setUniformValue("source", 0);
+          gl->glActiveTexture(GL_TEXTURE0);
+          gl->glBindTexture(GL_TEXTURE_2D, graph.getTexture(tonemapped));
+          drawFullscreen(fxaaProgram);
+        });
+  }
+}
+
+/**
+ * @brief PostProcessing::drawFullscreen Covers the viewport with one
+ * triangle, without depth test or blending, and releases the program.
+ * @param program The bound program.
+ */
+void PostProcessing::drawFullscreen(QOpenGLShaderProgram &program) {
+  gl->glDisable(GL_DEPTH_TEST);
+  gl->glDisable(GL_BLEND);
+  gl->glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  gl->glBindVertexArray(emptyArray);
+  gl->glDrawArrays(GL_TRIANGLES, 0, 3);
+  gl->glBindVertexArray(0);
+  gl->glEnable(GL_DEPTH_TEST);
+  program.release();
+}
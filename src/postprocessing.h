@@ -0,0 +1,58 @@
+#ifndef POSTPROCESSING_H
+#define POSTPROCESSING_H
+
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLShaderProgram>
+
+#include "rendergraph.h"
+
+/**
+ * @brief The passes that turn the HDR scene into the image on screen: bloom,
+ * tonemapping and FXAA.
+ *
+ * The bloom works on a chain of ever smaller textures, starting at half the
+ * size of the scene. The first downsample keeps only what is brighter than
+ * the threshold, each next one halves the size again, and the upsamples
+ * then add every level to the blurred level below it on the way back up.
+ * These are transient textures of the render graph, which keeps them from
+ * frame to frame while the size of the scene stays the same.
+ *
+ * At full size there are at most two passes: the tonemap adds the bloom,
+ * compresses the highlights and stores the luma for FXAA, and FXAA smooths
+ * the edges while it scales up to the output. Without FXAA the tonemap
+ * writes the output directly. Requires a current context for initialize(),
+ * destroy() and while the passes run.
+ */
+class PostProcessing {
+ public:
+  static constexpr int kBloomLevels = 5;  // half size down to 1/32
+
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  void setBloomEnabled(bool enabled) { bloomEnabled = enabled; }
+  void setFxaaEnabled(bool enabled) { fxaaEnabled = enabled; }
+  bool isEnabled() const { return bloomEnabled || fxaaEnabled; }
+
+  void addPasses(RenderGraph &graph, RenderGraph::Resource scene,
+                 RenderGraph::Resource output);
+
+ private:
+  void drawFullscreen(QOpenGLShaderProgram &program);
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  QOpenGLShaderProgram downsampleProgram;
+  QOpenGLShaderProgram upsampleProgram;
+  QOpenGLShaderProgram tonemapProgram;
+  QOpenGLShaderProgram fxaaProgram;
+  GLuint emptyArray = 0;  // the full-screen triangle has no attributes
+
+  bool bloomEnabled = true;
+  bool fxaaEnabled = true;
+  float bloomThreshold = 1.0F;
+  float bloomKnee = 0.5F;  // width of the soft transition at the threshold
+  float bloomIntensity = 0.6F;
+  float exposure = 1.0F;
+};
+
+#endif  // POSTPROCESSING_H
@@ -0,0 +1,73 @@
+#include "qualitygovernor.h"
+
+namespace {
+
+// From full quality down to the cheapest level.
+constexpr QualityLevel kLadder[] = {
+    {1.0F, 0, 1.0F},   {0.85F, 0, 1.0F},  {0.75F, 0, 1.0F},
+    {0.75F, 0, 0.85F}, {0.75F, 1, 0.85F}, {0.6F, 1, 0.85F},
+    {0.6F, 1, 0.7F},   {0.5F, 2, 0.7F},
+};
+constexpr int kStepCount = sizeof(kLadder) / sizeof(kLadder[0]);
+
+// Weight of a new measurement in the average.
+constexpr float kSmoothing = 0.1F;
+
+// Measurements to wait after a step before the next one.
+constexpr int kCooldown = 20;
+
+// Step down above this fraction of the target, and back up below the lower
+// one. The gap keeps the governor from flipping between two levels.
+constexpr float kDowngradeAbove = 1.1F;
+constexpr float kUpgradeBelow = 0.75F;
+
+}  // namespace
+
+/**
+ * @brief QualityGovernor::update Takes a new GPU frame time and steps the
+ * quality up or down if the average is off target.
+ * @param gpuMilliseconds The measured GPU time of a frame.
+ * @return True if the quality level changed.
+ */
+bool QualityGovernor::update(float gpuMilliseconds) {
+  if (averageFrameTime == 0.0F) {
+    averageFrameTime = gpuMilliseconds;
+  } else {
+    averageFrameTime += (gpuMilliseconds - averageFrameTime) * kSmoothing;
+  }
+
+  if (cooldown > 0) {
+    --cooldown;
+    return false;
+  }
+
+  int newStep = step;
+  if (averageFrameTime > targetFrameTime * kDowngradeAbove) {
+    newStep = step + 1;
+  } else if (averageFrameTime < targetFrameTime * kUpgradeBelow) {
+    newStep = step - 1;
+  }
+  if (newStep < 0 || newStep >= kStepCount || newStep == step) return false;
+
+  step = newStep;
+  cooldown = kCooldown;
+  return true;
+}
+
+/**
+ * @brief QualityGovernor::reset Returns to full quality.
+ */
+void QualityGovernor::reset() {
+  step = 0;
+  cooldown = kCooldown;
+  averageFrameTime = 0.0F;
+}
+
+void QualityGovernor::setTargetFrameTime(float milliseconds) {
+  targetFrameTime = milliseconds;
+  cooldown = 0;
+}
+
+const QualityLevel &QualityGovernor::getLevel() const { return kLadder[step]; }
+
+int QualityGovernor::getStepCount() { return kStepCount; }
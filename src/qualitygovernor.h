@@ -0,0 +1,43 @@
+#ifndef QUALITYGOVERNOR_H
+#define QUALITYGOVERNOR_H
+
+/**
+ * @brief The settings the governor controls.
+ */
+struct QualityLevel {
+  // Render resolution as a fraction of the window size.
+  float renderScale;
+  // Detail level of the streamed terrain, see TerrainStreamer::setDetail().
+  int terrainDetail;
+  // View distance as a fraction of the fog end.
+  float viewDistance;
+};
+
+/**
+ * @brief Holds the GPU frame time near a target by walking a ladder of
+ * quality levels. The render resolution goes first, then the view distance
+ * and the terrain density. The frame time is smoothed, and after every step
+ * the governor waits for the new level to show in the measurements.
+ */
+class QualityGovernor {
+ public:
+  QualityGovernor() = default;
+
+  bool update(float gpuMilliseconds);
+  void reset();
+
+  void setTargetFrameTime(float milliseconds);
+  float getTargetFrameTime() const { return targetFrameTime; }
+  float getAverageFrameTime() const { return averageFrameTime; }
+  const QualityLevel &getLevel() const;
+  int getStep() const { return step; }
+  static int getStepCount();
+
+ private:
+  float targetFrameTime = 16.6F;
+  float averageFrameTime = 0.0F;
+  int step = 0;
+  int cooldown = 0;
+};
+
+#endif  // QUALITYGOVERNOR_H
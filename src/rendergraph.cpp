@@ -0,0 +1,583 @@
+#include "rendergraph.h"
+
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+struct TextureFormat {
+  GLenum format;
+  GLenum type;
+  int bytesPerTexel;
+};
+
+TextureFormat textureFormat(GLenum internalFormat) {
+  switch (internalFormat) {
+    case GL_RGBA16F:
+      return {GL_RGBA, GL_HALF_FLOAT, 8};
+    case GL_DEPTH_COMPONENT24:
+      return {GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4};
+    default:
+      return {GL_RGBA, GL_UNSIGNED_BYTE, 4};
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief RenderGraph::PassBuilder::read Declares that the pass reads a
+ * resource, for example by sampling it.
+ * @param resource The resource.
+ */
+void RenderGraph::PassBuilder::read(Resource resource) {
+  graph.passes[pass].accesses.append({resource, READ, false});
+}
+
+/**
+ * @brief RenderGraph::PassBuilder::write Declares that the pass changes a
+ * resource by its own means, without drawing into it as an attachment.
+ * @param resource The resource.
+ */
+void RenderGraph::PassBuilder::write(Resource resource) {
+  graph.passes[pass].accesses.append({resource, WRITE, false});
+}
+
+/**
+ * @brief RenderGraph::PassBuilder::writeColor Declares that the pass draws
+ * into a color attachment. The attachments are bound in the order they are
+ * declared.
+ * @param resource The resource.
+ * @param clear Whether to clear it to the clear color first, dropping what
+ * earlier passes drew.
+ */
+void RenderGraph::PassBuilder::writeColor(Resource resource, bool clear) {
+  graph.passes[pass].accesses.append({resource, WRITE_COLOR, clear});
+}
+
+/**
+ * @brief RenderGraph::PassBuilder::writeDepth Declares that the pass draws
+ * into the depth attachment.
+ * @param resource The resource.
+ * @param clear Whether to clear it to the far plane first.
+ */
+void RenderGraph::PassBuilder::writeDepth(Resource resource, bool clear) {
+  graph.passes[pass].accesses.append({resource, WRITE_DEPTH, clear});
+}
+
+/**
+ * @brief RenderGraph::PassBuilder::readDepth Declares that the pass tests
+ * against a depth attachment without writing to it.
+ * @param resource The resource.
+ */
+void RenderGraph::PassBuilder::readDepth(Resource resource) {
+  graph.passes[pass].accesses.append({resource, READ_DEPTH, false});
+}
+
+/**
+ * @brief RenderGraph::PassBuilder::setSideEffect Keeps the pass even if
+ * nothing uses what it writes, for passes that hand results outside.
+ */
+void RenderGraph::PassBuilder::setSideEffect() {
+  graph.passes[pass].sideEffect = true;
+}
+
+void RenderGraph::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+}
+
+void RenderGraph::destroy() {
+  if (gl == nullptr) return;
+  for (const PooledFramebuffer &pooled : framebufferPool) {
+    gl->glDeleteFramebuffers(1, &pooled.framebuffer);
+  }
+  for (const PooledTexture &pooled : texturePool) {
+    gl->glDeleteTextures(1, &pooled.texture);
+  }
+  framebufferPool.clear();
+  texturePool.clear();
+  resources.clear();
+  passes.clear();
+}
+
+/**
+ * @brief RenderGraph::createTexture Declares a texture that only lives
+ * during this frame.
+ * @param name Name for messages.
+ * @param desc Size and format.
+ * @return The resource.
+ */
+RenderGraph::Resource RenderGraph::createTexture(const QString &name,
+                                                 const RenderTextureDesc &desc) {
+  ResourceNode node;
+  node.name = name;
+  node.desc = desc;
+  return addResource(node);
+}
+
+/**
+ * @brief RenderGraph::createTarget Declares a transient color texture and a
+ * depth texture of the same size.
+ * @param name Name for messages.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param colorFormat Format of the color texture.
+ * @return The two resources.
+ */
+RenderGraph::Target RenderGraph::createTarget(const QString &name, int width,
+                                              int height, GLenum colorFormat) {
+  Target target;
+  target.color = createTexture(name + " color", {width, height, colorFormat});
+  target.depth =
+      createTexture(name + " depth", {width, height, GL_DEPTH_COMPONENT24});
+  return target;
+}
+
+/**
+ * @brief RenderGraph::importFramebuffer Declares a framebuffer made outside
+ * the graph, such as the one of the window. Its color is what the frame is
+ * for, so the passes that draw it are never culled.
+ * @param name Name for messages.
+ * @param framebuffer The framebuffer.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @return Resources for its color and depth attachments.
+ */
+RenderGraph::Target RenderGraph::importFramebuffer(const QString &name,
+                                                   GLuint framebuffer,
+                                                   int width, int height) {
+  ResourceNode node;
+  node.imported = true;
+  node.framebuffer = framebuffer;
+  node.desc = {width, height, GL_RGBA8};
+  node.name = name + " color";
+  node.output = true;
+  Target target;
+  target.color = addResource(node);
+  node.name = name + " depth";
+  node.desc.format = GL_DEPTH_COMPONENT24;
+  node.output = false;
+  target.depth = addResource(node);
+  return target;
+}
+
+/**
+ * @brief RenderGraph::importTexture Declares a texture that lives outside
+ * the graph, so that passes can depend on each other through it.
+ * @param name Name for messages.
+ * @param texture The texture.
+ * @return The resource.
+ */
+RenderGraph::Resource RenderGraph::importTexture(const QString &name,
+                                                 GLuint texture) {
+  ResourceNode node;
+  node.name = name;
+  node.imported = true;
+  node.texture = texture;
+  return addResource(node);
+}
+
+/**
+ * @brief RenderGraph::addPass Adds a pass to the frame.
+ * @param name Name for messages.
+ * @param setup Declares the accesses of the pass, called right away.
+ * @param run Draws the pass, called by execute() unless the pass is culled.
+ */
+void RenderGraph::addPass(const QString &name,
+                          const std::function<void(PassBuilder &)> &setup,
+                          const std::function<void()> &run) {
+  PassNode node;
+  node.name = name;
+  node.run = run;
+  passes.append(node);
+  PassBuilder builder(*this, passes.size() - 1);
+  setup(builder);
+}
+
+/**
+ * @brief RenderGraph::execute Runs the passes of the frame, see the class
+ * description, and starts the next frame with an empty graph.
+ */
+void RenderGraph::execute() {
+  QVector<int> schedule = cullPasses(sortPasses());
+  allocateTextures(schedule);
+
+  currentFramebuffer = 0;
+  for (int index : schedule) {
+    const PassNode &pass = passes[index];
+    if (!bindAttachments(pass)) {
+      qWarning() << "RenderGraph: pass" << pass.name
+                 << "mixes imported and transient attachments, skipped";
+      continue;
+    }
+    pass.run();
+  }
+
+  stats.passes = schedule.size();
+  stats.culledPasses = passes.size() - schedule.size();
+  releaseUnused();
+  resources.clear();
+  passes.clear();
+}
+
+/**
+ * @brief RenderGraph::getTexture Returns the GL texture of a resource. For
+ * transient textures only valid while the passes run.
+ * @param resource The resource.
+ */
+GLuint RenderGraph::getTexture(Resource resource) const {
+  return resources[resource].texture;
+}
+
+/**
+ * @brief RenderGraph::blit Scales a color resource into the color
+ * attachment of the running pass, filtering linearly. The pass has to read
+ * the resource.
+ * @param source The resource to copy.
+ * @param target Where it goes in the attachment, in pixels from the bottom
+ * left. All of the attachment if empty.
+ */
+void RenderGraph::blit(Resource source, const QRect &target) {
+  const ResourceNode &node = resources[source];
+  GLuint readFramebuffer = node.framebuffer;
+  if (!node.imported) {
+    readFramebuffer = framebufferFor(&node.texture, 1, 0);
+  }
+  QRect rect = target.isEmpty() ? QRect(0, 0, currentWidth, currentHeight)
+                                : target;
+  gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+  gl->glBlitFramebuffer(0, 0, node.desc.width, node.desc.height, rect.left(),
+                        rect.top(), rect.left() + rect.width(),
+                        rect.top() + rect.height(), GL_COLOR_BUFFER_BIT,
+                        GL_LINEAR);
+  gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, currentFramebuffer);
+}
+
+bool RenderGraph::isWrite(AccessKind kind) {
+  return kind == WRITE || kind == WRITE_COLOR || kind == WRITE_DEPTH;
+}
+
+RenderGraph::Resource RenderGraph::addResource(const ResourceNode &node) {
+  resources.append(node);
+  return resources.size() - 1;
+}
+
+/**
+ * @brief RenderGraph::sortPasses Orders the passes so that every pass comes
+ * after the passes whose results it uses and before the passes that
+ * overwrite what it reads, otherwise in the order they were added.
+ * @return Indices of the passes in running order.
+ */
+QVector<int> RenderGraph::sortPasses() const {
+  int count = passes.size();
+  QVector<QVector<int>> successors(count);
+  QVector<int> predecessorCounts(count, 0);
+  auto addEdge = [&](int from, int to) {
+    if (from == to || successors[from].contains(to)) return;
+    successors[from].append(to);
+    predecessorCounts[to]++;
+  };
+
+  for (Resource resource = 0; resource != resources.size(); ++resource) {
+    // Writers keep the order they were added in. A reader comes after the
+    // writer added before it and before the next one, so that it sees what
+    // that writer left. Readers added before any writer read the result of
+    // the last one.
+    int lastWriter = -1;
+    QVector<int> readers;       // since the last writer
+    QVector<int> earlyReaders;  // before the first writer
+    for (int pass = 0; pass != count; ++pass) {
+      bool reads = false;
+      bool writes = false;
+      for (const Access &access : passes[pass].accesses) {
+        if (access.resource != resource) continue;
+        (isWrite(access.kind) ? writes : reads) = true;
+      }
+      if (writes) {
+        if (lastWriter != -1) addEdge(lastWriter, pass);
+        for (int reader : readers) {
+          addEdge(reader, pass);
+        }
+        readers.clear();
+        lastWriter = pass;
+      } else if (reads && lastWriter != -1) {
+        addEdge(lastWriter, pass);
+        readers.append(pass);
+      } else if (reads) {
+        earlyReaders.append(pass);
+      }
+    }
+    if (lastWriter == -1) continue;
+    for (int reader : earlyReaders) {
+      addEdge(lastWriter, reader);
+    }
+  }
+
+  // Kahn's algorithm, taking the earliest added pass that is ready
+  QVector<int> order;
+  QVector<bool> done(count, false);
+  while (order.size() != count) {
+    int next = -1;
+    for (int pass = 0; pass != count; ++pass) {
+      if (!done[pass] && predecessorCounts[pass] == 0) {
+        next = pass;
+        break;
+      }
+    }
+    if (next == -1) {
+      qWarning() << "RenderGraph: the passes depend on each other in a "
+                    "cycle, running them in the order they were added";
+      order.clear();
+      for (int pass = 0; pass != count; ++pass) order.append(pass);
+      return order;
+    }
+    done[next] = true;
+    order.append(next);
+    for (int successor : successors[next]) {
+      predecessorCounts[successor]--;
+    }
+  }
+  return order;
+}
+
+/**
+ * @brief RenderGraph::cullPasses Drops the passes whose writes nothing uses,
+ * going backwards from the outputs.
+ * @param order Indices of the passes in running order.
+ * @return The passes to run, in running order.
+ */
+QVector<int> RenderGraph::cullPasses(const QVector<int> &order) const {
+  // Whether the contents of each resource are still needed at this point
+  QVector<bool> needed(resources.size());
+  for (Resource resource = 0; resource != resources.size(); ++resource) {
+    needed[resource] = resources[resource].output;
+  }
+
+  QVector<int> schedule;
+  for (int i = order.size() - 1; i >= 0; --i) {
+    const PassNode &pass = passes[order[i]];
+    bool keep = pass.sideEffect;
+    for (const Access &access : pass.accesses) {
+      if (isWrite(access.kind) && needed[access.resource]) keep = true;
+    }
+    if (!keep) continue;
+    schedule.prepend(order[i]);
+
+    // What this pass clears was not needed before it
+    for (const Access &access : pass.accesses) {
+      if (isWrite(access.kind)) needed[access.resource] = !access.clear;
+    }
+    for (const Access &access : pass.accesses) {
+      if (!isWrite(access.kind)) needed[access.resource] = true;
+    }
+  }
+  return schedule;
+}
+
+/**
+ * @brief RenderGraph::allocateTextures Assigns a pooled GL texture to every
+ * transient texture that the scheduled passes use, sharing textures between
+ * resources whose uses do not overlap.
+ * @param schedule The passes to run, in running order.
+ */
+void RenderGraph::allocateTextures(const QVector<int> &schedule) {
+  for (int position = 0; position != schedule.size(); ++position) {
+    for (const Access &access : passes[schedule[position]].accesses) {
+      ResourceNode &node = resources[access.resource];
+      if (node.firstUse == -1) node.firstUse = position;
+      node.lastUse = position;
+    }
+  }
+
+  QVector<Resource> transients;
+  for (Resource resource = 0; resource != resources.size(); ++resource) {
+    if (!resources[resource].imported && resources[resource].firstUse != -1) {
+      transients.append(resource);
+    }
+  }
+  std::stable_sort(transients.begin(), transients.end(),
+                   [this](Resource a, Resource b) {
+                     return resources[a].firstUse < resources[b].firstUse;
+                   });
+
+  for (PooledTexture &pooled : texturePool) {
+    pooled.busyUntil = -1;
+    pooled.used = false;
+  }
+  for (Resource resource : transients) {
+    ResourceNode &node = resources[resource];
+    PooledTexture *match = nullptr;
+    for (PooledTexture &pooled : texturePool) {
+      if (pooled.desc == node.desc && pooled.busyUntil < node.firstUse) {
+        match = &pooled;
+        break;
+      }
+    }
+    if (match == nullptr) {
+      PooledTexture pooled;
+      pooled.desc = node.desc;
+      TextureFormat format = textureFormat(node.desc.format);
+      bool depth = node.desc.format == GL_DEPTH_COMPONENT24;
+      gl->glGenTextures(1, &pooled.texture);
+      gl->glBindTexture(GL_TEXTURE_2D, pooled.texture);
+      gl->glTexImage2D(GL_TEXTURE_2D, 0, node.desc.format, node.desc.width,
+                       node.desc.height, 0, format.format, format.type,
+                       nullptr);
+      gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                          depth ? GL_NEAREST : GL_LINEAR);
+      gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                          depth ? GL_NEAREST : GL_LINEAR);
+      gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      gl->glBindTexture(GL_TEXTURE_2D, 0);
+      texturePool.append(pooled);
+      match = &texturePool.last();
+    }
+    match->busyUntil = node.lastUse;
+    match->used = true;
+    node.texture = match->texture;
+  }
+
+  stats.transientTextures = transients.size();
+  stats.textures = 0;
+  stats.textureBytes = 0;
+  for (const PooledTexture &pooled : texturePool) {
+    if (!pooled.used) continue;
+    stats.textures++;
+    stats.textureBytes += static_cast<qsizetype>(pooled.desc.width) *
+                          pooled.desc.height *
+                          textureFormat(pooled.desc.format).bytesPerTexel;
+  }
+}
+
+/**
+ * @brief RenderGraph::bindAttachments Binds the framebuffer of the
+ * attachments of a pass, sets the viewport and does the clears it asked for.
+ * Passes without attachments leave the framebuffer as it is.
+ * @param pass The pass.
+ * @return False if the attachments cannot be bound together.
+ */
+bool RenderGraph::bindAttachments(const PassNode &pass) {
+  GLuint colors[kMaxColorAttachments] = {};
+  int colorCount = 0;
+  GLuint depth = 0;
+  GLuint imported = 0;
+  bool anyImported = false;
+  bool anyTransient = false;
+  GLbitfield clearBits = 0;
+  int width = 0;
+  int height = 0;
+
+  for (const Access &access : pass.accesses) {
+    if (access.kind != WRITE_COLOR && access.kind != WRITE_DEPTH &&
+        access.kind != READ_DEPTH) {
+      continue;
+    }
+    const ResourceNode &node = resources[access.resource];
+    if (node.imported) {
+      if (anyImported && node.framebuffer != imported) return false;
+      imported = node.framebuffer;
+      anyImported = true;
+    } else {
+      anyTransient = true;
+      if (access.kind != WRITE_COLOR) {
+        depth = node.texture;
+      } else if (colorCount != kMaxColorAttachments) {
+        colors[colorCount++] = node.texture;
+      }
+    }
+    width = node.desc.width;
+    height = node.desc.height;
+    if (access.clear) {
+      clearBits |= access.kind == WRITE_COLOR ? GL_COLOR_BUFFER_BIT
+                                              : GL_DEPTH_BUFFER_BIT;
+    }
+  }
+  if (!anyImported && !anyTransient) return true;
+  if (anyImported && anyTransient) return false;
+
+  currentFramebuffer =
+      anyImported ? imported : framebufferFor(colors, colorCount, depth);
+  currentWidth = width;
+  currentHeight = height;
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, currentFramebuffer);
+  gl->glViewport(0, 0, width, height);
+  if (clearBits != 0) {
+    if (clearBits & GL_DEPTH_BUFFER_BIT) gl->glDepthMask(GL_TRUE);
+    gl->glClear(clearBits);
+  }
+  return true;
+}
+
+/**
+ * @brief RenderGraph::framebufferFor Returns a pooled framebuffer with the
+ * given attachments, creating it if needed. Leaves the framebuffer of the
+ * running pass bound.
+ * @param colors The color textures.
+ * @param colorCount Number of color textures.
+ * @param depth The depth texture, or zero.
+ * @return The framebuffer.
+ */
+GLuint RenderGraph::framebufferFor(const GLuint *colors, int colorCount,
+                                   GLuint depth) {
+  for (PooledFramebuffer &pooled : framebufferPool) {
+    if (pooled.colorCount == colorCount && pooled.depth == depth &&
+        std::equal(colors, colors + colorCount, pooled.colors)) {
+      pooled.used = true;
+      return pooled.framebuffer;
+    }
+  }
+
+  PooledFramebuffer pooled;
+  std::copy(colors, colors + colorCount, pooled.colors);
+  pooled.colorCount = colorCount;
+  pooled.depth = depth;
+  pooled.used = true;
+  gl->glGenFramebuffers(1, &pooled.framebuffer);
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, pooled.framebuffer);
+  GLenum drawBuffers[kMaxColorAttachments];
+  for (int i = 0; i != colorCount; ++i) {
+    gl->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
+                               GL_TEXTURE_2D, colors[i], 0);
+    drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+  }
+  if (depth != 0) {
+    gl->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_TEXTURE_2D, depth, 0);
+  }
+  if (colorCount == 0) {
+    gl->glDrawBuffer(GL_NONE);
+    gl->glReadBuffer(GL_NONE);
+  } else {
+    gl->glDrawBuffers(colorCount, drawBuffers);
+  }
+  if (gl->glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+      GL_FRAMEBUFFER_COMPLETE) {
+    qWarning() << "RenderGraph: framebuffer with" << colorCount
+               << "color attachments is incomplete";
+  }
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, currentFramebuffer);
+  framebufferPool.append(pooled);
+  return pooled.framebuffer;
+}
+
+/**
+ * @brief RenderGraph::releaseUnused Deletes the pooled textures and
+ * framebuffers that the frame did not use, such as the ones of an earlier
+ * window size.
+ */
+void RenderGraph::releaseUnused() {
+  for (int i = framebufferPool.size() - 1; i >= 0; --i) {
+    PooledFramebuffer &pooled = framebufferPool[i];
+    if (pooled.used) {
+      pooled.used = false;
+      continue;
+    }
+    gl->glDeleteFramebuffers(1, &pooled.framebuffer);
+    framebufferPool.remove(i);
+  }
+  for (int i = texturePool.size() - 1; i >= 0; --i) {
+    if (texturePool[i].used) continue;
+    gl->glDeleteTextures(1, &texturePool[i].texture);
+    texturePool.remove(i);
+  }
+}
@@ -0,0 +1,182 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <QOpenGLFunctions_3_3_Core>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+/**
+ * @brief Size and format of a texture that passes draw into.
+ */
+struct RenderTextureDesc {
+  int width = 0;
+  int height = 0;
+  GLenum format = GL_RGBA8;  // GL_RGBA8, GL_RGBA16F or GL_DEPTH_COMPONENT24
+
+  bool operator==(const RenderTextureDesc &other) const {
+    return width == other.width && height == other.height &&
+           format == other.format;
+  }
+};
+
+/**
+ * @brief Counters of the last frame run by a RenderGraph.
+ */
+struct RenderGraphStats {
+  int passes = 0;
+  int culledPasses = 0;
+  int transientTextures = 0;  // declared by the passes that ran
+  int textures = 0;           // GL textures they were aliased to
+  qsizetype textureBytes = 0;
+};
+
+/**
+ * @brief The passes of a frame and the textures they draw into, declared
+ * anew every frame and then run in one go.
+ *
+ * Each pass declares the resources it reads and writes when it is added.
+ * execute() then
+ *  - orders the passes: the writers of a resource keep the order in which
+ *    they were added, and a pass that only reads a resource runs between
+ *    the writer added before it and the next one. A reader added before
+ *    all writers runs after the last of them;
+ *  - culls the passes whose results nothing uses. The color of an imported
+ *    framebuffer, such as the window, is used, and so are passes with side
+ *    effects. A write that clears hides the writes before it;
+ *  - gives every transient texture a GL texture for the passes from its
+ *    first to its last use. Transient textures of the same size and format
+ *    whose uses do not overlap share one GL texture. The GL textures and
+ *    framebuffers are kept for the next frames and deleted once a frame does
+ *    not use them;
+ *  - binds the framebuffer of the attachments of each pass, sets the
+ *    viewport to their size and clears them if asked, then runs the pass.
+ *
+ * The first write of a transient texture has to clear it or cover all of
+ * it, as it may hold what another texture held before. Requires a current
+ * context for initialize(), destroy(), execute() and blit().
+ */
+class RenderGraph {
+ public:
+  using Resource = int;
+
+  static constexpr int kMaxColorAttachments = 4;
+
+  /**
+   * @brief A color and a depth resource that are drawn into together.
+   */
+  struct Target {
+    Resource color = -1;
+    Resource depth = -1;
+  };
+
+  /**
+   * @brief Collects the accesses of a pass while it is added.
+   */
+  class PassBuilder {
+   public:
+    void read(Resource resource);
+    void write(Resource resource);
+    void writeColor(Resource resource, bool clear = false);
+    void writeDepth(Resource resource, bool clear = false);
+    void readDepth(Resource resource);
+    void setSideEffect();
+
+   private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph &graph, int pass) : graph(graph), pass(pass) {}
+
+    RenderGraph &graph;
+    int pass;
+  };
+
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  Resource createTexture(const QString &name, const RenderTextureDesc &desc);
+  Target createTarget(const QString &name, int width, int height,
+                      GLenum colorFormat);
+  Target importFramebuffer(const QString &name, GLuint framebuffer, int width,
+                           int height);
+  Resource importTexture(const QString &name, GLuint texture);
+  void addPass(const QString &name,
+               const std::function<void(PassBuilder &)> &setup,
+               const std::function<void()> &run);
+
+  void execute();
+
+  const RenderTextureDesc &getDesc(Resource resource) const {
+    return resources[resource].desc;
+  }
+  GLuint getTexture(Resource resource) const;
+  void blit(Resource source, const QRect &target = QRect());
+
+  const RenderGraphStats &getStats() const { return stats; }
+
+ private:
+  enum AccessKind { READ, WRITE, WRITE_COLOR, WRITE_DEPTH, READ_DEPTH };
+
+  struct Access {
+    Resource resource;
+    AccessKind kind;
+    bool clear;
+  };
+
+  struct ResourceNode {
+    QString name;
+    RenderTextureDesc desc;
+    bool imported = false;
+    bool output = false;      // used after the frame, by whoever imported it
+    GLuint framebuffer = 0;   // of an imported framebuffer
+    GLuint texture = 0;       // imported, or aliased while the graph runs
+    int firstUse = -1;        // position in the schedule
+    int lastUse = -1;
+  };
+
+  struct PassNode {
+    QString name;
+    QVector<Access> accesses;
+    std::function<void()> run;
+    bool sideEffect = false;
+  };
+
+  struct PooledTexture {
+    RenderTextureDesc desc;
+    GLuint texture = 0;
+    int busyUntil = -1;  // last position in the schedule that uses it
+    bool used = false;   // in this frame
+  };
+
+  struct PooledFramebuffer {
+    GLuint colors[kMaxColorAttachments] = {};
+    int colorCount = 0;
+    GLuint depth = 0;
+    GLuint framebuffer = 0;
+    bool used = false;  // in this frame
+  };
+
+  static bool isWrite(AccessKind kind);
+  Resource addResource(const ResourceNode &node);
+  QVector<int> sortPasses() const;
+  QVector<int> cullPasses(const QVector<int> &order) const;
+  void allocateTextures(const QVector<int> &schedule);
+  bool bindAttachments(const PassNode &pass);
+  GLuint framebufferFor(const GLuint *colors, int colorCount, GLuint depth);
+  void releaseUnused();
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  QVector<ResourceNode> resources;
+  QVector<PassNode> passes;
+  QVector<PooledTexture> texturePool;
+  QVector<PooledFramebuffer> framebufferPool;
+
+  // The attachments of the running pass
+  GLuint currentFramebuffer = 0;
+  int currentWidth = 0;
+  int currentHeight = 0;
+
+  RenderGraphStats stats;
+};
+
+#endif  // RENDERGRAPH_H
@@ -0,0 +1,185 @@
+#include "scrollingheightmap.h"
+
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Modulo that stays positive for negative rows.
+int wrap(int value, int size) { return ((value % size) + size) % size; }
+
+}  // namespace
+
+void ScrollingHeightMap::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+  gl->glGenTextures(1, &texture);
+  gl->glBindTexture(GL_TEXTURE_2D, texture);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  gl->glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ScrollingHeightMap::destroy() {
+  if (gl == nullptr) return;
+  gl->glDeleteTextures(1, &texture);
+  texture = 0;
+  valid = false;
+}
+
+/**
+ * @brief ScrollingHeightMap::setSource Takes the heights from the red channel
+ * of an image. Not mirrored, so that texel (x, y) matches
+ * image.pixelColor(x, y).
+ * @param image The height image.
+ */
+void ScrollingHeightMap::setSource(const QImage &image) {
+  QImage pixels = image.convertToFormat(QImage::Format_RGB32);
+  width = pixels.width();
+  sourceHeight = pixels.height();
+  source.resize(width * sourceHeight);
+  for (int y = 0; y != sourceHeight; ++y) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(pixels.constScanLine(y));
+    for (int x = 0; x != width; ++x) {
+      source[y * width + x] = static_cast<quint16>(qRed(line[x]) * 257);
+    }
+  }
+  valid = false;
+}
+
+/**
+ * @brief ScrollingHeightMap::setHeights Replaces the heights. The window is
+ * uploaded again on the next update(), so the size must not change after
+ * setWindow().
+ * @param newWidth Number of samples per row.
+ * @param newHeight Number of rows.
+ * @param values The heights from 0 to 1, row by row.
+ */
+void ScrollingHeightMap::setHeights(int newWidth, int newHeight,
+                                    const QVector<float> &values) {
+  width = newWidth;
+  sourceHeight = newHeight;
+  source.resize(width * sourceHeight);
+  for (int i = 0; i != source.size(); ++i) {
+    source[i] =
+        static_cast<quint16>(qBound(0.0F, values[i], 1.0F) * 65535.0F + 0.5F);
+  }
+  valid = false;
+}
+
+/**
+ * @brief ScrollingHeightMap::setHeights Replaces the heights in a region. The
+ * part of it in the window is uploaded on the next update(). Needs no
+ * context.
+ * @param region The samples that changed.
+ * @param values All heights from 0 to 1, row by row, of the size given to
+ * setSource() or setHeights(). Only the region is read.
+ */
+void ScrollingHeightMap::setHeights(const QRect &region,
+                                    const QVector<float> &values) {
+  QRect clipped = region & QRect(0, 0, width, sourceHeight);
+  if (clipped.isEmpty()) return;
+  for (int y = clipped.top(); y <= clipped.bottom(); ++y) {
+    for (int x = clipped.left(); x <= clipped.right(); ++x) {
+      int i = y * width + x;
+      source[i] =
+          static_cast<quint16>(qBound(0.0F, values[i], 1.0F) * 65535.0F + 0.5F);
+    }
+  }
+  dirtyRegion |= clipped;
+}
+
+/**
+ * @brief ScrollingHeightMap::setWindow Sets the rows kept on the GPU and
+ * reallocates the texture. Call update() afterwards to fill it.
+ * @param firstRow The first row of the window relative to the integer part
+ * of the scroll offset.
+ * @param rowCount Number of rows in the window.
+ */
+void ScrollingHeightMap::setWindow(int firstRow, int rowCount) {
+  rowOffset = firstRow;
+  rows = rowCount;
+  gl->glBindTexture(GL_TEXTURE_2D, texture);
+  gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, width, rows, 0, GL_RED,
+                   GL_UNSIGNED_SHORT, nullptr);
+  gl->glBindTexture(GL_TEXTURE_2D, 0);
+  valid = false;
+}
+
+/**
+ * @brief ScrollingHeightMap::update Moves the window to a new scroll offset,
+ * uploading the rows that came into view.
+ * @param scroll The scroll offset in image rows.
+ * @return Number of rows uploaded.
+ */
+int ScrollingHeightMap::update(float scroll) {
+  if (rows == 0 || sourceHeight == 0) return 0;
+  int first = static_cast<int>(std::floor(scroll)) + rowOffset;
+  if (valid && first == firstRow && dirtyRegion.isEmpty()) return 0;
+
+  int uploaded = 0;
+  if (!valid || std::abs(first - firstRow) >= rows) {
+    // A jump, such as the scroll offset starting over: refill the window
+    uploadRows(first, first + rows);
+    uploaded = rows;
+    dirtyRegion = QRect();
+  } else if (first > firstRow) {
+    uploadRows(firstRow + rows, first + rows);
+    uploaded = first - firstRow;
+  } else if (first < firstRow) {
+    uploadRows(first, firstRow);
+    uploaded = firstRow - first;
+  }
+  firstRow = first;
+  valid = true;
+
+  if (!dirtyRegion.isEmpty()) {
+    uploaded += uploadRegion(dirtyRegion);
+    dirtyRegion = QRect();
+  }
+  return uploaded;
+}
+
+/**
+ * @brief ScrollingHeightMap::uploadRows Copies image rows into their ring
+ * positions in the texture.
+ * @param first First image row to upload.
+ * @param last One past the last image row to upload.
+ */
+void ScrollingHeightMap::uploadRows(int first, int last) {
+  gl->glBindTexture(GL_TEXTURE_2D, texture);
+  gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+  for (int row = first; row != last; ++row) {
+    const quint16 *data = source.constData() + wrap(row, sourceHeight) * width;
+    gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, wrap(row, rows), width, 1,
+                        GL_RED, GL_UNSIGNED_SHORT, data);
+  }
+  gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  gl->glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * @brief ScrollingHeightMap::uploadRegion Copies the part of a region of the
+ * image that is in the window into the texture.
+ * @param region The samples to upload.
+ * @return Number of partial rows uploaded.
+ */
+int ScrollingHeightMap::uploadRegion(const QRect &region) {
+  gl->glBindTexture(GL_TEXTURE_2D, texture);
+  gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+  int uploaded = 0;
+  for (int y = region.top(); y <= region.bottom(); ++y) {
+    const quint16 *data = source.constData() + y * width + region.left();
+    // Every window row showing the image row, the window may wrap around
+    for (int row = firstRow + wrap(y - firstRow, sourceHeight);
+         row < firstRow + rows; row += sourceHeight) {
+      gl->glTexSubImage2D(GL_TEXTURE_2D, 0, region.left(), wrap(row, rows),
+                          region.width(), 1, GL_RED, GL_UNSIGNED_SHORT, data);
+      ++uploaded;
+    }
+  }
+  gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  gl->glBindTexture(GL_TEXTURE_2D, 0);
+  return uploaded;
+}
@@ -0,0 +1,56 @@
+#ifndef SCROLLINGHEIGHTMAP_H
+#define SCROLLINGHEIGHTMAP_H
+
+#include <QImage>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QRect>
+#include <QVector>
+
+/**
+ * @brief A window of rows of a height image on the GPU that scrolls along
+ * with the terrain.
+ *
+ * The texture holds just the rows the terrain mesh can reach and is used as
+ * a ring: image row r lives in texture row r modulo the row count, so the
+ * shader wraps the row index instead of the data moving. The texels are
+ * 16-bit, so that heights finer than the steps of the image, such as those
+ * of the erosion, survive; a full red channel still reads as 1. When the
+ * scroll offset crosses a row boundary, only the rows that came into view are
+ * uploaded, one texture row each. Edits of a region of the heights upload
+ * just that part of the rows in the window on the next update. Rows past the
+ * end of the image wrap around to its start. Requires a current context for
+ * all calls.
+ */
+class ScrollingHeightMap {
+ public:
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  void setSource(const QImage &image);
+  void setHeights(int newWidth, int newHeight, const QVector<float> &values);
+  void setHeights(const QRect &region, const QVector<float> &values);
+  void setWindow(int firstRow, int rowCount);
+  int update(float scroll);
+
+  GLuint getTexture() const { return texture; }
+  int getRowCount() const { return rows; }
+
+ private:
+  void uploadRows(int first, int last);
+  int uploadRegion(const QRect &region);
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  GLuint texture = 0;
+
+  QVector<quint16> source;  // heights from 0 to 65535, row by row
+  int width = 0;
+  int sourceHeight = 0;
+
+  int rowOffset = 0;  // first row of the window relative to the scroll
+  int rows = 0;
+  int firstRow = 0;     // image row in the first row of the window
+  bool valid = false;   // whether the texture holds the window at firstRow
+  QRect dirtyRegion;    // samples changed since the last update
+};
+
+#endif  // SCROLLINGHEIGHTMAP_H
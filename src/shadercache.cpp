@@ -0,0 +1,186 @@
+#include "shadercache.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include "cascadedshadowmap.h"
+
+namespace {
+
+struct FeatureName {
+  unsigned feature;
+  const char *name;
+};
+
+constexpr FeatureName kFeatureNames[] = {
+    {HEIGHT_MAP_DISPLACEMENT, "HEIGHT_MAP_DISPLACEMENT"},
+    {HEIGHT_MAP_NORMALS, "HEIGHT_MAP_NORMALS"},
+    {COLOR_LINE, "COLOR_LINE"},
+    {COLOR_PALETTE, "COLOR_PALETTE"},
+    {COLOR_MATERIAL, "COLOR_MATERIAL"},
+    {LIGHTING_VERTEX, "LIGHTING_VERTEX"},
+    {LIGHTING_FRAGMENT, "LIGHTING_FRAGMENT"},
+    {FOG, "FOG"},
+    {WIREFRAME, "WIREFRAME"},
+    {SHADOWS, "SHADOWS"},
+};
+
+QByteArray readSource(const QString &path) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qDebug() << "Could not open shader" << path;
+    return QByteArray();
+  }
+  return file.readAll();
+}
+
+}  // namespace
+
+/**
+ * @brief shadingFeatures Picks the features of the terrain shader for a
+ * shading mode and the settings that apply to it.
+ * @param shading The shading mode.
+ * @param heightMap Whether the vertices are displaced by the height map,
+ * rather than bringing their own heights and normals.
+ * @param shadows Whether shadows are on, they only apply to Phong shading.
+ * @param fog Whether fog is on.
+ * @param wireframe Whether the wireframe is drawn by the shader, Phong
+ * shading has none.
+ * @return Bitmask of ShaderFeature values.
+ */
+unsigned shadingFeatures(ShadingMode shading, bool heightMap, bool shadows,
+                         bool fog, bool wireframe) {
+  unsigned features = 0;
+  switch (shading) {
+    case NORMAL:
+      features = COLOR_LINE;
+      break;
+    case PHONG:
+      features = COLOR_MATERIAL | LIGHTING_FRAGMENT;
+      break;
+    case BLACKGREENWHITE:
+      features = COLOR_PALETTE | LIGHTING_VERTEX;
+      break;
+    case RAINBOWLAYERS:
+      features = COLOR_PALETTE;
+      break;
+  }
+  if (heightMap) {
+    features |= HEIGHT_MAP_DISPLACEMENT;
+    if (features & (LIGHTING_VERTEX | LIGHTING_FRAGMENT)) {
+      features |= HEIGHT_MAP_NORMALS;
+    }
+  }
+  if (shadows && (features & LIGHTING_FRAGMENT)) features |= SHADOWS;
+  if (fog) features |= FOG;
+  if (wireframe && shading != PHONG) features |= WIREFRAME;
+  return features;
+}
+
+/**
+ * @brief ShaderCache::ShaderCache Loads the sources of the shader. They must
+ * not start with a #version line, header() adds it.
+ * @param vertexPath Path of the vertex shader source.
+ * @param fragmentPath Path of the fragment shader source.
+ * @param fragmentLibraries Paths of sources with functions the fragment
+ * shader uses, see load().
+ */
+ShaderCache::ShaderCache(const QString &vertexPath, const QString &fragmentPath,
+                         const QStringList &fragmentLibraries)
+    : vertexPath(vertexPath),
+      fragmentPath(fragmentPath),
+      fragmentLibraries(fragmentLibraries) {}
+
+ShaderCache::~ShaderCache() { qDeleteAll(variants); }
+
+/**
+ * @brief ShaderCache::header Creates the lines that precede the source of a
+ * variant: the version, the constants shared with the C++ side and one
+ * #define per feature.
+ * @param features Bitmask of ShaderFeature values.
+ * @return The header.
+ */
+QByteArray ShaderCache::header(unsigned features) {
+  QByteArray header("#version 330 core\n");
+  header += "#define CASCADE_COUNT " +
+            QByteArray::number(CascadedShadowMap::kCascadeCount) + '\n';
+  for (const FeatureName &feature : kFeatureNames) {
+    if (features & feature.feature) {
+      header += "#define ";
+      header += feature.name;
+      header += '\n';
+    }
+  }
+  // Keep the line numbers of the compiler errors in line with the file
+  header += "#line 1\n";
+  return header;
+}
+
+/**
+ * @brief ShaderCache::load Reads a shader source, preceded by the libraries
+ * it uses. GLSL has no #include, so shared functions are put in front of
+ * the shaders that call them. The line numbers of each file start over.
+ * @param path Path of the source.
+ * @param libraries Paths of the libraries, in the order they are needed.
+ * @return The source, to go after header().
+ */
+QByteArray ShaderCache::load(const QString &path,
+                             const QStringList &libraries) {
+  QByteArray source;
+  for (const QString &library : libraries) {
+    source += readSource(library);
+    source += "\n#line 1\n";
+  }
+  return source + readSource(path);
+}
+
+/**
+ * @brief ShaderCache::program Returns the variant with the given features,
+ * compiling it the first time it is asked for.
+ * @param features Bitmask of ShaderFeature values.
+ * @return The linked program, or nullptr if the variant failed to compile or
+ * link. The failure is kept as well, so the errors are only logged once.
+ */
+QOpenGLShaderProgram *ShaderCache::program(unsigned features) {
+  auto found = variants.constFind(features);
+  if (found != variants.constEnd()) return found.value();
+
+  if (vertexSource.isEmpty()) {
+    vertexSource = load(vertexPath);
+    fragmentSource = load(fragmentPath, fragmentLibraries);
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QByteArray defines = header(features);
+  auto *program = new QOpenGLShaderProgram();
+  bool linked =
+      program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex,
+                                                defines + vertexSource) &&
+      program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment,
+                                                defines + fragmentSource) &&
+      program->link();
+  if (!linked) {
+    qWarning() << "Shader variant" << Qt::hex << features << "failed:"
+               << program->log();
+    delete program;
+    program = nullptr;
+  } else {
+    qDebug() << ":: Shader variant" << Qt::hex << features << Qt::dec
+             << "ready in" << timer.elapsed() << "ms";
+  }
+
+  variants.insert(features, program);
+  return program;
+}
+
+/**
+ * @brief ShaderCache::clear Deletes all variants. The binaries stay in the
+ * disk cache.
+ */
+void ShaderCache::clear() {
+  qDeleteAll(variants);
+  variants.clear();
+}
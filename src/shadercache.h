@@ -0,0 +1,62 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QOpenGLShaderProgram>
+#include <QString>
+#include <QStringList>
+
+#include "shadingmode.h"
+
+/**
+ * @brief The features of the terrain shader. Each one is a #define of the
+ * same name in the shader source.
+ */
+enum ShaderFeature : unsigned {
+  HEIGHT_MAP_DISPLACEMENT = 1U << 0,
+  HEIGHT_MAP_NORMALS = 1U << 1,
+  COLOR_LINE = 1U << 2,
+  COLOR_PALETTE = 1U << 3,
+  COLOR_MATERIAL = 1U << 4,
+  LIGHTING_VERTEX = 1U << 5,
+  LIGHTING_FRAGMENT = 1U << 6,
+  FOG = 1U << 7,
+  WIREFRAME = 1U << 8,
+  SHADOWS = 1U << 9,
+};
+
+unsigned shadingFeatures(ShadingMode shading, bool heightMap, bool shadows,
+                         bool fog, bool wireframe);
+
+/**
+ * @brief Compiles variants of one shader source on demand and keeps them by
+ * their feature bitmask, so every variant only runs the code it needs.
+ *
+ * The sources are compiled through Qt's program binary cache, so variants
+ * that were used before are loaded from disk instead of being compiled again.
+ * Requires a current context; clear() must run while it is still current.
+ */
+class ShaderCache {
+ public:
+  ShaderCache(const QString &vertexPath, const QString &fragmentPath,
+              const QStringList &fragmentLibraries = QStringList());
+  ~ShaderCache();
+
+  QOpenGLShaderProgram *program(unsigned features);
+  void clear();
+
+  int getVariantCount() const { return variants.size(); }
+
+  static QByteArray header(unsigned features);
+  static QByteArray load(const QString &path,
+                         const QStringList &libraries = QStringList());
+
+ private:
+  QString vertexPath, fragmentPath;
+  QStringList fragmentLibraries;
+  QByteArray vertexSource, fragmentSource;
+  QHash<unsigned, QOpenGLShaderProgram *> variants;
+};
+
+#endif  // SHADERCACHE_H
@@ -0,0 +1,71 @@
+#version 330 core
+
+// Halves the size of a bloom level with 13 bilinear taps, which do not
+// flicker as the image moves by less than a texel. The first downsample
+// also keeps only what is brighter than the threshold, and weighs its taps
+// down where they are bright so that single bright pixels do not blink.
+
+in vec2 textureCoordinates;
+
+uniform sampler2D source;
+uniform bool prefilter;
+uniform float threshold;
+uniform float knee;
+
+out vec4 fColor;
+
+float luma(vec3 color) {
+  return dot(color, vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+// Quadratic transition from zero at threshold - knee to linear at
+// threshold + knee
+vec3 brightPart(vec3 color) {
+  float brightness = max(color.r, max(color.g, color.b));
+  float soft = clamp(brightness - threshold + knee, 0.0F, 2.0F * knee);
+  soft = soft * soft / (4.0F * knee + 1e-4F);
+  float weight = max(soft, brightness - threshold) / max(brightness, 1e-4F);
+  return color * weight;
+}
+
+vec3 box(vec3 a, vec3 b, vec3 c, vec3 d) {
+  if (!prefilter) {
+    return (a + b + c + d) * 0.25F;
+  }
+  a = brightPart(a);
+  b = brightPart(b);
+  c = brightPart(c);
+  d = brightPart(d);
+  float wa = 1.0F / (1.0F + luma(a));
+  float wb = 1.0F / (1.0F + luma(b));
+  float wc = 1.0F / (1.0F + luma(c));
+  float wd = 1.0F / (1.0F + luma(d));
+  return (a * wa + b * wb + c * wc + d * wd) / (wa + wb + wc + wd);
+}
+
+void main() {
+  vec2 texel = 1.0F / vec2(textureSize(source, 0));
+  vec2 uv = textureCoordinates;
+  vec3 a = texture(source, uv + texel * vec2(-2.0F, -2.0F)).rgb;
+  vec3 b = texture(source, uv + texel * vec2(0.0F, -2.0F)).rgb;
+  vec3 c = texture(source, uv + texel * vec2(2.0F, -2.0F)).rgb;
+  vec3 d = texture(source, uv + texel * vec2(-1.0F, -1.0F)).rgb;
+  vec3 e = texture(source, uv + texel * vec2(1.0F, -1.0F)).rgb;
+  vec3 f = texture(source, uv + texel * vec2(-2.0F, 0.0F)).rgb;
+  vec3 g = texture(source, uv).rgb;
+  vec3 h = texture(source, uv + texel * vec2(2.0F, 0.0F)).rgb;
+  vec3 i = texture(source, uv + texel * vec2(-1.0F, 1.0F)).rgb;
+  vec3 j = texture(source, uv + texel * vec2(1.0F, 1.0F)).rgb;
+  vec3 k = texture(source, uv + texel * vec2(-2.0F, 2.0F)).rgb;
+  vec3 l = texture(source, uv + texel * vec2(0.0F, 2.0F)).rgb;
+  vec3 m = texture(source, uv + texel * vec2(2.0F, 2.0F)).rgb;
+
+  // The inner box counts for half, the four overlapping outer boxes for the
+  // other half
+  vec3 color = box(d, e, i, j) * 0.5F;
+  color += box(a, b, f, g) * 0.125F;
+  color += box(b, c, g, h) * 0.125F;
+  color += box(f, g, k, l) * 0.125F;
+  color += box(g, h, l, m) * 0.125F;
+  fColor = vec4(color, 1.0F);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+
+// Doubles the size of a bloom level with a 3 x 3 tent filter and adds the
+// level of the down chain of the new size
+
+in vec2 textureCoordinates;
+
+uniform sampler2D blurred;
+uniform sampler2D detail;
+
+out vec4 fColor;
+
+void main() {
+  vec2 texel = 1.0F / vec2(textureSize(blurred, 0));
+  vec2 uv = textureCoordinates;
+  vec3 color = texture(blurred, uv).rgb * 4.0F;
+  color += texture(blurred, uv + texel * vec2(-1.0F, 0.0F)).rgb * 2.0F;
+  color += texture(blurred, uv + texel * vec2(1.0F, 0.0F)).rgb * 2.0F;
+  color += texture(blurred, uv + texel * vec2(0.0F, -1.0F)).rgb * 2.0F;
+  color += texture(blurred, uv + texel * vec2(0.0F, 1.0F)).rgb * 2.0F;
+  color += texture(blurred, uv + texel * vec2(-1.0F, -1.0F)).rgb;
+  color += texture(blurred, uv + texel * vec2(1.0F, -1.0F)).rgb;
+  color += texture(blurred, uv + texel * vec2(-1.0F, 1.0F)).rgb;
+  color += texture(blurred, uv + texel * vec2(1.0F, 1.0F)).rgb;
+  fColor = vec4(color / 16.0F + texture(detail, uv).rgb, 1.0F);
+}
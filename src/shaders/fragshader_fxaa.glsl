@@ -0,0 +1,45 @@
+#version 330 core
+
+// Fast approximate anti-aliasing after Lottes: finds the direction of the
+// edge from the luma of the neighbours and blurs along it. The source holds
+// the luma in alpha, see fragshader_tonemap.glsl. The output may be larger
+// than the source, the taps are at texels of the source.
+
+#define REDUCE_MIN (1.0F / 128.0F)
+#define REDUCE_MUL (1.0F / 8.0F)
+#define SPAN_MAX 8.0F
+
+in vec2 textureCoordinates;
+
+uniform sampler2D source;
+
+out vec4 fColor;
+
+void main() {
+  vec2 texel = 1.0F / vec2(textureSize(source, 0));
+  vec2 uv = textureCoordinates;
+  float lumaNW = texture(source, uv + texel * vec2(-0.5F, -0.5F)).a;
+  float lumaNE = texture(source, uv + texel * vec2(0.5F, -0.5F)).a;
+  float lumaSW = texture(source, uv + texel * vec2(-0.5F, 0.5F)).a;
+  float lumaSE = texture(source, uv + texel * vec2(0.5F, 0.5F)).a;
+  vec4 center = texture(source, uv);
+  float lumaMin = min(center.a, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+  float lumaMax = max(center.a, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+  vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)),
+                        (lumaNW + lumaSW) - (lumaNE + lumaSE));
+  float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25F * REDUCE_MUL,
+                     REDUCE_MIN);
+  float scale = 1.0F / (min(abs(direction.x), abs(direction.y)) + reduce);
+  direction = clamp(direction * scale, vec2(-SPAN_MAX), vec2(SPAN_MAX)) * texel;
+
+  vec3 near =
+      0.5F * (texture(source, uv + direction * (1.0F / 3.0F - 0.5F)).rgb +
+              texture(source, uv + direction * (2.0F / 3.0F - 0.5F)).rgb);
+  vec3 far = near * 0.5F + 0.25F * (texture(source, uv - direction * 0.5F).rgb +
+                                    texture(source, uv + direction * 0.5F).rgb);
+  // The far taps crossed another edge if they left the range of the
+  // neighbourhood
+  float lumaFar = dot(far, vec3(0.299F, 0.587F, 0.114F));
+  fColor = vec4(lumaFar < lumaMin || lumaFar > lumaMax ? near : far, 1.0F);
+}
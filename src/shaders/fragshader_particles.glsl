@@ -0,0 +1,17 @@
+#version 330 core
+
+// A round, soft point sprite, blended additively
+
+in vec4 color;
+
+out vec4 fColor;
+
+void main() {
+  vec2 offset = gl_PointCoord * 2.0F - 1.0F;
+  float radiusSquared = dot(offset, offset);
+  if (radiusSquared > 1.0F) {
+    discard;
+  }
+  float falloff = 1.0F - radiusSquared;
+  fColor = vec4(color.rgb, color.a * falloff * falloff);
+}
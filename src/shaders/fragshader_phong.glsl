@@ -1,4 +1,5 @@
-#version 330 core
+// Fragment shader of the sun and the ship. ShaderCache::load() puts the
+// shadow lookup of shadows.glsl in front of it.
 
 // Define constants
 #define M_PI 3.141593
@@ -14,6 +15,11 @@ uniform vec3 lightPosition;
 uniform vec3 lightColor;
 uniform vec4 materialCoeffecients;
 uniform sampler2D samplerUniform; 
+// Whether the light and shadows apply; the sky sphere shows its texture as is
+uniform bool lit;
+// Added to the brightest texels of the unlit sky, so that the stars bloom in
+// the HDR scene
+uniform float emission;
 
 // Specify the constants
 const vec3 materialColor = vec3(1.0F, 1.0F, 1.0F);
@@ -27,6 +33,12 @@ void main() {
   if(textureColor.a < 0.5) {
       discard;
   }
+  if (!lit) {
+    float peak = max(textureColor.r, max(textureColor.g, textureColor.b));
+    float glow = emission * smoothstep(0.7F, 1.0F, peak);
+    fColor = vec4(textureColor.rgb * (1.0F + glow), 1.0F);
+    return;
+  }
 
   vec3 V = vec3(coordinates);
   vec3 normNormal = normalize(vertNormal);
@@ -38,6 +50,7 @@ void main() {
 
   vec3 normV = normalize(-V);
   vec3 Is = pow(max(0.0, dot(R, normV)), materialCoeffecients.w) * lightColor * materialCoeffecients.z;
-  vec3 phongColor = Ia + Id + Is;
-  fColor = vec4(textureColor.rgb, 1.0F);
+  float shadow = shadowFactor(coordinates);
+  vec3 phongColor = Ia + (Id + Is) * shadow;
+  fColor = vec4(phongColor, 1.0F);
 }
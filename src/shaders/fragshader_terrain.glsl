@@ -0,0 +1,112 @@
+// Terrain fragment shader for all shading modes, see vertshader_terrain.glsl
+// for the features.
+
+#ifdef COLOR_LINE
+uniform vec3 lineColor;
+#endif
+
+#ifdef COLOR_PALETTE
+in vec3 color;
+#endif
+
+#ifdef COLOR_MATERIAL
+uniform vec3 materialColor;
+#endif
+
+#ifdef LIGHTING_VERTEX
+in float lighting;
+#endif
+
+#ifdef LIGHTING_FRAGMENT
+uniform vec3 lightPosition;
+uniform vec3 lightColor;
+uniform vec4 materialCoeffecients;
+
+in vec3 vertNormal;
+in vec4 coordinates;
+
+vec3 phong(vec3 albedo) {
+  vec3 V = vec3(coordinates);
+  vec3 normNormal = normalize(vertNormal);
+
+  vec3 Ia = albedo * materialCoeffecients.x;
+  vec3 L = normalize(lightPosition - V);
+  vec3 Id = max(0.0, dot(L, normNormal)) * albedo * lightColor * materialCoeffecients.y;
+  vec3 R = reflect(-L, normNormal);
+
+  vec3 normV = normalize(-V);
+  vec3 Is = pow(max(0.0, dot(R, normV)), materialCoeffecients.w) * lightColor * materialCoeffecients.z;
+#ifdef SHADOWS
+  float shadow = shadowFactor(coordinates);
+  Id *= shadow;
+  Is *= shadow;
+#endif
+  return Ia + Id + Is;
+}
+#endif
+
+#ifdef FOG
+uniform vec3 fogColor;
+
+in float visibility;
+#endif
+
+#ifdef WIREFRAME
+uniform float lineWidth;
+uniform bool hiddenLineFill;
+uniform vec3 fillColor;
+
+in vec3 barycentric;
+
+// Returns how much of the pixel is covered by the nearest triangle edge. The
+// barycentric coordinates divided by their screen space derivatives give the
+// distance to each edge in pixels, which yields anti-aliased lines of any
+// width.
+float edgeCoverage() {
+  vec3 pixels = barycentric / fwidth(barycentric);
+  float edgeDistance = min(min(pixels.x, pixels.y), pixels.z);
+  return 1.0F - smoothstep(lineWidth * 0.5F - 0.5F, lineWidth * 0.5F + 0.5F, edgeDistance);
+}
+
+vec4 wireframeColor(vec3 color) {
+  float coverage = edgeCoverage();
+  if (hiddenLineFill) {
+    // Opaque triangles hide the lines behind them
+    return vec4(mix(fillColor, color, coverage), 1.0F);
+  }
+  if (coverage < 1.0F / 255.0F) {
+    discard;
+  }
+  return vec4(color, coverage);
+}
+#endif
+
+out vec4 fColor;
+
+void main() {
+#if defined(COLOR_LINE)
+  vec3 baseColor = lineColor;
+#elif defined(COLOR_PALETTE)
+  vec3 baseColor = color;
+#elif defined(COLOR_MATERIAL)
+  vec3 baseColor = materialColor;
+#else
+  vec3 baseColor = vec3(1.0F);
+#endif
+
+#if defined(LIGHTING_VERTEX)
+  baseColor *= lighting;
+#elif defined(LIGHTING_FRAGMENT)
+  baseColor = phong(baseColor);
+#endif
+
+#ifdef WIREFRAME
+  fColor = wireframeColor(baseColor);
+#else
+  fColor = vec4(baseColor, 1.0F);
+#endif
+
+#ifdef FOG
+  fColor.rgb = mix(fogColor, fColor.rgb, visibility);
+#endif
+}
@@ -0,0 +1,37 @@
+#version 330 core
+
+// Adds the bloom to the HDR scene and maps it to the display. Colors up to
+// the shoulder stay as they are, so the scene looks as it does without post
+// processing, and brighter colors are compressed towards white instead of
+// clipping. The luma goes into alpha for FXAA.
+
+#define SHOULDER 0.8F
+
+in vec2 textureCoordinates;
+
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float bloomIntensity;
+uniform float exposure;
+
+out vec4 fColor;
+
+void main() {
+  vec3 color = texture(scene, textureCoordinates).rgb;
+  if (bloomIntensity > 0.0F) {
+    color += texture(bloom, textureCoordinates).rgb * bloomIntensity;
+  }
+  color *= exposure;
+
+  // Compress the largest channel and scale the others along, which keeps
+  // the hue of bright colors
+  float peak = max(color.r, max(color.g, color.b));
+  if (peak > SHOULDER) {
+    float over = peak - SHOULDER;
+    float range = 1.0F - SHOULDER;
+    float mapped = SHOULDER + range * over / (over + range);
+    color *= mapped / peak;
+  }
+  float luma = dot(color, vec3(0.299F, 0.587F, 0.114F));
+  fColor = vec4(color, luma);
+}
@@ -0,0 +1,32 @@
+// Shadow lookup shared by the terrain and the objects. ShaderCache puts it in
+// front of the fragment shaders that use it and defines CASCADE_COUNT from
+// CascadedShadowMap::kCascadeCount.
+
+#ifdef SHADOWS
+// Cascaded shadow map of the light, see CascadedShadowMap. The cascade is
+// picked by the view distance, then 3 x 3 compared taps soften the edge.
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowTransforms[CASCADE_COUNT];
+uniform float cascadeEnds[CASCADE_COUNT];
+
+float shadowFactor(vec4 viewPosition) {
+  float depth = -viewPosition.z;
+  int cascade = 0;
+  while (cascade < CASCADE_COUNT && depth >= cascadeEnds[cascade]) {
+    cascade++;
+  }
+  if (cascade == CASCADE_COUNT) {
+    return 1.0F;
+  }
+  vec4 position = shadowTransforms[cascade] * viewPosition;
+  vec2 texelSize = 1.0F / vec2(textureSize(shadowMap, 0).xy);
+  float visible = 0.0F;
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      vec2 offset = vec2(x, y) * texelSize;
+      visible += texture(shadowMap, vec4(position.xy + offset, float(cascade), position.z));
+    }
+  }
+  return visible / 9.0F;
+}
+#endif
@@ -0,0 +1,13 @@
+#version 330 core
+
+// One triangle that covers the viewport, for the passes of PostProcessing.
+// Drawn without attributes, the corners come from gl_VertexID.
+
+out vec2 textureCoordinates;
+
+void main() {
+  vec2 position = vec2(gl_VertexID == 1 ? 3.0F : -1.0F,
+                       gl_VertexID == 2 ? 3.0F : -1.0F);
+  textureCoordinates = position * 0.5F + 0.5F;
+  gl_Position = vec4(position, 0.0F, 1.0F);
+}
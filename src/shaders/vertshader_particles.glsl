@@ -0,0 +1,31 @@
+#version 330 core
+
+// Draws the particles as point sprites, see ParticleSystem::draw()
+
+layout(location = 0) in vec4 positionAge_in;
+layout(location = 1) in vec4 velocityLifetime_in;
+
+uniform mat4 projectionTransform;
+uniform float pointScale;
+uniform float size;
+uniform vec3 startColor;
+uniform vec3 endColor;
+
+out vec4 color;
+
+void main() {
+  float life = positionAge_in.w / max(velocityLifetime_in.w, 1.0e-6F);
+  if (positionAge_in.w < 0.0F || life >= 1.0F) {
+    // Not born yet or dead: outside the clip volume, so it is dropped
+    gl_Position = vec4(2.0F, 2.0F, 2.0F, 1.0F);
+    gl_PointSize = 0.0F;
+    color = vec4(0.0F);
+    return;
+  }
+
+  vec4 position = vec4(positionAge_in.xyz, 1.0F);
+  gl_Position = projectionTransform * position;
+  // Grows as it cools down, and fades out
+  gl_PointSize = size * (1.0F + life) * pointScale / max(-position.z, 0.1F);
+  color = vec4(mix(startColor, endColor, life), 1.0F - life);
+}
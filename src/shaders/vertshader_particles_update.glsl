@@ -0,0 +1,91 @@
+#version 330 core
+
+// Advances the particles of one emitter by a time step. Runs with the
+// rasterizer off; ParticleSystem captures the outputs into the other buffer
+// with transform feedback.
+
+// The state of a particle, see ParticleSystem::Particle
+layout(location = 0) in vec4 positionAge_in;
+layout(location = 1) in vec4 velocityLifetime_in;
+
+uniform mat4 emitterTransform;          // at the end of the step
+uniform mat4 previousEmitterTransform;  // at its start
+uniform float timeStep;
+uniform vec3 drift;
+uniform uint seed;
+uniform bool restart;
+
+// The emitter, see ParticleEmitter
+uniform vec3 emitterPosition;
+uniform vec3 emitterDirection;
+uniform float spread;
+uniform float speed;
+uniform float drag;
+uniform float lifetime;
+uniform int firstParticle;
+uniform int particleCount;
+
+out vec4 positionAge;
+out vec4 velocityLifetime;
+
+const float PI = 3.141593F;
+
+// Integer hash after the PCG generator, good enough for particles
+uint hash(uint value) {
+  uint state = value * 747796405U + 2891336453U;
+  uint word = ((state >> ((state >> 28U) + 4U)) ^ state) * 277803737U;
+  return (word >> 22U) ^ word;
+}
+
+float random(inout uint state) {
+  state = hash(state);
+  return float(state) / 4294967295.0F;
+}
+
+void main() {
+  if (restart) {
+    // Spread the first births over a lifetime, so the emitter starts with a
+    // steady stream instead of a burst. A particle waits while its age is
+    // negative.
+    float order = float(gl_VertexID - firstParticle) / float(particleCount);
+    positionAge = vec4(0.0F, 0.0F, 0.0F, -order * lifetime);
+    velocityLifetime = vec4(0.0F);
+    return;
+  }
+
+  float age = positionAge_in.w + timeStep;
+  vec3 velocity = velocityLifetime_in.xyz;
+  if (age < 0.0F) {
+    positionAge = vec4(positionAge_in.xyz, age);
+    velocityLifetime = velocityLifetime_in;
+    return;
+  }
+
+  if (age >= velocityLifetime_in.w) {
+    // Born again at a random moment of the step, where the emitter was then
+    uint state = hash(uint(gl_VertexID) ^ hash(seed));
+    float moment = random(state);
+    vec3 start = (previousEmitterTransform * vec4(emitterPosition, 1.0F)).xyz;
+    vec3 end = (emitterTransform * vec4(emitterPosition, 1.0F)).xyz;
+
+    // A direction in the cone around the emitter direction
+    vec3 axis = normalize(mat3(emitterTransform) * emitterDirection);
+    vec3 side = normalize(cross(axis, abs(axis.y) < 0.9F ? vec3(0.0F, 1.0F, 0.0F) : vec3(1.0F, 0.0F, 0.0F)));
+    vec3 up = cross(axis, side);
+    float cosTheta = mix(1.0F, cos(spread), random(state));
+    float sinTheta = sqrt(1.0F - cosTheta * cosTheta);
+    float phi = 2.0F * PI * random(state);
+    vec3 direction = axis * cosTheta + (side * cos(phi) + up * sin(phi)) * sinTheta;
+
+    velocity = direction * speed * mix(0.7F, 1.0F, random(state)) + drift;
+    float born = (1.0F - moment) * timeStep;
+    positionAge = vec4(mix(start, end, moment) + velocity * born, born);
+    velocityLifetime = vec4(velocity, lifetime * mix(0.6F, 1.0F, random(state)));
+    return;
+  }
+
+  // Slow down to the speed of the air
+  velocity = drift + (velocity - drift) * exp(-drag * timeStep);
+  positionAge = vec4(positionAge_in.xyz + velocity * timeStep, age);
+  velocityLifetime = vec4(velocity, velocityLifetime_in.w);
+}
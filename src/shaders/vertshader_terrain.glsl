@@ -0,0 +1,143 @@
+// Terrain vertex shader for all shading modes. ShaderCache prepends the
+// version and a #define for every feature of the variant:
+//   HEIGHT_MAP_DISPLACEMENT  take the heights from heightMap, not the vertices
+//   HEIGHT_MAP_NORMALS       derive the normals from heightMap
+//   COLOR_LINE, COLOR_PALETTE or COLOR_MATERIAL  where the color comes from
+//   LIGHTING_VERTEX          ambient and diffuse lighting per vertex
+//   LIGHTING_FRAGMENT        Phong lighting per fragment
+//   SHADOWS                  shadow map lookup, with LIGHTING_FRAGMENT only
+//   FOG                      exponential height fog
+//   WIREFRAME                anti-aliased wireframe on filled triangles
+
+// Specify the input locations of attributes
+layout(location = 0) in vec3 vertCoordinates_in;
+layout(location = 1) in vec3 vertNormal_in;
+layout(location = 3) in vec3 vertBarycentric_in;
+
+// Specify the Uniforms of the vertex shader
+uniform mat4 modelViewTransform;
+uniform mat4 projectionTransform;
+uniform mat3 normalMatrix;
+
+// The depth prepass draws the same vertices with only the displacement, the
+// shaded pass has to land on exactly the same depths
+invariant gl_Position;
+
+#if defined(HEIGHT_MAP_DISPLACEMENT) || defined(HEIGHT_MAP_NORMALS)
+// Height source of the fixed terrain: a window of noise rows that scrolls
+// along with flying, see ScrollingHeightMap. Image row r is stored in
+// texture row r modulo the height of the texture.
+uniform sampler2D heightMap;
+uniform float heightScale;
+uniform float flying;
+
+float heightAt(ivec2 texel) {
+  ivec2 size = textureSize(heightMap, 0);
+  texel.x = clamp(texel.x, 0, size.x - 1);
+  texel.y = ((texel.y % size.y) + size.y) % size.y;
+  return texelFetch(heightMap, texel, 0).r * heightScale;
+}
+
+float heightAtPosition(vec3 position) {
+  // Same mapping as TerrainChunks::noiseColumn() and noiseRow(). The rows
+  // scroll by fractions of a row, so blend the two rows around the vertex.
+  vec2 coordinates = vec2(position.x + 2.0F, 2.0F - position.z + flying);
+  ivec2 texel = ivec2(floor(coordinates));
+  return mix(heightAt(texel), heightAt(texel + ivec2(0, 1)), fract(coordinates.y));
+}
+
+vec3 heightMapNormal(vec3 position) {
+  float dx = heightAtPosition(position + vec3(1.0F, 0.0F, 0.0F)) -
+             heightAtPosition(position - vec3(1.0F, 0.0F, 0.0F));
+  float dz = heightAtPosition(position + vec3(0.0F, 0.0F, 1.0F)) -
+             heightAtPosition(position - vec3(0.0F, 0.0F, 1.0F));
+  return normalize(vec3(-dx, 2.0F, -dz));
+}
+#endif
+
+#ifdef COLOR_PALETTE
+// Height colors, baked into a lookup table by PaletteTexture. The range holds
+// the heights at the start and end of the table.
+uniform sampler1D palette;
+uniform vec2 paletteRange;
+
+out vec3 color;
+
+vec3 paletteColor(float height) {
+  return texture(palette, (height - paletteRange.x) / (paletteRange.y - paletteRange.x)).rgb;
+}
+#endif
+
+#ifdef LIGHTING_VERTEX
+uniform vec3 lightPosition;
+uniform vec4 materialCoeffecients;
+
+out float lighting;
+#endif
+
+#ifdef LIGHTING_FRAGMENT
+out vec3 vertNormal;
+out vec4 coordinates;
+#endif
+
+#ifdef FOG
+// Exponential fog that thins out above the valleys. It reaches the fog color
+// at fogEnd, beyond which the terrain is not drawn at all.
+uniform float fogDensity;
+uniform float fogHeightFalloff;
+uniform float fogEnd;
+
+out float visibility;
+
+float fogVisibility(vec3 viewPosition, float height) {
+  float viewDistance = length(viewPosition);
+  float density = fogDensity * exp(-fogHeightFalloff * max(height, 0.0F));
+  float fade = clamp((fogEnd - viewDistance) / (0.25F * fogEnd), 0.0F, 1.0F);
+  return min(exp(-viewDistance * density), fade);
+}
+#endif
+
+#ifdef WIREFRAME
+out vec3 barycentric;
+#endif
+
+void main() {
+  vec3 position = vertCoordinates_in;
+#ifdef HEIGHT_MAP_DISPLACEMENT
+  position.y = heightAtPosition(position);
+#endif
+
+  // gl_Position is the output (a vec4) of the vertex shader
+  vec4 viewPosition = modelViewTransform * vec4(position, 1.0F);
+  gl_Position = projectionTransform * viewPosition;
+
+#if defined(LIGHTING_VERTEX) || defined(LIGHTING_FRAGMENT)
+#ifdef HEIGHT_MAP_NORMALS
+  vec3 normal = normalize(normalMatrix * heightMapNormal(position));
+#else
+  vec3 normal = normalize(normalMatrix * vertNormal_in);
+#endif
+#endif
+
+#ifdef COLOR_PALETTE
+  color = paletteColor(position.y);
+#endif
+
+#ifdef LIGHTING_VERTEX
+  vec3 L = normalize(lightPosition - viewPosition.xyz);
+  lighting = materialCoeffecients.x + materialCoeffecients.y * max(0.0F, dot(L, normal));
+#endif
+
+#ifdef LIGHTING_FRAGMENT
+  vertNormal = normal;
+  coordinates = viewPosition;
+#endif
+
+#ifdef FOG
+  visibility = fogVisibility(viewPosition.xyz, position.y);
+#endif
+
+#ifdef WIREFRAME
+  barycentric = vertBarycentric_in;
+#endif
+}
@@ -1,3 +1,157 @@
 #include "spaceship.h"
 
-spaceShip::spaceShip() {}
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Top speed along x and z in units per second, and how quickly the velocity
+// follows the controls.
+constexpr float kMaxSpeed = 30.0F;
+constexpr float kResponse = 8.0F;
+
+// How far the ship may stray from its home position.
+constexpr float kSidewaysLimit = 40.0F;
+constexpr float kDepthLimit = 12.0F;
+
+// Critically damped spring that pulls the ship to its flying height.
+constexpr float kStiffness = 80.0F;
+constexpr float kDamping = 17.9F;  // 2 * sqrt(kStiffness)
+
+// Clearance above the terrain controlled by climbing and diving.
+constexpr float kClimbRate = 10.0F;
+constexpr float kMaxClearance = 20.0F;
+
+// Time ahead covered by the ground samples.
+constexpr float kLookAheadTime = 0.6F;
+
+// Banking in degrees per unit of speed, and its limits.
+constexpr float kRollPerSpeed = 1.0F;
+constexpr float kPitchPerSpeed = 1.5F;
+constexpr float kMaxRoll = 30.0F;
+constexpr float kMaxPitch = 25.0F;
+
+}  // namespace
+
+/**
+ * @brief SpaceShip::setControl Records whether a control is held.
+ * @param control The control.
+ * @param held True while the key of the control is down.
+ */
+void SpaceShip::setControl(Control control, bool held) {
+  controls[control] = held;
+}
+
+/**
+ * @brief SpaceShip::releaseControls Lets go of all controls, for example
+ * when the window loses the keyboard focus and misses the key releases.
+ */
+void SpaceShip::releaseControls() {
+  std::fill_n(controls, CONTROL_COUNT, false);
+}
+
+/**
+ * @brief SpaceShip::reset Places the ship at rest at a new home position.
+ * @param position The position in view space.
+ */
+void SpaceShip::reset(const QVector3D &position) {
+  home = position;
+  current = State();
+  current.position = position;
+  previous = current;
+  clearance = 0.0F;
+}
+
+/**
+ * @brief SpaceShip::lookAhead Computes where to sample the ground along the
+ * path the ship is about to fly. The path follows from the current velocity
+ * and from the terrain scrolling towards the ship.
+ * @param column Column of the ground under the home position.
+ * @param row Row of the ground under the home position.
+ * @param rowsPerSecond Speed at which the terrain scrolls.
+ * @param columns Output, kLookAheadSamples columns.
+ * @param rows Output, kLookAheadSamples rows.
+ */
+void SpaceShip::lookAhead(float column, float row, float rowsPerSecond,
+                          float *columns, float *rows) const {
+  // Rows increase away from the viewer, along -z.
+  float startColumn = column + current.position.x() - home.x();
+  float startRow = row - (current.position.z() - home.z());
+  for (int i = 0; i != kLookAheadSamples; ++i) {
+    float t = kLookAheadTime * i / (kLookAheadSamples - 1);
+    columns[i] = startColumn + current.velocity.x() * t;
+    rows[i] = startRow + (rowsPerSecond - current.velocity.z()) * t;
+  }
+}
+
+/**
+ * @brief SpaceShip::step Advances the ship by one fixed step.
+ * @param seconds Length of the step.
+ * @param floor The lowest height the ship may fly at.
+ */
+void SpaceShip::step(float seconds, float floor) {
+  previous = current;
+  State &s = current;
+
+  float sideways = static_cast<float>(controls[RIGHT]) - controls[LEFT];
+  float forward = static_cast<float>(controls[FORWARD]) - controls[BACKWARD];
+  float blend = 1.0F - std::exp(-kResponse * seconds);
+  s.velocity.setX(s.velocity.x() +
+                  (sideways * kMaxSpeed - s.velocity.x()) * blend);
+  s.velocity.setZ(s.velocity.z() +
+                  (-forward * kMaxSpeed - s.velocity.z()) * blend);
+
+  float climb = static_cast<float>(controls[CLIMB]) - controls[DIVE];
+  clearance = std::clamp(clearance + climb * kClimbRate * seconds, 0.0F,
+                         kMaxClearance);
+  float target = floor + clearance;
+  float acceleration =
+      kStiffness * (target - s.position.y()) - kDamping * s.velocity.y();
+  s.velocity.setY(s.velocity.y() + acceleration * seconds);
+
+  s.position += s.velocity * seconds;
+
+  // Stop at the edges of the flying area and never sink into the ground.
+  QVector3D offset = s.position - home;
+  if (std::fabs(offset.x()) > kSidewaysLimit) {
+    s.position.setX(home.x() + std::copysign(kSidewaysLimit, offset.x()));
+    s.velocity.setX(0.0F);
+  }
+  if (std::fabs(offset.z()) > kDepthLimit) {
+    s.position.setZ(home.z() + std::copysign(kDepthLimit, offset.z()));
+    s.velocity.setZ(0.0F);
+  }
+  if (s.position.y() < floor) {
+    s.position.setY(floor);
+    s.velocity.setY(std::max(s.velocity.y(), 0.0F));
+  }
+
+  float roll =
+      std::clamp(-s.velocity.x() * kRollPerSpeed, -kMaxRoll, kMaxRoll);
+  float pitch =
+      std::clamp(s.velocity.y() * kPitchPerSpeed, -kMaxPitch, kMaxPitch);
+  s.roll += (roll - s.roll) * blend;
+  s.pitch += (pitch - s.pitch) * blend;
+}
+
+/**
+ * @brief SpaceShip::getPosition Interpolates the position between the last
+ * two steps.
+ * @param alpha Fraction of a step since the last one, from 0 to 1.
+ * @return The position in view space.
+ */
+QVector3D SpaceShip::getPosition(float alpha) const {
+  return previous.position + (current.position - previous.position) * alpha;
+}
+
+/**
+ * @brief SpaceShip::getBank Interpolates the banking between the last two
+ * steps.
+ * @param alpha Fraction of a step since the last one, from 0 to 1.
+ * @return Pitch and roll as Euler angles in degrees.
+ */
+QVector3D SpaceShip::getBank(float alpha) const {
+  float pitch = previous.pitch + (current.pitch - previous.pitch) * alpha;
+  float roll = previous.roll + (current.roll - previous.roll) * alpha;
+  return QVector3D(pitch, 0.0F, roll);
+}
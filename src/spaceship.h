@@ -1,10 +1,47 @@
 #ifndef SPACESHIP_H
 #define SPACESHIP_H
 
-class spaceShip
-{
-public:
-    spaceShip();
+#include <QVector3D>
+
+/**
+ * @brief Flight model of the ship. Input is kept as a set of held controls
+ * and the state advances in fixed steps, so the handling does not depend on
+ * the frame rate. For drawing, the state is interpolated between the last
+ * two steps.
+ *
+ * The ship flies in view space and follows the terrain: the caller samples
+ * the ground at the points from lookAhead() and passes the lowest height the
+ * ship may fly at to step(). Climbing and diving change the clearance above
+ * that floor.
+ */
+class SpaceShip {
+ public:
+  enum Control { LEFT, RIGHT, FORWARD, BACKWARD, CLIMB, DIVE, CONTROL_COUNT };
+  static constexpr int kLookAheadSamples = 8;
+
+  void setControl(Control control, bool held);
+  void releaseControls();
+
+  void reset(const QVector3D &position);
+  void lookAhead(float column, float row, float rowsPerSecond, float *columns,
+                 float *rows) const;
+  void step(float seconds, float floor);
+
+  QVector3D getPosition(float alpha) const;
+  QVector3D getBank(float alpha) const;
+
+ private:
+  struct State {
+    QVector3D position;
+    QVector3D velocity;
+    float pitch = 0.0F;  // degrees, from the vertical speed
+    float roll = 0.0F;   // degrees, from the sideways speed
+  };
+
+  bool controls[CONTROL_COUNT] = {};
+  State current, previous;
+  QVector3D home;  // the ship is kept within reach of this position
+  float clearance = 0.0F;
 };
 
-#endif // SPACESHIP_H
+#endif  // SPACESHIP_H
@@ -42,15 +42,14 @@ GLuint Sun::getSize()
 }
 
 void Sun::initializeModel() {
-    Model model(":/models/sun.obj");
+    Model model(":/models/sun.obj", Model::UNPACKED);
     QImage image(":/textures/starry-night-sky.jpg");
-    textureCoords = model.getTextureCoords();
-    normals = model.getNormals();
-    coords = model.getCoords();
 
     QVector<quint8> textureVector = imageToBytes(image);
 
-    size = coords.size();
+    size = model.getCoords().size();
+    // Nothing is uploaded here, so the mesh data is not needed any more
+    model.release();
 }
 
 
@@ -28,9 +28,6 @@ private:
     float scale = 1.0F;
     QVector3D rotation;
     QVector3D translation;
-    QVector<QVector2D> textureCoords;
-    QVector<QVector3D> coords;
-    QVector<QVector3D> normals;
 
     void initializeModel();
     QVector<quint8> imageToBytes(const QImage &image);
@@ -0,0 +1,203 @@
+#include "terrainchunks.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief TerrainChunks::build Sorts the triangles of the terrain into square
+ * chunks, so that every chunk is a contiguous range of vertices that can be
+ * drawn with a single glDrawArrays() call.
+ * @param vertices The vertices of the terrain, three per triangle. Only read
+ * here, so they can be released afterwards.
+ * @param chunkSize Size of a chunk along x and z.
+ * @return The vertices, reordered per chunk.
+ */
+QVector<QVector3D> TerrainChunks::build(MeshSpan<QVector3D> vertices,
+                                        float chunkSize) {
+  chunks.clear();
+  columnStart.clear();
+  columnEnd.clear();
+  if (vertices.isEmpty()) return QVector<QVector3D>();
+
+  Aabb extent = Aabb::fromPoints(vertices.data(), vertices.size());
+  int columns = std::max(
+      1, static_cast<int>(std::ceil(
+             (extent.maximum.x() - extent.minimum.x()) / chunkSize)));
+  int rows = std::max(
+      1, static_cast<int>(std::ceil(
+             (extent.maximum.z() - extent.minimum.z()) / chunkSize)));
+
+  // Assign every triangle to the chunk containing its centroid.
+  int triangleCount = vertices.size() / 3;
+  QVector<int> triangleChunks(triangleCount);
+  QVector<int> chunkSizes(columns * rows, 0);
+  for (int t = 0; t != triangleCount; ++t) {
+    QVector3D centroid =
+        (vertices[t * 3] + vertices[t * 3 + 1] + vertices[t * 3 + 2]) / 3.0F;
+    int column = std::min(
+        columns - 1,
+        static_cast<int>((centroid.x() - extent.minimum.x()) / chunkSize));
+    int row = std::min(
+        rows - 1,
+        static_cast<int>((centroid.z() - extent.minimum.z()) / chunkSize));
+    triangleChunks[t] = row * columns + column;
+    ++chunkSizes[triangleChunks[t]];
+  }
+
+  chunks.resize(columns * rows);
+  int offset = 0;
+  for (int c = 0; c != chunks.size(); ++c) {
+    chunks[c].firstVertex = offset;
+    chunks[c].vertexCount = chunkSizes[c] * 3;
+    chunks[c].noiseColumn = c % columns;
+    offset += chunks[c].vertexCount;
+  }
+
+  QVector<QVector3D> result(vertices.size());
+  QVector<int> fill(chunks.size());
+  for (int c = 0; c != chunks.size(); ++c) {
+    fill[c] = chunks[c].firstVertex;
+  }
+  for (int t = 0; t != triangleCount; ++t) {
+    int &position = fill[triangleChunks[t]];
+    for (int k = 0; k != 3; ++k) {
+      result[position++] = vertices[t * 3 + k];
+    }
+  }
+
+  // Bounds in x and z are fixed, the heights follow from the noise.
+  columnStart.fill(noiseColumn(extent.maximum.x()), columns);
+  columnEnd.fill(noiseColumn(extent.minimum.x()), columns);
+  for (TerrainChunk &chunk : chunks) {
+    if (chunk.vertexCount == 0) continue;
+
+    QVector<QVector3D> chunkVertices(
+        result.begin() + chunk.firstVertex,
+        result.begin() + chunk.firstVertex + chunk.vertexCount);
+    chunk.bounds = Aabb::fromPoints(chunkVertices);
+
+    int column = chunk.noiseColumn;
+    columnStart[column] = std::min(columnStart[column],
+                                   noiseColumn(chunk.bounds.minimum.x()));
+    columnEnd[column] =
+        std::max(columnEnd[column], noiseColumn(chunk.bounds.maximum.x()));
+  }
+
+  // Drop empty chunks, they have nothing to draw.
+  chunks.erase(std::remove_if(chunks.begin(), chunks.end(),
+                              [](const TerrainChunk &chunk) {
+                                return chunk.vertexCount == 0;
+                              }),
+               chunks.end());
+  return result;
+}
+
+/**
+ * @brief TerrainChunks::setHeightSource Precomputes the minimum and maximum
+ * red value of every image row within the columns of each chunk column. Must
+ * be called after build().
+ * @param noise The noise image the terrain heights are taken from.
+ */
+void TerrainChunks::setHeightSource(const QImage &noise) {
+  QImage image = noise.convertToFormat(QImage::Format_RGB32);
+  noiseWidth = image.width();
+  noiseHeight = image.height();
+  int columns = columnStart.size();
+  rowMinimum.fill(255, columns * noiseHeight);
+  rowMaximum.fill(0, columns * noiseHeight);
+
+  for (int y = 0; y != noiseHeight; ++y) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+    for (int c = 0; c != columns; ++c) {
+      int begin = std::max(0, columnStart[c]);
+      int end = std::min(image.width() - 1, columnEnd[c]);
+      quint8 &minimum = rowMinimum[c * noiseHeight + y];
+      quint8 &maximum = rowMaximum[c * noiseHeight + y];
+      for (int x = begin; x <= end; ++x) {
+        quint8 red = static_cast<quint8>(qRed(line[x]));
+        minimum = std::min(minimum, red);
+        maximum = std::max(maximum, red);
+      }
+    }
+  }
+}
+
+/**
+ * @brief TerrainChunks::setHeights Like setHeightSource(), for heights that
+ * fall between the red values, such as eroded ones. The tables are rounded
+ * outwards, so the bounds stay conservative.
+ * @param width Number of samples per row.
+ * @param height Number of rows.
+ * @param values The heights from 0 to 1, as red / 255, row by row.
+ */
+void TerrainChunks::setHeights(int width, int height,
+                               const QVector<float> &values) {
+  noiseWidth = width;
+  noiseHeight = height;
+  int columns = columnStart.size();
+  rowMinimum.fill(255, columns * noiseHeight);
+  rowMaximum.fill(0, columns * noiseHeight);
+  updateRows(QRect(0, 0, width, height), values);
+}
+
+/**
+ * @brief TerrainChunks::setHeights Updates the tables for a region of the
+ * heights, such as an edit. Only the rows of the region are scanned, and
+ * only within the chunk columns it overlaps.
+ * @param region The samples that changed.
+ * @param values All heights from 0 to 1, row by row, of the size given to
+ * setHeightSource() or setHeights().
+ */
+void TerrainChunks::setHeights(const QRect &region,
+                               const QVector<float> &values) {
+  updateRows(region & QRect(0, 0, noiseWidth, noiseHeight), values);
+}
+
+void TerrainChunks::updateRows(const QRect &region,
+                               const QVector<float> &values) {
+  for (int y = region.top(); y <= region.bottom(); ++y) {
+    const float *line = values.constData() + y * noiseWidth;
+    for (int c = 0; c != columnStart.size(); ++c) {
+      int begin = std::max(0, columnStart[c]);
+      int end = std::min(noiseWidth - 1, columnEnd[c]);
+      if (begin > region.right() || end < region.left()) continue;
+      float minimum = 1.0F;
+      float maximum = 0.0F;
+      for (int x = begin; x <= end; ++x) {
+        minimum = std::min(minimum, line[x]);
+        maximum = std::max(maximum, line[x]);
+      }
+      rowMinimum[c * noiseHeight + y] = static_cast<quint8>(
+          qBound(0.0F, std::floor(minimum * 255.0F), 255.0F));
+      rowMaximum[c * noiseHeight + y] = static_cast<quint8>(
+          qBound(0.0F, std::ceil(maximum * 255.0F), 255.0F));
+    }
+  }
+}
+
+/**
+ * @brief TerrainChunks::updateBounds Updates the height bounds of all chunks
+ * for the current scroll offset of the terrain.
+ * @param flying The scroll offset, in noise image rows.
+ */
+void TerrainChunks::updateBounds(float flying) {
+  if (noiseHeight == 0) return;
+
+  for (TerrainChunk &chunk : chunks) {
+    // The shader blends each vertex with the next row
+    int first = std::max(0, noiseRow(chunk.bounds.maximum.z(), flying));
+    int last = std::min(noiseHeight - 1,
+                        noiseRow(chunk.bounds.minimum.z(), flying) + 1);
+    const quint8 *minimums = &rowMinimum[chunk.noiseColumn * noiseHeight];
+    const quint8 *maximums = &rowMaximum[chunk.noiseColumn * noiseHeight];
+
+    quint8 minimum = 255;
+    quint8 maximum = 0;
+    for (int row = first; row <= last; ++row) {
+      minimum = std::min(minimum, minimums[row]);
+      maximum = std::max(maximum, maximums[row]);
+    }
+    chunk.bounds.minimum.setY(heightFromNoise(minimum));
+    chunk.bounds.maximum.setY(heightFromNoise(maximum));
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef TERRAINCHUNKS_H
+#define TERRAINCHUNKS_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector3D>
+#include <QVector>
+
+#include "frustum.h"
+#include "mesharena.h"
+
+/**
+ * @brief A square piece of the terrain mesh that is culled as a whole.
+ */
+struct TerrainChunk {
+  int firstVertex = 0;
+  int vertexCount = 0;
+  int noiseColumn = 0;  // column range in the tables of TerrainChunks
+  Aabb bounds;          // in the local space of the terrain mesh
+};
+
+/**
+ * @brief Splits the flat terrain grid into chunks and keeps their bounding
+ * boxes up to date while the height source scrolls. The height bounds are
+ * looked up in per-row min/max tables of the noise image, so they do not
+ * depend on the vertex heights computed for the frame.
+ */
+class TerrainChunks {
+ public:
+  QVector<QVector3D> build(MeshSpan<QVector3D> vertices, float chunkSize);
+  void setHeightSource(const QImage &noise);
+  void setHeights(int width, int height, const QVector<float> &values);
+  void setHeights(const QRect &region, const QVector<float> &values);
+  void updateBounds(float flying);
+
+  int getChunkCount() const { return chunks.size(); }
+  const TerrainChunk &getChunk(int index) const { return chunks[index]; }
+
+  // Mapping from terrain mesh coordinates to the noise image
+  static int noiseColumn(float x) { return static_cast<int>(x + 2); }
+  static int noiseRow(float z, float flying) {
+    return static_cast<int>(-(z - 2) + flying);
+  }
+  static float heightFromNoise(int red) { return red / 6.0F; }
+
+ private:
+  QVector<TerrainChunk> chunks;
+
+  // Noise column range covered by each column of chunks
+  QVector<int> columnStart;
+  QVector<int> columnEnd;
+
+  void updateRows(const QRect &region, const QVector<float> &values);
+
+  // Minimum and maximum red value per chunk column and image row
+  QVector<quint8> rowMinimum;
+  QVector<quint8> rowMaximum;
+  int noiseWidth = 0;
+  int noiseHeight = 0;
+};
+
+#endif  // TERRAINCHUNKS_H
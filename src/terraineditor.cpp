@@ -0,0 +1,287 @@
+#include "terraineditor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Part of the gap to the target that the smooth and flatten brushes close
+// per unit of strength
+constexpr float kBlendPerStrength = 20.0F;
+
+}  // namespace
+
+/**
+ * @brief TerrainEditor::setHeights Replaces the heights and forgets the undo
+ * log, whose deltas no longer apply. A stroke in progress goes on from the
+ * new heights.
+ * @param newWidth Number of samples per row.
+ * @param newHeight Number of rows.
+ * @param values The heights from 0 to 1, row by row.
+ */
+void TerrainEditor::setHeights(int newWidth, int newHeight,
+                               const QVector<float> &values) {
+  width = newWidth;
+  height = newHeight;
+  heights = values;
+  committed = values;
+  strokeRegion = QRect();
+  undoLog.clear();
+  redoLog.clear();
+}
+
+/**
+ * @brief TerrainEditor::setHeights Takes over heights that changed elsewhere,
+ * such as by the erosion, in a region. The undo log is kept: undoing a
+ * stroke afterwards takes its deltas off the new heights. A stroke in
+ * progress keeps what it has changed so far on top of the new heights.
+ * @param region The samples that changed.
+ * @param values All heights from 0 to 1, row by row, of the size of the
+ * grid. Only the region is read.
+ */
+void TerrainEditor::setHeights(const QRect &region,
+                               const QVector<float> &values) {
+  QRect clipped = region & QRect(0, 0, width, height);
+  for (int row = clipped.top(); row <= clipped.bottom(); ++row) {
+    for (int column = clipped.left(); column <= clipped.right(); ++column) {
+      int i = row * width + column;
+      committed[i] += values[i] - heights[i];
+      heights[i] = values[i];
+    }
+  }
+}
+
+/**
+ * @brief TerrainEditor::setHeightSource Takes the heights from the red
+ * channel of an image.
+ * @param image The height image, pixel (x, y) becomes sample (x, y).
+ */
+void TerrainEditor::setHeightSource(const QImage &image) {
+  QImage pixels = image.convertToFormat(QImage::Format_RGB32);
+  QVector<float> values(pixels.width() * pixels.height());
+  for (int y = 0; y != pixels.height(); ++y) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(pixels.constScanLine(y));
+    for (int x = 0; x != pixels.width(); ++x) {
+      values[y * pixels.width() + x] = qRed(line[x]) / 255.0F;
+    }
+  }
+  setHeights(pixels.width(), pixels.height(), values);
+}
+
+/**
+ * @brief TerrainEditor::beginStroke Starts a stroke. All changes until
+ * endStroke() are undone as one.
+ * @param newBrush What the stroke does to the heights.
+ * @param x Column where the stroke starts.
+ * @param y Row where the stroke starts. The flatten brush pulls towards the
+ * height here.
+ */
+void TerrainEditor::beginStroke(Brush newBrush, float x, float y) {
+  if (width == 0 || height == 0) return;
+  endStroke();
+  brush = newBrush;
+  stroking = true;
+  strokeRegion = QRect();
+  int column = qBound(0, static_cast<int>(std::lround(x)), width - 1);
+  int row = qBound(0, static_cast<int>(std::lround(y)), height - 1);
+  target = heights[row * width + column];
+}
+
+/**
+ * @brief TerrainEditor::apply Applies the brush of the stroke around a
+ * point. The effect falls off smoothly towards the radius and grows with the
+ * time the brush is held, so that it does not depend on the frame rate.
+ * @param x Column of the brush centre.
+ * @param y Row of the brush centre.
+ * @param seconds Time the brush was held at the point.
+ * @return The samples that changed, clipped to the grid. Empty outside a
+ * stroke.
+ */
+QRect TerrainEditor::apply(float x, float y, float seconds) {
+  if (!stroking) return QRect();
+  int left = std::max(0, static_cast<int>(std::ceil(x - radius)));
+  int top = std::max(0, static_cast<int>(std::ceil(y - radius)));
+  int right = std::min(width - 1, static_cast<int>(std::floor(x + radius)));
+  int bottom = std::min(height - 1, static_cast<int>(std::floor(y + radius)));
+  if (left > right || top > bottom) return QRect();
+  QRect region(QPoint(left, top), QPoint(right, bottom));
+
+  // The smooth brush reads the heights before this application, one sample
+  // around the region included
+  QRect source = region.adjusted(-1, -1, 1, 1) & QRect(0, 0, width, height);
+  if (brush == SMOOTH) {
+    scratch.resize(source.width() * source.height());
+    for (int row = source.top(); row <= source.bottom(); ++row) {
+      std::copy_n(heights.constData() + row * width + source.left(),
+                  source.width(),
+                  scratch.data() + (row - source.top()) * source.width());
+    }
+  }
+  auto before = [&](int column, int row) {
+    column = qBound(source.left(), column, source.right());
+    row = qBound(source.top(), row, source.bottom());
+    return scratch[(row - source.top()) * source.width() + column -
+                   source.left()];
+  };
+
+  float amount = strength * seconds;
+  float radiusSquared = radius * radius;
+  for (int row = top; row <= bottom; ++row) {
+    for (int column = left; column <= right; ++column) {
+      float dx = column - x;
+      float dy = row - y;
+      float distanceSquared = dx * dx + dy * dy;
+      if (distanceSquared >= radiusSquared) continue;
+      float falloff = 1.0F - distanceSquared / radiusSquared;
+      float weight = amount * falloff * falloff;
+      float blend = std::min(1.0F, weight * kBlendPerStrength);
+
+      float &value = heights[row * width + column];
+      switch (brush) {
+        case RAISE:
+          value += weight;
+          break;
+        case LOWER:
+          value -= weight;
+          break;
+        case SMOOTH: {
+          float sum = 0.0F;
+          for (int j = -1; j <= 1; ++j) {
+            for (int i = -1; i <= 1; ++i) {
+              sum += before(column + i, row + j);
+            }
+          }
+          value += (sum / 9.0F - value) * blend;
+          break;
+        }
+        case FLATTEN:
+          value += (target - value) * blend;
+          break;
+      }
+      // Keep to the steps of the height texture, so that the undo log
+      // holds exactly what is drawn
+      value = toCode(value) / 65535.0F;
+    }
+  }
+  strokeRegion |= region;
+  return region;
+}
+
+/**
+ * @brief TerrainEditor::endStroke Ends the stroke and stores what it changed
+ * in the undo log.
+ */
+void TerrainEditor::endStroke() {
+  if (!stroking) return;
+  stroking = false;
+  if (strokeRegion.isEmpty()) return;
+
+  Edit edit;
+  edit.region = strokeRegion;
+  quint16 unchanged = 0;
+  QVector<quint16> changed;
+  auto flush = [&]() {
+    edit.runs.append(unchanged);
+    edit.runs.append(static_cast<quint16>(changed.size()));
+    edit.runs.append(changed);
+    unchanged = 0;
+    changed.clear();
+  };
+  bool anyChange = false;
+  for (int row = strokeRegion.top(); row <= strokeRegion.bottom(); ++row) {
+    for (int column = strokeRegion.left(); column <= strokeRegion.right();
+         ++column) {
+      int i = row * width + column;
+      quint16 delta = toCode(heights[i]) - toCode(committed[i]);
+      if (delta == 0) {
+        if (!changed.isEmpty()) flush();
+        if (++unchanged == 0xFFFF) flush();
+      } else {
+        changed.append(delta);
+        anyChange = true;
+        if (changed.size() == 0xFFFF) flush();
+      }
+    }
+    std::copy_n(heights.constData() + row * width + strokeRegion.left(),
+                strokeRegion.width(),
+                committed.data() + row * width + strokeRegion.left());
+  }
+  if (!anyChange) return;
+  if (unchanged != 0 || !changed.isEmpty()) flush();
+
+  edit.runs.squeeze();
+  undoLog.append(edit);
+  redoLog.clear();
+  while (logBytes() > kMaxUndoBytes && !undoLog.isEmpty()) {
+    undoLog.removeFirst();
+  }
+}
+
+/**
+ * @brief TerrainEditor::undo Reverts the last stroke.
+ * @return The samples that changed, empty if there was nothing to undo.
+ */
+QRect TerrainEditor::undo() {
+  endStroke();
+  if (undoLog.isEmpty()) return QRect();
+  Edit edit = undoLog.takeLast();
+  QRect region = replay(edit, false);
+  redoLog.append(edit);
+  return region;
+}
+
+/**
+ * @brief TerrainEditor::redo Applies the last undone stroke again.
+ * @return The samples that changed, empty if there was nothing to redo.
+ */
+QRect TerrainEditor::redo() {
+  endStroke();
+  if (redoLog.isEmpty()) return QRect();
+  Edit edit = redoLog.takeLast();
+  QRect region = replay(edit, true);
+  undoLog.append(edit);
+  return region;
+}
+
+quint16 TerrainEditor::toCode(float value) {
+  return static_cast<quint16>(qBound(0.0F, value, 1.0F) * 65535.0F + 0.5F);
+}
+
+qsizetype TerrainEditor::logBytes() const {
+  qsizetype bytes = 0;
+  for (const Edit &edit : undoLog) {
+    bytes += sizeof(Edit) + edit.runs.size() * sizeof(quint16);
+  }
+  for (const Edit &edit : redoLog) {
+    bytes += sizeof(Edit) + edit.runs.size() * sizeof(quint16);
+  }
+  return bytes;
+}
+
+/**
+ * @brief TerrainEditor::replay Adds or subtracts the deltas of a stroke.
+ * @param edit The stroke.
+ * @param forward True to redo the stroke, false to undo it.
+ * @return The region of the stroke.
+ */
+QRect TerrainEditor::replay(const Edit &edit, bool forward) {
+  const QRect &region = edit.region;
+  qsizetype sample = 0;
+  qsizetype next = 0;
+  while (next < edit.runs.size()) {
+    sample += edit.runs[next];
+    int count = edit.runs[next + 1];
+    next += 2;
+    for (int k = 0; k != count; ++k, ++sample, ++next) {
+      int column = region.left() + static_cast<int>(sample % region.width());
+      int row = region.top() + static_cast<int>(sample / region.width());
+      int i = row * width + column;
+      quint16 delta = edit.runs[next];
+      quint16 code = forward ? toCode(heights[i]) + delta
+                             : toCode(heights[i]) - delta;
+      heights[i] = code / 65535.0F;
+      committed[i] = heights[i];
+    }
+  }
+  return region;
+}
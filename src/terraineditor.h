@@ -0,0 +1,78 @@
+#ifndef TERRAINEDITOR_H
+#define TERRAINEDITOR_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+/**
+ * @brief Sculpts a height grid with brushes and keeps an undo log of the
+ * strokes.
+ *
+ * Heights run from 0 to 1, as red / 255 of the noise image; sample (x, y)
+ * is column x of row y. Every call that changes heights returns the
+ * rectangle of samples it touched, so that the copies of the heights
+ * elsewhere only have to update that part. A stroke is stored as the
+ * difference to the heights before it, in steps of 1 / 65535, the precision
+ * of the height texture, wrapping around in 16 bits so that undo and redo
+ * restore the edited samples to that precision. Runs of unchanged samples,
+ * such as the corners around a round brush, are stored as a count.
+ */
+class TerrainEditor {
+ public:
+  enum Brush { RAISE, LOWER, SMOOTH, FLATTEN };
+
+  // Undo log size before the oldest strokes are dropped
+  static constexpr qsizetype kMaxUndoBytes = 32 * 1024 * 1024;
+
+  void setHeights(int newWidth, int newHeight, const QVector<float> &values);
+  void setHeights(const QRect &region, const QVector<float> &values);
+  void setHeightSource(const QImage &image);
+
+  void setRadius(float samples) { radius = qBound(1.0F, samples, 64.0F); }
+  float getRadius() const { return radius; }
+  void setStrength(float perSecond) { strength = perSecond; }
+
+  void beginStroke(Brush newBrush, float x, float y);
+  QRect apply(float x, float y, float seconds);
+  void endStroke();
+  bool isStroking() const { return stroking; }
+
+  QRect undo();
+  QRect redo();
+  bool canUndo() const { return !undoLog.isEmpty(); }
+  bool canRedo() const { return !redoLog.isEmpty(); }
+
+  const QVector<float> &getHeights() const { return heights; }
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+
+ private:
+  struct Edit {
+    QRect region;
+    QVector<quint16> runs;  // unchanged count, changed count, deltas, ...
+  };
+
+  static quint16 toCode(float value);
+  qsizetype logBytes() const;
+  QRect replay(const Edit &edit, bool forward);
+
+  int width = 0;
+  int height = 0;
+  QVector<float> heights;
+  QVector<float> committed;  // the heights before the current stroke
+
+  float radius = 8.0F;    // in samples
+  float strength = 0.2F;  // full height per second at the brush centre
+
+  Brush brush = RAISE;
+  bool stroking = false;
+  float target = 0.0F;  // height the flatten brush pulls to
+  QRect strokeRegion;
+  QVector<float> scratch;
+
+  QVector<Edit> undoLog;
+  QVector<Edit> redoLog;
+};
+
+#endif  // TERRAINEDITOR_H
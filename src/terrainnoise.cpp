@@ -0,0 +1,94 @@
+#include "terrainnoise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// Feature size of the first octave, in terrain units. Chosen to give hills of
+// roughly the same size as the ones in the noise textures. The permutation
+// table wraps after 256 of these, which the finer octaves divide.
+constexpr float kBaseFrequency = 1.0F / 96.0F;
+constexpr int kOctaves = 5;
+constexpr float kLacunarity = 2.0F;
+constexpr float kGain = 0.5F;
+
+float fade(float t) { return t * t * t * (t * (t * 6.0F - 15.0F) + 10.0F); }
+
+float lerp(float a, float b, float t) { return a + t * (b - a); }
+
+float gradient(int hash, float x, float z) {
+  // Eight gradient directions on the unit square
+  switch (hash & 7) {
+    case 0: return x + z;
+    case 1: return x - z;
+    case 2: return -x + z;
+    case 3: return -x - z;
+    case 4: return x;
+    case 5: return -x;
+    case 6: return z;
+    default: return -z;
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief TerrainNoise::TerrainNoise Creates a noise function.
+ * @param seed The seed of the permutation table. Equal seeds give equal
+ * terrain.
+ */
+TerrainNoise::TerrainNoise(unsigned seed) {
+  permutation.resize(512);
+  for (int i = 0; i != 256; ++i) {
+    permutation[i] = i;
+  }
+  std::mt19937 generator(seed);
+  std::shuffle(permutation.begin(), permutation.begin() + 256, generator);
+  for (int i = 0; i != 256; ++i) {
+    permutation[256 + i] = permutation[i];
+  }
+}
+
+float TerrainNoise::gradientNoise(float x, float z) const {
+  float fx = std::floor(x);
+  float fz = std::floor(z);
+  int xi = static_cast<int>(fx) & 255;
+  int zi = static_cast<int>(fz) & 255;
+  x -= fx;
+  z -= fz;
+
+  float u = fade(x);
+  float v = fade(z);
+  int a = permutation[xi] + zi;
+  int b = permutation[xi + 1] + zi;
+
+  return lerp(lerp(gradient(permutation[a], x, z),
+                   gradient(permutation[b], x - 1.0F, z), u),
+              lerp(gradient(permutation[a + 1], x, z - 1.0F),
+                   gradient(permutation[b + 1], x - 1.0F, z - 1.0F), u),
+              v);
+}
+
+/**
+ * @brief TerrainNoise::sample Samples the fractal noise.
+ * @param x Position along the x axis of the terrain.
+ * @param z Position along the direction of flight.
+ * @return A value in the same 0-255 range as the red channel of the noise
+ * textures.
+ */
+float TerrainNoise::sample(float x, float z) const {
+  float value = 0.0F;
+  float amplitude = 0.5F;
+  float frequency = kBaseFrequency;
+  for (int octave = 0; octave != kOctaves; ++octave) {
+    value += amplitude * gradientNoise(x * frequency, z * frequency);
+    frequency *= kLacunarity;
+    amplitude *= kGain;
+  }
+
+  // Gradient noise stays well within [-1, 1], map it to [0, 255].
+  float normalized = std::fmin(std::fmax(value * 0.5F + 0.5F, 0.0F), 1.0F);
+  return normalized * 255.0F;
+}
@@ -0,0 +1,25 @@
+#ifndef TERRAINNOISE_H
+#define TERRAINNOISE_H
+
+#include <QVector>
+
+/**
+ * @brief Seeded fractal Perlin noise, used as an unbounded height source for
+ * the infinite terrain. The lattice wraps after 256 cells of the coarsest
+ * octave, so the noise repeats every 24576 terrain units along either axis,
+ * far beyond what is in view at once. Sampling is thread safe, so tiles can
+ * be generated on worker threads.
+ */
+class TerrainNoise {
+ public:
+  explicit TerrainNoise(unsigned seed = 1337);
+
+  float sample(float x, float z) const;
+
+ private:
+  float gradientNoise(float x, float z) const;
+
+  QVector<int> permutation;  // 512 entries, the table repeated twice
+};
+
+#endif  // TERRAINNOISE_H
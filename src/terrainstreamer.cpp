@@ -0,0 +1,320 @@
+#include "terrainstreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Tiles of 16 by 16 quads of 2 by 2 units, like the fixed terrain mesh.
+constexpr int kTileQuads = 16;
+constexpr float kQuadSize = 2.0F;
+
+// Tiles kept resident around the camera in every direction, and the extra
+// rows requested ahead of it so that they are ready in time.
+constexpr int kRingRadius = 4;
+constexpr int kLookaheadRows = 2;
+
+// Enough slots for the full ring plus the rows that are being replaced.
+constexpr int kSlotCount = (2 * kRingRadius + 1) * (2 * kRingRadius + 2);
+
+// Uploads are spread out to keep the frame time flat while moving. Shared by
+// all the simulation steps of a frame, see startFrame().
+constexpr int kMaxUploadsPerFrame = 4;
+
+constexpr qsizetype kDefaultMemoryBudget = 16 * 1024 * 1024;
+
+// Vertex steps of the detail levels: the full grid, then every second and
+// every fourth vertex.
+constexpr int kDetailSteps[TerrainStreamer::kDetailLevels] = {1, 2, 4};
+
+}  // namespace
+
+TerrainStreamer::TerrainStreamer()
+    : cache(kTileQuads, kQuadSize, kDefaultMemoryBudget) {}
+
+/**
+ * @brief TerrainStreamer::initialize Allocates the pool of tile buffers and
+ * the index buffer shared by all tiles, which holds the grids of all detail
+ * levels one after the other. Requires a current context.
+ * @param functions The OpenGL functions of the context.
+ */
+void TerrainStreamer::initialize(QOpenGLFunctions_3_3_Core *functions) {
+  gl = functions;
+
+  QVector<unsigned> indices;
+  for (int level = 0; level != kDetailLevels; ++level) {
+    QVector<unsigned> levelIndices = cache.gridIndices(kDetailSteps[level]);
+    indexOffsets[level] = indices.size() * sizeof(unsigned);
+    indexCounts[level] = levelIndices.size();
+    indices.append(levelIndices);
+  }
+  gl->glGenBuffers(1, &indexBuffer);
+
+  // The wireframe corners only depend on the grid, so all slots share them
+  QVector<quint8> barycentrics = cache.gridBarycentrics();
+  gl->glGenBuffers(1, &barycentricBuffer);
+  gl->glBindBuffer(GL_ARRAY_BUFFER, barycentricBuffer);
+  gl->glBufferData(GL_ARRAY_BUFFER, barycentrics.size(),
+                   barycentrics.constData(), GL_STATIC_DRAW);
+
+  GLsizeiptr tileBytes = cache.getVertexCount() * 6 * sizeof(float);
+  slots.resize(kSlotCount);
+  for (Slot &slot : slots) {
+    gl->glGenVertexArrays(1, &slot.vao);
+    gl->glBindVertexArray(slot.vao);
+
+    gl->glGenBuffers(1, &slot.vbo);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+    gl->glBufferData(GL_ARRAY_BUFFER, tileBytes, nullptr, GL_DYNAMIC_DRAW);
+
+    // Interleaved positions and normals
+    gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+                              reinterpret_cast<GLvoid *>(0));
+    gl->glEnableVertexAttribArray(0);
+    gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+                              reinterpret_cast<GLvoid *>(3 * sizeof(float)));
+    gl->glEnableVertexAttribArray(1);
+
+    gl->glBindBuffer(GL_ARRAY_BUFFER, barycentricBuffer);
+    gl->glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, 4,
+                              reinterpret_cast<GLvoid *>(0));
+    gl->glEnableVertexAttribArray(3);
+
+    // The element buffer binding is part of the VAO state
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    if (&slot == &slots.first()) {
+      gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                       indices.size() * sizeof(unsigned), indices.constData(),
+                       GL_STATIC_DRAW);
+    }
+  }
+
+  gl->glBindVertexArray(0);
+  gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * @brief TerrainStreamer::destroy Frees the GPU buffers. Requires a current
+ * context.
+ */
+void TerrainStreamer::destroy() {
+  if (!gl) return;
+
+  for (Slot &slot : slots) {
+    gl->glDeleteBuffers(1, &slot.vbo);
+    gl->glDeleteVertexArrays(1, &slot.vao);
+  }
+  gl->glDeleteBuffers(1, &indexBuffer);
+  gl->glDeleteBuffers(1, &barycentricBuffer);
+  slots.clear();
+  gl = nullptr;
+}
+
+/**
+ * @brief TerrainStreamer::startFrame Refills the upload budget. Called once
+ * per rendered frame, as update() runs once per simulation step and a frame
+ * can take several of those, or none.
+ */
+void TerrainStreamer::startFrame() { uploadsLeft = kMaxUploadsPerFrame; }
+
+/**
+ * @brief TerrainStreamer::update Makes the ring of tiles around the camera
+ * resident, nearest tiles first, and requests the tiles ahead of it. Uploads
+ * at most what is left of the budget of the frame.
+ * @param cameraPosition Position of the camera in the local space of the
+ * terrain mesh.
+ * @param flying The distance flown, in terrain units.
+ * @return The number of tiles uploaded.
+ */
+int TerrainStreamer::update(const QVector3D &cameraPosition, double flying) {
+  ++frame;
+  cache.collectFinished();
+
+  float tileSize = cache.getTileSize();
+  double u = cameraPosition.x() + 2.0;
+  double v = 2.0 - cameraPosition.z() + flying;
+  int centerColumn = static_cast<int>(std::floor(u / tileSize));
+  int centerRow = static_cast<int>(std::floor(v / tileSize));
+
+  int uploads = 0;
+  for (int distance = 0; distance <= kRingRadius; ++distance) {
+    for (int row = centerRow - distance; row <= centerRow + distance; ++row) {
+      for (int column = centerColumn - distance;
+           column <= centerColumn + distance; ++column) {
+        // Only visit the outline of the square at this distance.
+        if (std::abs(row - centerRow) != distance &&
+            std::abs(column - centerColumn) != distance) {
+          continue;
+        }
+
+        int level = levelAt(column, row, u, v);
+        int index = findSlot(column, row);
+        if (index != -1) {
+          slots[index].lastUse = frame;
+          if (slots[index].level == level) {
+            cache.find(column, row, level);  // keep it warm in the cache
+            continue;
+          }
+        }
+
+        QSharedPointer<const TerrainTile> tile =
+            cache.find(column, row, level);
+        if (tile.isNull()) {
+          cache.request(column, row, level);
+          continue;
+        }
+        if (uploadsLeft == 0) continue;
+
+        if (index == -1) index = acquireSlot();
+        if (index == -1) continue;
+        upload(slots[index], *tile);
+        ++uploads;
+        --uploadsLeft;
+      }
+    }
+  }
+
+  for (int row = centerRow + kRingRadius + 1;
+       row <= centerRow + kRingRadius + kLookaheadRows; ++row) {
+    for (int column = centerColumn - kRingRadius;
+         column <= centerColumn + kRingRadius; ++column) {
+      cache.request(column, row, levelAt(column, row, u, v));
+    }
+  }
+  return uploads;
+}
+
+/**
+ * @brief TerrainStreamer::draw Draws the resident tiles of the ring that
+ * intersect the frustum and are not hidden by the fog. The shader program
+ * must be bound.
+ * @param program The bound shader program.
+ * @param meshTransform The model view transform of the terrain.
+ * @param frustum The view frustum, in view space.
+ * @param flying The distance flown, in terrain units.
+ * @param maxDistance Tiles further away from the camera are skipped.
+ */
+void TerrainStreamer::draw(QOpenGLShaderProgram &program,
+                           const QMatrix4x4 &meshTransform,
+                           const Frustum &frustum, double flying,
+                           float maxDistance) {
+  cullStats = CullStats();
+  for (const Slot &slot : slots) {
+    if (!slot.resident || slot.lastUse != frame) continue;
+
+    QMatrix4x4 modelView = meshTransform * tileTransform(slot, flying);
+    Aabb viewBounds = slot.bounds.transformed(modelView);
+    if (viewBounds.distanceTo(QVector3D()) > maxDistance) {
+      ++cullStats.fogged;
+      continue;
+    }
+    if (frustum.classify(viewBounds) == Frustum::OUTSIDE) {
+      ++cullStats.culled;
+      continue;
+    }
+    ++cullStats.visible;
+
+    program.setUniformValue("modelViewTransform", modelView);
+    gl->glBindVertexArray(slot.vao);
+    gl->glDrawElements(GL_TRIANGLES, indexCounts[detail], GL_UNSIGNED_INT,
+                       reinterpret_cast<GLvoid *>(indexOffsets[detail]));
+  }
+}
+
+/**
+ * @brief TerrainStreamer::heightAt Samples the terrain height directly from
+ * the height source, whether or not the tile is resident.
+ * @param u Position along the x axis of the noise plane.
+ * @param v Position along the direction of flight.
+ * @return The height of the terrain.
+ */
+float TerrainStreamer::heightAt(float u, float v) const {
+  return cache.heightAt(u, v);
+}
+
+/**
+ * @brief TerrainStreamer::setHeightSource Switches the heights of the
+ * terrain, see TileCache::setHeightSource(). The resident tiles are
+ * replaced as the new ones are generated.
+ * @param dem The elevation model, or null for the noise.
+ * @param level The finest level of the elevation model to sample.
+ */
+void TerrainStreamer::setHeightSource(QSharedPointer<const DemCache> dem,
+                                      int level) {
+  cache.setHeightSource(dem, level);
+  for (Slot &slot : slots) {
+    slot.resident = false;
+  }
+}
+
+/**
+ * @brief TerrainStreamer::levelAt Picks the level of the elevation model for
+ * a tile, from the distance between the camera and the nearest point of the
+ * tile in the noise plane.
+ * @param column Column of the tile.
+ * @param row Row of the tile.
+ * @param u Position of the camera along the x axis of the noise plane.
+ * @param v Position of the camera along the direction of flight.
+ * @return The level, see TileCache::levelAt().
+ */
+int TerrainStreamer::levelAt(int column, int row, double u, double v) const {
+  double tileSize = cache.getTileSize();
+  double du = std::max({column * tileSize - u, u - (column + 1) * tileSize,
+                        0.0});
+  double dv = std::max({row * tileSize - v, v - (row + 1) * tileSize, 0.0});
+  return cache.levelAt(static_cast<float>(std::hypot(du, dv)));
+}
+
+int TerrainStreamer::findSlot(int column, int row) const {
+  for (int i = 0; i != slots.size(); ++i) {
+    const Slot &slot = slots[i];
+    if (slot.resident && slot.column == column && slot.row == row) return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief TerrainStreamer::acquireSlot Finds a slot for a new tile: a free one,
+ * or else the one that has been out of the ring the longest.
+ * @return The index of the slot, or -1 if all slots are in use this frame.
+ */
+int TerrainStreamer::acquireSlot() {
+  int best = -1;
+  for (int i = 0; i != slots.size(); ++i) {
+    if (!slots[i].resident) return i;
+    if (slots[i].lastUse != frame &&
+        (best == -1 || slots[i].lastUse < slots[best].lastUse)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void TerrainStreamer::upload(Slot &slot, const TerrainTile &tile) {
+  gl->glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+  gl->glBufferSubData(GL_ARRAY_BUFFER, 0,
+                      tile.vertexData.size() * sizeof(float),
+                      tile.vertexData.constData());
+  gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  slot.column = tile.column;
+  slot.row = tile.row;
+  slot.level = tile.level;
+  slot.bounds = tile.bounds;
+  slot.resident = true;
+  slot.lastUse = frame;
+}
+
+/**
+ * @brief TerrainStreamer::tileTransform Computes the transform from the local
+ * space of a tile to the local space of the terrain mesh. The large values of
+ * flying and the tile row cancel out in double precision.
+ */
+QMatrix4x4 TerrainStreamer::tileTransform(const Slot &slot,
+                                          double flying) const {
+  double tileSize = cache.getTileSize();
+  QMatrix4x4 transform;
+  transform.translate(static_cast<float>(slot.column * tileSize - 2.0), 0.0F,
+                      static_cast<float>(2.0 + flying - slot.row * tileSize));
+  return transform;
+}
@@ -0,0 +1,79 @@
+#ifndef TERRAINSTREAMER_H
+#define TERRAINSTREAMER_H
+
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLShaderProgram>
+#include <QVector>
+
+#include "frustum.h"
+#include "tilecache.h"
+
+/**
+ * @brief Streams the infinite terrain: keeps the tiles in a ring around the
+ * camera resident in a fixed pool of GPU buffers, and requests the tiles
+ * ahead of the direction of flight from the TileCache.
+ *
+ * The noise plane is mapped to the local space of the terrain mesh like the
+ * noise texture is for the fixed terrain: x = u - 2 and z = 2 - v + flying.
+ * A resident tile is replaced when the camera moves far enough for it to
+ * need another level of the elevation model, but drawn until the new one
+ * has been generated.
+ */
+class TerrainStreamer {
+ public:
+  static constexpr int kDetailLevels = 3;
+
+  TerrainStreamer();
+
+  void initialize(QOpenGLFunctions_3_3_Core *functions);
+  void destroy();
+
+  void startFrame();
+  int update(const QVector3D &cameraPosition, double flying);
+  void draw(QOpenGLShaderProgram &program, const QMatrix4x4 &meshTransform,
+            const Frustum &frustum, double flying, float maxDistance);
+
+  float heightAt(float u, float v) const;
+  void setHeightSource(QSharedPointer<const DemCache> dem, int level);
+
+  void setMemoryBudget(qsizetype bytes) { cache.setMemoryBudget(bytes); }
+  // 0 draws the full grid, every level above halves its resolution.
+  void setDetail(int level) { detail = qBound(0, level, kDetailLevels - 1); }
+  int getDetail() const { return detail; }
+  const TileCache &getCache() const { return cache; }
+  const CullStats &getCullStats() const { return cullStats; }
+
+ private:
+  // A preallocated vertex buffer holding one resident tile.
+  struct Slot {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    int column = 0;
+    int row = 0;
+    int level = 0;
+    bool resident = false;
+    quint64 lastUse = 0;
+    Aabb bounds;
+  };
+
+  int findSlot(int column, int row) const;
+  int levelAt(int column, int row, double u, double v) const;
+  int acquireSlot();
+  void upload(Slot &slot, const TerrainTile &tile);
+  QMatrix4x4 tileTransform(const Slot &slot, double flying) const;
+
+  QOpenGLFunctions_3_3_Core *gl = nullptr;
+  TileCache cache;
+  QVector<Slot> slots;
+  GLuint indexBuffer = 0;
+  GLuint barycentricBuffer = 0;
+  GLsizei indexCounts[kDetailLevels] = {};
+  GLsizeiptr indexOffsets[kDetailLevels] = {};
+  int detail = 0;
+  quint64 frame = 0;  // counts the updates
+  int uploadsLeft = 0;
+  CullStats cullStats;
+};
+
+#endif  // TERRAINSTREAMER_H
@@ -0,0 +1,294 @@
+#include <QFile>
+#include <QScopedPointer>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+
+#include "demcache.h"
+#include "demimporter.h"
+
+namespace {
+
+// The smallest tile size, so that the test images span several tiles and
+// levels.
+constexpr int kTileSize = 16;
+
+void append16(QByteArray &bytes, quint16 value, bool bigEndian) {
+  if (bigEndian) {
+    bytes.append(char(value >> 8));
+    bytes.append(char(value & 0xff));
+  } else {
+    bytes.append(char(value & 0xff));
+    bytes.append(char(value >> 8));
+  }
+}
+
+void append32(QByteArray &bytes, quint32 value) {
+  append16(bytes, value & 0xffff, false);
+  append16(bytes, value >> 16, false);
+}
+
+// An entry of a little endian TIFF directory with a single SHORT value, or
+// the offset of the values.
+void appendTiffEntry(QByteArray &bytes, quint16 tag, quint16 type,
+                     quint32 count, quint32 value) {
+  append16(bytes, tag, false);
+  append16(bytes, type, false);
+  append32(bytes, count);
+  if (type == 3 && count == 1) {
+    append16(bytes, value, false);
+    append16(bytes, 0, false);
+  } else {
+    append32(bytes, value);
+  }
+}
+
+// Codes that are different for every sample and do not follow the rows.
+QVector<quint16> testCodes(int width, int height, int range) {
+  QVector<quint16> codes(width * height);
+  for (int y = 0; y != height; ++y) {
+    for (int x = 0; x != width; ++x) {
+      codes[y * width + x] = (x * 37 + y * 101 + x * y % 7) % range + 3;
+    }
+  }
+  return codes;
+}
+
+}  // namespace
+
+class TestDemImporter : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void init();
+  void importsPgm16();
+  void importsPgm8();
+  void rejectsTruncatedPgm();
+  void importsRawSquare();
+  void rejectsSmallRaw();
+  void importsHgtVoidsAsSeaLevel();
+  void importsTiffStrips();
+  void rejectsTiffStripOutOfRange();
+  void regionMatchesSample();
+
+ private:
+  QString write(const QString &name, const QByteArray &bytes);
+  bool import(const QString &source,
+              const DemImportOptions &options = DemImportOptions());
+  void compare(const QVector<quint16> &codes, int width, int height);
+  QByteArray tiff(const QVector<quint16> &codes, int width, int height,
+                  bool stripOutOfRange = false);
+
+  QScopedPointer<QTemporaryDir> directory;
+  DemCache cache;
+};
+
+void TestDemImporter::init() {
+  cache.close();
+  directory.reset(new QTemporaryDir);
+  QVERIFY(directory->isValid());
+}
+
+/**
+ * @brief TestDemImporter::write Writes a source file into the directory of
+ * the test.
+ * @return The path of the file.
+ */
+QString TestDemImporter::write(const QString &name, const QByteArray &bytes) {
+  QString path = directory->filePath(name);
+  QFile file(path);
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write(bytes);
+  }
+  return path;
+}
+
+/**
+ * @brief TestDemImporter::import Builds the tile cache of a source and opens
+ * it.
+ * @return False if the source was rejected.
+ */
+bool TestDemImporter::import(const QString &source,
+                             const DemImportOptions &options) {
+  DemImportOptions tiled = options;
+  tiled.tileSize = kTileSize;
+  QString path = directory->filePath("cache.tiles");
+  return DemImporter::import(source, path, tiled) && cache.open(path);
+}
+
+/**
+ * @brief TestDemImporter::compare Checks every sample of the first level
+ * against the codes of the source. Heights are scaled from the lowest to
+ * the highest code.
+ */
+void TestDemImporter::compare(const QVector<quint16> &codes, int width,
+                              int height) {
+  QCOMPARE(cache.getWidth(0), width);
+  QCOMPARE(cache.getHeight(0), height);
+  float minimum = *std::min_element(codes.begin(), codes.end());
+  float maximum = *std::max_element(codes.begin(), codes.end());
+  for (int y = 0; y != height; ++y) {
+    for (int x = 0; x != width; ++x) {
+      float expected = (codes[y * width + x] - minimum) / (maximum - minimum);
+      float sample = cache.sample(0, x, y);
+      QVERIFY2(std::abs(sample - expected) < 1.0e-5F,
+               qPrintable(QString("%1 instead of %2 at %3, %4")
+                              .arg(sample)
+                              .arg(expected)
+                              .arg(x)
+                              .arg(y)));
+    }
+  }
+}
+
+/**
+ * @brief TestDemImporter::tiff Builds a little endian 16-bit TIFF file with
+ * two strips, the second one first in the file.
+ * @param stripOutOfRange Let the first strip run past the end of the file.
+ */
+QByteArray TestDemImporter::tiff(const QVector<quint16> &codes, int width,
+                                 int height, bool stripOutOfRange) {
+  int rowsPerStrip = (height + 1) / 2;
+  int rowBytes = width * 2;
+  int entries = 9;
+  quint32 stripOffsets = 8 + 2 + entries * 12 + 4;
+  quint32 stripByteCounts = stripOffsets + 8;
+  quint32 secondStrip = stripByteCounts + 8;
+  quint32 firstStrip = secondStrip + (height - rowsPerStrip) * rowBytes;
+  if (stripOutOfRange) firstStrip += rowBytes;
+
+  QByteArray bytes("II");
+  append16(bytes, 42, false);
+  append32(bytes, 8);
+  append16(bytes, entries, false);
+  appendTiffEntry(bytes, 256, 3, 1, width);
+  appendTiffEntry(bytes, 257, 3, 1, height);
+  appendTiffEntry(bytes, 258, 3, 1, 16);
+  appendTiffEntry(bytes, 259, 3, 1, 1);  // no compression
+  appendTiffEntry(bytes, 262, 3, 1, 1);  // black is zero
+  appendTiffEntry(bytes, 273, 4, 2, stripOffsets);
+  appendTiffEntry(bytes, 277, 3, 1, 1);
+  appendTiffEntry(bytes, 278, 3, 1, rowsPerStrip);
+  appendTiffEntry(bytes, 279, 4, 2, stripByteCounts);
+  append32(bytes, 0);  // no next directory
+
+  append32(bytes, firstStrip);
+  append32(bytes, secondStrip);
+  append32(bytes, rowsPerStrip * rowBytes);
+  append32(bytes, (height - rowsPerStrip) * rowBytes);
+  for (int i = rowsPerStrip * width; i != codes.size(); ++i) {
+    append16(bytes, codes[i], false);
+  }
+  for (int i = 0; i != rowsPerStrip * width; ++i) {
+    append16(bytes, codes[i], false);
+  }
+  return bytes;
+}
+
+void TestDemImporter::importsPgm16() {
+  int width = 40;
+  int height = 30;
+  QVector<quint16> codes = testCodes(width, height, 5000);
+  QByteArray bytes = "P5\n# a comment\n40 30\n65535\n";
+  for (quint16 code : codes) {
+    append16(bytes, code, true);
+  }
+  QVERIFY(import(write("image.pgm", bytes)));
+  QCOMPARE(cache.getLevelCount(), 3);
+  compare(codes, width, height);
+}
+
+void TestDemImporter::importsPgm8() {
+  int width = 20;
+  int height = 20;
+  QVector<quint16> codes = testCodes(width, height, 250);
+  QByteArray bytes = "P5 20 20 255\n";
+  for (quint16 code : codes) {
+    bytes.append(char(code));
+  }
+  QVERIFY(import(write("image.pgm", bytes)));
+  compare(codes, width, height);
+}
+
+void TestDemImporter::rejectsTruncatedPgm() {
+  QByteArray bytes = "P5\n300 200\n65535\n";
+  bytes.append(QByteArray(1000, 1));
+  QVERIFY(!import(write("image.pgm", bytes)));
+}
+
+void TestDemImporter::importsRawSquare() {
+  int side = 24;
+  QVector<quint16> codes = testCodes(side, side, 60000);
+  QByteArray bytes;
+  for (quint16 code : codes) {
+    append16(bytes, code, false);
+  }
+  QVERIFY(import(write("image.raw", bytes)));
+  compare(codes, side, side);
+}
+
+void TestDemImporter::rejectsSmallRaw() {
+  QByteArray bytes;
+  for (quint16 code : testCodes(24, 24, 60000)) {
+    append16(bytes, code, false);
+  }
+  DemImportOptions options;
+  options.width = 30;
+  options.height = 30;
+  QVERIFY(!import(write("image.raw", bytes), options));
+}
+
+void TestDemImporter::importsHgtVoidsAsSeaLevel() {
+  int side = 20;
+  QVector<quint16> codes = testCodes(side, side, 600);
+  QByteArray bytes;
+  for (int i = 0; i != codes.size(); ++i) {
+    // Elevations from below to above sea level, with a few voids
+    qint16 elevation = codes[i] - 300;
+    if (i % 17 == 5) {
+      elevation = -32768;
+      codes[i] = 32768;
+    } else {
+      codes[i] = elevation + 32768;
+    }
+    append16(bytes, quint16(elevation), true);
+  }
+  QVERIFY(import(write("N00E000.hgt", bytes)));
+  QCOMPARE(cache.getHeader().codeOffset, 32768);
+  compare(codes, side, side);
+}
+
+void TestDemImporter::importsTiffStrips() {
+  int width = 18;
+  int height = 11;
+  QVector<quint16> codes = testCodes(width, height, 60000);
+  QVERIFY(import(write("image.tif", tiff(codes, width, height))));
+  compare(codes, width, height);
+}
+
+void TestDemImporter::rejectsTiffStripOutOfRange() {
+  int width = 18;
+  int height = 11;
+  QVector<quint16> codes = testCodes(width, height, 60000);
+  QVERIFY(!import(write("image.tif", tiff(codes, width, height, true))));
+}
+
+void TestDemImporter::regionMatchesSample() {
+  QByteArray bytes = "P5\n40 30\n65535\n";
+  for (quint16 code : testCodes(40, 30, 5000)) {
+    append16(bytes, code, true);
+  }
+  QVERIFY(import(write("image.pgm", bytes)));
+
+  // Also samples outside of the region, and across the edges of the data
+  DemCache::Region region = cache.region(0, 10.5F, 5.0F, 38.0F, 29.0F);
+  for (float y = -5.0F; y < 35.0F; y += 0.7F) {
+    for (float x = -5.0F; x < 45.0F; x += 0.9F) {
+      QCOMPARE(region.sample(x, y), cache.sample(0, x, y));
+    }
+  }
+}
+
+QTEST_APPLESS_MAIN(TestDemImporter)
+#include "tst_demimporter.moc"
@@ -0,0 +1,90 @@
+#include <QtTest>
+#include <cmath>
+
+#include "erosion.h"
+
+namespace {
+
+constexpr int kWidth = 200;  // several tiles, the last ones partial
+constexpr int kHeight = 150;
+constexpr int kBatches = 5;
+
+// Rolling hills, so that droplets and slopes have somewhere to go.
+QVector<float> hills() {
+  QVector<float> values(kWidth * kHeight);
+  for (int y = 0; y != kHeight; ++y) {
+    for (int x = 0; x != kWidth; ++x) {
+      values[y * kWidth + x] =
+          0.5F + 0.4F * std::sin(x * 0.1F) * std::cos(y * 0.13F);
+    }
+  }
+  return values;
+}
+
+QVector<float> erode(unsigned seed, int threadCount) {
+  ErosionSettings settings;
+  settings.seed = seed;
+  settings.threadCount = threadCount;
+  TerrainErosion erosion(settings);
+  erosion.setHeights(kWidth, kHeight, hills());
+  for (int i = 0; i != kBatches; ++i) {
+    erosion.runBatch();
+  }
+  return erosion.getHeights();
+}
+
+}  // namespace
+
+class TestErosion : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void changesHeights();
+  void sameResultOnAnyThreadCount();
+  void seedChangesResult();
+  void reportsChangedRegion();
+  void editIsNotReportedAsChanged();
+};
+
+void TestErosion::changesHeights() { QVERIFY(erode(1, 1) != hills()); }
+
+void TestErosion::sameResultOnAnyThreadCount() {
+  QVector<float> single = erode(1, 1);
+  QCOMPARE(erode(1, 4), single);
+  QCOMPARE(erode(1, 3), single);
+}
+
+void TestErosion::seedChangesResult() { QVERIFY(erode(1, 4) != erode(2, 4)); }
+
+void TestErosion::reportsChangedRegion() {
+  TerrainErosion erosion;
+  erosion.setHeights(kWidth, kHeight, hills());
+  QVERIFY(erosion.takeChangedRegion().isEmpty());
+
+  erosion.runBatch();
+  QRect changed = erosion.takeChangedRegion();
+  QVERIFY(!changed.isEmpty());
+  QVERIFY(QRect(0, 0, kWidth, kHeight).contains(changed));
+  QVERIFY(erosion.takeChangedRegion().isEmpty());
+}
+
+void TestErosion::editIsNotReportedAsChanged() {
+  TerrainErosion erosion;
+  erosion.setHeights(kWidth, kHeight, hills());
+  erosion.runBatch();
+  erosion.takeChangedRegion();
+
+  QVector<float> edited = erosion.getHeights();
+  QRect region(30, 70, 10, 5);
+  for (int y = region.top(); y <= region.bottom(); ++y) {
+    for (int x = region.left(); x <= region.right(); ++x) {
+      edited[y * kWidth + x] += 0.2F;
+    }
+  }
+  erosion.setHeights(region, edited);
+  QCOMPARE(erosion.getHeights(), edited);
+  QVERIFY(erosion.takeChangedRegion().isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestErosion)
+#include "tst_erosion.moc"
@@ -0,0 +1,146 @@
+#include <QMatrix4x4>
+#include <QtTest>
+#include <algorithm>
+#include <memory>
+#include <random>
+
+#include "bvh.h"
+#include "frustum.h"
+
+namespace {
+
+// A camera at the origin looking down -z, as MainView sets it up.
+Frustum cameraFrustum() {
+  QMatrix4x4 projection;
+  projection.perspective(60.0F, 4.0F / 3.0F, 0.2F, 100.0F);
+  QMatrix4x4 view;
+  view.rotate(20.0F, 0.0F, 1.0F, 0.0F);
+  Frustum frustum;
+  frustum.update(projection * view);
+  return frustum;
+}
+
+// Boxes of all sizes, in front of, behind and around the camera.
+QVector<Aabb> randomBoxes(int count, unsigned seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> position(-120.0F, 120.0F);
+  std::uniform_real_distribution<float> size(0.01F, 10.0F);
+  QVector<Aabb> boxes;
+  for (int i = 0; i != count; ++i) {
+    QVector3D minimum(position(random), position(random) * 0.2F,
+                      position(random));
+    boxes.append(
+        Aabb(minimum, minimum + QVector3D(size(random), size(random),
+                                          size(random))));
+  }
+  return boxes;
+}
+
+QVector<int> bruteForce(const Frustum &frustum, const QVector<Aabb> &boxes) {
+  QVector<int> visible;
+  for (int i = 0; i != boxes.size(); ++i) {
+    if (frustum.classify(boxes[i]) != Frustum::OUTSIDE) visible.append(i);
+  }
+  return visible;
+}
+
+}  // namespace
+
+class TestFrustum : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void classifiesBoxes();
+  void batchMatchesClassify();
+  void queryMatchesBruteForce();
+  void refitFollowsMovedItems();
+  void emptyTreeFindsNothing();
+};
+
+void TestFrustum::classifiesBoxes() {
+  Frustum frustum;
+  QMatrix4x4 projection;
+  projection.perspective(90.0F, 1.0F, 1.0F, 100.0F);
+  frustum.update(projection);
+
+  QCOMPARE(frustum.classify(Aabb(QVector3D(-1, -1, -11), QVector3D(1, 1, -9))),
+           Frustum::INSIDE);
+  QCOMPARE(frustum.classify(Aabb(QVector3D(-1, -1, 9), QVector3D(1, 1, 11))),
+           Frustum::OUTSIDE);
+  QCOMPARE(
+      frustum.classify(Aabb(QVector3D(-1, -1, -101), QVector3D(1, 1, -99))),
+      Frustum::INTERSECTING);
+  QCOMPARE(frustum.classify(Aabb(QVector3D(20, -1, -11), QVector3D(22, 1, -9))),
+           Frustum::OUTSIDE);
+}
+
+void TestFrustum::batchMatchesClassify() {
+  Frustum frustum = cameraFrustum();
+  // Not a multiple of four, so the scalar tail runs after the SSE batches
+  QVector<Aabb> boxes = randomBoxes(1003, 1);
+  QVector<const Aabb *> pointers;
+  for (const Aabb &box : boxes) {
+    pointers.append(&box);
+  }
+  std::unique_ptr<bool[]> visible(new bool[boxes.size()]());
+  frustum.testAabbs(pointers.constData(), pointers.size(), visible.get());
+
+  int visibleCount = 0;
+  for (int i = 0; i != boxes.size(); ++i) {
+    QCOMPARE(visible[i], frustum.classify(boxes[i]) != Frustum::OUTSIDE);
+    visibleCount += visible[i];
+  }
+  // Both outcomes are covered
+  QVERIFY(visibleCount > 0);
+  QVERIFY(visibleCount < boxes.size());
+}
+
+void TestFrustum::queryMatchesBruteForce() {
+  Frustum frustum = cameraFrustum();
+  QVector<Aabb> boxes = randomBoxes(500, 2);
+  Bvh bvh;
+  bvh.build(boxes);
+  QCOMPARE(bvh.getItemCount(), boxes.size());
+
+  QVector<int> visible;
+  CullStats stats;
+  bvh.query(frustum, visible, stats);
+  std::sort(visible.begin(), visible.end());
+  QCOMPARE(visible, bruteForce(frustum, boxes));
+  QCOMPARE(stats.visible, visible.size());
+  QCOMPARE(stats.visible + stats.culled, boxes.size());
+}
+
+void TestFrustum::refitFollowsMovedItems() {
+  Frustum frustum = cameraFrustum();
+  QVector<Aabb> boxes = randomBoxes(300, 3);
+  Bvh bvh;
+  bvh.build(boxes);
+
+  // Move every other box somewhere else, without rebuilding the tree
+  QVector<Aabb> moved = randomBoxes(boxes.size(), 4);
+  for (int i = 0; i < boxes.size(); i += 2) {
+    boxes[i] = moved[i];
+  }
+  bvh.refit(boxes);
+
+  QVector<int> visible;
+  CullStats stats;
+  bvh.query(frustum, visible, stats);
+  std::sort(visible.begin(), visible.end());
+  QCOMPARE(visible, bruteForce(frustum, boxes));
+}
+
+void TestFrustum::emptyTreeFindsNothing() {
+  Bvh bvh;
+  bvh.build(QVector<Aabb>());
+  QVERIFY(bvh.isEmpty());
+  QVector<int> visible;
+  CullStats stats;
+  bvh.query(cameraFrustum(), visible, stats);
+  QVERIFY(visible.isEmpty());
+  QCOMPARE(stats.visible + stats.culled, 0);
+}
+
+QTEST_APPLESS_MAIN(TestFrustum)
+#include "tst_frustum.moc"
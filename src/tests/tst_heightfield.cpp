@@ -0,0 +1,165 @@
+#include <QtTest>
+#include <cmath>
+#include <random>
+
+#include "heightfield.h"
+
+namespace {
+
+// Odd sizes, so that the pyramid has partial nodes along both edges.
+constexpr int kWidth = 37;
+constexpr int kHeight = 53;
+
+QVector<float> randomHeights(unsigned seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> value(0.0F, 10.0F);
+  QVector<float> heights(kWidth * kHeight);
+  for (float &h : heights) {
+    h = value(random);
+  }
+  return heights;
+}
+
+// Steps along the ray until it is first below the surface inside the grid.
+// @return The distance, or -1 if it stays above.
+float rayMarch(const Heightfield &field, const QVector3D &origin,
+               const QVector3D &direction, float maxDistance) {
+  QVector3D d = direction.normalized();
+  for (float t = 0.0F; t < maxDistance; t += 0.002F) {
+    QVector3D p = origin + d * t;
+    if (p.x() < 0.0F || p.z() < 0.0F || p.x() > kWidth - 1 ||
+        p.z() > kHeight - 1) {
+      continue;
+    }
+    if (p.y() <= field.heightAt(p.x(), p.z())) return t;
+  }
+  return -1.0F;
+}
+
+}  // namespace
+
+class TestHeightfield : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void interpolatesBilinearly();
+  void clampsOutsideGrid();
+  void batchMatchesHeightAt();
+  void intersectMatchesRayMarch();
+  void missesAboveSurface();
+  void regionUpdateReachesRays();
+};
+
+void TestHeightfield::interpolatesBilinearly() {
+  Heightfield field;
+  field.setHeights(2, 2, {0.0F, 1.0F, 2.0F, 4.0F});
+  QCOMPARE(field.heightAt(0.0F, 0.0F), 0.0F);
+  QCOMPARE(field.heightAt(1.0F, 1.0F), 4.0F);
+  QCOMPARE(field.heightAt(0.5F, 0.0F), 0.5F);
+  QCOMPARE(field.heightAt(0.0F, 0.5F), 1.0F);
+  QCOMPARE(field.heightAt(0.5F, 0.5F), 1.75F);
+}
+
+void TestHeightfield::clampsOutsideGrid() {
+  Heightfield field;
+  QVERIFY(field.isEmpty());
+  QCOMPARE(field.heightAt(1.0F, 1.0F), 0.0F);
+
+  QVector<float> heights = randomHeights(1);
+  field.setHeights(kWidth, kHeight, heights);
+  QCOMPARE(field.heightAt(-5.0F, -5.0F), heights[0]);
+  QVERIFY(std::abs(field.heightAt(kWidth + 3.0F, kHeight + 3.0F) -
+                   heights[kWidth * kHeight - 1]) < 1.0e-5F);
+  QCOMPARE(field.heightAt(-1.0F, 2.0F), heights[2 * kWidth]);
+}
+
+void TestHeightfield::batchMatchesHeightAt() {
+  Heightfield field;
+  field.setHeights(kWidth, kHeight, randomHeights(2));
+
+  // Inside, on the last row and column, and outside the grid. The count is
+  // not a multiple of four, so the scalar tail runs as well.
+  std::mt19937 random(3);
+  std::uniform_real_distribution<float> position(-5.0F, 60.0F);
+  QVector<float> x, z;
+  for (int i = 0; i != 1001; ++i) {
+    x.append(position(random));
+    z.append(position(random));
+  }
+  x.append({kWidth - 1.0F, 0.0F, kWidth - 1.5F});
+  z.append({kHeight - 1.0F, kHeight - 1.0F, 0.0F});
+
+  QVector<float> heights(x.size());
+  field.heightsAt(x.constData(), z.constData(), x.size(), heights.data());
+  for (int i = 0; i != x.size(); ++i) {
+    QVERIFY2(std::abs(heights[i] - field.heightAt(x[i], z[i])) < 1.0e-5F,
+             qPrintable(QString("at %1, %2").arg(x[i]).arg(z[i])));
+  }
+}
+
+void TestHeightfield::intersectMatchesRayMarch() {
+  Heightfield field;
+  field.setHeights(kWidth, kHeight, randomHeights(4));
+
+  std::mt19937 random(5);
+  // Starting around the grid, some rays miss it or leave it before they hit
+  std::uniform_real_distribution<float> alongX(-10.0F, kWidth + 10.0F);
+  std::uniform_real_distribution<float> alongZ(-10.0F, kHeight + 10.0F);
+  std::uniform_real_distribution<float> sideways(-1.0F, 1.0F);
+  std::uniform_real_distribution<float> down(0.05F, 1.0F);
+  int hits = 0;
+  for (int i = 0; i != 300; ++i) {
+    QVector3D origin(alongX(random), 30.0F, alongZ(random));
+    QVector3D direction(sideways(random), -down(random), sideways(random));
+    float expected = rayMarch(field, origin, direction, 200.0F);
+
+    HeightfieldHit hit;
+    bool found = field.intersect(origin, direction, 200.0F, hit);
+    QCOMPARE(found, expected >= 0.0F);
+    if (!found) continue;
+    ++hits;
+    QVERIFY2(std::abs(hit.distance - expected) < 0.01F,
+             qPrintable(QString("%1 instead of %2").arg(hit.distance)
+                            .arg(expected)));
+    QVERIFY((origin + direction.normalized() * hit.distance - hit.position)
+                .length() < 1.0e-3F);
+  }
+  // Both outcomes are covered
+  QVERIFY(hits > 20);
+  QVERIFY(hits < 300);
+}
+
+void TestHeightfield::missesAboveSurface() {
+  Heightfield field;
+  field.setHeights(kWidth, kHeight, randomHeights(6));
+  HeightfieldHit hit;
+  // Level above the highest sample, upwards, and too short to reach down
+  QVERIFY(!field.intersect(QVector3D(0, 11, 0), QVector3D(1, 0, 1), 100, hit));
+  QVERIFY(!field.intersect(QVector3D(5, 11, 5), QVector3D(0, 1, 0), 100, hit));
+  QVERIFY(!field.intersect(QVector3D(5, 30, 5), QVector3D(0, -1, 0), 15, hit));
+  QVERIFY(!field.intersect(QVector3D(5, 30, 5), QVector3D(), 100, hit));
+}
+
+void TestHeightfield::regionUpdateReachesRays() {
+  Heightfield field;
+  QVector<float> heights(kWidth * kHeight, 1.0F);
+  field.setHeights(kWidth, kHeight, heights);
+  QVector3D origin(0.0F, 5.0F, 20.0F);
+  QVector3D direction(1.0F, 0.0F, 0.0F);
+  HeightfieldHit hit;
+  QVERIFY(!field.intersect(origin, direction, 100.0F, hit));
+
+  // A wall across the path of the ray, scaled like the erosion results
+  for (int row = 15; row != 25; ++row) {
+    heights[row * kWidth + 30] = 5.0F;
+  }
+  field.setHeights(QRect(30, 15, 1, 10), heights, 2.0F);
+  QCOMPARE(field.heightAt(30.0F, 20.0F), 10.0F);
+  QVERIFY(field.intersect(origin, direction, 100.0F, hit));
+  // The slope up to the wall starts one sample before it
+  QVERIFY(hit.position.x() > 29.0F);
+  QVERIFY(hit.position.x() <= 30.0F);
+}
+
+QTEST_APPLESS_MAIN(TestHeightfield)
+#include "tst_heightfield.moc"
@@ -0,0 +1,130 @@
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtTest>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+
+namespace {
+
+// Size of the ring buffer of the log.
+constexpr int kQueueCapacity = 1024;
+
+QMutex capturedMutex;
+QStringList captured;
+QtMessageHandler previousHandler = nullptr;
+
+// Keeps the messages of the sink without the time in front of them.
+void capture(QtMsgType, const QMessageLogContext &, const QString &message) {
+  QMutexLocker locker(&capturedMutex);
+  if (message.startsWith('[')) {
+    captured.append(message.mid(message.indexOf("] ") + 2));
+  } else {
+    captured.append(message);
+  }
+}
+
+// Writes everything that is queued through a sink, and returns it.
+QStringList flush() {
+  { Log::Sink sink; }
+  QMutexLocker locker(&capturedMutex);
+  QStringList messages = captured;
+  captured.clear();
+  return messages;
+}
+
+}  // namespace
+
+class TestLogging : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void formatsArguments();
+  void truncatesText();
+  void keepsOrderPerThread();
+  void countsSuppressedMessages();
+  void countsDroppedMessages();
+};
+
+void TestLogging::initTestCase() {
+  previousHandler = qInstallMessageHandler(capture);
+}
+
+void TestLogging::cleanupTestCase() { qInstallMessageHandler(previousHandler); }
+
+void TestLogging::formatsArguments() {
+  Log::write(Log::LEVEL_WARNING, "int %1, real %2, literal %3, text %4", -42,
+             1.5, "abc", QString("def"));
+  QCOMPARE(flush(),
+           QStringList({"int -42, real 1.5, literal abc, text def"}));
+}
+
+void TestLogging::truncatesText() {
+  Log::write(Log::LEVEL_WARNING, "%1", QString(100, 'x'));
+  QCOMPARE(flush(), QStringList({QString(Log::kTextSize - 1, 'x')}));
+}
+
+void TestLogging::keepsOrderPerThread() {
+  constexpr int kThreads = 4;
+  constexpr int kMessages = 200;
+  static_assert(kThreads * kMessages <= kQueueCapacity,
+                "The messages have to fit in the queue");
+
+  std::vector<std::thread> threads;
+  {
+    Log::Sink sink;
+    for (int t = 0; t != kThreads; ++t) {
+      threads.emplace_back([t] {
+        for (int i = 0; i != kMessages; ++i) {
+          Log::write(Log::LEVEL_WARNING, "%1 %2", t, i);
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  QStringList messages = flush();
+  QCOMPARE(messages.size(), kThreads * kMessages);
+  QVector<int> next(kThreads, 0);
+  for (const QString &message : messages) {
+    QStringList fields = message.split(' ');
+    QCOMPARE(fields.size(), 2);
+    int thread = fields[0].toInt();
+    QCOMPARE(fields[1].toInt(), next[thread]);
+    ++next[thread];
+  }
+}
+
+void TestLogging::countsSuppressedMessages() {
+  for (int i = 0; i != 20; ++i) {
+    LOG_WARNING_RATE(5, "limited %1", i);
+  }
+  QStringList messages = flush();
+  QCOMPARE(messages.size(), 6);
+  QCOMPARE(messages[0], QString("limited 0"));
+  QCOMPARE(messages[4], QString("limited 4"));
+  QCOMPARE(messages[5],
+           QString("Log: 0 messages dropped, 15 suppressed by rate limits"));
+}
+
+void TestLogging::countsDroppedMessages() {
+  // Without a sink nothing drains the queue, so it fills up
+  for (int i = 0; i != kQueueCapacity + 100; ++i) {
+    Log::write(Log::LEVEL_WARNING, "message %1", i);
+  }
+  QStringList messages = flush();
+  QCOMPARE(messages.size(), kQueueCapacity + 1);
+  QCOMPARE(messages[kQueueCapacity - 1],
+           QString("message %1").arg(kQueueCapacity - 1));
+  // The report counts from the start, so it includes the earlier suppressions
+  QVERIFY2(messages.last().startsWith("Log: 100 messages dropped"),
+           qPrintable(messages.last()));
+}
+
+QTEST_APPLESS_MAIN(TestLogging)
+#include "tst_logging.moc"
@@ -0,0 +1,139 @@
+#include <QFile>
+#include <QTemporaryDir>
+#include <QVector3D>
+#include <QtTest>
+#include <cstdint>
+
+#include "mesharena.h"
+#include "model.h"
+
+namespace {
+
+struct alignas(32) Aligned {
+  float values[8];
+};
+
+bool isAligned(const void *pointer, std::size_t alignment) {
+  return reinterpret_cast<std::uintptr_t>(pointer) % alignment == 0;
+}
+
+}  // namespace
+
+class TestMeshArena : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void allocatesZeroedArrays();
+  void alignsArrays();
+  void allocatesNothingForEmptyArrays();
+  void givesLargeArraysTheirOwnBlock();
+  void releaseFreesEverything();
+  void spanViewsArray();
+  void modelWithoutNormalsInterleavesZeros();
+};
+
+void TestMeshArena::allocatesZeroedArrays() {
+  MeshArena arena(256);
+  QVector3D *vectors = arena.allocate<QVector3D>(100);
+  for (int i = 0; i != 100; ++i) {
+    QCOMPARE(vectors[i], QVector3D());
+  }
+  unsigned *indices = arena.allocate<unsigned>(100);
+  for (int i = 0; i != 100; ++i) {
+    QCOMPARE(indices[i], 0U);
+  }
+}
+
+void TestMeshArena::alignsArrays() {
+  MeshArena arena(1024);
+  arena.allocate<char>(3);
+  QVERIFY(isAligned(arena.allocate<float>(5), alignof(float)));
+  arena.allocate<char>(1);
+  QVERIFY(isAligned(arena.allocate<double>(2), alignof(double)));
+  arena.allocate<char>(7);
+  QVERIFY(isAligned(arena.allocate<Aligned>(3), alignof(Aligned)));
+}
+
+void TestMeshArena::allocatesNothingForEmptyArrays() {
+  MeshArena arena;
+  QCOMPARE(arena.allocate<float>(0), nullptr);
+  QCOMPARE(arena.getBytesAllocated(), qsizetype(0));
+}
+
+void TestMeshArena::givesLargeArraysTheirOwnBlock() {
+  MeshArena arena(64);
+  float *small = arena.allocate<float>(4);
+  float *large = arena.allocate<float>(1000);
+  float *after = arena.allocate<float>(4);
+  QVERIFY(large != nullptr);
+  // Writing the whole large array must not touch the small ones
+  small[0] = 1.0F;
+  after[0] = 2.0F;
+  for (int i = 0; i != 1000; ++i) {
+    large[i] = 3.0F;
+  }
+  QCOMPARE(small[0], 1.0F);
+  QCOMPARE(after[0], 2.0F);
+  QCOMPARE(arena.getBytesAllocated(), qsizetype(1008 * sizeof(float)));
+}
+
+void TestMeshArena::releaseFreesEverything() {
+  MeshArena arena(64);
+  arena.allocate<float>(10);
+  arena.allocate<float>(100);
+  arena.release();
+  QCOMPARE(arena.getBytesAllocated(), qsizetype(0));
+  // The arena can be used again after a release
+  float *values = arena.allocate<float>(4);
+  QCOMPARE(values[3], 0.0F);
+  QCOMPARE(arena.getBytesAllocated(), qsizetype(4 * sizeof(float)));
+}
+
+void TestMeshArena::spanViewsArray() {
+  MeshSpan<QVector3D> empty;
+  QVERIFY(empty.isEmpty());
+  QCOMPARE(empty.begin(), empty.end());
+
+  MeshArena arena;
+  QVector3D *vectors = arena.allocate<QVector3D>(3);
+  vectors[1] = QVector3D(1, 2, 3);
+  MeshSpan<QVector3D> span(vectors, 3);
+  QCOMPARE(span.size(), 3);
+  QCOMPARE(span.byteSize(), qsizetype(3 * sizeof(QVector3D)));
+  QCOMPARE(span[1], QVector3D(1, 2, 3));
+  QCOMPARE(span.end() - span.begin(), std::ptrdiff_t(3));
+  QCOMPARE(span.toVector(),
+           QVector<QVector3D>({QVector3D(), QVector3D(1, 2, 3), QVector3D()}));
+}
+
+void TestMeshArena::modelWithoutNormalsInterleavesZeros() {
+  QTemporaryDir directory;
+  QVERIFY(directory.isValid());
+  QString filename = directory.filePath("triangle.obj");
+  QFile file(filename);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n");
+  file.close();
+
+  Model model(filename);
+  QCOMPARE(model.getCoords().size(), 3);
+  QVERIFY(model.getNormals().isEmpty());
+
+  // Position, normal and texture coordinate, both layouts
+  for (const QVector<float> &buffer :
+       {model.getVNTInterleaved(), model.getVNTInterleavedIndexed()}) {
+    QCOMPARE(buffer.size(), 3 * 8);
+    for (int vertex = 0; vertex != 3; ++vertex) {
+      for (int i = 3; i != 8; ++i) {
+        QCOMPARE(buffer[vertex * 8 + i], 0.0F);
+      }
+    }
+  }
+
+  model.release();
+  QVERIFY(model.getCoords().isEmpty());
+  QVERIFY(model.getIndices().isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestMeshArena)
+#include "tst_mesharena.moc"
@@ -0,0 +1,102 @@
+#include <QtTest>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include "meshoptimizer.h"
+
+namespace {
+
+// A grid of quads, two triangles each, with the triangles shuffled.
+QVector<unsigned> shuffledGrid(int side, unsigned seed) {
+  QVector<unsigned> indices;
+  for (int y = 0; y != side; ++y) {
+    for (int x = 0; x != side; ++x) {
+      unsigned corner = y * (side + 1) + x;
+      indices << corner << corner + side + 1 << corner + 1;
+      indices << corner + 1 << corner + side + 1 << corner + side + 2;
+    }
+  }
+  QVector<int> order(indices.size() / 3);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+  QVector<unsigned> shuffled;
+  for (int triangle : order) {
+    shuffled << indices[triangle * 3] << indices[triangle * 3 + 1]
+             << indices[triangle * 3 + 2];
+  }
+  return shuffled;
+}
+
+// The triangles, each rotated to start at its smallest index, sorted.
+QVector<QVector<unsigned>> triangleSet(const QVector<unsigned> &indices) {
+  QVector<QVector<unsigned>> triangles;
+  for (int i = 0; i + 2 < indices.size(); i += 3) {
+    QVector<unsigned> triangle = {indices[i], indices[i + 1], indices[i + 2]};
+    std::rotate(triangle.begin(),
+                std::min_element(triangle.begin(), triangle.end()),
+                triangle.end());
+    triangles.append(triangle);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+}  // namespace
+
+class TestMeshOptimizer : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void analyzeSingleTriangle();
+  void vertexCacheKeepsTriangles();
+  void vertexCacheLowersMissRatio();
+  void vertexCacheHandlesEmptyMesh();
+  void fetchRemapOrdersByFirstUse();
+};
+
+void TestMeshOptimizer::analyzeSingleTriangle() {
+  VertexCacheStatistics statistics =
+      MeshOptimizer::analyzeVertexCache({0, 1, 2}, 3);
+  QCOMPARE(statistics.acmr, 3.0F);
+  QCOMPARE(statistics.atvr, 1.0F);
+}
+
+void TestMeshOptimizer::vertexCacheKeepsTriangles() {
+  QVector<unsigned> indices = shuffledGrid(16, 1);
+  QVector<unsigned> optimized = indices;
+  MeshOptimizer::optimizeVertexCache(optimized, 17 * 17);
+  QCOMPARE(optimized.size(), indices.size());
+  QCOMPARE(triangleSet(optimized), triangleSet(indices));
+}
+
+void TestMeshOptimizer::vertexCacheLowersMissRatio() {
+  int side = 32;
+  int vertexCount = (side + 1) * (side + 1);
+  QVector<unsigned> indices = shuffledGrid(side, 2);
+  float before = MeshOptimizer::analyzeVertexCache(indices, vertexCount).acmr;
+  MeshOptimizer::optimizeVertexCache(indices, vertexCount);
+  float after = MeshOptimizer::analyzeVertexCache(indices, vertexCount).acmr;
+  QVERIFY2(after < 0.8F * before,
+           qPrintable(QString("ACMR %1 -> %2").arg(before).arg(after)));
+  // A grid can not do better than half a vertex per triangle
+  QVERIFY(after >= 0.5F);
+}
+
+void TestMeshOptimizer::vertexCacheHandlesEmptyMesh() {
+  QVector<unsigned> indices;
+  MeshOptimizer::optimizeVertexCache(indices, 0);
+  QVERIFY(indices.isEmpty());
+}
+
+void TestMeshOptimizer::fetchRemapOrdersByFirstUse() {
+  QVector<unsigned> indices = {4, 2, 0, 0, 2, 3};
+  QVector<unsigned> remap;
+  int uniqueCount = MeshOptimizer::optimizeVertexFetchRemap(indices, 5, remap);
+  QCOMPARE(uniqueCount, 4);
+  QCOMPARE(indices, QVector<unsigned>({0, 1, 2, 2, 1, 3}));
+  QCOMPARE(remap, QVector<unsigned>({2, ~0U, 1, 3, 0}));
+}
+
+QTEST_APPLESS_MAIN(TestMeshOptimizer)
+#include "tst_meshoptimizer.moc"
@@ -0,0 +1,233 @@
+#include <QSet>
+#include <QVector3D>
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "meshsimplifier.h"
+
+namespace {
+
+constexpr int kCells = 20;  // quads along each side of the grid
+
+// A grid of kCells x kCells quads in the xy plane, bent up and down by bump.
+// With a seam column, the vertices of that column are split in two, as
+// alignData() does for different texture coordinates on either side.
+struct Grid {
+  QVector<unsigned> indices;
+  QVector<QVector3D> positions;
+  QVector<unsigned> seamLeft;  // per row, the copies of the seam vertices
+  QVector<unsigned> seamRight;
+
+  explicit Grid(float bump, int seamColumn = -1) {
+    for (int y = 0; y <= kCells; ++y) {
+      for (int x = 0; x <= kCells; ++x) {
+        positions.append(
+            QVector3D(x, y, bump * std::sin(x * 0.4F) * std::cos(y * 0.3F)));
+      }
+    }
+    if (seamColumn >= 0) {
+      for (int y = 0; y <= kCells; ++y) {
+        seamLeft.append(vertex(seamColumn, y));
+        seamRight.append(positions.size());
+        positions.append(positions[vertex(seamColumn, y)]);
+      }
+    }
+    for (int y = 0; y != kCells; ++y) {
+      for (int x = 0; x != kCells; ++x) {
+        unsigned a = vertex(x, y);
+        unsigned b = vertex(x + 1, y);
+        unsigned c = vertex(x, y + 1);
+        unsigned d = vertex(x + 1, y + 1);
+        if (x == seamColumn) {
+          a = seamRight[y];
+          c = seamRight[y + 1];
+        }
+        indices << a << b << d << a << d << c;
+      }
+    }
+  }
+
+  static unsigned vertex(int x, int y) { return y * (kCells + 1) + x; }
+};
+
+float triangleDistance(const QVector3D &p, const QVector3D &a,
+                       const QVector3D &b, const QVector3D &c) {
+  // Closest point on the plane if it lies inside, else on the closest edge
+  QVector3D normal = QVector3D::crossProduct(b - a, c - a).normalized();
+  QVector3D projected = p - normal * QVector3D::dotProduct(p - a, normal);
+  bool inside = true;
+  const QVector3D corners[3] = {a, b, c};
+  for (int k = 0; k != 3; ++k) {
+    QVector3D edge = corners[(k + 1) % 3] - corners[k];
+    QVector3D toPoint = projected - corners[k];
+    if (QVector3D::dotProduct(QVector3D::crossProduct(edge, toPoint),
+                              normal) < 0.0F) {
+      inside = false;
+    }
+  }
+  if (inside) return (p - projected).length();
+
+  float distance = std::numeric_limits<float>::infinity();
+  for (int k = 0; k != 3; ++k) {
+    QVector3D start = corners[k];
+    QVector3D edge = corners[(k + 1) % 3] - start;
+    float t = QVector3D::dotProduct(p - start, edge) / edge.lengthSquared();
+    t = std::clamp(t, 0.0F, 1.0F);
+    distance = std::min(distance, (p - (start + edge * t)).length());
+  }
+  return distance;
+}
+
+// The largest distance of a vertex of the grid to the simplified mesh.
+float largestDistance(const Grid &grid, const QVector<unsigned> &result) {
+  float largest = 0.0F;
+  for (const QVector3D &p : grid.positions) {
+    float distance = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < result.size(); i += 3) {
+      distance = std::min(
+          distance,
+          triangleDistance(p, grid.positions[result[i]],
+                           grid.positions[result[i + 1]],
+                           grid.positions[result[i + 2]]));
+    }
+    largest = std::max(largest, distance);
+  }
+  return largest;
+}
+
+bool hasEdge(const QVector<unsigned> &indices, unsigned a, unsigned b) {
+  for (int i = 0; i < indices.size(); i += 3) {
+    for (int k = 0; k != 3; ++k) {
+      unsigned from = indices[i + k];
+      unsigned to = indices[i + (k + 1) % 3];
+      if ((from == a && to == b) || (from == b && to == a)) return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+class TestMeshSimplifier : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void reachesTargetOnPlane();
+  void keepsCornersOfOutline();
+  void keepsSeamsLocked();
+  void errorBoundsDistance();
+  void keepsMeshThatCannotCollapse();
+  void lodChainCoarsensLevels();
+  void lodChainSkipsSmallMeshes();
+  void selectsCoarserLevelsFurtherAway();
+};
+
+void TestMeshSimplifier::reachesTargetOnPlane() {
+  Grid grid(0.0F);
+  float error = -1.0F;
+  QVector<unsigned> result =
+      MeshSimplifier::simplify(grid.indices, grid.positions, 300, &error);
+  QCOMPARE(result.size() % 3, 0);
+  QVERIFY(result.size() <= 300);
+  QVERIFY(!result.isEmpty());
+  QVERIFY(error >= 0.0F);
+  QVERIFY(error < 1.0e-4F);
+}
+
+void TestMeshSimplifier::keepsCornersOfOutline() {
+  Grid grid(0.0F);
+  QVector<unsigned> result =
+      MeshSimplifier::simplify(grid.indices, grid.positions, 60);
+  QSet<unsigned> used(result.begin(), result.end());
+  QVERIFY(used.contains(Grid::vertex(0, 0)));
+  QVERIFY(used.contains(Grid::vertex(kCells, 0)));
+  QVERIFY(used.contains(Grid::vertex(0, kCells)));
+  QVERIFY(used.contains(Grid::vertex(kCells, kCells)));
+}
+
+void TestMeshSimplifier::keepsSeamsLocked() {
+  Grid grid(0.5F, kCells / 2);
+  QVector<unsigned> result =
+      MeshSimplifier::simplify(grid.indices, grid.positions, 150);
+  QVERIFY(result.size() < grid.indices.size() / 2);
+
+  // Both sides still meet along every segment of the seam
+  for (int y = 0; y != kCells; ++y) {
+    QVERIFY(hasEdge(result, grid.seamLeft[y], grid.seamLeft[y + 1]));
+    QVERIFY(hasEdge(result, grid.seamRight[y], grid.seamRight[y + 1]));
+  }
+}
+
+void TestMeshSimplifier::errorBoundsDistance() {
+  for (float bump : {0.5F, 2.0F}) {
+    for (int target : {1200, 600, 300, 150}) {
+      Grid grid(bump);
+      float error = 0.0F;
+      QVector<unsigned> result =
+          MeshSimplifier::simplify(grid.indices, grid.positions, target, &error);
+      QVERIFY(error > 0.0F);
+      QVERIFY2(largestDistance(grid, result) <= error + 1.0e-5F,
+               qPrintable(QString("bump %1, target %2").arg(bump).arg(target)));
+    }
+  }
+}
+
+void TestMeshSimplifier::keepsMeshThatCannotCollapse() {
+  // Every vertex is a corner of the outline
+  QVector<QVector3D> positions = {QVector3D(0, 0, 0), QVector3D(1, 0, 0),
+                                  QVector3D(0, 1, 0)};
+  QVector<unsigned> indices = {0, 1, 2};
+  float error = -1.0F;
+  QCOMPARE(MeshSimplifier::simplify(indices, positions, 0, &error), indices);
+  QCOMPARE(error, 0.0F);
+}
+
+void TestMeshSimplifier::lodChainCoarsensLevels() {
+  Grid grid(2.0F);
+  LodChain chain(grid.indices, grid.positions);
+  const QVector<LodLevel> &levels = chain.getLevels();
+  QCOMPARE(levels.size(), 4);
+  QCOMPARE(levels.first().indexCount, grid.indices.size());
+  QCOMPARE(levels.first().error, 0.0F);
+
+  int firstIndex = 0;
+  for (int i = 0; i != levels.size(); ++i) {
+    QCOMPARE(levels[i].firstIndex, firstIndex);
+    firstIndex += levels[i].indexCount;
+    if (i > 0) {
+      QVERIFY(levels[i].indexCount < levels[i - 1].indexCount);
+      QVERIFY(levels[i].error >= levels[i - 1].error);
+    }
+  }
+  QCOMPARE(chain.getIndices().size(), firstIndex);
+}
+
+void TestMeshSimplifier::lodChainSkipsSmallMeshes() {
+  // A textured quad, like the ship
+  QVector<QVector3D> positions = {QVector3D(0, 0, 0), QVector3D(1, 0, 0),
+                                  QVector3D(1, 1, 0), QVector3D(0, 1, 0)};
+  QVector<unsigned> indices = {0, 1, 2, 0, 2, 3};
+  LodChain chain(indices, positions);
+  QCOMPARE(chain.getLevels().size(), 1);
+  QCOMPARE(chain.getIndices(), indices);
+}
+
+void TestMeshSimplifier::selectsCoarserLevelsFurtherAway() {
+  Grid grid(2.0F);
+  LodChain chain(grid.indices, grid.positions);
+  int last = chain.getLevels().size() - 1;
+  QCOMPARE(chain.selectLevel(1000.0F, 1.0F), 0);
+  QCOMPARE(chain.selectLevel(0.01F, 1.0F), last);
+
+  int previous = 0;
+  for (float pixels = 100.0F; pixels > 0.01F; pixels *= 0.5F) {
+    int level = chain.selectLevel(pixels, 1.0F);
+    QVERIFY(level >= previous);
+    previous = level;
+  }
+}
+
+QTEST_APPLESS_MAIN(TestMeshSimplifier)
+#include "tst_meshsimplifier.moc"
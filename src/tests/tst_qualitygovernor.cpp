@@ -0,0 +1,95 @@
+#include <QtTest>
+
+#include "qualitygovernor.h"
+
+namespace {
+
+// Updates after a step during which the governor holds its level.
+constexpr int kCooldown = 20;
+
+// Feeds the same frame time until the level changes, at most count times.
+// Returns the number of updates it took, or -1 if the level did not change.
+int updatesUntilStep(QualityGovernor &governor, float milliseconds,
+                     int count) {
+  for (int i = 1; i <= count; ++i) {
+    if (governor.update(milliseconds)) return i;
+  }
+  return -1;
+}
+
+}  // namespace
+
+class TestQualityGovernor : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void holdsOnTarget();
+  void stepsDownWhenSlow();
+  void waitsAfterStep();
+  void stepsUpWhenFast();
+  void clampsAtCheapestLevel();
+  void resetReturnsToFullQuality();
+};
+
+void TestQualityGovernor::holdsOnTarget() {
+  QualityGovernor governor;
+  QCOMPARE(updatesUntilStep(governor, governor.getTargetFrameTime(), 200),
+           -1);
+  QCOMPARE(governor.getStep(), 0);
+}
+
+void TestQualityGovernor::stepsDownWhenSlow() {
+  QualityGovernor governor;
+  QVERIFY(governor.update(30.0F));
+  QCOMPARE(governor.getStep(), 1);
+  QVERIFY(governor.getLevel().renderScale < 1.0F);
+}
+
+void TestQualityGovernor::waitsAfterStep() {
+  QualityGovernor governor;
+  QVERIFY(governor.update(30.0F));
+  QCOMPARE(updatesUntilStep(governor, 30.0F, kCooldown + 1), kCooldown + 1);
+  QCOMPARE(governor.getStep(), 2);
+}
+
+void TestQualityGovernor::stepsUpWhenFast() {
+  QualityGovernor governor;
+  governor.update(30.0F);
+  updatesUntilStep(governor, 30.0F, kCooldown + 1);
+  QCOMPARE(governor.getStep(), 2);
+
+  // The average has to come down first, then one step per cooldown
+  QVERIFY(updatesUntilStep(governor, 5.0F, 100) != -1);
+  QCOMPARE(governor.getStep(), 1);
+  QVERIFY(updatesUntilStep(governor, 5.0F, 100) != -1);
+  QCOMPARE(governor.getStep(), 0);
+  QCOMPARE(updatesUntilStep(governor, 5.0F, 100), -1);
+  QCOMPARE(governor.getStep(), 0);
+}
+
+void TestQualityGovernor::clampsAtCheapestLevel() {
+  QualityGovernor governor;
+  for (int i = 0; i != 1000; ++i) {
+    governor.update(100.0F);
+  }
+  QCOMPARE(governor.getStep(), QualityGovernor::getStepCount() - 1);
+  QCOMPARE(governor.update(100.0F), false);
+}
+
+void TestQualityGovernor::resetReturnsToFullQuality() {
+  QualityGovernor governor;
+  for (int i = 0; i != 100; ++i) {
+    governor.update(30.0F);
+  }
+  QVERIFY(governor.getStep() > 0);
+
+  governor.reset();
+  QCOMPARE(governor.getStep(), 0);
+  QCOMPARE(governor.getAverageFrameTime(), 0.0F);
+  // A reset waits for the new level to show as well
+  QCOMPARE(updatesUntilStep(governor, 30.0F, kCooldown), -1);
+  QVERIFY(governor.update(30.0F));
+}
+
+QTEST_APPLESS_MAIN(TestQualityGovernor)
+#include "tst_qualitygovernor.moc"
@@ -0,0 +1,212 @@
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QScopedPointer>
+#include <QSurfaceFormat>
+#include <QtTest>
+
+#include "rendergraph.h"
+
+class TestRenderGraph : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void runsPassesInDependencyOrder();
+  void cullsUnusedPasses();
+  void readsBeforeLaterWriter();
+  void aliasesTextures();
+  void keepsTexturesAcrossFrames();
+
+ private:
+  void declareFrame();
+
+  QScopedPointer<QOffscreenSurface> surface;
+  QScopedPointer<QOpenGLContext> context;
+  QOpenGLFunctions_3_3_Core gl;
+  RenderGraph graph;
+
+  // What the passes of the last frame did
+  QStringList ran;
+  GLuint textureA = 0;
+  GLuint textureB = 0;
+  GLuint textureC = 0;
+};
+
+void TestRenderGraph::initTestCase() {
+  QSurfaceFormat format;
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setVersion(3, 3);
+  surface.reset(new QOffscreenSurface);
+  surface->setFormat(format);
+  surface->create();
+  context.reset(new QOpenGLContext);
+  context->setFormat(format);
+  if (!surface->isValid() || !context->create() ||
+      !context->makeCurrent(surface.data()) ||
+      !gl.initializeOpenGLFunctions()) {
+    QSKIP("No OpenGL 3.3 core context");
+  }
+  graph.initialize(&gl);
+}
+
+void TestRenderGraph::cleanupTestCase() {
+  if (context && context->makeCurrent(surface.data())) {
+    graph.destroy();
+    context->doneCurrent();
+  }
+}
+
+/**
+ * @brief TestRenderGraph::declareFrame Declares a chain of passes out of
+ * order, from the scene through three textures of the same size to the
+ * window, and a pass whose result is not used, then runs the frame.
+ */
+void TestRenderGraph::declareFrame() {
+  ran.clear();
+  RenderGraph::Target window = graph.importFramebuffer(
+      "window", context->defaultFramebufferObject(), 64, 64);
+  RenderGraph::Target scene = graph.createTarget("scene", 32, 32, GL_RGBA8);
+  RenderTextureDesc desc{32, 32, GL_RGBA16F};
+  RenderGraph::Resource a = graph.createTexture("a", desc);
+  RenderGraph::Resource b = graph.createTexture("b", desc);
+  RenderGraph::Resource c = graph.createTexture("c", desc);
+  RenderGraph::Resource unused = graph.createTexture("unused", desc);
+
+  graph.addPass(
+      "present",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.read(c);
+        pass.writeColor(window.color);
+      },
+      [this] { ran.append("present"); });
+  graph.addPass(
+      "scene",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.writeColor(scene.color, true);
+        pass.writeDepth(scene.depth, true);
+      },
+      [this] { ran.append("scene"); });
+  graph.addPass(
+      "a",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.read(scene.color);
+        pass.writeColor(a, true);
+      },
+      [this, a] {
+        ran.append("a");
+        textureA = graph.getTexture(a);
+      });
+  graph.addPass(
+      "b",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.read(a);
+        pass.writeColor(b, true);
+      },
+      [this, b] {
+        ran.append("b");
+        textureB = graph.getTexture(b);
+      });
+  graph.addPass(
+      "c",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.read(b);
+        pass.writeColor(c, true);
+      },
+      [this, c] {
+        ran.append("c");
+        textureC = graph.getTexture(c);
+      });
+  graph.addPass(
+      "dead",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.read(scene.color);
+        pass.writeColor(unused, true);
+      },
+      [this] { ran.append("dead"); });
+  graph.addPass(
+      "readback", [](RenderGraph::PassBuilder &pass) { pass.setSideEffect(); },
+      [this] { ran.append("readback"); });
+  graph.execute();
+}
+
+void TestRenderGraph::runsPassesInDependencyOrder() {
+  declareFrame();
+  QCOMPARE(ran.size(), 6);
+  QVERIFY(ran.indexOf("scene") < ran.indexOf("a"));
+  QVERIFY(ran.indexOf("a") < ran.indexOf("b"));
+  QVERIFY(ran.indexOf("b") < ran.indexOf("c"));
+  QVERIFY(ran.indexOf("c") < ran.indexOf("present"));
+}
+
+void TestRenderGraph::cullsUnusedPasses() {
+  declareFrame();
+  QVERIFY(!ran.contains("dead"));
+  QVERIFY(ran.contains("readback"));
+  QCOMPARE(graph.getStats().passes, 6);
+  QCOMPARE(graph.getStats().culledPasses, 1);
+}
+
+void TestRenderGraph::readsBeforeLaterWriter() {
+  // The terrain tests against the depth of the prepass, and the objects
+  // draw their own depth afterwards
+  ran.clear();
+  RenderGraph::Target window = graph.importFramebuffer(
+      "window", context->defaultFramebufferObject(), 64, 64);
+  RenderGraph::Target scene = graph.createTarget("scene", 32, 32, GL_RGBA8);
+  graph.addPass(
+      "present",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.read(scene.color);
+        pass.writeColor(window.color);
+      },
+      [this] { ran.append("present"); });
+  graph.addPass(
+      "depth prepass",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.writeDepth(scene.depth, true);
+      },
+      [this] { ran.append("depth prepass"); });
+  graph.addPass(
+      "terrain",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.writeColor(scene.color, true);
+        pass.readDepth(scene.depth);
+      },
+      [this] { ran.append("terrain"); });
+  graph.addPass(
+      "objects",
+      [&](RenderGraph::PassBuilder &pass) {
+        pass.writeColor(scene.color);
+        pass.writeDepth(scene.depth);
+      },
+      [this] { ran.append("objects"); });
+  graph.execute();
+
+  QCOMPARE(ran, QStringList({"depth prepass", "terrain", "objects",
+                             "present"}));
+}
+
+void TestRenderGraph::aliasesTextures() {
+  declareFrame();
+  QVERIFY(textureA != 0);
+  QVERIFY(textureB != 0);
+  // a is no longer read when c is written, b still is
+  QCOMPARE(textureC, textureA);
+  QVERIFY(textureB != textureA);
+
+  const RenderGraphStats &stats = graph.getStats();
+  QCOMPARE(stats.transientTextures, 5);  // the scene color and depth too
+  QVERIFY(stats.textures < stats.transientTextures);
+}
+
+void TestRenderGraph::keepsTexturesAcrossFrames() {
+  declareFrame();
+  GLuint first = textureA;
+  declareFrame();
+  QCOMPARE(textureA, first);
+}
+
+QTEST_MAIN(TestRenderGraph)
+#include "tst_rendergraph.moc"
@@ -0,0 +1,215 @@
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QScopedPointer>
+#include <QSurfaceFormat>
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+
+#include "scrollingheightmap.h"
+
+namespace {
+
+constexpr int kWidth = 5;
+constexpr int kImageRows = 12;
+constexpr int kWindowRows = 8;
+
+int wrap(int value, int size) { return ((value % size) + size) % size; }
+
+quint16 toLevel(float height) {
+  return static_cast<quint16>(height * 65535.0F + 0.5F);
+}
+
+// Heights on exact 16-bit steps, different for every sample.
+QVector<float> rampHeights(int rows) {
+  QVector<float> heights(kWidth * rows);
+  for (int i = 0; i != heights.size(); ++i) {
+    heights[i] = (i + 1) * 97 / 65535.0F;
+  }
+  return heights;
+}
+
+}  // namespace
+
+class TestScrollingHeightMap : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void init();
+  void cleanup();
+  void fillsWindowOnFirstUpdate();
+  void uploadsRowsThatCameIntoView();
+  void refillsAfterJump();
+  void uploadsEditedRegionInWindow();
+  void uploadsEditInEveryCopy();
+  void ignoresRegionOutsideImage();
+
+ private:
+  bool holdsWindow(const QVector<float> &heights, int imageRows,
+                   int firstRow);
+
+  QScopedPointer<QOffscreenSurface> surface;
+  QScopedPointer<QOpenGLContext> context;
+  QOpenGLFunctions_3_3_Core gl;
+  ScrollingHeightMap map;
+};
+
+void TestScrollingHeightMap::initTestCase() {
+  QSurfaceFormat format;
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setVersion(3, 3);
+  surface.reset(new QOffscreenSurface);
+  surface->setFormat(format);
+  surface->create();
+  context.reset(new QOpenGLContext);
+  context->setFormat(format);
+  if (!surface->isValid() || !context->create() ||
+      !context->makeCurrent(surface.data()) ||
+      !gl.initializeOpenGLFunctions()) {
+    QSKIP("No OpenGL 3.3 core context");
+  }
+}
+
+void TestScrollingHeightMap::cleanupTestCase() {
+  if (context) context->doneCurrent();
+}
+
+void TestScrollingHeightMap::init() {
+  map = ScrollingHeightMap();
+  map.initialize(&gl);
+}
+
+void TestScrollingHeightMap::cleanup() { map.destroy(); }
+
+/**
+ * @brief TestScrollingHeightMap::holdsWindow Reads the texture back and
+ * compares every ring row with the image row it should hold.
+ * @param heights The heights last given to the map.
+ * @param imageRows Number of rows of the heights.
+ * @param firstRow Image row expected in the first row of the window.
+ * @return Whether all rows of the window match.
+ */
+bool TestScrollingHeightMap::holdsWindow(const QVector<float> &heights,
+                                         int imageRows, int firstRow) {
+  int rows = map.getRowCount();
+  QVector<quint16> texels(kWidth * rows);
+  gl.glBindTexture(GL_TEXTURE_2D, map.getTexture());
+  gl.glPixelStorei(GL_PACK_ALIGNMENT, 2);
+  gl.glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_SHORT,
+                   texels.data());
+  gl.glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  gl.glBindTexture(GL_TEXTURE_2D, 0);
+
+  for (int row = firstRow; row != firstRow + rows; ++row) {
+    const quint16 *texel = texels.constData() + wrap(row, rows) * kWidth;
+    const float *height =
+        heights.constData() + wrap(row, imageRows) * kWidth;
+    for (int x = 0; x != kWidth; ++x) {
+      if (texel[x] != toLevel(height[x])) return false;
+    }
+  }
+  return true;
+}
+
+void TestScrollingHeightMap::fillsWindowOnFirstUpdate() {
+  QVector<float> heights = rampHeights(kImageRows);
+  map.setHeights(kWidth, kImageRows, heights);
+  map.setWindow(-2, kWindowRows);
+  QCOMPARE(map.update(0.7F), kWindowRows);
+  QVERIFY(holdsWindow(heights, kImageRows, -2));
+  // Within the same row nothing moves
+  QCOMPARE(map.update(0.9F), 0);
+}
+
+void TestScrollingHeightMap::uploadsRowsThatCameIntoView() {
+  QVector<float> heights = rampHeights(kImageRows);
+  map.setHeights(kWidth, kImageRows, heights);
+  map.setWindow(-2, kWindowRows);
+  map.update(0.0F);
+
+  QCOMPARE(map.update(3.5F), 3);
+  QVERIFY(holdsWindow(heights, kImageRows, 1));
+  // Backwards, and past the start of the image
+  QCOMPARE(map.update(1.2F), 2);
+  QVERIFY(holdsWindow(heights, kImageRows, -1));
+  QCOMPARE(map.update(-0.5F), 2);
+  QVERIFY(holdsWindow(heights, kImageRows, -3));
+  // Past the end of the image
+  for (float scroll = 0.0F; scroll < 30.0F; scroll += 1.5F) {
+    map.update(scroll);
+    QVERIFY(holdsWindow(heights, kImageRows,
+                        static_cast<int>(std::floor(scroll)) - 2));
+  }
+}
+
+void TestScrollingHeightMap::refillsAfterJump() {
+  QVector<float> heights = rampHeights(kImageRows);
+  map.setHeights(kWidth, kImageRows, heights);
+  map.setWindow(0, kWindowRows);
+  map.update(0.0F);
+  QCOMPARE(map.update(kWindowRows + 0.5F), kWindowRows);
+  QVERIFY(holdsWindow(heights, kImageRows, kWindowRows));
+
+  // New heights refill the window where it is
+  heights = rampHeights(kImageRows);
+  std::reverse(heights.begin(), heights.end());
+  map.setHeights(kWidth, kImageRows, heights);
+  QCOMPARE(map.update(kWindowRows + 0.5F), kWindowRows);
+  QVERIFY(holdsWindow(heights, kImageRows, kWindowRows));
+}
+
+void TestScrollingHeightMap::uploadsEditedRegionInWindow() {
+  QVector<float> heights = rampHeights(kImageRows);
+  map.setHeights(kWidth, kImageRows, heights);
+  map.setWindow(-2, kWindowRows);
+  map.update(0.0F);
+
+  // Rows 3 to 7, of which the window from -2 to 5 shows three
+  QRect region(1, 3, 2, 5);
+  for (int y = region.top(); y <= region.bottom(); ++y) {
+    for (int x = region.left(); x <= region.right(); ++x) {
+      heights[y * kWidth + x] = 0.5F + y / 65535.0F;
+    }
+  }
+  map.setHeights(region, heights);
+  QCOMPARE(map.update(0.0F), 3);
+  QVERIFY(holdsWindow(heights, kImageRows, -2));
+
+  // The rest of the edit arrives with the rows, in the same update
+  map.setHeights(QRect(0, 0, 1, 1), heights);
+  QCOMPARE(map.update(2.0F), 2 + 1);
+  QVERIFY(holdsWindow(heights, kImageRows, 0));
+}
+
+void TestScrollingHeightMap::uploadsEditInEveryCopy() {
+  // A window longer than the image shows some rows twice
+  constexpr int kShortRows = 5;
+  QVector<float> heights = rampHeights(kShortRows);
+  map.setHeights(kWidth, kShortRows, heights);
+  map.setWindow(0, kWindowRows);
+  map.update(0.0F);
+
+  QRect region(0, 2, kWidth, 1);
+  for (int x = 0; x != kWidth; ++x) {
+    heights[2 * kWidth + x] = 1.0F;
+  }
+  map.setHeights(region, heights);
+  QCOMPARE(map.update(0.0F), 2);
+  QVERIFY(holdsWindow(heights, kShortRows, 0));
+}
+
+void TestScrollingHeightMap::ignoresRegionOutsideImage() {
+  QVector<float> heights = rampHeights(kImageRows);
+  map.setHeights(kWidth, kImageRows, heights);
+  map.setWindow(0, kWindowRows);
+  map.update(0.0F);
+  map.setHeights(QRect(-4, -4, 2, 2), heights);
+  map.setHeights(QRect(kWidth, 0, 3, 3), heights);
+  QCOMPARE(map.update(0.0F), 0);
+}
+
+QTEST_MAIN(TestScrollingHeightMap)
+#include "tst_scrollingheightmap.moc"
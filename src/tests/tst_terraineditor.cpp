@@ -0,0 +1,183 @@
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+
+#include "terraineditor.h"
+
+namespace {
+
+constexpr int kWidth = 100;
+constexpr int kHeight = 80;
+
+// Undo restores the heights at the precision of the height texture.
+constexpr float kTolerance = 2.0e-5F;
+
+// A slope along the rows, from 0.2 to 0.8, so that brushes do not clip.
+QVector<float> slope() {
+  QVector<float> values(kWidth * kHeight);
+  for (int y = 0; y != kHeight; ++y) {
+    for (int x = 0; x != kWidth; ++x) {
+      values[y * kWidth + x] = 0.2F + 0.6F * x / (kWidth - 1);
+    }
+  }
+  return values;
+}
+
+float largestDifference(const QVector<float> &a, const QVector<float> &b) {
+  float difference = 0.0F;
+  for (int i = 0; i != a.size(); ++i) {
+    difference = std::max(difference, std::abs(a[i] - b[i]));
+  }
+  return difference;
+}
+
+// A stroke of a few dabs along a row.
+void stroke(TerrainEditor &editor, TerrainEditor::Brush brush, float x,
+            float y) {
+  editor.beginStroke(brush, x, y);
+  for (int i = 0; i != 10; ++i) {
+    editor.apply(x + i, y, 0.05F);
+  }
+  editor.endStroke();
+}
+
+}  // namespace
+
+class TestTerrainEditor : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void brushesChangeHeights();
+  void undoRestoresHeights();
+  void redoRepeatsStroke();
+  void newStrokeClearsRedo();
+  void clipsDabsAtEdges();
+  void keepsExternalChangesOnUndo();
+  void keepsExternalChangesDuringStroke();
+};
+
+void TestTerrainEditor::brushesChangeHeights() {
+  TerrainEditor editor;
+  editor.setHeights(kWidth, kHeight, slope());
+  int centre = 40 * kWidth + 50;
+  float before = editor.getHeights()[centre];
+
+  stroke(editor, TerrainEditor::RAISE, 45, 40);
+  QVERIFY(editor.getHeights()[centre] > before);
+
+  editor.setHeights(kWidth, kHeight, slope());
+  stroke(editor, TerrainEditor::LOWER, 45, 40);
+  QVERIFY(editor.getHeights()[centre] < before);
+
+  // Pulls towards the height where the stroke started, lower on the slope
+  editor.setHeights(kWidth, kHeight, slope());
+  float target = editor.getHeights()[40 * kWidth + 30];
+  editor.beginStroke(TerrainEditor::FLATTEN, 30, 40);
+  editor.apply(50, 40, 0.05F);
+  editor.endStroke();
+  float flattened = editor.getHeights()[centre];
+  QVERIFY(flattened < before);
+  QVERIFY(flattened >= target);
+}
+
+void TestTerrainEditor::undoRestoresHeights() {
+  TerrainEditor editor;
+  editor.setHeights(kWidth, kHeight, slope());
+  QVERIFY(!editor.canUndo());
+
+  stroke(editor, TerrainEditor::RAISE, 20, 20);
+  stroke(editor, TerrainEditor::SMOOTH, 25, 22);
+  stroke(editor, TerrainEditor::LOWER, 60, 50);
+  QVERIFY(largestDifference(editor.getHeights(), slope()) > 0.01F);
+
+  for (int i = 0; i != 3; ++i) {
+    QVERIFY(editor.canUndo());
+    QVERIFY(!editor.undo().isEmpty());
+  }
+  QVERIFY(!editor.canUndo());
+  QVERIFY(editor.undo().isEmpty());
+  QVERIFY(largestDifference(editor.getHeights(), slope()) < kTolerance);
+}
+
+void TestTerrainEditor::redoRepeatsStroke() {
+  TerrainEditor editor;
+  editor.setHeights(kWidth, kHeight, slope());
+  stroke(editor, TerrainEditor::RAISE, 20, 20);
+  stroke(editor, TerrainEditor::FLATTEN, 30, 30);
+  QVector<float> stroked = editor.getHeights();
+
+  editor.undo();
+  editor.undo();
+  QVERIFY(editor.canRedo());
+  editor.redo();
+  editor.redo();
+  QVERIFY(!editor.canRedo());
+  QVERIFY(largestDifference(editor.getHeights(), stroked) < kTolerance);
+}
+
+void TestTerrainEditor::newStrokeClearsRedo() {
+  TerrainEditor editor;
+  editor.setHeights(kWidth, kHeight, slope());
+  stroke(editor, TerrainEditor::RAISE, 20, 20);
+  editor.undo();
+  QVERIFY(editor.canRedo());
+  stroke(editor, TerrainEditor::LOWER, 50, 50);
+  QVERIFY(!editor.canRedo());
+  QVERIFY(editor.redo().isEmpty());
+}
+
+void TestTerrainEditor::clipsDabsAtEdges() {
+  TerrainEditor editor;
+  editor.setHeights(kWidth, kHeight, slope());
+  editor.setRadius(8.0F);
+  editor.beginStroke(TerrainEditor::RAISE, -3, -3);
+  QCOMPARE(editor.apply(-3, -3, 0.05F), QRect(0, 0, 6, 6));
+  QCOMPARE(editor.apply(kWidth + 2, kHeight + 2, 0.05F),
+           QRect(QPoint(kWidth - 6, kHeight - 6),
+                 QPoint(kWidth - 1, kHeight - 1)));
+  QVERIFY(editor.apply(-20, 40, 0.05F).isEmpty());
+  editor.endStroke();
+
+  editor.undo();
+  QVERIFY(largestDifference(editor.getHeights(), slope()) < kTolerance);
+}
+
+void TestTerrainEditor::keepsExternalChangesOnUndo() {
+  TerrainEditor editor;
+  editor.setHeights(kWidth, kHeight, slope());
+  stroke(editor, TerrainEditor::RAISE, 20, 20);
+
+  // Such as the erosion, inside and outside the stroke
+  QVector<float> changed = editor.getHeights();
+  QVector<float> expected = slope();
+  for (int i : {20 * kWidth + 22, 60 * kWidth + 70}) {
+    changed[i] += 0.05F;
+    expected[i] += 0.05F;
+  }
+  editor.setHeights(QRect(0, 0, kWidth, kHeight), changed);
+
+  editor.undo();
+  QVERIFY(largestDifference(editor.getHeights(), expected) < kTolerance);
+}
+
+void TestTerrainEditor::keepsExternalChangesDuringStroke() {
+  TerrainEditor editor;
+  editor.setHeights(kWidth, kHeight, slope());
+  int centre = 20 * kWidth + 22;
+
+  editor.beginStroke(TerrainEditor::RAISE, 20, 20);
+  editor.apply(20, 20, 0.05F);
+  QVector<float> changed = editor.getHeights();
+  changed[centre] += 0.05F;
+  editor.setHeights(QRect(22, 20, 1, 1), changed);
+  editor.apply(24, 20, 0.05F);
+  editor.endStroke();
+
+  editor.undo();
+  QVector<float> expected = slope();
+  expected[centre] += 0.05F;
+  QVERIFY(largestDifference(editor.getHeights(), expected) < kTolerance);
+}
+
+QTEST_APPLESS_MAIN(TestTerrainEditor)
+#include "tst_terraineditor.moc"
@@ -0,0 +1,121 @@
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtTest>
+
+#include "tilecache.h"
+
+namespace {
+
+constexpr int kTileQuads = 8;
+constexpr float kQuadSize = 1.0F;
+
+// Waits for the workers and moves their tiles into the cache.
+bool collectAll(TileCache &cache) {
+  QElapsedTimer timer;
+  timer.start();
+  while (cache.getPendingCount() > 0) {
+    if (timer.elapsed() > 10000) return false;
+    if (cache.collectFinished() == 0) QThread::msleep(1);
+  }
+  return true;
+}
+
+// Generates a tile and puts it in the cache, so tiles enter one at a time.
+bool add(TileCache &cache, int column, int row) {
+  cache.request(column, row, 0);
+  return collectAll(cache);
+}
+
+// The bytes of one tile, which all tiles of a cache share.
+qsizetype tileBytes() {
+  TileCache cache(kTileQuads, kQuadSize, 1 << 20);
+  return add(cache, 0, 0) ? cache.getMemoryUsage() : 0;
+}
+
+}  // namespace
+
+class TestTileCache : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void generatesRequestedTiles();
+  void requestsEachTileOnce();
+  void staysWithinBudget();
+  void evictsLeastRecentlyUsed();
+  void smallerBudgetEvicts();
+};
+
+void TestTileCache::generatesRequestedTiles() {
+  TileCache cache(kTileQuads, kQuadSize, 1 << 20);
+  QVERIFY(cache.find(2, -3, 0).isNull());
+  QVERIFY(add(cache, 2, -3));
+
+  QSharedPointer<const TerrainTile> tile = cache.find(2, -3, 0);
+  QVERIFY(!tile.isNull());
+  QCOMPARE(tile->column, 2);
+  QCOMPARE(tile->row, -3);
+  QCOMPARE(tile->vertexData.size(), cache.getVertexCount() * 6);
+  QCOMPARE(cache.getMemoryUsage(), tile->byteSize());
+  QCOMPARE(cache.getTileCount(), 1);
+}
+
+void TestTileCache::requestsEachTileOnce() {
+  TileCache cache(kTileQuads, kQuadSize, 1 << 20);
+  cache.request(0, 0, 0);
+  cache.request(0, 0, 0);
+  QCOMPARE(cache.getPendingCount(), 1);
+  QVERIFY(collectAll(cache));
+  cache.request(0, 0, 0);
+  QCOMPARE(cache.getPendingCount(), 0);
+  QCOMPARE(cache.getTileCount(), 1);
+}
+
+void TestTileCache::staysWithinBudget() {
+  qsizetype bytes = tileBytes();
+  QVERIFY(bytes > 0);
+  TileCache cache(kTileQuads, kQuadSize, bytes * 7 / 2);
+
+  // Also when several tiles arrive in one collection
+  for (int column = 0; column != 6; ++column) {
+    cache.request(column, 0, 0);
+  }
+  QVERIFY(collectAll(cache));
+  QCOMPARE(cache.getTileCount(), 3);
+  QCOMPARE(cache.getMemoryUsage(), 3 * bytes);
+  for (int column = 6; column != 12; ++column) {
+    QVERIFY(add(cache, column, 0));
+    QVERIFY(cache.getMemoryUsage() <= bytes * 7 / 2);
+  }
+}
+
+void TestTileCache::evictsLeastRecentlyUsed() {
+  TileCache cache(kTileQuads, kQuadSize, tileBytes() * 3);
+  QVERIFY(add(cache, 0, 0));
+  QVERIFY(add(cache, 1, 0));
+  QVERIFY(add(cache, 2, 0));
+  QCOMPARE(cache.getTileCount(), 3);
+
+  // Using the oldest tile makes the second one the oldest
+  QVERIFY(!cache.find(0, 0, 0).isNull());
+  QVERIFY(add(cache, 3, 0));
+  QCOMPARE(cache.getTileCount(), 3);
+  QVERIFY(cache.find(1, 0, 0).isNull());
+  QVERIFY(!cache.find(0, 0, 0).isNull());
+  QVERIFY(!cache.find(2, 0, 0).isNull());
+  QVERIFY(!cache.find(3, 0, 0).isNull());
+}
+
+void TestTileCache::smallerBudgetEvicts() {
+  qsizetype bytes = tileBytes();
+  TileCache cache(kTileQuads, kQuadSize, bytes * 4);
+  for (int row = 0; row != 4; ++row) {
+    QVERIFY(add(cache, 0, row));
+  }
+  cache.setMemoryBudget(bytes);
+  QCOMPARE(cache.getTileCount(), 1);
+  QCOMPARE(cache.getMemoryUsage(), bytes);
+  QVERIFY(!cache.find(0, 3, 0).isNull());
+}
+
+QTEST_APPLESS_MAIN(TestTileCache)
+#include "tst_tilecache.moc"
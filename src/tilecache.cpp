@@ -0,0 +1,300 @@
+#include "tilecache.h"
+
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+
+#include "terrainchunks.h"
+
+namespace {
+
+// Tiles closer to the camera than this many tiles sample the finest level
+// of the elevation model, every doubling of the distance the next level.
+constexpr float kLevelDistance = 2.0F;
+
+}  // namespace
+
+/**
+ * @brief TileCache::TileCache Creates an empty cache.
+ * @param tileQuads Number of quads along each side of a tile.
+ * @param quadSize Size of a single quad, in terrain units.
+ * @param memoryBudget Maximum number of bytes used by cached tiles.
+ */
+TileCache::TileCache(int tileQuads, float quadSize, qsizetype memoryBudget)
+    : tileQuads(tileQuads), quadSize(quadSize), memoryBudget(memoryBudget) {
+  // Leave one core for the GUI thread.
+  workers.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+}
+
+/**
+ * @brief TileCache::~TileCache Drops the queued jobs and waits for the
+ * running ones, since they use the noise of this cache.
+ */
+TileCache::~TileCache() {
+  workers.clear();
+  workers.waitForDone();
+}
+
+/**
+ * @brief TileCache::find Looks up a tile and marks it as recently used.
+ * @param column Column of the tile.
+ * @param row Row of the tile.
+ * @param level Level of the elevation model, see levelAt().
+ * @return The tile, or null if it has not been generated yet.
+ */
+QSharedPointer<const TerrainTile> TileCache::find(int column, int row,
+                                                  int level) {
+  auto it = entries.find(key(column, row, level));
+  if (it == entries.end()) return {};
+
+  it->lastUse = ++useCounter;
+  return it->tile;
+}
+
+/**
+ * @brief TileCache::request Starts generating a tile on a worker thread,
+ * unless it is cached or already being generated.
+ * @param column Column of the tile.
+ * @param row Row of the tile.
+ * @param level Level of the elevation model, see levelAt().
+ */
+void TileCache::request(int column, int row, int level) {
+  quint64 k = key(column, row, level);
+  if (entries.contains(k) || pending.contains(k)) return;
+
+  pending.insert(k);
+  workers.start([this, column, row, level]() {
+    QSharedPointer<TerrainTile> tile = generate(column, row, level);
+    QMutexLocker locker(&finishedMutex);
+    finished.append(tile);
+  });
+}
+
+/**
+ * @brief TileCache::collectFinished Moves the tiles finished by the workers
+ * into the cache, evicting the least recently used tiles if the budget is
+ * exceeded.
+ * @return The number of new tiles.
+ */
+int TileCache::collectFinished() {
+  QVector<QSharedPointer<TerrainTile>> done;
+  {
+    QMutexLocker locker(&finishedMutex);
+    done.swap(finished);
+  }
+
+  for (const QSharedPointer<TerrainTile> &tile : done) {
+    quint64 k = key(tile->column, tile->row, tile->level);
+    pending.remove(k);
+
+    Entry entry;
+    entry.tile = tile;
+    entry.lastUse = ++useCounter;
+    entries.insert(k, entry);
+    memoryUsage += tile->byteSize();
+  }
+
+  evict();
+  return done.size();
+}
+
+/**
+ * @brief TileCache::setHeightSource Switches between the noise and a digital
+ * elevation model. Waits for the running jobs and drops all tiles, since
+ * they belong to the old heights.
+ * @param dem The elevation model, or null for the noise.
+ * @param level The finest level of the elevation model to sample, which
+ * sets the ground covered by a quad to 2^level samples.
+ */
+void TileCache::setHeightSource(QSharedPointer<const DemCache> dem,
+                                int level) {
+  workers.clear();
+  workers.waitForDone();
+  {
+    QMutexLocker locker(&finishedMutex);
+    finished.clear();
+  }
+  entries.clear();
+  pending.clear();
+  memoryUsage = 0;
+
+  this->dem = dem;
+  demLevel = dem.isNull() ? 0 : qBound(0, level, dem->getLevelCount() - 1);
+}
+
+/**
+ * @brief TileCache::levelAt Picks the level of the elevation model to sample
+ * for a tile, from its distance to the camera.
+ * @param distance The distance from the camera to the nearest point of the
+ * tile, in terrain units.
+ * @return The level to pass to request() and find(), 0 for the noise.
+ */
+int TileCache::levelAt(float distance) const {
+  if (dem.isNull()) return 0;
+  float tiles = distance / getTileSize();
+  int coarser = tiles < kLevelDistance
+                    ? 0
+                    : 1 + static_cast<int>(std::log2(tiles / kLevelDistance));
+  return std::min(demLevel + coarser, dem->getLevelCount() - 1);
+}
+
+/**
+ * @brief TileCache::heightAt Computes the terrain height at a position in the
+ * noise plane, at the finest level of the elevation model. Thread safe.
+ * @param u Position along the x axis of the noise plane.
+ * @param v Position along the direction of flight.
+ * @return The height of the terrain.
+ */
+float TileCache::heightAt(float u, float v) const {
+  if (dem.isNull()) {
+    return TerrainChunks::heightFromNoise(noise.sample(u, v));
+  }
+  // The elevations are stretched over the height range of the noise
+  return dem->sample(demLevel, u / quadSize, v / quadSize) *
+         TerrainChunks::heightFromNoise(255);
+}
+
+/**
+ * @brief TileCache::setMemoryBudget Changes the memory budget, evicting tiles
+ * right away when the cache is too large.
+ * @param bytes The new budget in bytes.
+ */
+void TileCache::setMemoryBudget(qsizetype bytes) {
+  memoryBudget = bytes;
+  evict();
+}
+
+void TileCache::evict() {
+  if (memoryUsage <= memoryBudget) return;
+
+  // Sort once on last use instead of searching the oldest tile every time.
+  QVector<QPair<quint64, quint64>> ages;
+  ages.reserve(entries.size());
+  for (auto it = entries.cbegin(); it != entries.cend(); ++it) {
+    ages.append(qMakePair(it->lastUse, it.key()));
+  }
+  std::sort(ages.begin(), ages.end());
+
+  for (const QPair<quint64, quint64> &age : ages) {
+    if (memoryUsage <= memoryBudget) break;
+    memoryUsage -= entries[age.second].tile->byteSize();
+    entries.remove(age.second);
+  }
+}
+
+/**
+ * @brief TileCache::gridIndices Creates the triangle indices of a tile. The
+ * layout is the same for every tile, so one index buffer serves all of them.
+ * @param step Vertices skipped per quad, for coarser versions of the grid. It
+ * must divide the number of quads of a tile.
+ * @return The indices, two counter-clockwise triangles per quad.
+ */
+QVector<unsigned> TileCache::gridIndices(int step) const {
+  QVector<unsigned> indices;
+  indices.reserve((tileQuads / step) * (tileQuads / step) * 6);
+  unsigned stride = tileQuads + 1;
+
+  for (int j = 0; j < tileQuads; j += step) {
+    for (int i = 0; i < tileQuads; i += step) {
+      unsigned a = j * stride + i;
+      unsigned b = a + step;
+      unsigned c = a + stride * step;
+      unsigned d = c + step;
+      indices.append({a, b, c, b, d, c});
+    }
+  }
+  return indices;
+}
+
+/**
+ * @brief TileCache::gridBarycentrics Creates the barycentric coordinates used
+ * by the shader wireframe. Vertex (i, j) gets corner (i + 2j) mod 3, which
+ * gives every triangle of the grid three different corners. This also holds
+ * for the coarser grids of gridIndices(), as long as the step is not a
+ * multiple of three.
+ * @return Four bytes per vertex, of which the first three are used.
+ */
+QVector<quint8> TileCache::gridBarycentrics() const {
+  QVector<quint8> barycentrics(getVertexCount() * 4, 0);
+  int stride = tileQuads + 1;
+  for (int j = 0; j <= tileQuads; ++j) {
+    for (int i = 0; i <= tileQuads; ++i) {
+      barycentrics[(j * stride + i) * 4 + (i + 2 * j) % 3] = 255;
+    }
+  }
+  return barycentrics;
+}
+
+/**
+ * @brief TileCache::generate Computes the heights, normals and bounds of a
+ * tile. Runs on a worker thread, so it only reads immutable members.
+ * @param column Column of the tile.
+ * @param row Row of the tile.
+ * @param level Level of the elevation model for the inside of the tile.
+ * @return The new tile.
+ */
+QSharedPointer<TerrainTile> TileCache::generate(int column, int row,
+                                                int level) const {
+  QSharedPointer<TerrainTile> tile(new TerrainTile);
+  tile->column = column;
+  tile->row = row;
+  tile->level = level;
+  tile->vertexData.reserve(getVertexCount() * 6);
+
+  float originX = column * getTileSize();
+  float originZ = row * getTileSize();
+
+  // The tiles of the elevation model under this tile, and the quad around
+  // it that the normals reach, are looked up once instead of per sample.
+  // The border is sampled at the finest level, the inside at its own.
+  DemCache::Region border, inside;
+  float insideScale = 1.0F;  // samples of the inside level per quad
+  if (!dem.isNull()) {
+    float x0 = originX / quadSize - 1.0F;
+    float y0 = originZ / quadSize - 1.0F;
+    float x1 = x0 + tileQuads + 2.0F;
+    float y1 = y0 + tileQuads + 2.0F;
+    border = dem->region(demLevel, x0, y0, x1, y1);
+    insideScale = std::ldexp(1.0F, demLevel - level);
+    inside = level == demLevel
+                 ? border
+                 : dem->region(level, x0 * insideScale, y0 * insideScale,
+                               x1 * insideScale, y1 * insideScale);
+  }
+  auto height = [&](float x, float z, bool onBorder) {
+    if (dem.isNull()) return heightAt(originX + x, originZ + z);
+    const DemCache::Region &region = onBorder ? border : inside;
+    float scale = (onBorder ? 1.0F : insideScale) / quadSize;
+    return region.sample((originX + x) * scale, (originZ + z) * scale) *
+           TerrainChunks::heightFromNoise(255);
+  };
+
+  float minimum = 1e30F;
+  float maximum = -1e30F;
+  for (int j = 0; j <= tileQuads; ++j) {
+    for (int i = 0; i <= tileQuads; ++i) {
+      bool onBorder = i == 0 || j == 0 || i == tileQuads || j == tileQuads;
+      float x = i * quadSize;
+      float z = j * quadSize;
+      float y = height(x, z, onBorder);
+      minimum = std::min(minimum, y);
+      maximum = std::max(maximum, y);
+
+      // Central differences, sampled outside the tile at the borders so
+      // that neighbouring tiles get matching normals. The tile is laid out
+      // along -z, which flips the sign of the z slope.
+      float dx = height(x + quadSize, z, onBorder) -
+                 height(x - quadSize, z, onBorder);
+      float dz = height(x, z + quadSize, onBorder) -
+                 height(x, z - quadSize, onBorder);
+      QVector3D normal =
+          QVector3D(-dx, 2.0F * quadSize, dz).normalized();
+
+      tile->vertexData.append({x, y, -z, normal.x(), normal.y(), normal.z()});
+    }
+  }
+
+  tile->bounds = Aabb(QVector3D(0.0F, minimum, -getTileSize()),
+                      QVector3D(getTileSize(), maximum, 0.0F));
+  return tile;
+}
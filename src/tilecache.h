@@ -0,0 +1,99 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+
+#include "demcache.h"
+#include "frustum.h"
+#include "terrainnoise.h"
+
+/**
+ * @brief A square tile of the infinite terrain, ready to be uploaded.
+ */
+struct TerrainTile {
+  int column = 0;
+  int row = 0;
+  int level = 0;  // of the elevation model, 0 for the noise
+  QVector<float> vertexData;  // interleaved position and normal per vertex
+  Aabb bounds;                // in the local space of the tile
+
+  qsizetype byteSize() const {
+    return sizeof(TerrainTile) + vertexData.size() * sizeof(float);
+  }
+};
+
+/**
+ * @brief Generates terrain tiles on worker threads and keeps the most
+ * recently used ones in memory, up to a memory budget.
+ *
+ * Tiles are addressed by column and row in the noise plane. A tile covers
+ * [column, column + 1) * tileSize along x and [row, row + 1) * tileSize along
+ * the direction of flight. The heights come from the noise, or from a
+ * DemCache with one sample per quad. Tiles further from the camera sample
+ * coarser levels of the DemCache; their border vertices keep sampling the
+ * finest level, so that neighbours of different levels do not crack apart.
+ * All functions must be called from the GUI thread.
+ */
+class TileCache {
+ public:
+  TileCache(int tileQuads, float quadSize, qsizetype memoryBudget);
+  ~TileCache();
+
+  QSharedPointer<const TerrainTile> find(int column, int row, int level);
+  void request(int column, int row, int level);
+  int collectFinished();
+
+  void setHeightSource(QSharedPointer<const DemCache> dem, int level);
+  int levelAt(float distance) const;
+  float heightAt(float u, float v) const;
+
+  void setMemoryBudget(qsizetype bytes);
+  qsizetype getMemoryUsage() const { return memoryUsage; }
+  int getTileCount() const { return entries.size(); }
+  int getPendingCount() const { return pending.size(); }
+
+  float getTileSize() const { return tileQuads * quadSize; }
+  int getVertexCount() const { return (tileQuads + 1) * (tileQuads + 1); }
+  QVector<unsigned> gridIndices(int step = 1) const;
+  QVector<quint8> gridBarycentrics() const;
+
+ private:
+  struct Entry {
+    QSharedPointer<const TerrainTile> tile;
+    quint64 lastUse = 0;
+  };
+
+  // 28 bits of column and row are over 8 billion units of terrain
+  static quint64 key(int column, int row, int level) {
+    return (static_cast<quint64>(level) << 56) |
+           (static_cast<quint64>(static_cast<quint32>(column) & 0xfffffff)
+            << 28) |
+           (static_cast<quint32>(row) & 0xfffffff);
+  }
+
+  QSharedPointer<TerrainTile> generate(int column, int row, int level) const;
+  void evict();
+
+  const int tileQuads;
+  const float quadSize;
+  qsizetype memoryBudget;
+  qsizetype memoryUsage = 0;
+  quint64 useCounter = 0;
+
+  TerrainNoise noise;
+  QSharedPointer<const DemCache> dem;  // replaces the noise when set
+  int demLevel = 0;  // the finest level, sampled near the camera
+  QHash<quint64, Entry> entries;
+  QSet<quint64> pending;
+
+  QThreadPool workers;
+  QMutex finishedMutex;
+  QVector<QSharedPointer<TerrainTile>> finished;
+};
+
+#endif  // TILECACHE_H
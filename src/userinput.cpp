@@ -1,35 +1,92 @@
-#include <QDebug>
+#include <cmath>
 
+#include "logging.h"
 #include "mainview.h"
 
+namespace {
+
 /**
- * @brief MainView::keyPressEvent Triggered by a key press.
- * @param ev Key event.
+ * @brief shipControl Looks up the ship control of a key.
+ * @param key The key, see QKeyEvent::key().
+ * @param control Output, the control of the key.
+ * @return False if the key does not steer the ship.
  */
-void MainView::keyPressEvent(QKeyEvent *ev) {
-  switch (ev->key()) {
+bool shipControl(int key, SpaceShip::Control &control) {
+  switch (key) {
     case 'A':
-        qDebug() << "A pressed";
-         // setTranslation(QVector3D(shipTranslation.x() + 10, shipTranslation.y(), shipTranslation.z()));
-        break;
+      control = SpaceShip::LEFT;
+      return true;
+    case 'D':
+      control = SpaceShip::RIGHT;
+      return true;
     case 'W':
-        qDebug() << "W pressed";
-        // setTranslation(QVector3D(translation.x(), translation.y(), translation.z() + 1));
-        break;
+      control = SpaceShip::FORWARD;
+      return true;
     case 'S':
-        qDebug() << "S pressed";
-        // setTranslation(QVector3D(translation.x(), translation.y(), translation.z() - 1));
-        break;
-    case 'D':
-        qDebug() << "D pressed";
-        // setTranslation(QVector3D(shipTranslation.x() - 10, shipTranslation.y(), shipTranslation.z()));
-        break;
+      control = SpaceShip::BACKWARD;
+      return true;
+    case Qt::Key_Space:
+      control = SpaceShip::CLIMB;
+      return true;
+    case 'C':
+      control = SpaceShip::DIVE;
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief sculptBrush Looks up the brush of a mouse button: the left button
+ * raises the terrain, smooths it with Shift and flattens it with Control, the
+ * right button lowers it.
+ * @param ev The mouse event.
+ * @param brush Output, the brush of the button.
+ * @return False if the button does not sculpt.
+ */
+bool sculptBrush(const QMouseEvent *ev, TerrainEditor::Brush &brush) {
+  switch (ev->button()) {
+    case Qt::LeftButton:
+      if (ev->modifiers() & Qt::ShiftModifier) {
+        brush = TerrainEditor::SMOOTH;
+      } else if (ev->modifiers() & Qt::ControlModifier) {
+        brush = TerrainEditor::FLATTEN;
+      } else {
+        brush = TerrainEditor::RAISE;
+      }
+      return true;
+    case Qt::RightButton:
+      brush = TerrainEditor::LOWER;
+      return true;
     default:
-      // ev->key() is an integer. For alpha numeric characters keys it
-      // equivalent with the char value ('A' == 65, '1' == 49) Alternatively,
-      // you could use Qt Key enums, see http://doc.qt.io/qt-6/qt.html#Key-enum
-      qDebug() << ev->key() << "pressed";
-      break;
+      return false;
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief MainView::keyPressEvent Triggered by a key press.
+ * @param ev Key event.
+ */
+void MainView::keyPressEvent(QKeyEvent *ev) {
+  SpaceShip::Control control;
+  if (ev->matches(QKeySequence::Undo)) {
+    finishErosionSlice();
+    applyTerrainEdit(terrainEditor.undo());
+  } else if (ev->matches(QKeySequence::Redo)) {
+    finishErosionSlice();
+    applyTerrainEdit(terrainEditor.redo());
+  } else if (shipControl(ev->key(), control)) {
+    // The ship keeps steering while the key is held, repeats change nothing
+    if (!ev->isAutoRepeat()) {
+      spaceShip.setControl(control, true);
+    }
+  } else {
+    // ev->key() is an integer. For alpha numeric characters keys it
+    // equivalent with the char value ('A' == 65, '1' == 49) Alternatively,
+    // you could use Qt Key enums, see http://doc.qt.io/qt-6/qt.html#Key-enum
+    LOG_TRACE("Key %1 pressed", ev->key());
   }
   // Used to update the screen after changes
   update();
@@ -40,27 +97,29 @@ void MainView::keyPressEvent(QKeyEvent *ev) {
  * @param ev Key event.
  */
 void MainView::keyReleaseEvent(QKeyEvent *ev) {
-  switch (ev->key()) {
-    case 'A':
-      qDebug() << "A released";
-      break;
-    case 'W':
-        qDebug() << "W released";
-        break;
-    case 'S':
-        qDebug() << "S released";
-        break;
-    case 'D':
-        qDebug() << "D released";
-        break;
-    default:
-      qDebug() << ev->key() << "released";
-      break;
+  SpaceShip::Control control;
+  if (shipControl(ev->key(), control)) {
+    if (!ev->isAutoRepeat()) {
+      spaceShip.setControl(control, false);
+    }
+  } else {
+    LOG_TRACE("Key %1 released", ev->key());
   }
 
   update();
 }
 
+/**
+ * @brief MainView::focusOutEvent Triggered when the widget loses the keyboard
+ * focus. The key releases go elsewhere from then on, so all ship controls
+ * are let go.
+ * @param ev Focus event.
+ */
+void MainView::focusOutEvent(QFocusEvent *ev) {
+  spaceShip.releaseControls();
+  QOpenGLWidget::focusOutEvent(ev);
+}
+
 /**
  * @brief MainView::mouseDoubleClickEvent Triggered by clicking two subsequent
  * times on any mouse button. It also fires two mousePress and mouseRelease
@@ -68,7 +127,7 @@ void MainView::keyReleaseEvent(QKeyEvent *ev) {
  * @param ev Mouse events.
  */
 void MainView::mouseDoubleClickEvent(QMouseEvent *ev) {
-  qDebug() << "Mouse double clicked:" << ev->button();
+  LOG_TRACE("Mouse double clicked: %1", ev->button());
 
   update();
 }
@@ -79,7 +138,9 @@ void MainView::mouseDoubleClickEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::mouseMoveEvent(QMouseEvent *ev) {
-  qDebug() << "x" << ev->position().x() << "y" << ev->position().y();
+  LOG_TRACE_RATE(10, "Mouse at x %1 y %2", ev->position().x(),
+                 ev->position().y());
+  sculptPosition = ev->position();
 
   update();
 }
@@ -89,7 +150,19 @@ void MainView::mouseMoveEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::mousePressEvent(QMouseEvent *ev) {
-  qDebug() << "Mouse button pressed:" << ev->button();
+  LOG_TRACE("Mouse button pressed: %1", ev->button());
+
+  QVector3D hit;
+  TerrainEditor::Brush brush;
+  if (pickTerrain(ev->position(), hit)) {
+    LOG_DEBUG("Picked terrain at %1, %2, %3", hit.x(), hit.y(), hit.z());
+    if (sculptBrush(ev, brush)) {
+      // The stroke is applied every tick until the button is released
+      sculptPosition = ev->position();
+      QVector3D sample = toHeightfield(hit);
+      terrainEditor.beginStroke(brush, sample.x(), sample.z());
+    }
+  }
 
   update();
   // Do not remove the line below, clicking must focus on this widget!
@@ -101,7 +174,8 @@ void MainView::mousePressEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::mouseReleaseEvent(QMouseEvent *ev) {
-  qDebug() << "Mouse button released" << ev->button();
+  LOG_TRACE("Mouse button released: %1", ev->button());
+  terrainEditor.endStroke();
 
   update();
 }
@@ -112,7 +186,11 @@ void MainView::mouseReleaseEvent(QMouseEvent *ev) {
  * @param ev Mouse event.
  */
 void MainView::wheelEvent(QWheelEvent *ev) {
-  qDebug() << "Mouse wheel:" << ev->angleDelta();
+  LOG_TRACE("Mouse wheel: %1, %2", ev->angleDelta().x(), ev->angleDelta().y());
+  // A notch of the wheel makes the brush a tenth larger or smaller
+  terrainEditor.setRadius(terrainEditor.getRadius() *
+                          std::pow(1.1F, ev->angleDelta().y() / 120.0F));
+  LOG_DEBUG("Brush radius %1", terrainEditor.getRadius());
 
   update();
 }
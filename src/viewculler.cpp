@@ -0,0 +1,75 @@
+#include "viewculler.h"
+
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief RenderView::localFrustum Returns the frustum in the space of the
+ * camera itself, for geometry that is placed with the view transform
+ * already applied.
+ */
+Frustum RenderView::localFrustum() const {
+  Frustum local;
+  local.update(projectionTransform);
+  return local;
+}
+
+/**
+ * @brief RenderView::pixelsPerUnit Returns how many pixels of the viewport
+ * one unit covers at a point, for both perspective and orthographic
+ * projections.
+ * @param point The point in the space of the camera.
+ */
+float RenderView::pixelsPerUnit(const QVector3D &point) const {
+  float scale = projectionTransform(1, 1) * viewportHeight * 0.5F;
+  float w = projectionTransform(3, 2) * point.z() + projectionTransform(3, 3);
+  return scale / std::max(std::abs(w), 1e-6F);
+}
+
+ViewCuller::ViewCuller() {
+  workers.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+}
+
+/**
+ * @brief ViewCuller::cull Updates the frustum and the visible items of every
+ * view. The first view is culled on the calling thread, the others on the
+ * workers.
+ * @param bvh The scene tree.
+ * @param bounds The bounds of the items of the tree.
+ * @param chunkCount The first chunkCount items are terrain chunks, which
+ * are dropped beyond the maximum distance of a view.
+ * @param views The views.
+ */
+void ViewCuller::cull(const Bvh &bvh, const QVector<Aabb> &bounds,
+                      int chunkCount, const QVector<RenderView *> &views) {
+  for (int i = 1; i < views.size(); ++i) {
+    RenderView *view = views[i];
+    workers.start([&bvh, &bounds, chunkCount, view]() {
+      cullView(bvh, bounds, chunkCount, *view);
+    });
+  }
+  if (!views.isEmpty()) {
+    cullView(bvh, bounds, chunkCount, *views[0]);
+  }
+  workers.waitForDone();
+}
+
+void ViewCuller::cullView(const Bvh &bvh, const QVector<Aabb> &bounds,
+                          int chunkCount, RenderView &view) {
+  view.frustum.update(view.projectionTransform * view.viewTransform);
+  QVector<int> visibleItems;
+  view.cullStats = CullStats();
+  bvh.query(view.frustum, visibleItems, view.cullStats);
+
+  QVector3D eye = view.viewTransform.inverted().map(QVector3D());
+  view.itemVisible.fill(false, bounds.size());
+  for (int item : visibleItems) {
+    if (item < chunkCount && bounds[item].distanceTo(eye) > view.maxDistance) {
+      view.cullStats.visible--;
+      view.cullStats.fogged++;
+      continue;
+    }
+    view.itemVisible[item] = true;
+  }
+}
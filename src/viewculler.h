@@ -0,0 +1,50 @@
+#ifndef VIEWCULLER_H
+#define VIEWCULLER_H
+
+#include <QMatrix4x4>
+#include <QThreadPool>
+#include <QVector>
+#include <limits>
+
+#include "bvh.h"
+#include "frustum.h"
+
+/**
+ * @brief A camera that the scene is drawn from, and what it sees of the
+ * scene tree. The camera is relative to the space of the main view, which is
+ * the space the scene tree is in.
+ */
+struct RenderView {
+  QMatrix4x4 viewTransform;  // from the space of the main view
+  QMatrix4x4 projectionTransform;
+  // Terrain chunks further than this from the camera are dropped
+  float maxDistance = std::numeric_limits<float>::infinity();
+  int viewportHeight = 1;  // in pixels, for the levels of detail
+
+  Frustum frustum;  // in the space of the main view
+  QVector<bool> itemVisible;
+  CullStats cullStats;
+
+  Frustum localFrustum() const;
+  float pixelsPerUnit(const QVector3D &point) const;
+};
+
+/**
+ * @brief Culls the scene tree for several views at once, one view per
+ * thread. The tree and the bounds are only read, so the views share them.
+ */
+class ViewCuller {
+ public:
+  ViewCuller();
+
+  void cull(const Bvh &bvh, const QVector<Aabb> &bounds, int chunkCount,
+            const QVector<RenderView *> &views);
+
+ private:
+  static void cullView(const Bvh &bvh, const QVector<Aabb> &bounds,
+                       int chunkCount, RenderView &view);
+
+  QThreadPool workers;
+};
+
+#endif  // VIEWCULLER_H